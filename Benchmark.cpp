@@ -0,0 +1,1312 @@
+// Micro-benchmarks for the pipeline building blocks, and the transcode
+// regression suite. On Android they run through nativeRunBenchmarks; host
+// builds get a command line driver (see main) that can compare against a
+// baseline file.
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <malloc.h>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "CodecPool.h"
+#include "Fmp4Muxer.h"
+#include "FramePool.h"
+#include "FrameScaler.h"
+#include "FrameQueue.h"
+#include "FrameTracer.h"
+#include "GlRenderer.h"
+#include "HevcSei.h"
+#include "KeyframeIndex.h"
+#include "Mp4Demuxer.h"
+#include "PipelineTelemetry.h"
+#include "SoftwareBackend.h"
+#include "Transcoder.h"
+#include "WorkerPool.h"
+#include "YuvFrame.h"
+
+#define LOG_TAG "Benchmark"
+#include "Log.h"
+
+#ifdef __ANDROID__
+#include <jni.h>
+#endif
+
+namespace {
+
+struct BenchmarkResult {
+    std::string name;
+    int64_t iterations;
+    double nsPerOp;
+    double opsPerSecond;
+
+    // Transcode suite only; negative when not measured
+    int64_t p50Us = -1;  // Per-frame latency, decoder input to encoded sample
+    int64_t p99Us = -1;
+    int64_t peakRssKib = -1;  // Peak RSS above the RSS the case started with
+    int64_t bytesCopied = -1;
+};
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Correctness failures: a benchmark whose output is wrong says so here, and
+// the run fails however fast it was
+int gFailures = 0;
+
+void fail(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+void fail(const char* format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    LOGE("%s", message);
+    gFailures++;
+}
+
+BenchmarkResult makeResult(const char* name, int64_t iterations, int64_t elapsedNs) {
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = iterations > 0 ? static_cast<double>(elapsedNs) / iterations : 0.0;
+    result.opsPerSecond = elapsedNs > 0 ? iterations * 1e9 / elapsedNs : 0.0;
+    return result;
+}
+
+// The mutex + condition_variable + std::queue handoff thread.cpp used before
+// SpscFrameQueue, kept as the baseline
+class MutexFrameQueue {
+public:
+    void push(const FrameDescriptor& frame) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mFrames.push(frame);
+        lock.unlock();
+        mCondition.notify_one();
+    }
+
+    bool pop(FrameDescriptor* frame) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return !mFrames.empty(); });
+        *frame = mFrames.front();
+        mFrames.pop();
+        return true;
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::queue<FrameDescriptor> mFrames;
+};
+
+// One producer and one consumer thread pass `frames` descriptors through the queue
+template <typename Queue>
+BenchmarkResult benchmarkHandoff(const char* name, Queue* queue, int64_t frames) {
+    int64_t checksum = 0;
+    int64_t startNs = nowNs();
+    std::thread consumer([queue, frames, &checksum] {
+        FrameDescriptor frame = {};
+        for (int64_t i = 0; i < frames; ++i) {
+            queue->pop(&frame);
+            checksum += frame.presentationTimeUs;
+        }
+    });
+    for (int64_t i = 0; i < frames; ++i) {
+        FrameDescriptor frame = { static_cast<ssize_t>(i & 15), 0, 4096, i, 0 };
+        queue->push(frame);
+    }
+    consumer.join();
+    int64_t elapsedNs = nowNs() - startNs;
+
+    if (checksum != frames * (frames - 1) / 2) {
+        fail("%s: frames were lost or reordered", name);
+    }
+    return makeResult(name, frames, elapsedNs);
+}
+
+void benchmarkFrameQueues(std::vector<BenchmarkResult>* results) {
+    const int64_t kFrames = 1000000;
+
+    MutexFrameQueue mutexQueue;
+    results->push_back(benchmarkHandoff("frame_queue/mutex", &mutexQueue, kFrames));
+
+    SpscFrameQueue spscQueue(16);
+    results->push_back(benchmarkHandoff("frame_queue/spsc_16", &spscQueue, kFrames));
+
+    SpscFrameQueue wideQueue(1024);
+    results->push_back(benchmarkHandoff("frame_queue/spsc_1024", &wideQueue, kFrames));
+}
+
+// Converts one 720p frame per iteration with the scalar kernels and with the
+// vector kernels of this build, and checks that both produce the same bytes
+void benchmarkYuvKernels(std::vector<BenchmarkResult>* results) {
+    const int32_t kWidth = 1280;
+    const int32_t kHeight = 720;
+    const int64_t kFrames = 200;
+    const struct {
+        const char* name;
+        FrameFormat source;
+        int32_t stride;
+        int32_t sliceHeight;
+        FrameFormat destination;
+    } kCases[] = {
+        { "yuv/repack_i420", FRAME_FORMAT_I420, 1344, 736, FRAME_FORMAT_I420 },
+        { "yuv/nv12_to_i420", FRAME_FORMAT_NV12, 0, 0, FRAME_FORMAT_I420 },
+        { "yuv/i420_to_nv12", FRAME_FORMAT_I420, 0, 0, FRAME_FORMAT_NV12 },
+        { "yuv/nv21_to_nv12", FRAME_FORMAT_NV21, 0, 0, FRAME_FORMAT_NV12 },
+        { "yuv/i420_to_rgba", FRAME_FORMAT_I420, 0, 0, FRAME_FORMAT_RGBA },
+        { "yuv/nv12_to_rgba", FRAME_FORMAT_NV12, 0, 0, FRAME_FORMAT_RGBA },
+    };
+
+    for (const auto& test : kCases) {
+        std::vector<uint8_t> source(frameBufferSize(test.source, kWidth, kHeight, test.stride, test.sliceHeight));
+        for (size_t i = 0; i < source.size(); ++i) {
+            source[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+        }
+        FrameView sourceView;
+        wrapFrame(source.data(), source.size(), test.source, kWidth, kHeight, test.stride, test.sliceHeight, &sourceView);
+
+        std::vector<uint8_t> outputs[2];
+        for (int simd = 0; simd < 2; ++simd) {
+            outputs[simd].resize(frameBufferSize(test.destination, kWidth, kHeight));
+            FrameView destinationView;
+            wrapFrame(outputs[simd].data(), outputs[simd].size(), test.destination, kWidth, kHeight, 0, 0,
+                      &destinationView);
+
+            int64_t startNs = nowNs();
+            for (int64_t i = 0; i < kFrames; ++i) {
+                convertFrame(sourceView, destinationView, simd != 0);
+            }
+            std::string name = std::string(test.name) + "/" + (simd ? yuvKernelName() : "scalar");
+            results->push_back(makeResult(name.c_str(), kFrames, nowNs() - startNs));
+        }
+        if (outputs[0] != outputs[1]) {
+            fail("%s: %s kernels disagree with scalar", test.name, yuvKernelName());
+        }
+    }
+}
+
+// Drives GlRenderer against the counting GL table, so this measures the
+// renderer's own CPU cost and checks its GL call budget without a GPU: after
+// the first frame a frame may not compile, create or allocate anything, and a
+// size change reallocates the texture ring once
+void benchmarkGlRenderer(std::vector<BenchmarkResult>* results) {
+    const int64_t kCallsPerFrame = 6;
+    const int32_t kTextureCount = 3;
+    const int64_t kFrames = 100000;
+    std::vector<uint8_t> frame(frameBufferSize(FRAME_FORMAT_RGBA, 1280, 720));
+
+    GlCallCounts counts;
+    GlRenderer renderer(countingGlApi(&counts), kTextureCount);
+    renderer.renderFrame(frame.data(), 1280, 720);
+    GlCallCounts setup = counts;
+
+    counts = GlCallCounts();
+    int64_t startNs = nowNs();
+    for (int64_t i = 0; i < kFrames; ++i) {
+        renderer.renderFrame(frame.data(), 1280, 720);
+    }
+    results->push_back(makeResult("gl_renderer/frame", kFrames, nowNs() - startNs));
+    if (counts.calls > kCallsPerFrame * kFrames || counts.shaderCompiles || counts.objectsCreated ||
+        counts.textureAllocations || counts.textureUploads != kFrames || counts.draws != kFrames) {
+        fail("gl_renderer: %.2f GL calls per frame over the budget of %lld (setup made %lld calls)",
+             static_cast<double>(counts.calls) / kFrames, static_cast<long long>(kCallsPerFrame),
+             static_cast<long long>(setup.calls));
+    }
+
+    counts = GlCallCounts();
+    renderer.setFrameSize(1920, 1080);
+    renderer.setFrameSize(1920, 1080);
+    if (counts.textureAllocations != kTextureCount || counts.shaderCompiles) {
+        fail("gl_renderer: size change made %lld texture allocations, expected %d",
+             static_cast<long long>(counts.textureAllocations), kTextureCount);
+    }
+}
+
+// Appends one Annex-B NAL unit, inserting emulation prevention bytes
+void appendNal(std::vector<uint8_t>* stream, int32_t type, const std::vector<uint8_t>& payload) {
+    const uint8_t header[] = { 0, 0, 0, 1, static_cast<uint8_t>(type << 1), 1 };
+    stream->insert(stream->end(), header, header + sizeof(header));
+    int32_t zeros = 0;
+    for (uint8_t byte : payload) {
+        if (zeros >= 2 && byte <= 3) {
+            stream->push_back(3);
+            zeros = 0;
+        }
+        stream->push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+}
+
+// Feeds the HEVC SEI parser 2 GiB of a synthetic 1080p-sized stream, one
+// 1 MiB read at a time as if streamed from disk; every access unit carries a
+// one-window HDR10+ SEI ahead of a 64 KiB slice
+void benchmarkHevcSei(std::vector<BenchmarkResult>* results) {
+    const int32_t kAccessUnits = 64;
+    const size_t kSliceSize = 64 * 1024;
+    const size_t kChunkSize = 1024 * 1024;
+    const int64_t kTotalBytes = 2LL * 1024 * 1024 * 1024;
+
+    // T.35 header, then num_windows = 1, 400 cd/m2 target, flat statistics
+    // and no optional parts, packed MSB first
+    std::vector<uint8_t> sei = { 4, 0, 0xB5, 0x00, 0x3C, 0x00, 0x01, 4, 1 };
+    uint64_t bits = 0;
+    int32_t bitCount = 0;
+    auto put = [&](uint32_t value, int32_t width) {
+        for (int32_t i = width - 1; i >= 0; --i) {
+            bits = (bits << 1) | ((value >> i) & 1);
+            if (++bitCount == 8) {
+                sei.push_back(static_cast<uint8_t>(bits));
+                bits = 0;
+                bitCount = 0;
+            }
+        }
+    };
+    put(1, 2);
+    put(400, 27);
+    put(0, 1);
+    for (int32_t i = 0; i < 4; ++i) {
+        put(1000, 17);
+    }
+    put(0, 4);
+    put(0, 10);
+    put(0, 3);
+    put(0, 8 - bitCount);
+    sei[1] = static_cast<uint8_t>(sei.size() - 2);
+    sei.push_back(0x80);
+
+    std::vector<uint8_t> stream;
+    std::vector<uint8_t> slice(kSliceSize);
+    uint32_t seed = 1;
+    for (int32_t au = 0; au < kAccessUnits; ++au) {
+        appendNal(&stream, HEVC_NAL_SEI_PREFIX, sei);
+        for (size_t i = 0; i < slice.size(); ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            slice[i] = static_cast<uint8_t>(seed >> 24);
+        }
+        slice[0] = 0x80;  // first_slice_segment_in_pic_flag
+        slice.back() = 0x80;
+        appendNal(&stream, 1, slice);
+    }
+
+    int64_t withMetadata = 0;
+    HevcSeiParser parser([&withMetadata](int64_t, const Hdr10PlusMetadata* metadata) {
+        withMetadata += metadata != nullptr;
+    });
+    int64_t passes = kTotalBytes / static_cast<int64_t>(stream.size());
+    int64_t startNs = nowNs();
+    for (int64_t pass = 0; pass < passes; ++pass) {
+        for (size_t pos = 0; pos < stream.size(); pos += kChunkSize) {
+            parser.feed(stream.data() + pos, std::min(kChunkSize, stream.size() - pos));
+        }
+    }
+    parser.flush();
+    int64_t elapsedNs = nowNs() - startNs;
+    // One iteration per MiB, so ops/s reads as MiB/s
+    results->push_back(makeResult("hevc_sei/annexb_mib", parser.bytesParsed() >> 20, elapsedNs));
+    if (parser.accessUnitCount() != passes * kAccessUnits || withMetadata != parser.accessUnitCount()) {
+        fail("hevc_sei: found %lld access units, %lld with HDR10+, expected %lld",
+             static_cast<long long>(parser.accessUnitCount()), static_cast<long long>(withMetadata),
+             static_cast<long long>(passes * kAccessUnits));
+    }
+}
+
+std::string benchmarkPath(const char* name) {
+    const char* tmpDir = getenv("TMPDIR");
+#ifdef __ANDROID__
+    return std::string(tmpDir ? tmpDir : "/data/local/tmp") + "/" + name;
+#else
+    return std::string(tmpDir ? tmpDir : "/tmp") + "/" + name;
+#endif
+}
+
+void putU16(std::vector<uint8_t>* out, uint32_t value) {
+    out->push_back(static_cast<uint8_t>(value >> 8));
+    out->push_back(static_cast<uint8_t>(value));
+}
+
+void putU32(std::vector<uint8_t>* out, uint32_t value) {
+    putU16(out, value >> 16);
+    putU16(out, value & 0xffff);
+}
+
+// Writes a box header, runs body to append the payload, then patches the size in
+template <typename Body>
+void putBox(std::vector<uint8_t>* out, const char* type, Body body) {
+    size_t start = out->size();
+    putU32(out, 0);
+    out->insert(out->end(), type, type + 4);
+    body();
+    uint32_t size = static_cast<uint32_t>(out->size() - start);
+    for (int32_t i = 0; i < 4; ++i) {
+        (*out)[start + i] = static_cast<uint8_t>(size >> (24 - 8 * i));
+    }
+}
+
+// A one hour 30 fps AVC track: every sample a single length-prefixed NAL,
+// a keyframe each second and one chunk per second, with moov after mdat
+bool writeLongMp4(const std::string& path, int32_t samples, int32_t sampleSize) {
+    const int32_t kFrameRate = 30;
+    const uint32_t kTimescale = 90000;
+    std::vector<uint8_t> file;
+    putBox(&file, "ftyp", [&] {
+        file.insert(file.end(), { 'i', 's', 'o', 'm', 0, 0, 2, 0, 'i', 's', 'o', 'm', 'a', 'v', 'c', '1' });
+    });
+    std::vector<uint32_t> chunkOffsets;
+    putBox(&file, "mdat", [&] {
+        for (int32_t i = 0; i < samples; ++i) {
+            if (i % kFrameRate == 0) {
+                chunkOffsets.push_back(static_cast<uint32_t>(file.size()));
+            }
+            putU32(&file, sampleSize - 4);
+            file.push_back(i % kFrameRate == 0 ? 0x65 : 0x41);
+            file.resize(file.size() + sampleSize - 5, static_cast<uint8_t>(i));
+        }
+    });
+
+    uint32_t duration = static_cast<uint32_t>(samples) * (kTimescale / kFrameRate);
+    auto putFullBox = [&file](const char* type, std::initializer_list<uint32_t> words) {
+        putBox(&file, type, [&] {
+            putU32(&file, 0);  // version 0, no flags
+            for (uint32_t word : words) {
+                putU32(&file, word);
+            }
+        });
+    };
+    putBox(&file, "moov", [&] {
+        putFullBox("mvhd", { 0, 0, kTimescale, duration, 0x00010000, 0x01000000, 0, 0, 0x00010000, 0, 0, 0, 0x00010000,
+                             0, 0, 0, 0x40000000, 0, 0, 0, 0, 0, 0, 2 });
+        putBox(&file, "trak", [&] {
+            putFullBox("tkhd", { 0, 0, 1, 0, duration, 0, 0, 0, 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000,
+                                 1280u << 16, 720u << 16 });
+            putBox(&file, "mdia", [&] {
+                putFullBox("mdhd", { 0, 0, kTimescale, duration, 0x55c40000 });
+                putFullBox("hdlr", { 0, 0x76696465, 0, 0, 0, 0 });  // 'vide'
+                putBox(&file, "minf", [&] {
+                    putBox(&file, "stbl", [&] {
+                        putBox(&file, "stsd", [&] {
+                            putU32(&file, 0);
+                            putU32(&file, 1);
+                            putBox(&file, "avc1", [&] {
+                                file.resize(file.size() + 6, 0);
+                                putU16(&file, 1);  // data_reference_index
+                                file.resize(file.size() + 16, 0);
+                                putU16(&file, 1280);
+                                putU16(&file, 720);
+                                putU32(&file, 0x00480000);
+                                putU32(&file, 0x00480000);
+                                putU32(&file, 0);
+                                putU16(&file, 1);
+                                file.resize(file.size() + 32, 0);
+                                putU16(&file, 0x18);
+                                putU16(&file, 0xffff);
+                                putBox(&file, "avcC", [&] {
+                                    file.insert(file.end(), { 1, 0x64, 0, 0x28, 0xff, 0xe1, 0, 4, 0x67, 0x64, 0, 0x28,
+                                                              1, 0, 4, 0x68, 0xee, 0x3c, 0x80 });
+                                });
+                            });
+                        });
+                        putFullBox("stts", { 1, static_cast<uint32_t>(samples), kTimescale / kFrameRate });
+                        putBox(&file, "stss", [&] {
+                            putU32(&file, 0);
+                            putU32(&file, static_cast<uint32_t>(chunkOffsets.size()));
+                            for (size_t i = 0; i < chunkOffsets.size(); ++i) {
+                                putU32(&file, static_cast<uint32_t>(i * kFrameRate + 1));
+                            }
+                        });
+                        putFullBox("stsc", { 1, 1, static_cast<uint32_t>(kFrameRate), 1 });
+                        putBox(&file, "stsz", [&] {
+                            putU32(&file, 0);
+                            putU32(&file, 0);
+                            putU32(&file, static_cast<uint32_t>(samples));
+                            for (int32_t i = 0; i < samples; ++i) {
+                                putU32(&file, static_cast<uint32_t>(sampleSize));
+                            }
+                        });
+                        putBox(&file, "stco", [&] {
+                            putU32(&file, 0);
+                            putU32(&file, static_cast<uint32_t>(chunkOffsets.size()));
+                            for (uint32_t offset : chunkOffsets) {
+                                putU32(&file, offset);
+                            }
+                        });
+                    });
+                });
+            });
+        });
+    });
+
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    bool written = fwrite(file.data(), 1, file.size(), out) == file.size();
+    return fclose(out) == 0 && written;
+}
+
+// The extractor-style loop the transcoder runs: size, time and flags, then
+// a copy of every sample. Returns the number of samples read.
+int64_t readAllSamples(SampleSource* source, std::vector<uint8_t>* buffer, int64_t* checksum) {
+    int64_t samples = 0;
+    source->selectTrack(0);
+    for (;;) {
+        ssize_t size = source->getSampleSize();
+        if (size < 0) {
+            break;
+        }
+        if (static_cast<size_t>(size) > buffer->size()) {
+            buffer->resize(size);
+        }
+        *checksum += source->getSampleTime() + source->getSampleFlags();
+        *checksum += source->readSampleData(buffer->data(), buffer->size());
+        samples++;
+        source->advance();
+    }
+    return samples;
+}
+
+void benchmarkMp4Demuxer(std::vector<BenchmarkResult>* results) {
+    const int32_t kSamples = 30 * 60 * 60;
+    const int32_t kSampleSize = 256;
+    const int32_t kOpens = 20;
+
+    std::string path = benchmarkPath("benchmark_long.mp4");
+    if (!writeLongMp4(path, kSamples, kSampleSize)) {
+        fail("mp4_demuxer: failed to write %s", path.c_str());
+        return;
+    }
+
+    // Mapping the file and flattening the sample tables
+    int64_t startNs = nowNs();
+    for (int32_t i = 0; i < kOpens; ++i) {
+        Mp4Demuxer demuxer;
+        if (!demuxer.open(path.c_str()) || demuxer.trackInfo(0).sampleCount != kSamples ||
+            demuxer.trackInfo(0).format.maxInputSize < kSampleSize) {
+            fail("mp4_demuxer: failed to parse %s", path.c_str());
+            remove(path.c_str());
+            return;
+        }
+    }
+    results->push_back(makeResult("mp4_demuxer/open", kOpens, nowNs() - startNs));
+
+    // Zero-copy views in decode order
+    Mp4Demuxer demuxer;
+    demuxer.open(path.c_str());
+    demuxer.selectTrack(0);
+    Mp4SampleView view;
+    int64_t samples = 0;
+    int64_t keyframes = 0;
+    int64_t checksum = 0;
+    startNs = nowNs();
+    while (demuxer.next(&view)) {
+        checksum += view.data[view.size - 1] + view.presentationTimeUs;
+        keyframes += view.flags & SAMPLE_FLAG_SYNC;
+        samples++;
+    }
+    results->push_back(makeResult("mp4_demuxer/views", samples, nowNs() - startNs));
+    if (samples != kSamples || keyframes != kSamples / 30) {
+        fail("mp4_demuxer: read %lld samples, %lld keyframes", static_cast<long long>(samples),
+             static_cast<long long>(keyframes));
+    }
+
+    // The same file through the SampleSource calls, copying every sample
+    std::vector<uint8_t> buffer;
+    std::unique_ptr<SampleSource> source = openMp4SampleSource(path.c_str());
+    startNs = nowNs();
+    samples = source ? readAllSamples(source.get(), &buffer, &checksum) : 0;
+    results->push_back(makeResult("mp4_demuxer/sample_source", samples, nowNs() - startNs));
+    if (samples != kSamples) {
+        fail("mp4_demuxer: sample source read %lld samples", static_cast<long long>(samples));
+    }
+
+#ifdef __ANDROID__
+    // Baseline: one AMediaExtractor call per field per sample
+    std::unique_ptr<CodecBackend> backend = createNdkBackend();
+    source = backend->openSource(path.c_str());
+    startNs = nowNs();
+    samples = source ? readAllSamples(source.get(), &buffer, &checksum) : 0;
+    results->push_back(makeResult("mp4_demuxer/ndk_extractor", samples, nowNs() - startNs));
+#endif
+    LOGI("mp4_demuxer: checksum %lld", static_cast<long long>(checksum));
+    remove(path.c_str());
+}
+
+// Scanning a one hour file for its keyframes against loading the cached index
+void benchmarkKeyframeIndex(std::vector<BenchmarkResult>* results) {
+    const int32_t kSamples = 30 * 60 * 60;
+    const int32_t kLoads = 100;
+
+    std::string path = benchmarkPath("benchmark_index.mp4");
+    std::string indexPath = keyframeIndexPath(path.c_str(), nullptr);
+    if (!writeLongMp4(path, kSamples, 64)) {
+        fail("keyframe_index: failed to write %s", path.c_str());
+        return;
+    }
+    std::unique_ptr<SampleSource> source = openMp4SampleSource(path.c_str());
+    KeyframeIndex index;
+    int64_t startNs = nowNs();
+    bool built = source && source->selectTrack(0) && index.build(source.get());
+    results->push_back(makeResult("keyframe_index/scan", 1, nowNs() - startNs));
+    if (!built || !index.save(indexPath.c_str(), path.c_str())) {
+        fail("keyframe_index: failed to build or save the index");
+    }
+
+    KeyframeIndex loaded;
+    startNs = nowNs();
+    for (int32_t i = 0; i < kLoads; ++i) {
+        loaded.load(indexPath.c_str(), path.c_str());
+    }
+    results->push_back(makeResult("keyframe_index/load", kLoads, nowNs() - startNs));
+    if (loaded.syncTimesUs() != index.syncTimesUs() || loaded.sampleCount() != kSamples) {
+        fail("keyframe_index: loaded %zu keyframes of %lld samples", loaded.syncTimesUs().size(),
+             static_cast<long long>(loaded.sampleCount()));
+    }
+    remove(indexPath.c_str());
+    remove(path.c_str());
+}
+
+// Five minutes of 2 Mbit/s 30 fps AVC as MediaCodec hands it out: Annex-B
+// samples with a keyframe each second
+void benchmarkFmp4Muxer(std::vector<BenchmarkResult>* results) {
+    const int32_t kFrames = 30 * 60 * 5;
+    const int32_t kFrameRate = 30;
+    const int32_t kSampleSize = 2000000 / 8 / kFrameRate;
+
+    TrackFormat format;
+    format.mime = "video/avc";
+    format.width = 1280;
+    format.height = 720;
+    format.frameRate = kFrameRate;
+    format.csd0 = { 0, 0, 0, 1, 0x67, 0x64, 0, 0x28, 0xac, 0xd9 };
+    format.csd1 = { 0, 0, 0, 1, 0x68, 0xeb, 0xe3, 0xcb };
+
+    std::vector<uint8_t> keyframe(kSampleSize, 0x5a);
+    std::vector<uint8_t> frame(kSampleSize, 0x5a);
+    const uint8_t kKeyframeHeader[] = { 0, 0, 0, 1, 0x65 };
+    const uint8_t kFrameHeader[] = { 0, 0, 0, 1, 0x41 };
+    memcpy(keyframe.data(), kKeyframeHeader, sizeof(kKeyframeHeader));
+    memcpy(frame.data(), kFrameHeader, sizeof(kFrameHeader));
+
+    std::string path = benchmarkPath("benchmark_fragmented.mp4");
+    std::unique_ptr<Fmp4Muxer> muxer = openFmp4Muxer(path.c_str(), Fmp4MuxerOptions());
+    if (!muxer || muxer->addTrack(format) != 0 || !muxer->start()) {
+        fail("fmp4_muxer: failed to start");
+        return;
+    }
+    int64_t startNs = nowNs();
+    for (int32_t i = 0; i < kFrames; ++i) {
+        bool sync = i % kFrameRate == 0;
+        CodecBufferInfo info = { 0, kSampleSize, i * 1000000LL / kFrameRate,
+                                 sync ? static_cast<uint32_t>(CODEC_BUFFER_FLAG_KEY_FRAME) : 0 };
+        if (!muxer->writeSampleData(0, sync ? keyframe.data() : frame.data(), info)) {
+            fail("fmp4_muxer: failed to write sample %d", i);
+            break;
+        }
+    }
+    muxer->stop();
+    results->push_back(makeResult("fmp4_muxer/samples", kFrames, nowNs() - startNs));
+    const Fmp4MuxerStats& stats = muxer->stats();
+    if (stats.samplesWritten != kFrames || stats.fragmentsWritten != kFrames / kFrameRate) {
+        fail("fmp4_muxer: wrote %lld samples in %lld fragments", static_cast<long long>(stats.samplesWritten),
+             static_cast<long long>(stats.fragmentsWritten));
+    }
+    LOGI("fmp4_muxer: %lld bytes in %lld writes", static_cast<long long>(stats.bytesWritten),
+         static_cast<long long>(stats.writeCalls));
+    muxer.reset();
+
+    // Baseline: one write per sample, as SoftwareSampleSink does
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    startNs = nowNs();
+    for (int32_t i = 0; i < kFrames && fd >= 0; ++i) {
+        const std::vector<uint8_t>& sample = i % kFrameRate == 0 ? keyframe : frame;
+        if (write(fd, sample.data(), sample.size()) != static_cast<ssize_t>(sample.size())) {
+            fail("fmp4_muxer: baseline write failed");
+            break;
+        }
+    }
+    results->push_back(makeResult("fmp4_muxer/write_per_sample", kFrames, nowNs() - startNs));
+    if (fd >= 0) {
+        close(fd);
+    }
+    remove(path.c_str());
+}
+
+// A 30 s clip through the software codecs, whose per-frame costs make the
+// chain codec-bound, with one session and with segments on four, then
+// segmented again with open GOPs
+void benchmarkSegmentedTranscode(std::vector<BenchmarkResult>* results) {
+    SoftwareBackendConfig config;
+    config.frameCount = 900;
+    config.gopSize = 30;
+    config.decodeLatencyUs = 2000;
+    config.encodeLatencyUs = 4000;
+
+    for (int32_t sessions : { 1, 4 }) {
+        SoftwareBackend backend(config);
+        TranscodeOptions options;
+        options.parallelSegments = sessions;
+        options.minSegmentDurationUs = 2000000;
+        TranscodeResult result;
+        int64_t startNs = nowNs();
+        bool ok = transcodeVideo(&backend, "", "", options, &result);
+        int64_t elapsedNs = nowNs() - startNs;
+        std::string name = "segmented_transcode/sessions_" + std::to_string(sessions);
+        results->push_back(makeResult(name.c_str(), result.samplesWritten, elapsedNs));
+        if (!ok || result.samplesWritten != config.frameCount) {
+            fail("%s: wrote %lld of %d frames", name.c_str(), static_cast<long long>(result.samplesWritten),
+                 config.frameCount);
+        }
+    }
+
+    // Open GOPs with B-frames: each sync sample's leading frames come after
+    // it in decode order and only the previous segment can decode them
+    config.bFrames = 2;
+    config.openGop = true;
+    SoftwareBackend backend(config);
+    TranscodeOptions options;
+    options.parallelSegments = 4;
+    options.minSegmentDurationUs = 2000000;
+    TranscodeResult result;
+    int64_t startNs = nowNs();
+    bool ok = transcodeVideo(&backend, "", "", options, &result);
+    int64_t elapsedNs = nowNs() - startNs;
+    results->push_back(makeResult("segmented_transcode/open_gop", result.samplesWritten, elapsedNs));
+    if (!ok || result.samplesWritten != config.frameCount) {
+        fail("segmented_transcode/open_gop: wrote %lld of %d frames", static_cast<long long>(result.samplesWritten),
+             config.frameCount);
+    }
+}
+
+// Downscales a 1080p I420 frame with every filter, on the scalar kernels,
+// the vector kernels and the vector kernels on a four-thread pool.
+// Iterations are megapixels read, so ops/s is megapixels per second.
+void benchmarkScaler(std::vector<BenchmarkResult>* results) {
+    const int32_t kWidth = 1920;
+    const int32_t kHeight = 1080;
+    const int64_t kFrames = 30;
+    const struct {
+        const char* name;
+        int32_t width;
+        int32_t height;
+    } kTargets[] = {
+        { "720p", 1280, 720 },
+        { "360p", 640, 360 },
+    };
+    const struct {
+        const char* name;
+        ScaleFilter filter;
+    } kFilters[] = {
+        { "box", SCALE_FILTER_BOX },
+        { "bilinear", SCALE_FILTER_BILINEAR },
+        { "lanczos", SCALE_FILTER_LANCZOS },
+    };
+
+    std::vector<uint8_t> source(frameBufferSize(FRAME_FORMAT_I420, kWidth, kHeight));
+    for (size_t i = 0; i < source.size(); ++i) {
+        source[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+    }
+    FrameView sourceView;
+    wrapFrame(source.data(), source.size(), FRAME_FORMAT_I420, kWidth, kHeight, 0, 0, &sourceView);
+    WorkerPool pool(4);
+    int64_t megapixels = kFrames * kWidth * kHeight / 1000000;
+
+    for (const auto& target : kTargets) {
+        for (const auto& filter : kFilters) {
+            std::vector<uint8_t> outputs[3];
+            for (int mode = 0; mode < 3; ++mode) {
+                outputs[mode].resize(frameBufferSize(FRAME_FORMAT_I420, target.width, target.height));
+                FrameView destinationView;
+                wrapFrame(outputs[mode].data(), outputs[mode].size(), FRAME_FORMAT_I420, target.width,
+                          target.height, 0, 0, &destinationView);
+                int64_t startNs = nowNs();
+                for (int64_t i = 0; i < kFrames; ++i) {
+                    scaleFrame(sourceView, destinationView, filter.filter, mode == 2 ? &pool : nullptr, mode != 0);
+                }
+                int64_t elapsedNs = nowNs() - startNs;
+                std::string kernel = mode == 0 ? "scalar" : scalerKernelName();
+                std::string name = std::string("scaler/") + target.name + "/" + filter.name + "/" + kernel +
+                                   (mode == 2 ? "_pool4" : "");
+                results->push_back(makeResult(name.c_str(), megapixels, elapsedNs));
+            }
+            if (outputs[0] != outputs[1] || outputs[0] != outputs[2]) {
+                fail("scaler/%s/%s: %s kernels disagree with scalar", target.name, filter.name, scalerKernelName());
+            }
+        }
+    }
+}
+
+// Three renditions of one input: three separate transcodes, each decoding
+// the input again, against one ladder transcode that decodes it once.
+// Iterations are encoded frames across all renditions. Also checks a preset
+// against a portrait source.
+void benchmarkLadder(std::vector<BenchmarkResult>* results) {
+    SoftwareBackendConfig config;
+    config.width = 640;
+    config.height = 360;
+    config.frameCount = 300;
+    config.decodeLatencyUs = 4000;
+    config.encodeLatencyUs = 2000;
+    const char* presets[] = { "source", "360p", "240p" };
+    std::vector<LadderRendition> renditions(3);
+    for (size_t i = 0; i < renditions.size(); ++i) {
+        findEncodePreset(presets[i], &renditions[i].encode);
+    }
+
+    {
+        SoftwareBackend backend(config);
+        int64_t frames = 0;
+        int64_t startNs = nowNs();
+        for (const LadderRendition& rendition : renditions) {
+            TranscodeOptions options;
+            options.encode = rendition.encode;
+            TranscodeResult result;
+            transcodeVideo(&backend, "", "", options, &result);
+            frames += result.samplesWritten;
+        }
+        results->push_back(makeResult("ladder/separate_transcodes", frames, nowNs() - startNs));
+    }
+    {
+        SoftwareBackend backend(config);
+        TranscodeOptions options;
+        std::vector<TranscodeResult> ladder;
+        int64_t startNs = nowNs();
+        bool ok = transcodeLadder(&backend, "", renditions, options, &ladder);
+        int64_t elapsedNs = nowNs() - startNs;
+        int64_t frames = 0;
+        for (const TranscodeResult& result : ladder) {
+            frames += result.samplesWritten;
+        }
+        results->push_back(makeResult("ladder/shared_decode", frames, elapsedNs));
+        if (!ok || frames != config.frameCount * static_cast<int64_t>(renditions.size())) {
+            fail("ladder: wrote %lld frames", static_cast<long long>(frames));
+        }
+    }
+
+    // Presets size the short side, so a portrait source stays portrait, and
+    // nothing drops frames, so the encoder keeps the source rate
+    TrackFormat portrait;
+    portrait.width = 1080;
+    portrait.height = 1920;
+    portrait.frameRate = 60;
+    EncodeProfile profile;
+    findEncodePreset("720p", &profile);
+    profile.frameRate = 30;
+    TrackFormat format = resolveEncodeProfile(profile, portrait);
+    if (format.width != 720 || format.height != 1280 || format.frameRate != 60) {
+        fail("ladder: 720p of a 1080x1920 60 fps source resolved to %dx%d at %d fps", format.width, format.height,
+             format.frameRate);
+    }
+}
+
+// A run of one-second clips through codecs that take 20 ms to create and
+// 10 ms to start, as hardware codecs roughly do: a fresh decoder and encoder
+// per clip against warm ones from a codec pool. Iterations are clips.
+void benchmarkCodecPool(std::vector<BenchmarkResult>* results) {
+    const int32_t kClips = 20;
+    SoftwareBackendConfig config;
+    config.width = 640;
+    config.height = 360;
+    config.frameCount = 30;
+    config.decodeLatencyUs = 500;
+    config.encodeLatencyUs = 1000;
+    config.codecCreateLatencyUs = 20000;
+    config.codecStartLatencyUs = 10000;
+
+    for (bool pooled : { false, true }) {
+        SoftwareBackend backend(config);
+        CodecPool pool(&backend);
+        TranscodeOptions options;
+        options.codecPool = pooled ? &pool : nullptr;
+        int64_t frames = 0;
+        int64_t startNs = nowNs();
+        for (int32_t i = 0; i < kClips; ++i) {
+            TranscodeResult result;
+            transcodeVideo(&backend, "", "", options, &result);
+            frames += result.samplesWritten;
+        }
+        int64_t elapsedNs = nowNs() - startNs;
+        const char* name = pooled ? "codec_pool/pooled" : "codec_pool/fresh_codecs";
+        results->push_back(makeResult(name, kClips, elapsedNs));
+        if (frames != static_cast<int64_t>(kClips) * config.frameCount) {
+            fail("%s: wrote %lld frames", name, static_cast<long long>(frames));
+        }
+        if (pooled) {
+            CodecPoolStats stats = pool.stats();
+            LOGI("codec_pool: %lld hits, %lld misses, %lld ms starting codecs, %lld codecs created",
+                 static_cast<long long>(stats.hits), static_cast<long long>(stats.misses),
+                 static_cast<long long>(stats.startupUs / 1000),
+                 static_cast<long long>(backend.stats().codecsCreated.load()));
+        }
+    }
+}
+
+// The same 10 s transcode driven by three polling stages and by the
+// asynchronous event loop, with an encoder slower than the decoder.
+// Iterations are frames; the CPU time of each run is logged next to it.
+void benchmarkAsyncCodecs(std::vector<BenchmarkResult>* results) {
+    SoftwareBackendConfig config;
+    config.width = 640;
+    config.height = 360;
+    config.frameCount = 300;
+    config.decodeLatencyUs = 1000;
+    config.encodeLatencyUs = 3000;
+
+    for (bool async : { false, true }) {
+        SoftwareBackend backend(config);
+        TranscodeOptions options;
+        options.asyncCodecs = async;
+        TranscodeResult result;
+        std::clock_t startCpu = std::clock();
+        int64_t startNs = nowNs();
+        bool ok = transcodeVideo(&backend, "", "", options, &result);
+        int64_t elapsedNs = nowNs() - startNs;
+        double cpuMs = 1000.0 * (std::clock() - startCpu) / CLOCKS_PER_SEC;
+        const char* name = async ? "async_codecs/event_loop" : "async_codecs/polling";
+        results->push_back(makeResult(name, result.samplesWritten, elapsedNs));
+        LOGI("%s: %.1f ms CPU for %lld ms", name, cpuMs, static_cast<long long>(elapsedNs / 1000000));
+        if (!ok || result.samplesWritten != config.frameCount) {
+            fail("%s: wrote %lld of %d frames", name, static_cast<long long>(result.samplesWritten),
+                 config.frameCount);
+        }
+    }
+}
+
+// Cost of recording into a histogram, then a transcode with and without a
+// caller's telemetry. The decode minimum should match the software
+// decoder's latency; the percentiles add the wait behind earlier frames.
+void benchmarkTelemetry(std::vector<BenchmarkResult>* results) {
+    const int kRecords = 1000000;
+    LatencyHistogram histogram;
+    int64_t startNs = nowNs();
+    for (int i = 0; i < kRecords; ++i) {
+        histogram.record(i & 0xffff);
+    }
+    results->push_back(makeResult("telemetry/histogram_record", kRecords, nowNs() - startNs));
+
+    SoftwareBackendConfig config;
+    config.width = 640;
+    config.height = 360;
+    config.frameCount = 300;
+    config.decodeLatencyUs = 2000;
+    for (bool external : { false, true }) {
+        SoftwareBackend backend(config);
+        PipelineTelemetry telemetry;
+        TranscodeOptions options;
+        options.telemetry = external ? &telemetry : nullptr;
+        TranscodeResult result;
+        startNs = nowNs();
+        transcodeVideo(&backend, "", "", options, &result);
+        results->push_back(makeResult(external ? "telemetry/transcode_exported" : "telemetry/transcode_internal",
+                                      result.samplesWritten, nowNs() - startNs));
+        if (external) {
+            LOGI("decode min %lld us (configured %lld): %s",
+                 static_cast<long long>(telemetry.stage(STAGE_DECODE).min()),
+                 static_cast<long long>(config.decodeLatencyUs), telemetry.toJson().c_str());
+        }
+    }
+}
+
+// Cost of one traced span, then a transcode with and without a tracer; the
+// trace is left in benchmark_trace.json for a look in Perfetto
+void benchmarkTracer(std::vector<BenchmarkResult>* results) {
+    const int kSpans = 1000000;
+    FrameTracer tracer(4096);
+    int64_t startNs = nowNs();
+    for (int i = 0; i < kSpans; ++i) {
+        TraceScope scope(&tracer, TRACE_COPY, i, i & 7);
+    }
+    results->push_back(makeResult("tracer/span", kSpans, nowNs() - startNs));
+
+    SoftwareBackendConfig config;
+    config.width = 640;
+    config.height = 360;
+    config.frameCount = 300;
+    config.decodeLatencyUs = 1000;
+    config.encodeLatencyUs = 2000;
+    for (bool traced : { false, true }) {
+        SoftwareBackend backend(config);
+        FrameTracer frameTracer;
+        TranscodeOptions options;
+        options.tracer = traced ? &frameTracer : nullptr;
+        TranscodeResult result;
+        startNs = nowNs();
+        transcodeVideo(&backend, "", "", options, &result);
+        results->push_back(makeResult(traced ? "tracer/transcode_traced" : "tracer/transcode_untraced",
+                                      result.samplesWritten, nowNs() - startNs));
+        if (traced) {
+            std::string path = benchmarkPath("benchmark_trace.json");
+            frameTracer.writeChromeTrace(path.c_str());
+            LOGI("tracer: %lld spans in %s", static_cast<long long>(frameTracer.recorded()), path.c_str());
+        }
+    }
+}
+
+// Makes the writes to data observable, so the compiler cannot drop them,
+// nor a malloc and free around them
+void keepWrites(void* data) {
+    asm volatile("" : : "r"(data) : "memory");
+}
+
+// 4K I420 frames written into a fresh allocation each, as the ladder and
+// the frame dumper used to, against buffers recycled through a frame pool,
+// which skips the page faults. Four frames are in flight, as between a
+// decoder and its encoders. Then a 4K ladder whose frames share a
+// pool capped at four frames, so the decoder is held back by the slowest
+// rendition. Iterations are frames.
+void benchmarkFramePool(std::vector<BenchmarkResult>* results) {
+    const int kFrames = 120;
+    const size_t kFrameSize = frameBufferSize(FRAME_FORMAT_I420, 3840, 2160);
+
+    const int kInFlight = 4;
+
+    uint8_t* allocated[kInFlight] = {};
+    int64_t startNs = nowNs();
+    for (int i = 0; i < kFrames; ++i) {
+        uint8_t*& frame = allocated[i % kInFlight];
+        free(frame);
+        frame = static_cast<uint8_t*>(malloc(kFrameSize));
+        memset(frame, i, kFrameSize);
+        keepWrites(frame);
+    }
+    for (uint8_t* frame : allocated) {
+        free(frame);
+    }
+    results->push_back(makeResult("frame_pool/malloc_4k", kFrames, nowNs() - startNs));
+
+    FramePool pool;
+    std::shared_ptr<FrameBuffer> pooled[kInFlight];
+    startNs = nowNs();
+    for (int i = 0; i < kFrames; ++i) {
+        std::shared_ptr<FrameBuffer>& frame = pooled[i % kInFlight];
+        frame.reset();
+        frame = pool.acquire(kFrameSize);
+        memset(frame->data(), i, frame->size());
+        keepWrites(frame->data());
+    }
+    for (std::shared_ptr<FrameBuffer>& frame : pooled) {
+        frame.reset();
+    }
+    results->push_back(makeResult("frame_pool/pooled_4k", kFrames, nowNs() - startNs));
+
+    SoftwareBackendConfig config;
+    config.width = 3840;
+    config.height = 2160;
+    config.frameCount = 60;
+    const char* presets[] = { "source", "1080p", "720p" };
+    std::vector<LadderRendition> renditions(3);
+    for (size_t i = 0; i < renditions.size(); ++i) {
+        findEncodePreset(presets[i], &renditions[i].encode);
+    }
+    FramePoolOptions poolOptions;
+    poolOptions.maxBytes = 4 * static_cast<int64_t>(FramePool::classSize(kFrameSize));
+    FramePool cappedPool(poolOptions);
+    SoftwareBackend backend(config);
+    TranscodeOptions options;
+    options.framePool = &cappedPool;
+    std::vector<TranscodeResult> ladder;
+    startNs = nowNs();
+    bool ok = transcodeLadder(&backend, "", renditions, options, &ladder);
+    int64_t elapsedNs = nowNs() - startNs;
+    results->push_back(makeResult("frame_pool/ladder_4k_capped", config.frameCount, elapsedNs));
+    FramePoolStats stats = cappedPool.stats();
+    LOGI("frame_pool: %lld hits, %lld misses, %lld waits (%lld ms), peak %lld MiB in use",
+         static_cast<long long>(stats.hits), static_cast<long long>(stats.misses),
+         static_cast<long long>(stats.waits), static_cast<long long>(stats.waitUs / 1000),
+         static_cast<long long>(stats.peakBytesInUse >> 20));
+    if (!ok || stats.peakBytes > poolOptions.maxBytes || stats.buffersInUse != 0) {
+        fail("frame_pool: ladder %s, peak %lld bytes, %d buffers still in use", ok ? "done" : "failed",
+             static_cast<long long>(stats.peakBytes), stats.buffersInUse);
+    }
+}
+
+// Reads a "<field>: <n> kB" line of /proc/self/status; -1 if there is none
+int64_t procStatusKib(const char* field) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) {
+        return -1;
+    }
+    char line[128];
+    size_t length = strlen(field);
+    long long kib = -1;
+    while (fgets(line, sizeof(line), status)) {
+        if (!strncmp(line, field, length) && line[length] == ':' && sscanf(line + length + 1, "%lld", &kib) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+    return kib;
+}
+
+// Starts a case's peak memory measurement: hands the heap earlier cases
+// freed back to the kernel, resets the peak RSS (Linux 4.0 and up) to the
+// RSS left, and returns that RSS. The case's own peak is the peak RSS minus
+// it, whatever ran before.
+int64_t resetPeakRss() {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#elif defined(M_PURGE)
+    mallopt(M_PURGE, 0);
+#endif
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd >= 0) {
+        if (write(fd, "5", 1) != 1) {
+            LOGW("Cannot reset the peak RSS");
+        }
+        close(fd);
+    }
+    return procStatusKib("VmRSS");
+}
+
+// The regression suite: synthetic inputs of several sizes, lengths and GOP
+// structures through the whole pipeline on the software codecs. The codecs
+// cost nothing per frame, so the pipeline's own copies, conversions and
+// hand-offs set the pace. Iterations are frames, so ops/s is fps.
+void benchmarkTranscodeSuite(std::vector<BenchmarkResult>* results) {
+    const struct {
+        const char* name;
+        int32_t width;
+        int32_t height;
+        int32_t frames;
+        int32_t gopSize;
+        bool nv12;  // Decoder output the encoder has to convert
+    } kCases[] = {
+        { "360p_gop30", 640, 360, 600, 30, false },
+        { "720p_gop30", 1280, 720, 300, 30, false },
+        { "720p_gop1", 1280, 720, 300, 1, false },
+        { "720p_gop250_nv12", 1280, 720, 500, 250, true },
+        { "1080p_gop30", 1920, 1080, 150, 30, false },
+        { "2160p_gop60", 3840, 2160, 60, 60, false },
+    };
+
+    for (const auto& test : kCases) {
+        SoftwareBackendConfig config;
+        config.width = test.width;
+        config.height = test.height;
+        config.frameCount = test.frames;
+        config.gopSize = test.gopSize;
+        config.decoderColorFormat = test.nv12 ? CODEC_COLOR_FORMAT_YUV420_SEMI_PLANAR
+                                              : CODEC_COLOR_FORMAT_YUV420_PLANAR;
+        SoftwareBackend backend(config);
+        PipelineTelemetry telemetry;
+        TranscodeOptions options;
+        options.telemetry = &telemetry;
+        TranscodeResult result;
+
+        int64_t startRssKib = resetPeakRss();
+        int64_t startNs = nowNs();
+        bool ok = transcodeVideo(&backend, "", "", options, &result);
+        int64_t elapsedNs = nowNs() - startNs;
+
+        std::string name = std::string("transcode/") + test.name;
+        BenchmarkResult benchmark = makeResult(name.c_str(), result.samplesWritten, elapsedNs);
+        benchmark.p50Us = telemetry.stage(STAGE_FRAME).percentile(50);
+        benchmark.p99Us = telemetry.stage(STAGE_FRAME).percentile(99);
+        int64_t peakKib = procStatusKib("VmHWM");
+        benchmark.peakRssKib = peakKib >= 0 && startRssKib >= 0 ? std::max<int64_t>(peakKib - startRssKib, 0) : -1;
+        benchmark.bytesCopied = result.bytesCopied;
+        // A case that did not transcode every frame has no speed to compare
+        if (!ok || result.samplesWritten != test.frames) {
+            fail("%s: wrote %lld of %d frames", name.c_str(), static_cast<long long>(result.samplesWritten),
+                 test.frames);
+            continue;
+        }
+        results->push_back(benchmark);
+    }
+}
+
+typedef void (*BenchmarkFunction)(std::vector<BenchmarkResult>* results);
+
+const struct {
+    const char* name;
+    BenchmarkFunction run;
+} kBenchmarks[] = {
+    { "frame_queue", benchmarkFrameQueues },
+    { "yuv", benchmarkYuvKernels },
+    { "gl_renderer", benchmarkGlRenderer },
+    { "hevc_sei", benchmarkHevcSei },
+    { "mp4_demuxer", benchmarkMp4Demuxer },
+    { "keyframe_index", benchmarkKeyframeIndex },
+    { "fmp4_muxer", benchmarkFmp4Muxer },
+    { "segmented_transcode", benchmarkSegmentedTranscode },
+    { "ladder", benchmarkLadder },
+    { "scaler", benchmarkScaler },
+    { "codec_pool", benchmarkCodecPool },
+    { "async_codecs", benchmarkAsyncCodecs },
+    { "telemetry", benchmarkTelemetry },
+    { "tracer", benchmarkTracer },
+    { "frame_pool", benchmarkFramePool },
+    { "transcode", benchmarkTranscodeSuite },
+};
+
+// Runs every benchmark whose name starts with filter (all if null) and
+// returns a one-line-per-result report; gFailures counts the correctness
+// failures of the run, which leave their benchmark out of results
+std::string runBenchmarks(const char* filter, std::vector<BenchmarkResult>* results) {
+    gFailures = 0;
+    for (const auto& benchmark : kBenchmarks) {
+        if (!filter || !strncmp(benchmark.name, filter, strlen(filter))) {
+            benchmark.run(results);
+        }
+    }
+
+    std::string report;
+    char line[256];
+    for (const BenchmarkResult& result : *results) {
+        int length = snprintf(line, sizeof(line), "%-32s %12lld iters %12.1f ns/op %14.0f ops/s",
+                              result.name.c_str(), static_cast<long long>(result.iterations), result.nsPerOp,
+                              result.opsPerSecond);
+        if (result.p50Us >= 0 && length > 0 && length < static_cast<int>(sizeof(line))) {
+            snprintf(line + length, sizeof(line) - length, "  p50 %lld us  p99 %lld us  peak %lld KiB  copied %lld MiB",
+                     static_cast<long long>(result.p50Us), static_cast<long long>(result.p99Us),
+                     static_cast<long long>(result.peakRssKib), static_cast<long long>(result.bytesCopied >> 20));
+        }
+        LOGI("%s", line);
+        report += line;
+        report += '\n';
+    }
+    if (gFailures > 0) {
+        snprintf(line, sizeof(line), "FAILED: %d correctness checks", gFailures);
+        LOGE("%s", line);
+        report += line;
+        report += '\n';
+    }
+    return report;
+}
+
+// Baseline files are JSON objects with one result per line:
+//   "transcode/720p_gop30": {"ops_per_second": 812.5, "p50_us": 9000, ...},
+// written by writeBaseline and read back line by line
+bool writeBaseline(const char* path, const std::vector<BenchmarkResult>& results) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        LOGE("Cannot write baseline %s", path);
+        return false;
+    }
+    fputs("{\n", file);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        fprintf(file, "  \"%s\": {\"ops_per_second\": %.1f, \"ns_per_op\": %.1f, \"p50_us\": %lld, "
+                "\"p99_us\": %lld, \"peak_rss_kib\": %lld, \"bytes_copied\": %lld}%s\n",
+                result.name.c_str(), result.opsPerSecond, result.nsPerOp, static_cast<long long>(result.p50Us),
+                static_cast<long long>(result.p99Us), static_cast<long long>(result.peakRssKib),
+                static_cast<long long>(result.bytesCopied), i + 1 < results.size() ? "," : "");
+    }
+    fputs("}\n", file);
+    return fclose(file) == 0;
+}
+
+bool readBaseline(const char* path, std::map<std::string, double>* opsPerSecond) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        LOGE("Cannot read baseline %s", path);
+        return false;
+    }
+    char line[512];
+    char name[256];
+    double ops;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, " \"%255[^\"]\": {\"ops_per_second\": %lf", name, &ops) == 2) {
+            (*opsPerSecond)[name] = ops;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// Returns the number of results more than tolerance (a fraction) slower than the baseline
+int compareWithBaseline(const std::vector<BenchmarkResult>& results, const std::map<std::string, double>& baseline,
+                        double tolerance) {
+    int regressions = 0;
+    for (const BenchmarkResult& result : results) {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end() || it->second <= 0) {
+            continue;
+        }
+        double change = result.opsPerSecond / it->second - 1.0;
+        bool regressed = change < -tolerance;
+        if (regressed) {
+            regressions++;
+        }
+        fprintf(regressed ? stderr : stdout, "%-32s %14.0f ops/s vs %14.0f baseline  %+6.1f%%%s\n",
+                result.name.c_str(), result.opsPerSecond, it->second, 100.0 * change,
+                regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+} // namespace
+
+#ifdef __ANDROID__
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeRunBenchmarks(JNIEnv *env, jobject /* this */,
+                                                                      jstring filter_) {
+    const char *filter = filter_ ? env->GetStringUTFChars(filter_, nullptr) : nullptr;
+    std::vector<BenchmarkResult> results;
+    std::string report = runBenchmarks(filter, &results);
+    if (filter) {
+        env->ReleaseStringUTFChars(filter_, filter);
+    }
+    return env->NewStringUTF(report.c_str());
+}
+#else
+// bench [filter] [--write-baseline file] [--baseline file] [--tolerance fraction]
+// Exits with 1 when a benchmark fails a correctness check (no baseline is
+// written then) or a result is more than tolerance (default 0.15) below its
+// baseline ops/s, so CI can run e.g.
+//   bench transcode --baseline transcode_baseline.json
+int main(int argc, char** argv) {
+    const char* filter = nullptr;
+    const char* baselinePath = nullptr;
+    const char* writeBaselinePath = nullptr;
+    double tolerance = 0.15;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (!strcmp(argv[i], "--write-baseline") && i + 1 < argc) {
+            writeBaselinePath = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [filter] [--write-baseline file] [--baseline file] [--tolerance fraction]\n",
+                    argv[0]);
+            return 2;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+    std::string report = runBenchmarks(filter, &results);
+    fputs(report.c_str(), stdout);
+    if (gFailures > 0) {
+        return 1;
+    }
+    if (writeBaselinePath && !writeBaseline(writeBaselinePath, results)) {
+        return 2;
+    }
+    if (baselinePath) {
+        std::map<std::string, double> baseline;
+        if (!readBaseline(baselinePath, &baseline)) {
+            return 2;
+        }
+        if (compareWithBaseline(results, baseline, tolerance) > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Codec backend interface used by the transcode pipeline. The calls mirror
+// AMediaExtractor / AMediaCodec / AMediaMuxer one to one so the NDK backend
+// is a thin wrapper, while the software backend lets the same pipeline run
+// on hosts without MediaCodec.
+
+// Dequeue results (values match AMEDIACODEC_INFO_*)
+enum {
+    CODEC_INFO_TRY_AGAIN_LATER = -1,
+    CODEC_INFO_OUTPUT_FORMAT_CHANGED = -2,
+    CODEC_INFO_OUTPUT_BUFFERS_CHANGED = -3,
+};
+
+// Buffer flags (values match AMEDIACODEC_BUFFER_FLAG_*)
+enum {
+    CODEC_BUFFER_FLAG_KEY_FRAME = 1,
+    CODEC_BUFFER_FLAG_CODEC_CONFIG = 2,
+    CODEC_BUFFER_FLAG_END_OF_STREAM = 4,
+};
+
+// Color formats (values match MediaCodecInfo.CodecCapabilities COLOR_Format*)
+const int32_t CODEC_COLOR_FORMAT_YUV420_PLANAR = 19;              // I420
+const int32_t CODEC_COLOR_FORMAT_YUV420_PACKED_PLANAR = 20;       // I420
+const int32_t CODEC_COLOR_FORMAT_YUV420_SEMI_PLANAR = 21;         // NV12
+const int32_t CODEC_COLOR_FORMAT_YUV420_PACKED_SEMI_PLANAR = 39;  // NV12
+const int32_t CODEC_COLOR_FORMAT_SURFACE = 0x7F000789;            // Encoder surface input
+
+// Sample flags (values match AMEDIAEXTRACTOR_SAMPLE_FLAG_*)
+enum {
+    SAMPLE_FLAG_SYNC = 1,
+};
+
+// Same layout as AMediaCodecBufferInfo
+struct CodecBufferInfo {
+    int32_t offset;
+    int32_t size;
+    int64_t presentationTimeUs;
+    uint32_t flags;
+};
+
+// Backend-neutral subset of AMediaFormat
+struct TrackFormat {
+    std::string mime;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t bitRate = 0;
+    int32_t frameRate = 0;
+    int32_t colorFormat = 0;
+    int32_t stride = 0;       // Raw frames: bytes per luma row, 0 when tightly packed
+    int32_t sliceHeight = 0;  // Raw frames: luma rows before the chroma plane, 0 when tightly packed
+    int32_t iFrameInterval = 0;
+    int32_t bitrateMode = -1;  // Encoders: CODEC_BITRATE_MODE_* (EncodeProfile.h), -1 for the codec default
+    int32_t quality = 0;       // Encoders in CQ mode
+    int32_t maxBFrames = 0;
+    int32_t profile = 0;       // MediaCodecInfo.CodecProfileLevel values, 0 when unknown
+    int32_t level = 0;
+    int32_t sampleRate = 0;    // Audio tracks
+    int32_t channelCount = 0;
+    int64_t durationUs = 0;
+    int32_t maxInputSize = 0;     // Largest sample in bytes, 0 to let the decoder size its input buffers
+    int32_t rotationDegrees = 0;  // Display rotation, clockwise
+    int32_t colorStandard = 0;    // MediaFormat COLOR_STANDARD_*, COLOR_TRANSFER_* and COLOR_RANGE_*, 0 when unknown
+    int32_t colorTransfer = 0;
+    int32_t colorRange = 0;
+    std::vector<uint8_t> csd0;  // Codec specific data (SPS / VPS, AAC AudioSpecificConfig)
+    std::vector<uint8_t> csd1;  // Codec specific data (PPS)
+    std::vector<uint8_t> csd2;  // Codec specific data (Dolby Vision, some audio codecs)
+    std::vector<uint8_t> hdrStaticInfo;  // HDR10 mastering display and content light level ("hdr-static-info")
+};
+
+// Opaque handle to a codec input surface (ANativeWindow on Android)
+struct CodecSurface;
+
+class VideoCodec;
+
+// Notifications of a codec in asynchronous mode, modelled on
+// AMediaCodecOnAsyncNotifyCallback. They arrive on a thread of the codec,
+// one at a time and in order; an index handed over belongs to the client
+// until it queues or releases it. Keep them short: post the work elsewhere.
+class CodecCallback {
+public:
+    virtual ~CodecCallback() = default;
+
+    virtual void onInputAvailable(VideoCodec* codec, size_t index) = 0;
+    virtual void onOutputAvailable(VideoCodec* codec, size_t index, const CodecBufferInfo& info) = 0;
+    virtual void onFormatChanged(VideoCodec* codec, const TrackFormat& format) = 0;
+    virtual void onError(VideoCodec* codec, int32_t error, const char* detail) = 0;
+};
+
+// Demuxer, modelled on AMediaExtractor
+class SampleSource {
+public:
+    virtual ~SampleSource() = default;
+
+    virtual int getTrackCount() = 0;
+    virtual bool getTrackFormat(int trackIndex, TrackFormat* format) = 0;
+    virtual bool selectTrack(int trackIndex) = 0;
+
+    // Returns the size of the current sample, or -1 at end of stream
+    virtual ssize_t getSampleSize() = 0;
+    virtual int64_t getSampleTime() = 0;
+    virtual uint32_t getSampleFlags() = 0;
+    virtual int getSampleTrackIndex() = 0;
+    virtual ssize_t readSampleData(uint8_t* buffer, size_t capacity) = 0;
+    virtual bool advance() = 0;
+
+    // Moves the selected tracks to their last sync sample at or before
+    // timeUs, or their first sample (AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC)
+    virtual bool seekTo(int64_t timeUs) = 0;
+};
+
+// Decoder or encoder, modelled on AMediaCodec in synchronous mode
+class VideoCodec {
+public:
+    virtual ~VideoCodec() = default;
+
+    // A decoder configured with a surface renders into it on
+    // releaseOutputBuffer(index, true) instead of exposing pixels to the CPU
+    virtual bool configure(const TrackFormat& format, CodecSurface* surface, bool encoder) = 0;
+
+    bool configure(const TrackFormat& format, bool encoder) {
+        return configure(format, nullptr, encoder);
+    }
+
+    // Encoder only, between configure and start. The codec keeps ownership
+    // of the surface; end the stream with signalEndOfInputStream().
+    virtual CodecSurface* createInputSurface() = 0;
+
+    // Switches the codec to asynchronous mode: buffers are handed out
+    // through callback and the dequeue calls no longer return any. Call
+    // before configure. Returns false if the codec only runs synchronously.
+    virtual bool setCallback(CodecCallback* callback) = 0;
+
+    virtual bool start() = 0;
+    virtual bool stop() = 0;
+
+    // Drops every queued buffer and returns to the state right after
+    // start(), also after end of stream, so a new stream can follow without
+    // configuring again. The output format is not announced again (read it
+    // with getOutputFormat), and an encoder starts the new stream with a
+    // sync frame.
+    virtual bool flush() = 0;
+
+    // Timeouts are in microseconds; negative waits forever
+    virtual ssize_t dequeueInputBuffer(int64_t timeoutUs) = 0;
+    virtual uint8_t* getInputBuffer(size_t index, size_t* capacity) = 0;
+    virtual bool queueInputBuffer(size_t index, size_t offset, size_t size, int64_t presentationTimeUs, uint32_t flags) = 0;
+
+    // Returns a buffer index or one of the CODEC_INFO_* values
+    virtual ssize_t dequeueOutputBuffer(CodecBufferInfo* info, int64_t timeoutUs) = 0;
+    virtual uint8_t* getOutputBuffer(size_t index, size_t* capacity) = 0;
+    virtual bool releaseOutputBuffer(size_t index, bool render) = 0;
+    virtual bool getOutputFormat(TrackFormat* format) = 0;
+
+    virtual bool signalEndOfInputStream() = 0;
+};
+
+// Muxer, modelled on AMediaMuxer
+class SampleSink {
+public:
+    virtual ~SampleSink() = default;
+
+    virtual ssize_t addTrack(const TrackFormat& format) = 0;
+    virtual bool start() = 0;
+    virtual bool writeSampleData(size_t trackIndex, const uint8_t* data, const CodecBufferInfo& info) = 0;
+    virtual bool stop() = 0;
+};
+
+// Factory for one family of sources, codecs and sinks
+class CodecBackend {
+public:
+    virtual ~CodecBackend() = default;
+
+    virtual const char* name() const = 0;
+    virtual std::unique_ptr<SampleSource> openSource(const char* inputPath) = 0;
+    virtual std::unique_ptr<VideoCodec> createDecoder(const char* mime) = 0;
+    virtual std::unique_ptr<VideoCodec> createEncoder(const char* mime) = 0;
+    virtual std::unique_ptr<SampleSink> openSink(const char* outputPath) = 0;
+};
+
+#ifdef __ANDROID__
+// AMediaExtractor / AMediaCodec / AMediaMuxer backend (NdkBackend.cpp).
+// useMp4Demuxer reads MP4 input with Mp4Demuxer instead of AMediaExtractor,
+// falling back to the extractor for files it cannot parse.
+std::unique_ptr<CodecBackend> createNdkBackend(bool useMp4Demuxer = false);
+
+// Conversions between AMediaFormat and TrackFormat; toMediaFormat's result
+// is the caller's to delete
+struct AMediaFormat;
+void fromMediaFormat(AMediaFormat* mediaFormat, TrackFormat* format);
+AMediaFormat* toMediaFormat(const TrackFormat& format);
+#endif
@@ -0,0 +1,370 @@
+#include <chrono>
+
+#include "CodecPool.h"
+
+#define LOG_TAG "CodecPool"
+#include "Log.h"
+
+namespace {
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Hardware codecs size their buffers for the configured resolution, so only
+// codecs of a similar size are reconfigured into each other
+int sizeClass(int32_t width, int32_t height) {
+    int64_t pixels = static_cast<int64_t>(width) * height;
+    if (pixels <= 640 * 480) return 0;
+    if (pixels <= 1280 * 720) return 1;
+    if (pixels <= 1920 * 1088) return 2;
+    if (pixels <= 3840 * 2160) return 3;
+    return 4;
+}
+
+std::string poolKey(const TrackFormat& format, bool encoder) {
+    return format.mime + (encoder ? "/encoder/" : "/decoder/") +
+           std::to_string(sizeClass(format.width, format.height));
+}
+
+// Everything configure sees; the duration is only informational
+bool sameConfig(const TrackFormat& a, const TrackFormat& b) {
+    return a.mime == b.mime && a.width == b.width && a.height == b.height && a.bitRate == b.bitRate &&
+           a.frameRate == b.frameRate && a.colorFormat == b.colorFormat && a.stride == b.stride &&
+           a.sliceHeight == b.sliceHeight && a.iFrameInterval == b.iFrameInterval &&
+           a.bitrateMode == b.bitrateMode && a.quality == b.quality && a.maxBFrames == b.maxBFrames &&
+           a.profile == b.profile && a.level == b.level && a.sampleRate == b.sampleRate &&
+           a.channelCount == b.channelCount && a.csd0 == b.csd0 && a.csd1 == b.csd1;
+}
+
+bool usesSurface(const TrackFormat& format, bool encoder, CodecSurface* outputSurface) {
+    return encoder ? format.colorFormat == CODEC_COLOR_FORMAT_SURFACE : outputSurface != nullptr;
+}
+
+// Configures and starts codec, fetching the encoder input surface in surface mode
+bool configureAndStart(VideoCodec* codec, const TrackFormat& format, bool encoder, CodecSurface* outputSurface,
+                       CodecSurface** inputSurface) {
+    if (!codec->configure(format, encoder ? nullptr : outputSurface, encoder)) {
+        return false;
+    }
+    if (encoder && format.colorFormat == CODEC_COLOR_FORMAT_SURFACE) {
+        CodecSurface* surface = codec->createInputSurface();
+        if (!surface) {
+            return false;
+        }
+        if (inputSurface) {
+            *inputSurface = surface;
+        }
+    }
+    return codec->start();
+}
+
+} // namespace
+
+CodecPool::CodecPool(CodecBackend* backend, const CodecPoolOptions& options)
+    : mBackend(backend), mOptions(options) {
+    if (mOptions.maxInstances < 1) {
+        mOptions.maxInstances = 1;
+    }
+}
+
+CodecPool::~CodecPool() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (std::unique_ptr<Entry>& entry : mEntries) {
+        if (entry->inUse) {
+            LOGE("Destroying a %s that is still in use", entry->key.c_str());
+        }
+        if (entry->started) {
+            entry->codec->stop();
+        }
+    }
+}
+
+VideoCodec* CodecPool::acquire(const TrackFormat& format, bool encoder, CodecSurface* outputSurface,
+                               CodecSurface** inputSurface) {
+    bool surfaceMode = usesSurface(format, encoder, outputSurface);
+    std::string key = poolKey(format, encoder);
+    std::vector<std::unique_ptr<Entry>> retired;
+    std::unique_ptr<Entry> created;
+    Entry* entry = nullptr;
+    Entry* hit = nullptr;
+    bool waited = false;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    int64_t deadlineUs = nowUs() + mOptions.acquireTimeoutUs;
+    while (!hit && !entry && !created) {
+        int64_t now = nowUs();
+        expireLocked(now, false, &retired);
+
+        Entry* sameKey = nullptr;
+        for (std::unique_ptr<Entry>& candidate : mEntries) {
+            if (candidate->inUse || candidate->key != key) {
+                continue;
+            }
+            if (!surfaceMode && candidate->started && sameConfig(candidate->format, format)) {
+                // Flushed on release: ready as is
+                hit = candidate.get();
+                break;
+            }
+            if (!sameKey) {
+                sameKey = candidate.get();
+            }
+        }
+        if (hit) {
+            hit->inUse = true;
+            mStats.hits++;
+            break;
+        }
+        if (sameKey) {
+            entry = sameKey;
+            entry->inUse = true;
+            break;
+        }
+
+        if (mEntries.size() + mCreating >= static_cast<size_t>(mOptions.maxInstances)) {
+            Entry* victim = nullptr;
+            for (std::unique_ptr<Entry>& candidate : mEntries) {
+                if (!candidate->inUse && (!victim || candidate->idleSinceUs < victim->idleSinceUs)) {
+                    victim = candidate.get();
+                }
+            }
+            if (victim) {
+                retired.push_back(takeLocked(victim));
+                mStats.evictions++;
+            }
+        }
+        if (mEntries.size() + mCreating < static_cast<size_t>(mOptions.maxInstances)) {
+            mCreating++;
+            created.reset(new Entry());
+            break;
+        }
+
+        if (!waited) {
+            mStats.waits++;
+            waited = true;
+        }
+        if (mOptions.acquireTimeoutUs < 0) {
+            mCondition.wait(lock);
+        } else if (now >= deadlineUs) {
+            mStats.failures++;
+            lock.unlock();
+            LOGE("No %s free after %lld ms: all %d codecs are in use", key.c_str(),
+                 static_cast<long long>(mOptions.acquireTimeoutUs / 1000), mOptions.maxInstances);
+            return nullptr;
+        } else {
+            mCondition.wait_for(lock, std::chrono::microseconds(deadlineUs - now));
+        }
+    }
+    lock.unlock();
+
+    for (std::unique_ptr<Entry>& old : retired) {
+        if (old->started) {
+            old->codec->stop();
+        }
+    }
+    retired.clear();
+    if (hit) {
+        return hit->codec.get();
+    }
+
+    int64_t startUs = nowUs();
+    bool ok;
+    if (created) {
+        created->codec = encoder ? mBackend->createEncoder(format.mime.c_str())
+                                 : mBackend->createDecoder(format.mime.c_str());
+        created->key = key;
+        created->encoder = encoder;
+        created->inUse = true;
+        ok = created->codec && prepare(created.get(), format, outputSurface, inputSurface);
+    } else {
+        ok = prepare(entry, format, outputSurface, inputSurface);
+    }
+    int64_t elapsedUs = nowUs() - startUs;
+
+    std::unique_ptr<Entry> failed;
+    lock.lock();
+    if (created) {
+        mCreating--;
+        entry = created.get();
+        if (ok) {
+            mEntries.push_back(std::move(created));
+            mStats.misses++;
+            mStats.startupUs += elapsedUs;
+        }
+    } else if (ok) {
+        mStats.reconfigures++;
+        mStats.reuseUs += elapsedUs;
+    } else {
+        failed = takeLocked(entry);
+    }
+    if (!ok) {
+        mStats.failures++;
+    }
+    lock.unlock();
+
+    if (!ok) {
+        // A codec that failed to configure may be in any state; do not keep it
+        mCondition.notify_all();
+        LOGE("Failed to start %s %dx%d", key.c_str(), format.width, format.height);
+        if (created && created->codec && created->started) {
+            created->codec->stop();
+        }
+        if (failed && failed->started) {
+            failed->codec->stop();
+        }
+        return nullptr;
+    }
+    return entry->codec.get();
+}
+
+bool CodecPool::prepare(Entry* entry, const TrackFormat& format, CodecSurface* outputSurface,
+                        CodecSurface** inputSurface) {
+    VideoCodec* codec = entry->codec.get();
+    if (entry->started) {
+        codec->stop();
+        entry->started = false;
+    }
+    entry->format = format;
+    entry->outputSurface = entry->encoder ? nullptr : outputSurface;
+    if (!configureAndStart(codec, format, entry->encoder, outputSurface, inputSurface)) {
+        return false;
+    }
+    entry->started = true;
+    return true;
+}
+
+void CodecPool::release(VideoCodec* codec, bool reusable) {
+    if (!codec) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mMutex);
+    Entry* entry = nullptr;
+    for (std::unique_ptr<Entry>& candidate : mEntries) {
+        if (candidate->codec.get() == codec && candidate->inUse) {
+            entry = candidate.get();
+            break;
+        }
+    }
+    if (!entry) {
+        LOGE("Releasing a codec the pool did not hand out");
+        return;
+    }
+    lock.unlock();
+
+    // Still marked in use, so the entry is ours until relocking
+    if (reusable && entry->started) {
+        if (usesSurface(entry->format, entry->encoder, entry->outputSurface)) {
+            codec->stop();
+            entry->started = false;
+        } else if (!codec->flush()) {
+            reusable = false;
+        }
+    }
+
+    std::unique_ptr<Entry> retired;
+    lock.lock();
+    if (reusable) {
+        entry->inUse = false;
+        entry->idleSinceUs = nowUs();
+    } else {
+        retired = takeLocked(entry);
+    }
+    lock.unlock();
+    mCondition.notify_all();
+
+    if (retired && retired->started) {
+        retired->codec->stop();
+    }
+}
+
+void CodecPool::trim(bool all) {
+    std::vector<std::unique_ptr<Entry>> retired;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        expireLocked(nowUs(), all, &retired);
+    }
+    if (retired.empty()) {
+        return;
+    }
+    mCondition.notify_all();
+    for (std::unique_ptr<Entry>& entry : retired) {
+        if (entry->started) {
+            entry->codec->stop();
+        }
+    }
+    LOGI("Released %zu idle codecs", retired.size());
+}
+
+CodecPoolStats CodecPool::stats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    CodecPoolStats stats = mStats;
+    for (const std::unique_ptr<Entry>& entry : mEntries) {
+        if (entry->inUse) {
+            stats.inUse++;
+        } else {
+            stats.idle++;
+        }
+    }
+    return stats;
+}
+
+std::unique_ptr<CodecPool::Entry> CodecPool::takeLocked(Entry* entry) {
+    for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+        if (it->get() == entry) {
+            std::unique_ptr<Entry> taken = std::move(*it);
+            mEntries.erase(it);
+            return taken;
+        }
+    }
+    return nullptr;
+}
+
+void CodecPool::expireLocked(int64_t nowUs, bool all, std::vector<std::unique_ptr<Entry>>* retired) {
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        Entry* entry = it->get();
+        if (!entry->inUse && (all || nowUs - entry->idleSinceUs >= mOptions.idleTimeoutUs)) {
+            retired->push_back(std::move(*it));
+            it = mEntries.erase(it);
+            mStats.evictions++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+CodecLease::CodecLease(CodecBackend* backend, CodecPool* pool) : mBackend(backend), mPool(pool) {
+    if (mPool && mPool->backend() != backend) {
+        LOGW("Codec pool belongs to another backend; creating codecs directly");
+        mPool = nullptr;
+    }
+}
+
+VideoCodec* CodecLease::acquire(const TrackFormat& format, bool encoder, CodecSurface* outputSurface,
+                                CodecSurface** inputSurface) {
+    finish(false);
+    if (mPool) {
+        mCodec = mPool->acquire(format, encoder, outputSurface, inputSurface);
+        return mCodec;
+    }
+    mOwned = encoder ? mBackend->createEncoder(format.mime.c_str()) : mBackend->createDecoder(format.mime.c_str());
+    if (!mOwned || !configureAndStart(mOwned.get(), format, encoder, outputSurface, inputSurface)) {
+        mOwned.reset();
+        return nullptr;
+    }
+    mCodec = mOwned.get();
+    return mCodec;
+}
+
+void CodecLease::finish(bool reusable) {
+    if (!mCodec) {
+        return;
+    }
+    if (mPool) {
+        mPool->release(mCodec, reusable);
+    } else {
+        mOwned->stop();
+        mOwned.reset();
+    }
+    mCodec = nullptr;
+}
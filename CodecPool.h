@@ -0,0 +1,125 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CodecBackend.h"
+
+struct CodecPoolOptions {
+    int32_t maxInstances = 4;            // Codecs alive at once, in use or idle
+    int64_t idleTimeoutUs = 30000000;    // Idle codecs older than this are released
+    int64_t acquireTimeoutUs = 5000000;  // How long acquire waits for a free slot; negative waits forever
+};
+
+struct CodecPoolStats {
+    int64_t hits = 0;          // Idle started codec with the same configuration, flushed and handed out
+    int64_t reconfigures = 0;  // Idle codec of the same kind, configured and started again
+    int64_t misses = 0;        // Codec created
+    int64_t evictions = 0;     // Idle codecs released to make room or after idleTimeoutUs
+    int64_t waits = 0;         // acquire calls that found every slot in use
+    int64_t failures = 0;      // acquire calls that returned null
+    int64_t startupUs = 0;     // Spent creating, configuring and starting on misses
+    int64_t reuseUs = 0;       // Spent readying codecs on hits and reconfigures
+    int32_t inUse = 0;
+    int32_t idle = 0;
+};
+
+// Keeps decoders and encoders of one backend alive between transcodes, since
+// creating and starting a hardware codec costs tens of milliseconds while a
+// flush costs next to nothing. Codecs are keyed by mime, role and resolution
+// class (up to 640x480, 720p, 1080p, 4K, above):
+//  - hit: an idle codec already started with the same configuration. It was
+//    flushed when released, so it is handed out as is.
+//  - reconfigure: an idle codec of the same key is stopped, configured for
+//    the new format and started.
+//  - miss: a codec is created, after releasing the least recently used idle
+//    codec of another key if the pool is full. When every slot is in use,
+//    acquire waits for a release.
+// Codecs that render into or read from a surface are stopped when released,
+// since the surface may not outlive the job, and come back through a
+// reconfigure. Thread safe.
+class CodecPool {
+public:
+    explicit CodecPool(CodecBackend* backend, const CodecPoolOptions& options = CodecPoolOptions());
+    ~CodecPool();  // Every acquired codec must have been released
+
+    CodecBackend* backend() const { return mBackend; }
+    int32_t maxInstances() const { return mOptions.maxInstances; }
+
+    // Returns a started codec configured with format, or null on failure or
+    // after acquireTimeoutUs without a free slot. Decoders render into
+    // outputSurface when it is given. An encoder whose format.colorFormat is
+    // CODEC_COLOR_FORMAT_SURFACE stores its input surface in *inputSurface
+    // and fails if it has none. The output format is only announced through
+    // CODEC_INFO_OUTPUT_FORMAT_CHANGED on a codec's first stream; on reuse
+    // read it with getOutputFormat.
+    VideoCodec* acquire(const TrackFormat& format, bool encoder, CodecSurface* outputSurface = nullptr,
+                        CodecSurface** inputSurface = nullptr);
+
+    // Hands back a codec from acquire. reusable says the stream ended
+    // cleanly; otherwise the codec is destroyed.
+    void release(VideoCodec* codec, bool reusable);
+
+    // Releases idle codecs past idleTimeoutUs, or every idle codec with all
+    // set (on memory pressure)
+    void trim(bool all = false);
+
+    CodecPoolStats stats() const;
+
+private:
+    struct Entry {
+        std::unique_ptr<VideoCodec> codec;
+        std::string key;
+        TrackFormat format;
+        bool encoder = false;
+        CodecSurface* outputSurface = nullptr;
+        bool started = false;
+        bool inUse = false;
+        int64_t idleSinceUs = 0;
+    };
+
+    // Both called with mMutex held; the removed codecs go to retired, to be
+    // destroyed after unlocking
+    std::unique_ptr<Entry> takeLocked(Entry* entry);
+    void expireLocked(int64_t nowUs, bool all, std::vector<std::unique_ptr<Entry>>* retired);
+
+    bool prepare(Entry* entry, const TrackFormat& format, CodecSurface* outputSurface, CodecSurface** inputSurface);
+
+    CodecBackend* mBackend;
+    CodecPoolOptions mOptions;
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<std::unique_ptr<Entry>> mEntries;
+    int32_t mCreating = 0;  // Slots reserved by acquire calls creating a codec outside the lock
+    CodecPoolStats mStats;
+};
+
+// One codec held for a job: borrowed from pool when there is one, otherwise
+// created for the holder alone and destroyed by finish
+class CodecLease {
+public:
+    CodecLease(CodecBackend* backend, CodecPool* pool);
+    ~CodecLease() { finish(false); }
+
+    CodecLease(const CodecLease&) = delete;
+    CodecLease& operator=(const CodecLease&) = delete;
+
+    // Same contract as CodecPool::acquire; a codec already held is finished first
+    VideoCodec* acquire(const TrackFormat& format, bool encoder, CodecSurface* outputSurface = nullptr,
+                        CodecSurface** inputSurface = nullptr);
+
+    VideoCodec* get() const { return mCodec; }
+
+    // Stops the codec; with a pool and reusable set it stays warm for the next job
+    void finish(bool reusable);
+
+private:
+    CodecBackend* mBackend;
+    CodecPool* mPool;
+    VideoCodec* mCodec = nullptr;
+    std::unique_ptr<VideoCodec> mOwned;  // Without a pool
+};
@@ -3,20 +3,46 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <media/NdkMediaCodec.h>
-#include <media/NdkMediaFormat.h>
-#include <media/NdkMediaExtractor.h>
-#include <media/NdkMediaMuxer.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CodecBackend.h"
+#include "EncodeProfile.h"
+#include "PipelineTelemetry.h"
+#include "TranscodeEngine.h"
+#include "Transcoder.h"
 
 extern "C" {
 
 // Function prototypes
 void encodeVideo(const char* inputPath, const char* outputPath);
+static bool encodeVideoWithProfile(const char* inputPath, const char* outputPath, const EncodeProfile& profile);
 void decodeVideo(const char* inputPath, const char* outputPath);
 
 int openOutputFile(const char* outputPath);
 size_t getFileSize(const char* filePath);
 
+// Shared engine behind the asynchronous job API; its codec pool also serves
+// the synchronous calls, so every transcode counts against one codec limit
+static std::mutex gEngineMutex;
+static std::unique_ptr<CodecBackend> gEngineBackend;
+static std::unique_ptr<TranscodeEngine> gEngine;
+static const int32_t kDefaultMaxCodecInstances = 8;
+static const int64_t kEncodeFragmentDurationUs = 1000000;
+
+static TranscodeEngine* getEngine() {
+    std::lock_guard<std::mutex> lock(gEngineMutex);
+    if (!gEngine) {
+        gEngineBackend = createNdkBackend();
+        gEngine.reset(new TranscodeEngine(gEngineBackend.get(), kDefaultMaxCodecInstances));
+    }
+    return gEngine.get();
+}
+
 JNIEXPORT void JNICALL
 Java_com_example_mediaprocessing_MediaCodecHelper_nativeEncodeVideo(JNIEnv *env, jobject /* this */,
                                                                     jstring inputPath_,
@@ -30,6 +56,33 @@ Java_com_example_mediaprocessing_MediaCodecHelper_nativeEncodeVideo(JNIEnv *env,
     env->ReleaseStringUTFChars(outputPath_, outputPath);
 }
 
+// Encodes with a named preset from EncodeProfile.h ("720p", "1080p_hevc", ...)
+JNIEXPORT jboolean JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeEncodeVideoWithPreset(JNIEnv *env, jobject /* this */,
+                                                                              jstring inputPath_,
+                                                                              jstring outputPath_,
+                                                                              jstring preset_) {
+    const char *preset = env->GetStringUTFChars(preset_, nullptr);
+    EncodeProfile profile;
+    bool found = findEncodePreset(preset, &profile);
+    if (!found) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Unknown encode preset %s", preset);
+    }
+    env->ReleaseStringUTFChars(preset_, preset);
+    if (!found) {
+        return JNI_FALSE;
+    }
+
+    const char *inputPath = env->GetStringUTFChars(inputPath_, nullptr);
+    const char *outputPath = env->GetStringUTFChars(outputPath_, nullptr);
+
+    bool ok = encodeVideoWithProfile(inputPath, outputPath, profile);
+
+    env->ReleaseStringUTFChars(inputPath_, inputPath);
+    env->ReleaseStringUTFChars(outputPath_, outputPath);
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
 JNIEXPORT void JNICALL
 Java_com_example_mediaprocessing_MediaCodecHelper_nativeDecodeVideo(JNIEnv *env, jobject /* this */,
                                                                     jstring inputPath_,
@@ -43,201 +96,269 @@ Java_com_example_mediaprocessing_MediaCodecHelper_nativeDecodeVideo(JNIEnv *env,
     env->ReleaseStringUTFChars(outputPath_, outputPath);
 }
 
-void encodeVideo(const char* inputPath, const char* outputPath) {
-    AMediaExtractor *extractor = nullptr;
-    AMediaCodec *encoder = nullptr;
-    AMediaCodec *decoder = nullptr;
-    AMediaFormat *format = nullptr;
-    AMediaMuxer *muxer = nullptr;
-
-    // Open input file and get file descriptor
-    int inputFd = open(inputPath, O_RDONLY);
-    if (inputFd < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to open input file: %s", strerror(errno));
-        return;
+// Starts the job engine with a cap on concurrent codec instances. Returns
+// false if the engine is already running.
+JNIEXPORT jboolean JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeStartEngine(JNIEnv *env, jobject /* this */,
+                                                                    jint maxCodecInstances) {
+    std::lock_guard<std::mutex> lock(gEngineMutex);
+    if (gEngine) {
+        return JNI_FALSE;
     }
+    gEngineBackend = createNdkBackend();
+    gEngine.reset(new TranscodeEngine(gEngineBackend.get(), maxCodecInstances));
+    return JNI_TRUE;
+}
+
+// Queues a transcode and returns its job id without waiting for it
+JNIEXPORT jlong JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeSubmitTranscode(JNIEnv *env, jobject /* this */,
+                                                                        jstring inputPath_,
+                                                                        jstring outputPath_) {
+    const char *inputPath = env->GetStringUTFChars(inputPath_, nullptr);
+    const char *outputPath = env->GetStringUTFChars(outputPath_, nullptr);
+
+    TranscodeOptions options;
+    int64_t jobId = getEngine()->submit(inputPath, outputPath, options);
+
+    env->ReleaseStringUTFChars(inputPath_, inputPath);
+    env->ReleaseStringUTFChars(outputPath_, outputPath);
+    return jobId;
+}
+
+// Returns a TranscodeJobState value
+JNIEXPORT jint JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativePollTranscode(JNIEnv *env, jobject /* this */,
+                                                                      jlong jobId) {
+    TranscodeJobStatus status;
+    getEngine()->poll(jobId, &status);
+    return status.state;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeCancelTranscode(JNIEnv *env, jobject /* this */,
+                                                                        jlong jobId) {
+    return getEngine()->cancel(jobId) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Blocks for up to timeoutMs (negative waits forever) and returns a TranscodeJobState value
+JNIEXPORT jint JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeWaitTranscode(JNIEnv *env, jobject /* this */,
+                                                                      jlong jobId, jlong timeoutMs) {
+    TranscodeJobStatus status;
+    getEngine()->wait(jobId, timeoutMs < 0 ? -1 : timeoutMs * 1000, &status);
+    return status.state;
+}
+
+// Frees a finished job's bookkeeping
+JNIEXPORT jboolean JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeReleaseTranscode(JNIEnv *env, jobject /* this */,
+                                                                         jlong jobId) {
+    return getEngine()->release(jobId) ? JNI_TRUE : JNI_FALSE;
+}
 
-    // Initialize MediaExtractor from FD
-    extractor = AMediaExtractor_new();
-    media_status_t status = AMediaExtractor_setDataSourceFd(extractor, inputFd, 0, getFileSize(inputPath));
-    if (status != AMEDIA_OK) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to set data source for %s", inputPath);
-        close(inputFd);
-        return;
+// Returns the job's telemetry as JSON (per-stage latency percentiles,
+// buffer gauges, throughput and TRY_AGAIN_LATER counters), or null for an
+// unknown job id. Live while the job runs.
+JNIEXPORT jstring JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeGetJobTelemetry(JNIEnv *env, jobject /* this */,
+                                                                       jlong jobId) {
+    std::string json;
+    if (!getEngine()->telemetryJson(jobId, &json)) {
+        return nullptr;
     }
+    return env->NewStringUTF(json.c_str());
+}
 
-    // Get video track format from extractor
-    int trackCount = AMediaExtractor_getTrackCount(extractor);
-    AMediaFormat *trackFormat = nullptr;
-    int videoTrackIndex = -1;
-    for (int i = 0; i < trackCount; ++i) {
-        trackFormat = AMediaExtractor_getTrackFormat(extractor, i);
-        const char *mime;
-        if (AMediaFormat_getString(trackFormat, AMEDIAFORMAT_KEY_MIME, &mime) && !strncmp(mime, "video/", 6)) {
-            videoTrackIndex = i;
-            break;
-        }
+// Traces the jobs submitted from now on into directory_/transcode-<job id>.json
+// (Chrome trace format, opens in Perfetto); null turns tracing off
+JNIEXPORT void JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeSetTraceDirectory(JNIEnv *env, jobject /* this */,
+                                                                         jstring directory_) {
+    const char *directory = directory_ ? env->GetStringUTFChars(directory_, nullptr) : nullptr;
+    getEngine()->setTraceDirectory(directory ? directory : "");
+    if (directory) {
+        env->ReleaseStringUTFChars(directory_, directory);
     }
+}
 
-    if (videoTrackIndex < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "No video track found");
-        close(inputFd);
-        AMediaExtractor_delete(extractor);
-        return;
+// Transcodes the part of the input presented between startUs and endUs
+// (negative: to the end). cacheDir_ may be null to keep the keyframe index
+// next to the input.
+JNIEXPORT jboolean JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeTranscodeRange(JNIEnv *env, jobject /* this */,
+                                                                       jstring inputPath_, jstring outputPath_,
+                                                                       jlong startUs, jlong endUs,
+                                                                       jstring cacheDir_) {
+    const char *inputPath = env->GetStringUTFChars(inputPath_, nullptr);
+    const char *outputPath = env->GetStringUTFChars(outputPath_, nullptr);
+    const char *cacheDir = cacheDir_ ? env->GetStringUTFChars(cacheDir_, nullptr) : nullptr;
+
+    TranscodeEngine* engine = getEngine();
+    TranscodeOptions options;
+    options.useSurface = true;
+    options.fragmentDurationUs = kEncodeFragmentDurationUs;
+    options.keyframeIndexDir = cacheDir;
+    options.codecPool = engine->codecPool();
+    TranscodeResult result;
+    bool ok = transcodeRange(engine->backend(), inputPath, outputPath, startUs, endUs, options, &result);
+    if (!ok) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to transcode %s from %lld to %lld", inputPath,
+                            static_cast<long long>(startUs), static_cast<long long>(endUs));
     }
 
-    AMediaExtractor_selectTrack(extractor, videoTrackIndex);
+    if (cacheDir) {
+        env->ReleaseStringUTFChars(cacheDir_, cacheDir);
+    }
+    env->ReleaseStringUTFChars(inputPath_, inputPath);
+    env->ReleaseStringUTFChars(outputPath_, outputPath);
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
 
-    // Initialize MediaCodec encoder
-    encoder = AMediaCodec_createEncoderByType("video/avc");
-    if (!encoder) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create encoder");
-        close(inputFd);
-        AMediaExtractor_delete(extractor);
-        return;
+// Encodes one rendition per preset (see EncodeProfile.h) into the matching
+// output path, decoding the input only once
+JNIEXPORT jboolean JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeEncodeLadder(JNIEnv *env, jobject /* this */,
+                                                                     jstring inputPath_,
+                                                                     jobjectArray outputPaths_,
+                                                                     jobjectArray presets_) {
+    jsize count = env->GetArrayLength(outputPaths_);
+    if (count == 0 || env->GetArrayLength(presets_) != count) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Ladder needs one preset per output");
+        return JNI_FALSE;
     }
 
-    format = AMediaFormat_new();
-    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, "video/avc");
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, 1280);  // Specify your video width
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, 720);  // Specify your video height
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, 2000000);  // Specify your video bit rate
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_FRAME_RATE, 30);  // Specify your video frame rate
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, 19);  // COLOR_FormatYUV420Planar (NV12)
-
-    AMediaCodec_configure(encoder, format, nullptr, nullptr, AMEDIACODEC_CONFIGURE_FLAG_ENCODE);
-    AMediaCodec_start(encoder);
-
-    // Initialize MediaCodec decoder
-    decoder = AMediaCodec_createDecoderByType("video/avc");
-    if (!decoder) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create decoder");
-        close(inputFd);
-        AMediaCodec_stop(encoder);
-        AMediaCodec_delete(encoder);
-        AMediaExtractor_delete(extractor);
-        AMediaFormat_delete(format);
-        return;
+    // The renditions point into these strings
+    std::vector<std::string> outputPaths(count);
+    std::vector<LadderRendition> renditions(count);
+    for (jsize i = 0; i < count; ++i) {
+        jstring outputPath_ = static_cast<jstring>(env->GetObjectArrayElement(outputPaths_, i));
+        jstring preset_ = static_cast<jstring>(env->GetObjectArrayElement(presets_, i));
+        const char *outputPath = env->GetStringUTFChars(outputPath_, nullptr);
+        const char *preset = env->GetStringUTFChars(preset_, nullptr);
+        outputPaths[i] = outputPath;
+        bool found = findEncodePreset(preset, &renditions[i].encode);
+        if (!found) {
+            __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Unknown encode preset %s", preset);
+        }
+        env->ReleaseStringUTFChars(outputPath_, outputPath);
+        env->ReleaseStringUTFChars(preset_, preset);
+        env->DeleteLocalRef(outputPath_);
+        env->DeleteLocalRef(preset_);
+        if (!found) {
+            return JNI_FALSE;
+        }
+        renditions[i].outputPath = outputPaths[i].c_str();
     }
 
-    AMediaCodec_configure(decoder, trackFormat, nullptr, nullptr, 0);
-    AMediaCodec_start(decoder);
+    const char *inputPath = env->GetStringUTFChars(inputPath_, nullptr);
+    TranscodeEngine* engine = getEngine();
+    TranscodeOptions options;
+    options.fragmentDurationUs = kEncodeFragmentDurationUs;
+    options.codecPool = engine->codecPool();
+    options.framePool = engine->framePool();
+    std::vector<TranscodeResult> results;
+    bool ok = transcodeLadder(engine->backend(), inputPath, renditions, options, &results);
+    if (!ok) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to encode the ladder of %s", inputPath);
+    } else {
+        __android_log_print(ANDROID_LOG_INFO, "MediaCodec", "Decoded %lld frames once for %d renditions in %lld ms",
+                            static_cast<long long>(results[0].framesDecoded), static_cast<int>(count),
+                            static_cast<long long>(results[0].elapsedUs / 1000));
+    }
+    env->ReleaseStringUTFChars(inputPath_, inputPath);
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
 
-    // Open output file and get file descriptor
-    int outputFd = openOutputFile(outputPath);
-    if (outputFd < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to open output file");
-        close(inputFd);
-        AMediaCodec_stop(encoder);
-        AMediaCodec_delete(encoder);
-        AMediaCodec_stop(decoder);
-        AMediaCodec_delete(decoder);
-        AMediaExtractor_delete(extractor);
-        AMediaFormat_delete(format);
-        return;
+// Releases the idle codecs kept warm for later transcodes, e.g. from
+// onTrimMemory. Codecs in use are not affected.
+JNIEXPORT void JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeTrimCodecPool(JNIEnv *env, jobject /* this */) {
+    std::lock_guard<std::mutex> lock(gEngineMutex);
+    if (gEngine) {
+        gEngine->codecPool()->trim(true);
     }
+}
 
-    // Initialize MediaMuxer from FD for output MP4 file
-    muxer = AMediaMuxer_newFromFd(outputFd, AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4);
-    if (!muxer) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create muxer");
-        close(inputFd);
-        close(outputFd);
-        AMediaCodec_stop(encoder);
-        AMediaCodec_delete(encoder);
-        AMediaCodec_stop(decoder);
-        AMediaCodec_delete(decoder);
-        AMediaExtractor_delete(extractor);
-        AMediaFormat_delete(format);
-        return;
+// Returns the codec pool counters as { hits, reconfigures, misses, evictions,
+// waits, failures, startupUs, reuseUs, inUse, idle }
+JNIEXPORT jlongArray JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeGetCodecPoolStats(JNIEnv *env, jobject /* this */) {
+    CodecPoolStats stats = getEngine()->codecPool()->stats();
+    const jlong values[] = {
+        stats.hits, stats.reconfigures, stats.misses, stats.evictions, stats.waits,
+        stats.failures, stats.startupUs, stats.reuseUs, stats.inUse, stats.idle,
+    };
+    jsize count = static_cast<jsize>(sizeof(values) / sizeof(values[0]));
+    jlongArray array = env->NewLongArray(count);
+    if (array) {
+        env->SetLongArrayRegion(array, 0, count, values);
     }
+    return array;
+}
 
-    // Read and decode frames, then encode and write to muxer
-    ssize_t inputIndex = -1;
-    ssize_t outputIndex = -1;
-    int trackIndex = -1;
-
-    AMediaCodecBufferInfo info;
-    bool sawInputEOS = false;
-    bool sawOutputEOS = false;
-
-    while (!sawOutputEOS) {
-        if (!sawInputEOS) {
-            ssize_t inputBufferIndex = AMediaCodec_dequeueInputBuffer(decoder, 10000);  // Timeout in microseconds
-            if (inputBufferIndex >= 0) {
-                uint8_t *inputBuffer = AMediaCodec_getInputBuffer(decoder, inputBufferIndex, &inputIndex);
-
-                // Get sample size and time
-                ssize_t sampleSize = AMediaExtractor_getSampleSize(extractor);
-                if (sampleSize < 0) {
-                    sawInputEOS = true;
-                    sampleSize = 0;
-                }
-                int64_t sampleTime = AMediaExtractor_getSampleTime(extractor);
-                uint32_t sampleFlags = AMediaExtractor_getSampleFlags(extractor);
-
-                // Copy sample data directly
-                if (sampleSize > 0) {
-                    ssize_t bytesRead = AMediaExtractor_readSampleData(extractor, inputBuffer, sampleSize);
-                    if (bytesRead != sampleSize) {
-                        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Error reading sample data: %zd", bytesRead);
-                        break;
-                    }
-                }
-
-                // Queue input buffer
-                AMediaCodec_queueInputBuffer(decoder, inputBufferIndex, 0, sampleSize, sampleTime, sampleFlags);
-
-                // Advance to the next sample
-                AMediaExtractor_advance(extractor);
-            }
-        }
+// Frees the frame buffers cached for later transcodes, e.g. from
+// onTrimMemory. Buffers in use are not affected.
+JNIEXPORT void JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeTrimFramePool(JNIEnv *env, jobject /* this */) {
+    std::lock_guard<std::mutex> lock(gEngineMutex);
+    if (gEngine) {
+        gEngine->framePool()->trim();
+    }
+}
 
-        ssize_t outputBufferIndex = AMediaCodec_dequeueOutputBuffer(decoder, &info, 10000);
-        if (outputBufferIndex >= 0) {
-            uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(decoder, outputBufferIndex, &outputIndex);
-
-            ssize_t inputBufferIndex = AMediaCodec_dequeueInputBuffer(encoder, 10000);  // Timeout in microseconds
-            if (inputBufferIndex >= 0) {
-                uint8_t *inputBuffer = AMediaCodec_getInputBuffer(encoder, inputBufferIndex, &inputIndex);
-                memcpy(inputBuffer, outputBuffer, info.size);
-                AMediaCodec_queueInputBuffer(encoder, inputBufferIndex, 0, info.size, info.presentationTimeUs, 0);
-
-                // Write encoded frame to muxer
-                AMediaCodecBufferInfo encodeInfo;
-                ssize_t encodeOutputIndex = AMediaCodec_dequeueOutputBuffer(encoder, &encodeInfo, 10000);
-                if (encodeOutputIndex >= 0) {
-                    size_t encodedDataSize;
-                    uint8_t *encodedData = AMediaCodec_getOutputBuffer(encoder, encodeOutputIndex, &encodedDataSize);
-                    AMediaMuxer_writeSampleData(muxer, trackIndex, encodedData, &encodeInfo);
-                    AMediaCodec_releaseOutputBuffer(encoder, encodeOutputIndex, false);
-                }
-            }
-
-            AMediaCodec_releaseOutputBuffer(decoder, outputBufferIndex, false);
-            if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
-                sawOutputEOS = true;
-            }
-        } else if (outputBufferIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
-            AMediaFormat *format = AMediaCodec_getOutputFormat(decoder);
-            trackIndex = AMediaMuxer_addTrack(muxer, format);
-            AMediaMuxer_start(muxer);
-        } else if (outputBufferIndex == AMEDIACODEC_INFO_TRY_AGAIN_LATER) {
-            // Handle timeout
-        }
+// Returns the frame pool counters as { hits, misses, evictions, waits,
+// failures, waitUs, bytesInUse, bytesCached, peakBytesInUse, peakBytes,
+// buffersInUse }
+JNIEXPORT jlongArray JNICALL
+Java_com_example_mediaprocessing_MediaCodecHelper_nativeGetFramePoolStats(JNIEnv *env, jobject /* this */) {
+    FramePoolStats stats = getEngine()->framePool()->stats();
+    const jlong values[] = {
+        stats.hits, stats.misses, stats.evictions, stats.waits, stats.failures, stats.waitUs,
+        stats.bytesInUse, stats.bytesCached, stats.peakBytesInUse, stats.peakBytes, stats.buffersInUse,
+    };
+    jsize count = static_cast<jsize>(sizeof(values) / sizeof(values[0]));
+    jlongArray array = env->NewLongArray(count);
+    if (array) {
+        env->SetLongArrayRegion(array, 0, count, values);
+    }
+    return array;
+}
+
+void encodeVideo(const char* inputPath, const char* outputPath) {
+    // Source resolution and frame rate, bitrate sized for them
+    encodeVideoWithProfile(inputPath, outputPath, EncodeProfile());
+}
+
+static bool encodeVideoWithProfile(const char* inputPath, const char* outputPath, const EncodeProfile& profile) {
+    // Codecs come warm from the engine's pool when an earlier call left them there
+    TranscodeEngine* engine = getEngine();
+
+    // Decoded frames go straight to the encoder surface when the codec allows it
+    TranscodeOptions options;
+    options.encode = profile;
+    options.useSurface = true;
+    // Fragmented output: each second is on disk as soon as it is encoded
+    options.fragmentDurationUs = kEncodeFragmentDurationUs;
+    // The audio track is copied in the same pass (the default)
+    options.passthroughTracks = PASSTHROUGH_AUDIO;
+    options.codecPool = engine->codecPool();
+    PipelineTelemetry telemetry;
+    options.telemetry = &telemetry;
+    TranscodeResult result;
+    bool ok = transcodeVideo(engine->backend(), inputPath, outputPath, options, &result);
+    __android_log_print(ANDROID_LOG_INFO, "MediaCodec", "Telemetry: %s", telemetry.toJson().c_str());
+    if (!ok) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to transcode %s", inputPath);
+        return false;
     }
 
-    // Clean up
-    close(inputFd);
-    close(outputFd);
-    AMediaCodec_stop(encoder);
-    AMediaCodec_delete(encoder);
-    AMediaCodec_stop(decoder);
-    AMediaCodec_delete(decoder);
-    AMediaExtractor_delete(extractor);
-    AMediaFormat_delete(format);
-    AMediaMuxer_stop(muxer);
-    AMediaMuxer_delete(muxer);
+    __android_log_print(ANDROID_LOG_INFO, "MediaCodec",
+                        "Transcoded %lld frames in %lld ms (%s, %lld bytes copied), %lld audio samples passed through",
+                        static_cast<long long>(result.framesEncoded), static_cast<long long>(result.elapsedUs / 1000),
+                        result.usedSurface ? "surface" : "buffers", static_cast<long long>(result.bytesCopied),
+                        static_cast<long long>(result.samplesPassedThrough));
+    return true;
 }
 
 void decodeVideo(const char* inputPath, const char* outputPath) {
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "EncodeProfile.h"
+
+namespace {
+
+// Bits per pixel per frame at which each codec looks good for typical
+// content; 1280x720 at 30 fps gives about 2 Mbit/s for AVC
+float defaultBitsPerPixel(const std::string& mime) {
+    if (mime == "video/hevc" || mime == "video/x-vnd.on2.vp9") {
+        return 0.045f;
+    }
+    if (mime == "video/av01") {
+        return 0.035f;
+    }
+    return 0.07f;
+}
+
+int32_t even(int64_t value) {
+    return static_cast<int32_t>(std::max<int64_t>(value & ~1LL, 2));
+}
+
+const int32_t kMinBitRate = 64000;
+
+// Bitrates are for 16:9 at 30 fps; they become bits per pixel
+const struct {
+    const char* name;
+    const char* mime;
+    int32_t shortSide;
+    int32_t bitRate;
+    int32_t maxBFrames;
+    int32_t profile;
+} kEncodePresets[] = {
+    { "2160p_hevc", "video/hevc", 2160, 16000000, 2, CODEC_PROFILE_HEVC_MAIN },
+    { "1080p_hevc", "video/hevc", 1080, 4000000, 2, CODEC_PROFILE_HEVC_MAIN },
+    { "1080p", "video/avc", 1080, 5000000, 2, CODEC_PROFILE_AVC_HIGH },
+    { "720p", "video/avc", 720, 2500000, 2, CODEC_PROFILE_AVC_HIGH },
+    { "540p", "video/avc", 540, 1600000, 2, CODEC_PROFILE_AVC_HIGH },
+    { "480p", "video/avc", 480, 1100000, 0, CODEC_PROFILE_AVC_MAIN },
+    { "360p", "video/avc", 360, 700000, 0, CODEC_PROFILE_AVC_MAIN },
+    { "240p", "video/avc", 240, 400000, 0, CODEC_PROFILE_AVC_BASELINE },
+};
+
+} // namespace
+
+TrackFormat resolveEncodeProfile(const EncodeProfile& profile, const TrackFormat& source) {
+    int32_t sourceWidth = source.width > 0 ? source.width : 1280;
+    int32_t sourceHeight = source.height > 0 ? source.height : 720;
+
+    int64_t width = profile.width;
+    int64_t height = profile.height;
+    if (width <= 0 && height <= 0 && profile.shortSide > 0) {
+        if (sourceWidth < sourceHeight) {
+            width = profile.shortSide;
+        } else {
+            height = profile.shortSide;
+        }
+    }
+    if (width <= 0 && height <= 0) {
+        width = sourceWidth;
+        height = sourceHeight;
+    } else if (width <= 0) {
+        width = height * sourceWidth / sourceHeight;
+    } else if (height <= 0) {
+        height = width * sourceHeight / sourceWidth;
+    }
+    if (!profile.allowUpscale && (width > sourceWidth || height > sourceHeight)) {
+        width = sourceWidth;
+        height = sourceHeight;
+    }
+
+    TrackFormat format;
+    format.mime = profile.mime;
+    format.width = even(width);
+    format.height = even(height);
+    // Every decoded frame is encoded, so a known source rate is the output rate
+    if (source.frameRate > 0) {
+        format.frameRate = source.frameRate;
+    } else {
+        format.frameRate = profile.frameRate > 0 ? profile.frameRate : 30;
+    }
+
+    format.bitrateMode = profile.bitrateMode;
+    if (profile.bitrateMode == CODEC_BITRATE_MODE_CQ) {
+        format.quality = profile.quality;
+    } else if (profile.bitRate > 0) {
+        format.bitRate = profile.bitRate;
+    } else {
+        float bitsPerPixel = profile.bitsPerPixel > 0 ? profile.bitsPerPixel : defaultBitsPerPixel(profile.mime);
+        double pixels = static_cast<double>(format.width) * format.height;
+        double bitRate = pixels * format.frameRate * bitsPerPixel;
+        if (source.bitRate > 0 && source.width > 0 && source.height > 0) {
+            bitRate = std::min(bitRate, source.bitRate * pixels / (static_cast<double>(source.width) * source.height));
+        }
+        format.bitRate = static_cast<int32_t>(std::lround(std::max(bitRate, static_cast<double>(kMinBitRate))));
+    }
+
+    format.iFrameInterval = profile.iFrameInterval;
+    format.maxBFrames = profile.maxBFrames;
+    format.profile = profile.profile;
+    format.level = profile.level;
+    format.colorFormat = profile.colorFormat;
+    return format;
+}
+
+bool findEncodePreset(const char* name, EncodeProfile* profile) {
+    if (!name) {
+        return false;
+    }
+    *profile = EncodeProfile();
+    if (!strcmp(name, "source")) {
+        return true;
+    }
+    for (const auto& preset : kEncodePresets) {
+        if (!strcmp(name, preset.name)) {
+            double referencePixels = preset.shortSide * 16.0 / 9.0 * preset.shortSide;
+            profile->mime = preset.mime;
+            profile->shortSide = preset.shortSide;
+            profile->bitsPerPixel = static_cast<float>(preset.bitRate / (referencePixels * 30));
+            profile->maxBFrames = preset.maxBFrames;
+            profile->profile = preset.profile;
+            return true;
+        }
+    }
+    return false;
+}
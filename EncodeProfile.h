@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "CodecBackend.h"
+
+// Bitrate modes (values match MediaCodecInfo.EncoderCapabilities BITRATE_MODE_*)
+const int32_t CODEC_BITRATE_MODE_CQ = 0;
+const int32_t CODEC_BITRATE_MODE_VBR = 1;
+const int32_t CODEC_BITRATE_MODE_CBR = 2;
+
+// Profiles (values match MediaCodecInfo.CodecProfileLevel)
+const int32_t CODEC_PROFILE_AVC_BASELINE = 0x01;
+const int32_t CODEC_PROFILE_AVC_MAIN = 0x02;
+const int32_t CODEC_PROFILE_AVC_HIGH = 0x08;
+const int32_t CODEC_PROFILE_HEVC_MAIN = 0x01;
+const int32_t CODEC_PROFILE_HEVC_MAIN10 = 0x02;
+
+// What to encode into. Zero fields are derived from the source track by
+// resolveEncodeProfile, so the default profile re-encodes at the source's
+// resolution and frame rate with a bitrate sized for both.
+struct EncodeProfile {
+    std::string mime = "video/avc";
+    int32_t width = 0;          // 0: from height and the source aspect ratio, or the source width
+    int32_t height = 0;         // 0: from width and the source aspect ratio, or the source height
+    int32_t shortSide = 0;      // With width and height 0: the smaller dimension, so portrait sources stay portrait
+    bool allowUpscale = false;  // Otherwise sizes above the source's are clamped to it
+    int32_t bitRate = 0;        // 0: bitsPerPixel times the output pixel rate
+    float bitsPerPixel = 0;     // 0: the codec's default budget
+    int32_t bitrateMode = CODEC_BITRATE_MODE_VBR;
+    int32_t quality = 0;        // CQ mode only; codec-specific scale
+    int32_t frameRate = 0;      // Only for sources without a known rate; nothing drops frames to lower it
+    int32_t iFrameInterval = 1; // Seconds between sync frames
+    int32_t maxBFrames = 0;
+    int32_t profile = 0;        // CODEC_PROFILE_*; 0 lets the encoder choose
+    int32_t level = 0;          // MediaCodecInfo.CodecProfileLevel level; 0 lets the encoder choose
+    int32_t colorFormat = CODEC_COLOR_FORMAT_YUV420_PLANAR;  // Buffer input layout
+};
+
+// The encoder format for profile applied to a source track. Sizes are kept
+// even. A derived bitrate is capped at the source bitrate scaled to the
+// output size when that is known, since re-encoding cannot add detail.
+TrackFormat resolveEncodeProfile(const EncodeProfile& profile, const TrackFormat& source);
+
+// Named presets: "source" plus "2160p_hevc", "1080p_hevc", "1080p",
+// "720p", "540p", "480p", "360p" and "240p". Each sets a short side and a
+// bits-per-pixel budget, so the bitrate follows the source's aspect ratio,
+// orientation and frame rate.
+bool findEncodePreset(const char* name, EncodeProfile* profile);
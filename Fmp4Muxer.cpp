@@ -0,0 +1,686 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+#include "Fmp4Muxer.h"
+
+#define LOG_TAG "Fmp4Muxer"
+#include "Log.h"
+
+namespace {
+
+// Appends big-endian fields and nested boxes, patching each box size on end()
+class BoxWriter {
+public:
+    explicit BoxWriter(std::vector<uint8_t>* out) : mOut(out) {}
+
+    void u8(uint32_t value) { mOut->push_back(static_cast<uint8_t>(value)); }
+    void u16(uint32_t value) { u8(value >> 8); u8(value); }
+    void u32(uint32_t value) { u16(value >> 16); u16(value & 0xffff); }
+    void u64(uint64_t value) { u32(static_cast<uint32_t>(value >> 32)); u32(static_cast<uint32_t>(value)); }
+    void zeros(size_t count) { mOut->resize(mOut->size() + count, 0); }
+    void bytes(const uint8_t* data, size_t size) { mOut->insert(mOut->end(), data, data + size); }
+    void type(const char* fourcc) { bytes(reinterpret_cast<const uint8_t*>(fourcc), 4); }
+
+    void begin(const char* fourcc) {
+        mStarts.push_back(mOut->size());
+        u32(0);
+        type(fourcc);
+    }
+
+    void beginFull(const char* fourcc, uint8_t version, uint32_t flags) {
+        begin(fourcc);
+        u32((static_cast<uint32_t>(version) << 24) | flags);
+    }
+
+    void end() {
+        size_t start = mStarts.back();
+        mStarts.pop_back();
+        patchU32(start, static_cast<uint32_t>(mOut->size() - start));
+    }
+
+    size_t size() const { return mOut->size(); }
+
+    void patchU32(size_t at, uint32_t value) {
+        for (int32_t i = 0; i < 4; ++i) {
+            (*mOut)[at + i] = static_cast<uint8_t>(value >> (24 - 8 * i));
+        }
+    }
+
+private:
+    std::vector<uint8_t>* mOut;
+    std::vector<size_t> mStarts;
+};
+
+// Offset of the next 00 00 01 at or after pos, or size if there is none
+size_t findStartCode(const uint8_t* data, size_t size, size_t pos) {
+    while (pos + 3 <= size) {
+        const uint8_t* one = static_cast<const uint8_t*>(memchr(data + pos + 2, 1, size - pos - 2));
+        if (!one) {
+            break;
+        }
+        size_t at = one - data;
+        if (data[at - 1] == 0 && data[at - 2] == 0) {
+            return at - 2;
+        }
+        pos = at - 1;
+    }
+    return size;
+}
+
+// Calls onNal for every NAL unit of an Annex-B buffer, trailing zeros trimmed
+template <typename OnNal>
+void forEachAnnexBNal(const uint8_t* data, size_t size, OnNal onNal) {
+    size_t start = findStartCode(data, size, 0);
+    while (start < size) {
+        size_t nal = start + 3;
+        size_t next = findStartCode(data, size, nal);
+        size_t end = next;
+        while (end > nal && data[end - 1] == 0) {
+            end--;
+        }
+        if (end > nal) {
+            onNal(data + nal, end - nal);
+        }
+        start = next;
+    }
+}
+
+// True if 4-byte NAL lengths cover the sample exactly
+bool isLengthPrefixed(const uint8_t* data, size_t size) {
+    size_t pos = 0;
+    while (size - pos >= 4) {
+        uint32_t length = (static_cast<uint32_t>(data[pos]) << 24) | (data[pos + 1] << 16) |
+                          (data[pos + 2] << 8) | data[pos + 3];
+        if (length == 0 || length > size - pos - 4) {
+            return false;
+        }
+        pos += 4 + length;
+    }
+    return pos == size;
+}
+
+// Appends data as 4-byte length-prefixed NAL units and returns the byte count
+size_t appendSample(const uint8_t* data, size_t size, std::vector<uint8_t>* payload) {
+    size_t before = payload->size();
+    if (isLengthPrefixed(data, size)) {
+        payload->insert(payload->end(), data, data + size);
+        return size;
+    }
+    forEachAnnexBNal(data, size, [payload](const uint8_t* nal, size_t nalSize) {
+        uint8_t length[4] = { static_cast<uint8_t>(nalSize >> 24), static_cast<uint8_t>(nalSize >> 16),
+                              static_cast<uint8_t>(nalSize >> 8), static_cast<uint8_t>(nalSize) };
+        payload->insert(payload->end(), length, length + 4);
+        payload->insert(payload->end(), nal, nal + nalSize);
+    });
+    return payload->size() - before;
+}
+
+typedef std::vector<std::pair<const uint8_t*, size_t>> NalList;
+
+void collectNals(const TrackFormat& format, NalList* nals) {
+    auto add = [nals](const uint8_t* nal, size_t size) { nals->push_back(std::make_pair(nal, size)); };
+    forEachAnnexBNal(format.csd0.data(), format.csd0.size(), add);
+    forEachAnnexBNal(format.csd1.data(), format.csd1.size(), add);
+}
+
+void putParameterSet(BoxWriter* w, const std::pair<const uint8_t*, size_t>& nal) {
+    w->u16(static_cast<uint32_t>(nal.second));
+    w->bytes(nal.first, nal.second);
+}
+
+// AVCDecoderConfigurationRecord from the SPS and PPS in csd-0 / csd-1
+bool buildAvcC(const TrackFormat& format, std::vector<uint8_t>* config) {
+    NalList nals;
+    collectNals(format, &nals);
+    NalList sps;
+    NalList pps;
+    for (const auto& nal : nals) {
+        int32_t type = nal.first[0] & 0x1f;
+        if (type == 7 && nal.second >= 4) sps.push_back(nal);
+        if (type == 8) pps.push_back(nal);
+    }
+    if (sps.empty() || pps.empty() || sps.size() > 31 || pps.size() > 255) {
+        return false;
+    }
+    BoxWriter w(config);
+    w.u8(1);
+    w.bytes(sps[0].first + 1, 3);  // profile, compatibility, level
+    w.u8(0xff);                    // 4-byte NAL lengths
+    w.u8(0xe0 | static_cast<uint32_t>(sps.size()));
+    for (const auto& nal : sps) putParameterSet(&w, nal);
+    w.u8(static_cast<uint32_t>(pps.size()));
+    for (const auto& nal : pps) putParameterSet(&w, nal);
+    return true;
+}
+
+// HEVCDecoderConfigurationRecord; the profile, tier and level come from the
+// start of the SPS, emulation prevention bytes removed
+bool buildHvcC(const TrackFormat& format, std::vector<uint8_t>* config) {
+    NalList nals;
+    collectNals(format, &nals);
+    NalList arrays[3];  // VPS, SPS, PPS
+    for (const auto& nal : nals) {
+        int32_t type = (nal.first[0] >> 1) & 0x3f;
+        if (type >= 32 && type <= 34) {
+            arrays[type - 32].push_back(nal);
+        }
+    }
+    if (arrays[0].empty() || arrays[1].empty() || arrays[2].empty()) {
+        return false;
+    }
+
+    std::vector<uint8_t> sps;
+    const auto& spsNal = arrays[1][0];
+    int32_t zeros = 0;
+    for (size_t i = 0; i < spsNal.second && sps.size() < 15; ++i) {
+        uint8_t byte = spsNal.first[i];
+        if (zeros >= 2 && byte == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = byte == 0 ? zeros + 1 : 0;
+        sps.push_back(byte);
+    }
+    if (sps.size() < 15) {
+        return false;
+    }
+    // sps[2]: vps id (4), max_sub_layers_minus1 (3), temporal_id_nesting (1);
+    // sps[3..14]: general profile_tier_level
+    int32_t subLayers = ((sps[2] >> 1) & 7) + 1;
+    bool temporalIdNested = sps[2] & 1;
+    int32_t profile = sps[3] & 0x1f;
+    uint32_t bitDepthMinus8 = profile == 2 ? 2 : 0;  // Main 10
+
+    BoxWriter w(config);
+    w.u8(1);
+    w.bytes(sps.data() + 3, 12);  // profile space/tier/idc, compatibility, constraints, level
+    w.u16(0xf000);                // min_spatial_segmentation_idc
+    w.u8(0xfc);                   // parallelismType
+    w.u8(0xfd);                   // chroma_format_idc 4:2:0
+    w.u8(0xf8 | bitDepthMinus8);
+    w.u8(0xf8 | bitDepthMinus8);
+    w.u16(0);                     // avgFrameRate
+    w.u8((subLayers << 3) | (temporalIdNested ? 4 : 0) | 3);
+    w.u8(3);
+    for (int32_t i = 0; i < 3; ++i) {
+        w.u8(0x80 | (32 + i));    // array_completeness
+        w.u16(static_cast<uint32_t>(arrays[i].size()));
+        for (const auto& nal : arrays[i]) putParameterSet(&w, nal);
+    }
+    return true;
+}
+
+// Descriptor tag and length, the length in the 4-byte expandable form
+void putDescriptor(BoxWriter* w, uint32_t tag, size_t length) {
+    w->u8(tag);
+    w->u8(0x80 | ((length >> 21) & 0x7f));
+    w->u8(0x80 | ((length >> 14) & 0x7f));
+    w->u8(0x80 | ((length >> 7) & 0x7f));
+    w->u8(length & 0x7f);
+}
+
+// ES_Descriptor wrapping the AAC AudioSpecificConfig in csd-0
+bool buildEsds(const TrackFormat& format, std::vector<uint8_t>* config) {
+    const std::vector<uint8_t>& asc = format.csd0;
+    if (asc.size() < 2) {
+        return false;
+    }
+    size_t decoderSpecificSize = 5 + asc.size();
+    size_t decoderConfigSize = 5 + 13 + decoderSpecificSize;
+    size_t slConfigSize = 5 + 1;
+    uint32_t bitRate = format.bitRate > 0 ? static_cast<uint32_t>(format.bitRate) : 0;
+
+    BoxWriter w(config);
+    putDescriptor(&w, 0x03, 3 + decoderConfigSize + slConfigSize);
+    w.u16(0);                       // ES_ID, unused in MP4
+    w.u8(0);                        // no dependency, URL or OCR stream
+    putDescriptor(&w, 0x04, 13 + decoderSpecificSize);
+    w.u8(0x40);                     // MPEG-4 audio
+    w.u8(0x15);                     // audio stream
+    w.u8(0);                        // bufferSizeDB
+    w.u16(0);
+    w.u32(bitRate);                 // maxBitrate
+    w.u32(bitRate);                 // avgBitrate
+    putDescriptor(&w, 0x05, asc.size());
+    w.bytes(asc.data(), asc.size());
+    putDescriptor(&w, 0x06, 1);
+    w.u8(0x02);                     // MP4 SL config
+    return true;
+}
+
+// Rounded, so that 1024-sample AAC frames at 21333 us stay 1024 ticks long
+int64_t usToTicks(int64_t us, uint32_t timescale) {
+    return (us / 1000000) * timescale + ((us % 1000000) * timescale + 500000) / 1000000;
+}
+
+const uint32_t kMatrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+
+// trun sample_flags: sample_depends_on = 2 for sync samples, otherwise
+// sample_depends_on = 1 and sample_is_non_sync_sample
+const uint32_t kSyncSampleFlags = 0x02000000;
+const uint32_t kNonSyncSampleFlags = 0x01010000;
+
+} // namespace
+
+Fmp4Muxer::Fmp4Muxer(int fd, const Fmp4MuxerOptions& options) : mFd(fd), mOptions(options) {}
+
+Fmp4Muxer::~Fmp4Muxer() {
+    if (mStarted) {
+        stop();
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+ssize_t Fmp4Muxer::addTrack(const TrackFormat& format) {
+    if (mStarted) {
+        return -1;
+    }
+    Track track;
+    track.format = format;
+    if (format.mime == "video/avc") {
+        if (!buildAvcC(format, &track.config)) {
+            LOGE("No SPS / PPS in the AVC track format");
+            return -1;
+        }
+    } else if (format.mime == "video/hevc") {
+        track.hevc = true;
+        if (!buildHvcC(format, &track.config)) {
+            LOGE("No VPS / SPS / PPS in the HEVC track format");
+            return -1;
+        }
+    } else if (format.mime == "audio/mp4a-latm") {
+        track.audio = true;
+        if (mTracks.empty()) {
+            LOGE("The first track must be video");
+            return -1;
+        }
+        if (format.sampleRate <= 0 || !buildEsds(format, &track.config)) {
+            LOGE("No sample rate or AudioSpecificConfig in the AAC track format");
+            return -1;
+        }
+        track.timescale = static_cast<uint32_t>(format.sampleRate);
+    } else {
+        LOGE("Unsupported track type %s", format.mime.c_str());
+        return -1;
+    }
+    mTracks.push_back(std::move(track));
+    return static_cast<ssize_t>(mTracks.size() - 1);
+}
+
+bool Fmp4Muxer::start() {
+    if (mStarted || mTracks.empty() || mFd < 0) {
+        return false;
+    }
+    if (!writeInitSegment()) {
+        return false;
+    }
+    mStarted = true;
+    return true;
+}
+
+bool Fmp4Muxer::writeInitSegment() {
+    std::vector<uint8_t> init;
+    BoxWriter w(&init);
+
+    w.begin("ftyp");
+    w.type("iso6");
+    w.u32(0);
+    w.type("iso6");
+    w.type("isom");
+    w.type("mp41");
+    w.type("dash");
+    if (mTracks.size() == 1) {
+        w.type("cmfc");  // CMAF allows one track per file
+    }
+    w.end();
+
+    w.begin("moov");
+    w.beginFull("mvhd", 0, 0);
+    w.zeros(8);                     // creation and modification time
+    w.u32(1000);
+    w.u32(0);                       // duration is in the fragments
+    w.u32(0x00010000);              // rate 1.0
+    w.u16(0x0100);                  // volume 1.0
+    w.zeros(10);
+    for (uint32_t value : kMatrix) w.u32(value);
+    w.zeros(24);
+    w.u32(static_cast<uint32_t>(mTracks.size() + 1));
+    w.end();
+
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        const Track& track = mTracks[i];
+        uint32_t trackId = static_cast<uint32_t>(i + 1);
+        w.begin("trak");
+        w.beginFull("tkhd", 0, 3);  // enabled, in movie
+        w.zeros(8);
+        w.u32(trackId);
+        w.zeros(4);
+        w.u32(0);
+        w.zeros(12);                // reserved, layer, alternate group
+        w.u16(track.audio ? 0x0100 : 0);  // volume
+        w.zeros(2);
+        for (uint32_t value : kMatrix) w.u32(value);
+        w.u32(static_cast<uint32_t>(track.format.width) << 16);
+        w.u32(static_cast<uint32_t>(track.format.height) << 16);
+        w.end();
+
+        w.begin("mdia");
+        w.beginFull("mdhd", 0, 0);
+        w.zeros(8);
+        w.u32(track.timescale);
+        w.u32(0);
+        w.u16(0x55c4);              // 'und'
+        w.u16(0);
+        w.end();
+        w.beginFull("hdlr", 0, 0);
+        w.u32(0);
+        w.type(track.audio ? "soun" : "vide");
+        w.zeros(12);
+        const char* name = track.audio ? "SoundHandler" : "VideoHandler";
+        w.bytes(reinterpret_cast<const uint8_t*>(name), strlen(name) + 1);
+        w.end();
+
+        w.begin("minf");
+        if (track.audio) {
+            w.beginFull("smhd", 0, 0);
+            w.zeros(4);             // balance, reserved
+        } else {
+            w.beginFull("vmhd", 0, 1);
+            w.zeros(8);
+        }
+        w.end();
+        w.begin("dinf");
+        w.beginFull("dref", 0, 0);
+        w.u32(1);
+        w.beginFull("url ", 0, 1);  // media is in this file
+        w.end();
+        w.end();
+        w.end();
+
+        w.begin("stbl");
+        w.beginFull("stsd", 0, 0);
+        w.u32(1);
+        if (track.audio) {
+            w.begin("mp4a");
+            w.zeros(6);
+            w.u16(1);               // data_reference_index
+            w.zeros(8);
+            w.u16(static_cast<uint32_t>(track.format.channelCount > 0 ? track.format.channelCount : 2));
+            w.u16(16);              // samplesize
+            w.zeros(4);
+            w.u32(track.timescale <= 0xffff ? track.timescale << 16 : 0);
+            w.beginFull("esds", 0, 0);
+            w.bytes(track.config.data(), track.config.size());
+            w.end();
+            w.end();
+        } else {
+            w.begin(track.hevc ? "hvc1" : "avc1");
+            w.zeros(6);
+            w.u16(1);               // data_reference_index
+            w.zeros(16);
+            w.u16(static_cast<uint32_t>(track.format.width));
+            w.u16(static_cast<uint32_t>(track.format.height));
+            w.u32(0x00480000);      // 72 dpi
+            w.u32(0x00480000);
+            w.u32(0);
+            w.u16(1);               // frame_count
+            w.zeros(32);            // compressorname
+            w.u16(0x0018);
+            w.u16(0xffff);
+            w.begin(track.hevc ? "hvcC" : "avcC");
+            w.bytes(track.config.data(), track.config.size());
+            w.end();
+            w.end();
+        }
+        w.end();                    // stsd
+        // Empty sample tables; the samples are in the fragments
+        for (const char* table : { "stts", "stsc", "stco" }) {
+            w.beginFull(table, 0, 0);
+            w.u32(0);
+            w.end();
+        }
+        w.beginFull("stsz", 0, 0);
+        w.u32(0);
+        w.u32(0);
+        w.end();
+        w.end();                    // stbl
+        w.end();                    // minf
+        w.end();                    // mdia
+        w.end();                    // trak
+    }
+
+    w.begin("mvex");
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        w.beginFull("trex", 0, 0);
+        w.u32(static_cast<uint32_t>(i + 1));
+        w.u32(1);                   // default_sample_description_index
+        w.zeros(12);
+        w.end();
+    }
+    w.end();
+    w.end();                        // moov
+
+    iovec iov = { init.data(), init.size() };
+    return writeAll(&iov, 1);
+}
+
+bool Fmp4Muxer::writeSampleData(size_t trackIndex, const uint8_t* data, const CodecBufferInfo& info) {
+    if (!mStarted || mFailed || trackIndex >= mTracks.size() || info.size <= 0) {
+        return false;
+    }
+    bool sync = (info.flags & CODEC_BUFFER_FLAG_KEY_FRAME) != 0;
+
+    // The first track decides where fragments start
+    if (trackIndex == 0) {
+        if (mFragmentStartUs < 0) {
+            mFragmentStartUs = info.presentationTimeUs;
+        } else if (info.presentationTimeUs - mFragmentStartUs >= mOptions.fragmentDurationUs &&
+                   (sync || !mOptions.keyframeAligned)) {
+            if (!flushFragment(info.presentationTimeUs)) {
+                return false;
+            }
+            mFragmentStartUs = info.presentationTimeUs;
+        }
+    }
+
+    Track& track = mTracks[trackIndex];
+    size_t size = static_cast<size_t>(info.size);
+    if (track.audio) {
+        track.payload.insert(track.payload.end(), data + info.offset, data + info.offset + size);
+    } else {
+        size = appendSample(data + info.offset, size, &track.payload);
+    }
+    if (size == 0) {
+        LOGE("Empty sample at %lld", static_cast<long long>(info.presentationTimeUs));
+        return false;
+    }
+    Sample sample = { info.presentationTimeUs, static_cast<uint32_t>(size), sync };
+    track.samples.push_back(sample);
+    return true;
+}
+
+bool Fmp4Muxer::flushFragment(int64_t nextPresentationTimeUs) {
+    // The first track's samples all go out; later tracks keep the ones
+    // presented from the next fragment's start on
+    std::vector<size_t> counts(mTracks.size(), 0);
+    std::vector<size_t> payloadSizes(mTracks.size(), 0);
+    size_t payloadSize = 0;
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        const Track& track = mTracks[i];
+        size_t& count = counts[i];
+        if (i == 0 || nextPresentationTimeUs < 0) {
+            count = track.samples.size();
+            payloadSizes[i] = track.payload.size();
+        } else {
+            while (count < track.samples.size() && track.samples[count].presentationTimeUs < nextPresentationTimeUs) {
+                payloadSizes[i] += track.samples[count++].size;
+            }
+        }
+        payloadSize += payloadSizes[i];
+    }
+    if (payloadSize == 0) {
+        return true;
+    }
+    if (payloadSize > UINT32_MAX - 8) {
+        LOGE("Fragment of %zu bytes is too large", payloadSize);
+        mFailed = true;
+        return false;
+    }
+
+    mHeader.clear();
+    BoxWriter w(&mHeader);
+    w.begin("moof");
+    w.beginFull("mfhd", 0, 0);
+    w.u32(++mSequenceNumber);
+    w.end();
+
+    std::vector<size_t> dataOffsetFields(mTracks.size(), 0);
+    std::vector<int64_t> decodeTicks;
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        Track& track = mTracks[i];
+        size_t count = counts[i];
+        if (count == 0) {
+            continue;
+        }
+
+        // Samples arrive in decode order with presentation times only. The
+        // sorted presentation times serve as decode times, so every fragment
+        // starting at a keyframe begins at its own presentation time and
+        // reordered frames get (possibly negative) composition offsets.
+        // Samples held back for the next fragment still time the last one.
+        size_t pending = track.samples.size();
+        decodeTicks.resize(pending);
+        for (size_t s = 0; s < pending; ++s) {
+            decodeTicks[s] = usToTicks(track.samples[s].presentationTimeUs, track.timescale);
+        }
+        std::sort(decodeTicks.begin(), decodeTicks.end());
+
+        w.begin("traf");
+        w.beginFull("tfhd", 0, 0x020000);  // default-base-is-moof
+        w.u32(static_cast<uint32_t>(i + 1));
+        w.end();
+        w.beginFull("tfdt", 1, 0);
+        w.u64(static_cast<uint64_t>(decodeTicks[0]));
+        w.end();
+        // data offset, duration, size, flags and composition offset per sample
+        w.beginFull("trun", 1, 0xf01);
+        w.u32(static_cast<uint32_t>(count));
+        dataOffsetFields[i] = w.size();
+        w.u32(0);
+        for (size_t s = 0; s < count; ++s) {
+            int64_t duration;
+            if (s + 1 < pending) {
+                duration = decodeTicks[s + 1] - decodeTicks[s];
+            } else if (i == 0 && nextPresentationTimeUs >= 0) {
+                duration = usToTicks(nextPresentationTimeUs, track.timescale) - decodeTicks[s];
+            } else if (track.lastDurationTicks > 0) {
+                duration = track.lastDurationTicks;
+            } else if (track.audio) {
+                duration = 1024;            // One AAC frame
+            } else {
+                duration = track.timescale / (track.format.frameRate > 0 ? track.format.frameRate : 30);
+            }
+            if (duration > 0) {
+                track.lastDurationTicks = duration;
+            }
+            const Sample& sample = track.samples[s];
+            w.u32(static_cast<uint32_t>(std::max<int64_t>(duration, 0)));
+            w.u32(sample.size);
+            w.u32(sample.sync ? kSyncSampleFlags : kNonSyncSampleFlags);
+            w.u32(static_cast<uint32_t>(usToTicks(sample.presentationTimeUs, track.timescale) - decodeTicks[s]));
+        }
+        w.end();
+        w.end();
+    }
+    w.end();
+
+    // Data offsets are relative to the start of moof
+    size_t dataOffset = mHeader.size() + 8;
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        if (counts[i] > 0) {
+            w.patchU32(dataOffsetFields[i], static_cast<uint32_t>(dataOffset));
+            dataOffset += payloadSizes[i];
+        }
+    }
+    w.u32(static_cast<uint32_t>(payloadSize + 8));
+    w.type("mdat");
+
+    // moof + mdat in one call; the payload buffers keep their capacity for
+    // the next fragment
+    std::vector<iovec> iov;
+    iov.push_back({ mHeader.data(), mHeader.size() });
+    int64_t samples = 0;
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        if (payloadSizes[i] > 0) {
+            iov.push_back({ mTracks[i].payload.data(), payloadSizes[i] });
+        }
+        samples += static_cast<int64_t>(counts[i]);
+    }
+    if (!writeAll(iov.data(), static_cast<int>(iov.size()))) {
+        mFailed = true;
+        return false;
+    }
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        Track& track = mTracks[i];
+        track.samples.erase(track.samples.begin(), track.samples.begin() + counts[i]);
+        track.payload.erase(track.payload.begin(), track.payload.begin() + payloadSizes[i]);
+    }
+    mStats.fragmentsWritten++;
+    mStats.samplesWritten += samples;
+    return true;
+}
+
+bool Fmp4Muxer::writeAll(iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(mFd, iov, std::min(count, IOV_MAX));
+        mStats.writeCalls++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("Failed to write fragment: %s", strerror(errno));
+            return false;
+        }
+        mStats.bytesWritten += written;
+        // Skip what was written, possibly part of a buffer
+        while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+bool Fmp4Muxer::stop() {
+    if (!mStarted) {
+        return false;
+    }
+    bool ok = flushFragment(-1) && !mFailed;
+    mStarted = false;
+    LOGI("Wrote %lld samples in %lld fragments, %lld bytes in %lld writes",
+         static_cast<long long>(mStats.samplesWritten), static_cast<long long>(mStats.fragmentsWritten),
+         static_cast<long long>(mStats.bytesWritten), static_cast<long long>(mStats.writeCalls));
+    return ok;
+}
+
+std::unique_ptr<Fmp4Muxer> openFmp4Muxer(const char* outputPath, const Fmp4MuxerOptions& options) {
+    int fd = open(outputPath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        LOGE("Failed to open output file %s: %s", outputPath, strerror(errno));
+        return nullptr;
+    }
+    return std::unique_ptr<Fmp4Muxer>(new Fmp4Muxer(fd, options));
+}
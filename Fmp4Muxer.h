@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <sys/uio.h>
+
+#include "CodecBackend.h"
+
+struct Fmp4MuxerOptions {
+    // A fragment is closed at the first keyframe of the first track once it
+    // spans this long, or exactly at this duration without keyframeAligned
+    int64_t fragmentDurationUs = 1000000;
+    bool keyframeAligned = true;
+};
+
+struct Fmp4MuxerStats {
+    int64_t fragmentsWritten = 0;
+    int64_t samplesWritten = 0;
+    int64_t bytesWritten = 0;
+    int64_t writeCalls = 0;
+};
+
+// Fragmented MP4 (CMAF style) muxer for AVC and HEVC video and AAC audio
+// tracks. start() writes the init segment (ftyp + moov with empty sample
+// tables); samples are then buffered and each fragment goes out as moof +
+// mdat in a single writev, so everything up to the last fragment is playable
+// while encoding continues and survives a crash. Video samples may arrive as
+// Annex-B (what MediaCodec produces) or already length-prefixed; codec
+// config comes from the csd buffers passed to addTrack. The first track must
+// be video: its keyframes close the fragments, and samples of later tracks
+// go into the fragment that covers their presentation time.
+class Fmp4Muxer : public SampleSink {
+public:
+    // Takes ownership of fd
+    Fmp4Muxer(int fd, const Fmp4MuxerOptions& options);
+    ~Fmp4Muxer() override;
+
+    Fmp4Muxer(const Fmp4Muxer&) = delete;
+    Fmp4Muxer& operator=(const Fmp4Muxer&) = delete;
+
+    ssize_t addTrack(const TrackFormat& format) override;
+    bool start() override;
+    bool writeSampleData(size_t trackIndex, const uint8_t* data, const CodecBufferInfo& info) override;
+
+    // Writes the last fragment
+    bool stop() override;
+
+    const Fmp4MuxerStats& stats() const { return mStats; }
+
+private:
+    struct Sample {
+        int64_t presentationTimeUs;
+        uint32_t size;
+        bool sync;
+    };
+
+    struct Track {
+        TrackFormat format;
+        bool hevc = false;
+        bool audio = false;
+        uint32_t timescale = 90000;   // The sample rate for audio
+        std::vector<uint8_t> config;  // avcC, hvcC or esds payload
+        std::vector<Sample> samples;  // Pending for the current fragment
+        std::vector<uint8_t> payload; // Their data, video length-prefixed
+        int64_t lastDurationTicks = 0;
+    };
+
+    bool writeInitSegment();
+    bool flushFragment(int64_t nextPresentationTimeUs);
+    bool writeAll(iovec* iov, int count);
+
+    int mFd;
+    Fmp4MuxerOptions mOptions;
+    std::vector<Track> mTracks;
+    bool mStarted = false;
+    bool mFailed = false;
+    uint32_t mSequenceNumber = 0;
+    int64_t mFragmentStartUs = -1;
+    std::vector<uint8_t> mHeader;  // moof + mdat header of the fragment being written
+    Fmp4MuxerStats mStats;
+};
+
+// Opens (and truncates) outputPath for an Fmp4Muxer
+std::unique_ptr<Fmp4Muxer> openFmp4Muxer(const char* outputPath, const Fmp4MuxerOptions& options);
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#include "FrameDumper.h"
+
+#define LOG_TAG "FrameDumper"
+#include "Log.h"
+
+namespace {
+
+FramePoolOptions framePoolOptions(const FrameDumpOptions& options) {
+    FramePoolOptions poolOptions;
+    poolOptions.maxBytes = static_cast<int64_t>(options.memoryBudgetBytes);
+    return poolOptions;
+}
+
+} // namespace
+
+FrameDumper::FrameDumper(const FrameDumpOptions& options) : mOptions(options), mPool(framePoolOptions(options)) {
+    std::sort(mOptions.timestampsUs.begin(), mOptions.timestampsUs.end());
+    if (mOptions.everyNth < 1) {
+        mOptions.everyNth = 1;
+    }
+}
+
+FrameDumper::~FrameDumper() {
+    close();
+}
+
+bool FrameDumper::open() {
+    if (mOpen) {
+        return true;
+    }
+    if (mOptions.packed) {
+        mContainer = fopen(mOptions.outputPath.c_str(), "wb");
+        std::string indexPath = mOptions.outputPath + ".idx";
+        mIndex = fopen(indexPath.c_str(), "w");
+        if (!mContainer || !mIndex) {
+            LOGE("Failed to open %s or its index", mOptions.outputPath.c_str());
+            if (mContainer) fclose(mContainer);
+            if (mIndex) fclose(mIndex);
+            mContainer = nullptr;
+            mIndex = nullptr;
+            return false;
+        }
+    }
+    mClosing = false;
+    mOpen = true;
+    mWriter = std::thread(&FrameDumper::writerLoop, this);
+    return true;
+}
+
+bool FrameDumper::selects(int64_t index, const FrameDumpInfo& info) const {
+    switch (mOptions.selection) {
+        case FRAME_DUMP_ALL:
+            return true;
+        case FRAME_DUMP_EVERY_NTH:
+            return index % mOptions.everyNth == 0;
+        case FRAME_DUMP_KEYFRAMES:
+            return info.keyframe;
+        case FRAME_DUMP_TIMESTAMPS: {
+            auto it = std::lower_bound(mOptions.timestampsUs.begin(), mOptions.timestampsUs.end(),
+                                       info.presentationTimeUs - mOptions.timestampToleranceUs);
+            return it != mOptions.timestampsUs.end() &&
+                   *it <= info.presentationTimeUs + mOptions.timestampToleranceUs;
+        }
+    }
+    return false;
+}
+
+bool FrameDumper::submit(const uint8_t* data, size_t size, const FrameDumpInfo& info) {
+    int64_t index = mNextIndex++;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.framesSeen++;
+        if (!mOpen || mClosing || !data || size == 0 || !selects(index, info)) {
+            return false;
+        }
+    }
+
+    // Over budget this waits for the writer to hand buffers back, unless frames are dropped instead
+    PendingFrame frame;
+    frame.data = mPool.acquire(size, mOptions.dropWhenFull ? 0 : -1);
+    if (!frame.data) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.framesDropped++;
+        return false;
+    }
+    // The copy is the only per-frame cost left on the caller's thread
+    memcpy(frame.data->data(), data, size);
+    frame.index = index;
+    frame.info = info;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQueue.push_back(std::move(frame));
+    mStats.framesQueued++;
+    mQueueCondition.notify_one();
+    return true;
+}
+
+bool FrameDumper::writeFrame(const PendingFrame& frame) {
+    size_t size = frame.data->size();
+    if (mOptions.packed) {
+        if (fwrite(frame.data->data(), 1, size, mContainer) != size) {
+            return false;
+        }
+        fprintf(mIndex, "%" PRId64 " %" PRId64 " %d %d %d %" PRId64 " %zu\n", frame.index,
+                frame.info.presentationTimeUs, frame.info.width, frame.info.height, frame.info.format,
+                mContainerOffset, size);
+        mContainerOffset += size;
+        return true;
+    }
+
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/frame_%" PRId64 ".raw", mOptions.outputPath.c_str(), frame.index);
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(frame.data->data(), 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+void FrameDumper::writerLoop() {
+    std::deque<PendingFrame> batch;
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        mQueueCondition.wait(lock, [this] { return !mQueue.empty() || mClosing; });
+        if (mQueue.empty()) {
+            break;
+        }
+        batch.swap(mQueue);
+        lock.unlock();
+
+        int64_t written = 0;
+        int64_t bytes = 0;
+        for (const PendingFrame& frame : batch) {
+            if (!mWriteFailed && writeFrame(frame)) {
+                written++;
+                bytes += frame.data->size();
+            } else if (!mWriteFailed) {
+                // Log once; later frames are counted as dropped
+                LOGE("Failed to write frame %" PRId64 " under %s", frame.index, mOptions.outputPath.c_str());
+                mWriteFailed = true;
+            }
+        }
+        if (mOptions.packed && (fflush(mContainer) != 0 || fflush(mIndex) != 0) && !mWriteFailed) {
+            LOGE("Failed to flush %s", mOptions.outputPath.c_str());
+            mWriteFailed = true;
+        }
+
+        // Hands the buffers back to the pool, waking submit() if it waits for one
+        int64_t batchSize = static_cast<int64_t>(batch.size());
+        batch.clear();
+
+        lock.lock();
+        mStats.framesWritten += written;
+        mStats.framesDropped += batchSize - written;
+        mStats.bytesWritten += bytes;
+    }
+}
+
+void FrameDumper::close() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mOpen) {
+            return;
+        }
+        mClosing = true;
+    }
+    mQueueCondition.notify_one();
+    mWriter.join();
+
+    if (mContainer) {
+        fclose(mContainer);
+        mContainer = nullptr;
+    }
+    if (mIndex) {
+        fclose(mIndex);
+        mIndex = nullptr;
+    }
+
+    mPool.trim();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mOpen = false;
+    mStats.stallUs = mPool.stats().waitUs;
+    LOGI("Dumped %" PRId64 " of %" PRId64 " frames (%" PRId64 " bytes, %" PRId64 " dropped, %" PRId64
+         " us stalled) to %s", mStats.framesWritten, mStats.framesSeen, mStats.bytesWritten, mStats.framesDropped,
+         mStats.stallUs, mOptions.outputPath.c_str());
+}
+
+FrameDumpStats FrameDumper::stats() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    FrameDumpStats stats = mStats;
+    stats.stallUs = mPool.stats().waitUs;
+    return stats;
+}
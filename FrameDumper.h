@@ -0,0 +1,112 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FramePool.h"
+#include "YuvFrame.h"
+
+enum FrameDumpSelection {
+    FRAME_DUMP_ALL = 0,
+    FRAME_DUMP_EVERY_NTH,    // Frames 0, n, 2n, ...
+    FRAME_DUMP_KEYFRAMES,    // Frames decoded from sync samples
+    FRAME_DUMP_TIMESTAMPS,   // Frames whose timestamp is in timestampsUs
+};
+
+struct FrameDumpOptions {
+    // Directory for one file per frame (frame_<index>.raw), or the container
+    // file when packed is set
+    std::string outputPath = "/sdcard";
+    // One file holding every frame back to back, plus a text index at
+    // outputPath + ".idx" with one "index ptsUs width height format offset size"
+    // line per frame
+    bool packed = false;
+    FrameDumpSelection selection = FRAME_DUMP_ALL;
+    int32_t everyNth = 1;
+    std::vector<int64_t> timestampsUs;
+    int64_t timestampToleranceUs = 0;
+    // Frame copies waiting for the writer never take more than this. When it
+    // is used up submit() waits for the writer, or drops the frame if
+    // dropWhenFull is set.
+    size_t memoryBudgetBytes = 64 * 1024 * 1024;
+    bool dropWhenFull = false;
+};
+
+struct FrameDumpInfo {
+    int32_t width = 0;
+    int32_t height = 0;
+    FrameFormat format = FRAME_FORMAT_RGBA;
+    int64_t presentationTimeUs = 0;
+    bool keyframe = false;
+};
+
+struct FrameDumpStats {
+    int64_t framesSeen = 0;
+    int64_t framesQueued = 0;
+    int64_t framesWritten = 0;
+    int64_t framesDropped = 0;  // Over budget with dropWhenFull, or lost to a write error
+    int64_t bytesWritten = 0;
+    int64_t stallUs = 0;        // Time submit() spent waiting for the writer
+};
+
+// Writes decoded frames to storage on a background thread so the decode loop
+// only pays for a copy. Frames are copied into buffers recycled through a
+// frame pool capped at memoryBudgetBytes (see FramePool.h) and written
+// in batches: the writer takes everything queued at once and flushes once
+// per batch. submit() must be called for every decoded frame, in decode
+// order, from a single thread; frame indices count those calls.
+class FrameDumper {
+public:
+    explicit FrameDumper(const FrameDumpOptions& options);
+    ~FrameDumper();
+
+    FrameDumper(const FrameDumper&) = delete;
+    FrameDumper& operator=(const FrameDumper&) = delete;
+
+    // Opens the container (packed mode) and starts the writer
+    bool open();
+
+    // Counts the frame and, if the selection wants it, copies it for the
+    // writer. Returns true if the frame was queued.
+    bool submit(const uint8_t* data, size_t size, const FrameDumpInfo& info);
+
+    // Writes everything still queued, stops the writer and closes the files
+    void close();
+
+    FrameDumpStats stats();
+
+private:
+    struct PendingFrame {
+        int64_t index;
+        FrameDumpInfo info;
+        std::shared_ptr<FrameBuffer> data;
+    };
+
+    bool selects(int64_t index, const FrameDumpInfo& info) const;
+    bool writeFrame(const PendingFrame& frame);
+    void writerLoop();
+
+    FrameDumpOptions mOptions;
+    std::thread mWriter;
+    FILE* mContainer = nullptr;
+    FILE* mIndex = nullptr;
+    int64_t mContainerOffset = 0;
+    bool mWriteFailed = false;
+    int64_t mNextIndex = 0;
+
+    FramePool mPool;
+    std::mutex mMutex;
+    std::condition_variable mQueueCondition;  // Signals queued frames and close to the writer
+    std::deque<PendingFrame> mQueue;
+    bool mClosing = false;
+    bool mOpen = false;
+    FrameDumpStats mStats;
+};
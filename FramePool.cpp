@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <sys/mman.h>
+
+#include "FramePool.h"
+
+#define LOG_TAG "FramePool"
+#include "Log.h"
+
+namespace {
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const size_t kMinClassSize = 4096;
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+// posix_memalign wants a power of two that is a multiple of the pointer size
+FramePoolOptions sanitized(FramePoolOptions options) {
+    size_t alignment = sizeof(void*);
+    while (alignment < options.alignment) {
+        alignment <<= 1;
+    }
+    options.alignment = alignment;
+    return options;
+}
+
+void destroy(const std::vector<FrameBuffer*>& buffers) {
+    for (FrameBuffer* buffer : buffers) {
+        free(buffer->data());
+        delete buffer;
+    }
+}
+
+} // namespace
+
+FramePool::FramePool(const FramePoolOptions& options) : mOptions(sanitized(options)) {}
+
+FramePool::~FramePool() {
+    if (mStats.buffersInUse > 0) {
+        LOGE("Destroyed with %d buffers in use", mStats.buffersInUse);
+    }
+    trim();
+}
+
+size_t FramePool::classSize(size_t size) {
+    if (size <= kMinClassSize) {
+        return kMinClassSize;
+    }
+    // Four classes per power of two: (size - 1) in [2^msb, 2^(msb+1)) rounds up to a quarter of 2^msb
+    int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(size - 1));
+    size_t step = static_cast<size_t>(1) << (msb - 2);
+    return (size + step - 1) & ~(step - 1);
+}
+
+uint8_t* FramePool::allocate(size_t capacity) {
+    bool hugePages = mOptions.hugePages && capacity >= kHugePageSize;
+    void* data = nullptr;
+    if (posix_memalign(&data, hugePages ? std::max(mOptions.alignment, kHugePageSize) : mOptions.alignment,
+                       capacity) != 0) {
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugePages) {
+        // Advisory only; kernels without transparent huge pages ignore it
+        madvise(data, capacity, MADV_HUGEPAGE);
+    }
+#endif
+    return static_cast<uint8_t*>(data);
+}
+
+bool FramePool::evictLocked(int64_t bytes, std::vector<FrameBuffer*>* retired) {
+    if (mStats.bytesInUse > 0 && mStats.bytesInUse + bytes > mOptions.maxBytes) {
+        return false;
+    }
+    for (auto it = mCached.rbegin(); it != mCached.rend(); ++it) {
+        while (!it->second.empty() && mStats.bytesInUse + mStats.bytesCached + bytes > mOptions.maxBytes) {
+            retired->push_back(it->second.back());
+            it->second.pop_back();
+            mStats.bytesCached -= it->first;
+            mStats.evictions++;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<FrameBuffer> FramePool::acquire(size_t size, int64_t timeoutUs, const std::atomic<bool>* aborted) {
+    size_t capacity = classSize(size);
+    FrameBuffer* buffer = nullptr;
+    bool allocating = false;
+    std::vector<FrameBuffer*> retired;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        int64_t waitStartUs = 0;
+        for (;;) {
+            auto it = mCached.find(capacity);
+            if (it != mCached.end() && !it->second.empty()) {
+                buffer = it->second.back();
+                it->second.pop_back();
+                mStats.bytesCached -= capacity;
+                mStats.hits++;
+                break;
+            }
+            if (evictLocked(capacity, &retired)) {
+                // The bytes are counted as in use while the buffer is allocated outside the lock
+                mStats.misses++;
+                allocating = true;
+                break;
+            }
+            int64_t waitedUs = waitStartUs ? nowUs() - waitStartUs : 0;
+            if ((aborted && *aborted) || timeoutUs == 0 || (timeoutUs > 0 && waitedUs >= timeoutUs)) {
+                break;
+            }
+            if (!waitStartUs) {
+                waitStartUs = nowUs();
+                mStats.waits++;
+            }
+            if (timeoutUs < 0) {
+                mCondition.wait(lock);
+            } else {
+                mCondition.wait_for(lock, std::chrono::microseconds(timeoutUs - waitedUs));
+            }
+        }
+        if (waitStartUs) {
+            mStats.waitUs += nowUs() - waitStartUs;
+        }
+        if (!buffer && !allocating) {
+            mStats.failures++;
+        } else {
+            mStats.bytesInUse += capacity;
+            mStats.buffersInUse++;
+            mStats.peakBytesInUse = std::max(mStats.peakBytesInUse, mStats.bytesInUse);
+            mStats.peakBytes = std::max(mStats.peakBytes, mStats.bytesInUse + mStats.bytesCached);
+        }
+    }
+    destroy(retired);
+
+    if (allocating) {
+        uint8_t* data = allocate(capacity);
+        if (!data) {
+            LOGE("Failed to allocate a %zu byte frame buffer", capacity);
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.bytesInUse -= capacity;
+            mStats.buffersInUse--;
+            mStats.failures++;
+            mCondition.notify_all();
+            return nullptr;
+        }
+        buffer = new FrameBuffer(data, capacity);
+    }
+    if (!buffer) {
+        return nullptr;
+    }
+    buffer->mSize = size;
+    return std::shared_ptr<FrameBuffer>(buffer, [this](FrameBuffer* released) { recycle(released); });
+}
+
+void FramePool::recycle(FrameBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCached[buffer->mCapacity].push_back(buffer);
+    mStats.bytesInUse -= buffer->mCapacity;
+    mStats.bytesCached += buffer->mCapacity;
+    mStats.buffersInUse--;
+    mCondition.notify_all();
+}
+
+void FramePool::wake() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCondition.notify_all();
+}
+
+void FramePool::trim() {
+    std::vector<FrameBuffer*> retired;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto& entry : mCached) {
+            retired.insert(retired.end(), entry.second.begin(), entry.second.end());
+            mStats.evictions += entry.second.size();
+        }
+        mCached.clear();
+        mStats.bytesCached = 0;
+    }
+    destroy(retired);
+}
+
+FramePoolStats FramePool::stats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
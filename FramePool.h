@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct FramePoolOptions {
+    // Buffers handed out plus buffers cached never take more than this; a
+    // single buffer larger than it is still handed out while nothing else
+    // is in use
+    int64_t maxBytes = 256 * 1024 * 1024;
+    size_t alignment = 64;   // Power of two; the cache line by default, 4096 for page aligned buffers
+    bool hugePages = false;  // Buffers of 2 MiB and up are 2 MiB aligned and advised for transparent huge pages
+};
+
+struct FramePoolStats {
+    int64_t hits = 0;       // Cached buffer of the size class handed out
+    int64_t misses = 0;     // Buffer allocated
+    int64_t evictions = 0;  // Cached buffers freed to make room for another size class, or by trim
+    int64_t waits = 0;      // acquire calls that found the cap reached
+    int64_t failures = 0;   // acquire calls that returned null
+    int64_t waitUs = 0;     // Time acquire spent waiting for buffers to come back
+    int64_t bytesInUse = 0;
+    int64_t bytesCached = 0;
+    int64_t peakBytesInUse = 0;
+    int64_t peakBytes = 0;  // Highest bytesInUse + bytesCached
+    int32_t buffersInUse = 0;
+};
+
+// One buffer from a FramePool. data() is aligned as the pool was told, and
+// capacity() is the size class, at least size().
+class FrameBuffer {
+public:
+    uint8_t* data() const { return mData; }
+    size_t size() const { return mSize; }
+    size_t capacity() const { return mCapacity; }
+
+private:
+    friend class FramePool;
+
+    FrameBuffer(uint8_t* data, size_t capacity) : mData(data), mCapacity(capacity) {}
+
+    uint8_t* const mData;
+    const size_t mCapacity;
+    size_t mSize = 0;
+};
+
+// Recycles the CPU-side frame buffers of a transcode, so a 4K stream does
+// not pay for a fresh 12 MB allocation, and its page faults, on every frame.
+// Sizes are rounded up to size classes four to a power of two (at most 25%
+// over), and a released buffer is cached for the next request of its class.
+// Buffers are reference counted: every holder of a copy of the shared_ptr
+// keeps it alive, and the last one returns it to the pool, so one frame can
+// be handed to several consumers. The memory cap is hard: when it is
+// reached, cached buffers of other classes are freed first, and then
+// acquire waits for a buffer to come back, which holds up the producer
+// (usually the decode stage) until its consumers catch up. Thread safe; the
+// pool must outlive its buffers.
+class FramePool {
+public:
+    explicit FramePool(const FramePoolOptions& options = FramePoolOptions());
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // Returns a buffer of at least size bytes, waiting at most timeoutUs
+    // (negative waits forever, zero not at all) for room under the cap.
+    // Returns null on timeout, on allocation failure, or once *aborted is
+    // set; call wake() after setting it to end the wait.
+    std::shared_ptr<FrameBuffer> acquire(size_t size, int64_t timeoutUs = -1,
+                                         const std::atomic<bool>* aborted = nullptr);
+
+    // Wakes every acquire call to check its aborted flag
+    void wake();
+
+    // Frees every cached buffer (on memory pressure); buffers in use are not affected
+    void trim();
+
+    FramePoolStats stats() const;
+
+    // The size class size is rounded up to
+    static size_t classSize(size_t size);
+
+private:
+    void recycle(FrameBuffer* buffer);
+    uint8_t* allocate(size_t capacity);
+
+    // Called with mMutex held; moves cached buffers to retired, largest
+    // first, until bytes more fit under the cap
+    bool evictLocked(int64_t bytes, std::vector<FrameBuffer*>* retired);
+
+    const FramePoolOptions mOptions;
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;  // Signals recycled buffers and wake() to acquire
+    std::map<size_t, std::vector<FrameBuffer*>> mCached;  // By size class
+    FramePoolStats mStats;
+};
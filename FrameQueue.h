@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/types.h>
+
+// One codec buffer handed from one pipeline thread to another
+struct FrameDescriptor {
+    ssize_t bufferIndex;  // Codec buffer index, or a CODEC_INFO_* / AMEDIACODEC_INFO_* status
+    int32_t offset;
+    int32_t size;
+    int64_t presentationTimeUs;
+    uint32_t flags;
+};
+
+const size_t kCacheLineSize = 64;
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// Fixed-capacity single-producer / single-consumer ring of frame descriptors.
+// Push and pop are lock free; a blocked side spins briefly, then yields, then
+// parks on a condition variable that the other side only touches when a
+// waiter is actually parked. A full queue blocks the producer, which is how
+// back-pressure reaches the stage feeding it.
+class SpscFrameQueue {
+public:
+    explicit SpscFrameQueue(size_t capacity) {
+        mCapacity = 1;
+        while (mCapacity < capacity) {
+            mCapacity <<= 1;
+        }
+        mMask = mCapacity - 1;
+        mSlots.reset(new FrameDescriptor[mCapacity]);
+    }
+
+    SpscFrameQueue(const SpscFrameQueue&) = delete;
+    SpscFrameQueue& operator=(const SpscFrameQueue&) = delete;
+
+    size_t capacity() const { return mCapacity; }
+
+    size_t size() const {
+        return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+    }
+
+    // Producer side
+    bool tryPush(const FrameDescriptor& frame) {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mCachedHead >= mCapacity) {
+            mCachedHead = mHead.load(std::memory_order_acquire);
+            if (tail - mCachedHead >= mCapacity) {
+                return false;
+            }
+        }
+        mSlots[tail & mMask] = frame;
+        mTail.store(tail + 1, std::memory_order_release);
+        wakeParked();
+        return true;
+    }
+
+    // Waits while the queue is full. Returns false on timeout or close.
+    bool push(const FrameDescriptor& frame, int64_t timeoutUs = -1) {
+        while (!tryPush(frame)) {
+            if (!waitUntil([this] { return mTail.load(std::memory_order_relaxed) - mHead.load(std::memory_order_acquire) < mCapacity; },
+                           timeoutUs)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Consumer side
+    bool tryPop(FrameDescriptor* frame) {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mCachedTail) {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head == mCachedTail) {
+                return false;
+            }
+        }
+        *frame = mSlots[head & mMask];
+        mHead.store(head + 1, std::memory_order_release);
+        wakeParked();
+        return true;
+    }
+
+    // Waits while the queue is empty. Returns false on timeout, or once the
+    // queue is closed and drained.
+    bool pop(FrameDescriptor* frame, int64_t timeoutUs = -1) {
+        while (!tryPop(frame)) {
+            if (!waitUntil([this] { return mHead.load(std::memory_order_relaxed) != mTail.load(std::memory_order_acquire); },
+                           timeoutUs)) {
+                return tryPop(frame);
+            }
+        }
+        return true;
+    }
+
+    // Wakes both sides; pending frames can still be popped
+    void close() {
+        std::lock_guard<std::mutex> lock(mParkMutex);
+        mClosed.store(true, std::memory_order_release);
+        mParkCondition.notify_all();
+    }
+
+    bool closed() const { return mClosed.load(std::memory_order_acquire); }
+
+private:
+    static const int kSpinCount = 256;
+    static const int kYieldCount = 16;
+
+    // Spinning only helps when the other side runs on another core
+    static int spinCount() {
+        static const int count = std::thread::hardware_concurrency() > 1 ? kSpinCount : 0;
+        return count;
+    }
+
+    template <typename Predicate>
+    bool waitUntil(Predicate ready, int64_t timeoutUs) {
+        for (int i = 0; i < spinCount(); ++i) {
+            if (ready()) return true;
+            if (closed()) return false;
+            cpuRelax();
+        }
+        if (timeoutUs == 0) {
+            return ready();
+        }
+        for (int i = 0; i < kYieldCount; ++i) {
+            if (ready()) return true;
+            if (closed()) return false;
+            std::this_thread::yield();
+        }
+
+        std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs < 0 ? 0 : timeoutUs);
+        std::unique_lock<std::mutex> lock(mParkMutex);
+        mParked.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool result = true;
+        while (!ready()) {
+            if (closed()) {
+                result = false;
+                break;
+            }
+            if (timeoutUs < 0) {
+                mParkCondition.wait(lock);
+            } else if (mParkCondition.wait_until(lock, deadline) == std::cv_status::timeout) {
+                result = ready();
+                break;
+            }
+        }
+        mParked.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    void wakeParked() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mParked.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(mParkMutex);
+            mParkCondition.notify_all();
+        }
+    }
+
+    // Consumer-owned line
+    alignas(kCacheLineSize) std::atomic<size_t> mHead{0};
+    size_t mCachedTail = 0;
+
+    // Producer-owned line
+    alignas(kCacheLineSize) std::atomic<size_t> mTail{0};
+    size_t mCachedHead = 0;
+
+    // Shared, read-mostly line
+    alignas(kCacheLineSize) size_t mCapacity;
+    size_t mMask;
+    std::unique_ptr<FrameDescriptor[]> mSlots;
+    std::atomic<bool> mClosed{false};
+    std::atomic<int> mParked{0};
+    std::mutex mParkMutex;
+    std::condition_variable mParkCondition;
+};
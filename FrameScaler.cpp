@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "FrameScaler.h"
+#include "WorkerPool.h"
+
+namespace {
+
+// Filter weights are Q14 fixed point, so a tap times a pixel fits in 16 bits
+// signed and a whole output pixel in a 32-bit accumulator
+const int32_t kWeightBits = 14;
+const int32_t kWeightOne = 1 << kWeightBits;
+const int32_t kRound = 1 << (kWeightBits - 1);
+
+// Output rows per pool task
+const int32_t kRowsPerBand = 16;
+
+inline uint8_t clampPixel(int32_t value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+double filterSupport(ScaleFilter filter) {
+    switch (filter) {
+        case SCALE_FILTER_BOX:
+            return 0.5;
+        case SCALE_FILTER_LANCZOS:
+            return 3.0;
+        default:
+            return 1.0;
+    }
+}
+
+double sinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+double filterWeight(ScaleFilter filter, double x) {
+    switch (filter) {
+        case SCALE_FILTER_BOX:
+            return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+        case SCALE_FILTER_LANCZOS:
+            return x > -3.0 && x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+        default:
+            return std::max(0.0, 1.0 - std::fabs(x));
+    }
+}
+
+// Weights of one axis: output i reads source samples
+// [starts[i], starts[i] + taps), clamped to the edge, with
+// weights[i * taps ...] summing to kWeightOne
+struct FilterBank {
+    int32_t taps = 0;
+    std::vector<int32_t> starts;
+    std::vector<int16_t> weights;
+};
+
+FilterBank buildFilterBank(ScaleFilter filter, int32_t srcSize, int32_t dstSize) {
+    double scale = static_cast<double>(srcSize) / dstSize;
+    double stretch = std::max(1.0, scale);
+    double support = filterSupport(filter) * stretch;
+
+    FilterBank bank;
+    bank.taps = std::min(static_cast<int32_t>(ceil(2 * support)) + 2, srcSize);
+    bank.starts.resize(dstSize);
+    bank.weights.assign(static_cast<size_t>(dstSize) * bank.taps, 0);
+    std::vector<double> window(bank.taps);
+    for (int32_t i = 0; i < dstSize; ++i) {
+        double center = (i + 0.5) * scale;
+        int32_t first = static_cast<int32_t>(floor(center - support));
+        int32_t last = static_cast<int32_t>(ceil(center + support));
+        int32_t start = std::max(0, std::min(first, srcSize - bank.taps));
+        std::fill(window.begin(), window.end(), 0.0);
+        double total = 0;
+        for (int32_t p = first; p <= last; ++p) {
+            double weight = filterWeight(filter, (p + 0.5 - center) / stretch);
+            if (weight == 0.0) {
+                continue;
+            }
+            int32_t clamped = std::max(0, std::min(p, srcSize - 1));
+            window[clamped - start] += weight;
+            total += weight;
+        }
+        if (total == 0.0) {
+            // Box filter enlarging onto a pixel edge
+            window[std::max(0, std::min(static_cast<int32_t>(center), srcSize - 1)) - start] = total = 1.0;
+        }
+
+        // Round to Q14 and put the rounding error on the largest tap
+        int16_t* weights = &bank.weights[static_cast<size_t>(i) * bank.taps];
+        int32_t sum = 0;
+        int32_t largest = 0;
+        for (int32_t k = 0; k < bank.taps; ++k) {
+            weights[k] = static_cast<int16_t>(lround(window[k] / total * kWeightOne));
+            sum += weights[k];
+            if (abs(weights[k]) > abs(weights[largest])) {
+                largest = k;
+            }
+        }
+        weights[largest] = static_cast<int16_t>(weights[largest] + kWeightOne - sum);
+        bank.starts[i] = start;
+    }
+    return bank;
+}
+
+// Row kernels. verticalRow blends taps source rows into one row of count
+// bytes; horizontalRow filters one row, channels bytes per pixel. The
+// vector versions finish the tail with the scalar ones.
+
+void verticalRowScalar(const uint8_t* const* rows, const int16_t* weights, int32_t taps, uint8_t* out,
+                       int32_t begin, int32_t count) {
+    for (int32_t x = begin; x < count; ++x) {
+        int32_t sum = kRound;
+        for (int32_t k = 0; k < taps; ++k) {
+            sum += weights[k] * rows[k][x];
+        }
+        out[x] = clampPixel(sum >> kWeightBits);
+    }
+}
+
+void horizontalRow(const FilterBank& bank, const uint8_t* in, uint8_t* out, int32_t width, int32_t channels) {
+    const int32_t taps = bank.taps;
+    for (int32_t x = 0; x < width; ++x) {
+        const int16_t* weights = &bank.weights[static_cast<size_t>(x) * taps];
+        const uint8_t* source = in + static_cast<size_t>(bank.starts[x]) * channels;
+        for (int32_t c = 0; c < channels; ++c) {
+            int32_t sum = kRound;
+            for (int32_t k = 0; k < taps; ++k) {
+                sum += weights[k] * source[k * channels + c];
+            }
+            out[x * channels + c] = clampPixel(sum >> kWeightBits);
+        }
+    }
+}
+
+#if defined(__SSE2__)
+
+const char kSimdName[] = "sse2";
+
+// Eight pixels at a time; taps go in pairs through pmaddwd
+void verticalRowSimd(const uint8_t* const* rows, const int16_t* weights, int32_t taps, uint8_t* out,
+                     int32_t begin, int32_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(kRound);
+    int32_t x = begin;
+    for (; x + 8 <= count; x += 8) {
+        __m128i low = round;
+        __m128i high = round;
+        for (int32_t k = 0; k < taps; k += 2) {
+            bool pair = k + 1 < taps;
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k] + x)), zero);
+            __m128i b = pair ? _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k + 1] + x)),
+                                                 zero)
+                             : zero;
+            int32_t packed = static_cast<uint16_t>(weights[k]) |
+                             (pair ? static_cast<int32_t>(static_cast<uint16_t>(weights[k + 1])) << 16 : 0);
+            __m128i w = _mm_set1_epi32(packed);
+            low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        __m128i words = _mm_packs_epi32(_mm_srai_epi32(low, kWeightBits), _mm_srai_epi32(high, kWeightBits));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(words, words));
+    }
+    verticalRowScalar(rows, weights, taps, out, x, count);
+}
+
+#elif defined(__ARM_NEON)
+
+const char kSimdName[] = "neon";
+
+void verticalRowSimd(const uint8_t* const* rows, const int16_t* weights, int32_t taps, uint8_t* out,
+                     int32_t begin, int32_t count) {
+    int32_t x = begin;
+    for (; x + 8 <= count; x += 8) {
+        int32x4_t low = vdupq_n_s32(0);
+        int32x4_t high = vdupq_n_s32(0);
+        for (int32_t k = 0; k < taps; ++k) {
+            int16x8_t pixels = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[k] + x)));
+            low = vmlal_n_s16(low, vget_low_s16(pixels), weights[k]);
+            high = vmlal_n_s16(high, vget_high_s16(pixels), weights[k]);
+        }
+        // Rounding narrow: (sum + kRound) >> kWeightBits, clamped to 0..255
+        uint16x8_t words = vcombine_u16(vqrshrun_n_s32(low, kWeightBits), vqrshrun_n_s32(high, kWeightBits));
+        vst1_u8(out + x, vqmovn_u16(words));
+    }
+    verticalRowScalar(rows, weights, taps, out, x, count);
+}
+
+#else
+
+const char kSimdName[] = "scalar";
+
+void verticalRowSimd(const uint8_t* const* rows, const int16_t* weights, int32_t taps, uint8_t* out,
+                     int32_t begin, int32_t count) {
+    verticalRowScalar(rows, weights, taps, out, begin, count);
+}
+
+#endif
+
+// One plane, channels bytes per pixel
+struct PlaneJob {
+    const uint8_t* src;
+    int32_t srcStride;
+    int32_t srcWidth;
+    int32_t srcHeight;
+    uint8_t* dst;
+    int32_t dstStride;
+    int32_t dstWidth;
+    int32_t dstHeight;
+    int32_t channels;
+};
+
+void scaleRows(const PlaneJob& plane, const FilterBank& columns, const FilterBank& rows, bool allowSimd,
+               int32_t firstRow, int32_t lastRow) {
+    const int32_t srcBytes = plane.srcWidth * plane.channels;
+    const int32_t dstBytes = plane.dstWidth * plane.channels;
+    bool sameHeight = plane.srcHeight == plane.dstHeight;
+    bool sameWidth = plane.srcWidth == plane.dstWidth;
+    std::vector<uint8_t> blended(sameHeight ? 0 : srcBytes);
+    std::vector<const uint8_t*> sources(rows.taps);
+    for (int32_t y = firstRow; y < lastRow; ++y) {
+        uint8_t* out = plane.dst + static_cast<size_t>(y) * plane.dstStride;
+        const uint8_t* row = plane.src + static_cast<size_t>(y) * plane.srcStride;
+        if (!sameHeight) {
+            const int16_t* weights = &rows.weights[static_cast<size_t>(y) * rows.taps];
+            for (int32_t k = 0; k < rows.taps; ++k) {
+                sources[k] = plane.src + static_cast<size_t>(rows.starts[y] + k) * plane.srcStride;
+            }
+            // Blend straight into the output when there is no horizontal pass
+            uint8_t* target = sameWidth ? out : blended.data();
+            if (allowSimd) {
+                verticalRowSimd(sources.data(), weights, rows.taps, target, 0, srcBytes);
+            } else {
+                verticalRowScalar(sources.data(), weights, rows.taps, target, 0, srcBytes);
+            }
+            if (sameWidth) {
+                continue;
+            }
+            row = blended.data();
+        }
+        if (sameWidth) {
+            memcpy(out, row, dstBytes);
+        } else {
+            horizontalRow(columns, row, out, plane.dstWidth, plane.channels);
+        }
+    }
+}
+
+void scalePlane(const PlaneJob& plane, ScaleFilter filter, WorkerPool* pool, bool allowSimd) {
+    FilterBank columns;
+    FilterBank rows;
+    if (plane.srcWidth != plane.dstWidth) {
+        columns = buildFilterBank(filter, plane.srcWidth, plane.dstWidth);
+    }
+    if (plane.srcHeight != plane.dstHeight) {
+        rows = buildFilterBank(filter, plane.srcHeight, plane.dstHeight);
+    }
+    if (!pool || plane.dstHeight <= kRowsPerBand) {
+        scaleRows(plane, columns, rows, allowSimd, 0, plane.dstHeight);
+        return;
+    }
+    pool->parallelFor(0, plane.dstHeight, kRowsPerBand, [&](int32_t first, int32_t last) {
+        scaleRows(plane, columns, rows, allowSimd, first, last);
+    });
+}
+
+} // namespace
+
+bool scaleFrame(const FrameView& src, const FrameView& dst, ScaleFilter filter, WorkerPool* pool, bool allowSimd) {
+    bool yuv = src.format == FRAME_FORMAT_I420 || src.format == FRAME_FORMAT_NV12 || src.format == FRAME_FORMAT_NV21;
+    if (!yuv || src.format != dst.format || src.width <= 0 || src.height <= 0 || dst.width <= 0 ||
+        dst.height <= 0) {
+        return false;
+    }
+    int32_t srcChromaWidth = (src.width + 1) / 2;
+    int32_t srcChromaHeight = (src.height + 1) / 2;
+    int32_t dstChromaWidth = (dst.width + 1) / 2;
+    int32_t dstChromaHeight = (dst.height + 1) / 2;
+
+    PlaneJob luma = { src.planes[0], src.strides[0], src.width, src.height,
+                      dst.planes[0], dst.strides[0], dst.width, dst.height, 1 };
+    scalePlane(luma, filter, pool, allowSimd);
+    int32_t chromaPlanes = src.format == FRAME_FORMAT_I420 ? 2 : 1;
+    for (int32_t plane = 1; plane <= chromaPlanes; ++plane) {
+        PlaneJob chroma = { src.planes[plane], src.strides[plane], srcChromaWidth, srcChromaHeight,
+                            dst.planes[plane], dst.strides[plane], dstChromaWidth, dstChromaHeight,
+                            3 - chromaPlanes };
+        scalePlane(chroma, filter, pool, allowSimd);
+    }
+    return true;
+}
+
+const char* scalerKernelName() {
+    return kSimdName;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "YuvFrame.h"
+
+class WorkerPool;
+
+// Resampling filters, cheapest first. Each is stretched by the scale factor
+// when shrinking, so downscaling averages every source pixel instead of
+// skipping rows and columns.
+enum ScaleFilter {
+    SCALE_FILTER_BOX = 0,       // Area average; nearest neighbour when enlarging
+    SCALE_FILTER_BILINEAR,      // Triangle filter
+    SCALE_FILTER_LANCZOS,       // Three-lobe Lanczos, sharpest
+};
+
+// Resizes src into dst, sampling pixel centres so both frames cover the
+// same picture. The views must be the same YUV format (I420, NV12 or NV21)
+// and may have any strides; interleaved chroma is filtered per channel.
+// Each plane is filtered vertically, then horizontally, one output row at a
+// time; with a pool the rows are split into bands across its threads.
+// allowSimd = false forces the scalar kernels, which give bit-identical
+// results. Returns false for other formats or empty frames.
+bool scaleFrame(const FrameView& src, const FrameView& dst, ScaleFilter filter = SCALE_FILTER_BILINEAR,
+                WorkerPool* pool = nullptr, bool allowSimd = true);
+
+// Vector kernels compiled into this build: "sse2", "neon" or "scalar"
+const char* scalerKernelName();
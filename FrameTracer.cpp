@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+
+#include "FrameTracer.h"
+
+#define LOG_TAG "FrameTracer"
+#include "Log.h"
+
+namespace {
+
+std::atomic<uint64_t> gNextTracerId{1};
+
+// The ring the calling thread last recorded into, and whose tracer it belongs to
+struct RingCache {
+    uint64_t tracerId = 0;
+    void* ring = nullptr;
+};
+thread_local RingCache tRingCache;
+
+void appendf(std::string* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string* out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) {
+        out->append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+    }
+}
+
+void appendEscaped(std::string* out, const std::string& text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            *out += '\\';
+        }
+        *out += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+    }
+}
+
+} // namespace
+
+FrameTracer::FrameTracer(size_t ringCapacity)
+    : mId(gNextTracerId++), mRingCapacity(std::max<size_t>(ringCapacity, 1)), mStartNs(nowNs()) {}
+
+FrameTracer::~FrameTracer() = default;
+
+int64_t FrameTracer::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameTracer::Ring* FrameTracer::ringForThisThread() {
+    if (tRingCache.tracerId == mId) {
+        return static_cast<Ring*>(tRingCache.ring);
+    }
+    std::thread::id self = std::this_thread::get_id();
+    Ring* ring = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (std::unique_ptr<Ring>& candidate : mRings) {
+            if (candidate->owner == self) {
+                ring = candidate.get();
+                break;
+            }
+        }
+        if (!ring) {
+            ring = new Ring();
+            ring->owner = self;
+            ring->trackId = static_cast<int32_t>(mRings.size()) + 1;
+            ring->events.resize(mRingCapacity);
+            mRings.emplace_back(ring);
+        }
+    }
+    tRingCache.tracerId = mId;
+    tRingCache.ring = ring;
+    return ring;
+}
+
+void FrameTracer::nameThread(const std::string& name) {
+    Ring* ring = ringForThisThread();
+    std::lock_guard<std::mutex> lock(mMutex);
+    ring->name = name;
+}
+
+void FrameTracer::record(TraceEventType type, int64_t beginNs, int64_t endNs, int64_t presentationTimeUs,
+                         int64_t bufferIndex) {
+    Ring* ring = ringForThisThread();
+    uint64_t index = ring->written.load(std::memory_order_relaxed);
+    ring->events[index % mRingCapacity] = { beginNs, endNs, presentationTimeUs, static_cast<int32_t>(bufferIndex),
+                                            type };
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+int64_t FrameTracer::recorded() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    int64_t total = 0;
+    for (const std::unique_ptr<Ring>& ring : mRings) {
+        total += ring->written.load(std::memory_order_acquire);
+    }
+    return total;
+}
+
+int64_t FrameTracer::dropped() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    int64_t total = 0;
+    for (const std::unique_ptr<Ring>& ring : mRings) {
+        uint64_t written = ring->written.load(std::memory_order_acquire);
+        total += written > mRingCapacity ? written - mRingCapacity : 0;
+    }
+    return total;
+}
+
+const char* FrameTracer::eventName(TraceEventType type) {
+    static const char* const kNames[TRACE_EVENT_TYPE_COUNT] = {
+        "feed", "decoded", "copy", "process", "encoded", "mux",
+    };
+    return kNames[type];
+}
+
+std::string FrameTracer::toChromeTraceJson() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"transcode\"}}";
+    uint64_t dropped = 0;
+    for (const std::unique_ptr<Ring>& ring : mRings) {
+        appendf(&json, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                ring->trackId);
+        if (ring->name.empty()) {
+            appendf(&json, "thread %d", ring->trackId);
+        } else {
+            appendEscaped(&json, ring->name);
+        }
+        json += "\"}}";
+
+        // Oldest first; the ring keeps the latest mRingCapacity spans
+        uint64_t written = ring->written.load(std::memory_order_acquire);
+        uint64_t first = written > mRingCapacity ? written - mRingCapacity : 0;
+        dropped += first;
+        for (uint64_t i = first; i < written; ++i) {
+            const Event& event = ring->events[i % mRingCapacity];
+            appendf(&json, ",{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,"
+                    "\"tid\":%d,\"args\":{\"pts\":%" PRId64 ",\"buffer\":%d}}",
+                    eventName(static_cast<TraceEventType>(event.type)), (event.beginNs - mStartNs) / 1000.0,
+                    (event.endNs - event.beginNs) / 1000.0, ring->trackId, event.presentationTimeUs,
+                    event.bufferIndex);
+        }
+    }
+    appendf(&json, "],\"otherData\":{\"dropped\":\"%" PRIu64 "\"}}", dropped);
+    return json;
+}
+
+bool FrameTracer::writeChromeTrace(const char* path) const {
+    std::string json = toChromeTraceJson();
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        LOGE("Cannot open %s for the trace", path);
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        LOGE("Failed to write the trace to %s", path);
+    }
+    return ok;
+}
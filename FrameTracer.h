@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-frame spans recorded by the pipeline stages (TranscodeOptions::tracer)
+enum TraceEventType {
+    TRACE_FEED,     // Extractor sample read and queued to the decoder
+    TRACE_DECODED,  // Decoder output handled, from dequeue to release
+    TRACE_COPY,     // Decoded frame copied, scaled and converted into an encoder input
+    TRACE_PROCESS,  // FrameProcessor
+    TRACE_ENCODED,  // Encoder output handled, from dequeue to release
+    TRACE_MUX,      // Encoded sample written
+    TRACE_EVENT_TYPE_COUNT,
+};
+
+// Records begin / end spans of the frames going through a transcode and
+// writes them out in the Chrome trace event format, which chrome://tracing
+// and the Perfetto UI open directly. Every thread records into a ring of
+// its own, so recording takes no lock: two clock reads and one slot
+// written. A thread keeps its latest ringCapacity spans; older ones are
+// overwritten and counted in dropped(). Export once the transcode is over.
+class FrameTracer {
+public:
+    explicit FrameTracer(size_t ringCapacity = 16384);
+    ~FrameTracer();
+
+    FrameTracer(const FrameTracer&) = delete;
+    FrameTracer& operator=(const FrameTracer&) = delete;
+
+    // Nanoseconds on the tracer's clock, for record
+    static int64_t nowNs();
+
+    // Names the calling thread's track in the trace
+    void nameThread(const std::string& name);
+
+    void record(TraceEventType type, int64_t beginNs, int64_t endNs, int64_t presentationTimeUs,
+                int64_t bufferIndex);
+
+    int64_t recorded() const;
+    int64_t dropped() const;
+
+    std::string toChromeTraceJson() const;
+    bool writeChromeTrace(const char* path) const;
+
+    static const char* eventName(TraceEventType type);
+
+private:
+    struct Event {
+        int64_t beginNs;
+        int64_t endNs;
+        int64_t presentationTimeUs;
+        int32_t bufferIndex;
+        int32_t type;
+    };
+
+    // Written by its thread only
+    struct Ring {
+        std::thread::id owner;
+        int32_t trackId;
+        std::string name;
+        std::vector<Event> events;
+        std::atomic<uint64_t> written{0};
+    };
+
+    Ring* ringForThisThread();
+
+    const uint64_t mId;  // Tells the thread-local ring cache apart from earlier tracers
+    const size_t mRingCapacity;
+    const int64_t mStartNs;
+    mutable std::mutex mMutex;  // Guards mRings and the ring names
+    std::vector<std::unique_ptr<Ring>> mRings;
+};
+
+// Times a scope into one span; does nothing without a tracer
+class TraceScope {
+public:
+    TraceScope(FrameTracer* tracer, TraceEventType type, int64_t presentationTimeUs, int64_t bufferIndex = -1)
+        : mTracer(tracer), mType(type), mPresentationTimeUs(presentationTimeUs), mBufferIndex(bufferIndex),
+          mBeginNs(tracer ? FrameTracer::nowNs() : 0) {}
+
+    ~TraceScope() {
+        if (mTracer) {
+            mTracer->record(mType, mBeginNs, FrameTracer::nowNs(), mPresentationTimeUs, mBufferIndex);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // The presentation time is often known only once the buffer is dequeued
+    void setFrame(int64_t presentationTimeUs, int64_t bufferIndex) {
+        mPresentationTimeUs = presentationTimeUs;
+        mBufferIndex = bufferIndex;
+    }
+
+private:
+    FrameTracer* mTracer;
+    TraceEventType mType;
+    int64_t mPresentationTimeUs;
+    int64_t mBufferIndex;
+    int64_t mBeginNs;
+};
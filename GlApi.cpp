@@ -0,0 +1,87 @@
+#include "GlApi.h"
+
+#ifdef __ANDROID__
+const GlApi& systemGlApi() {
+    static const GlApi kApi = {
+        glCreateShader, glShaderSource, glCompileShader, glGetShaderiv, glGetShaderInfoLog, glDeleteShader,
+        glCreateProgram, glAttachShader, glLinkProgram, glGetProgramiv, glDeleteProgram, glUseProgram,
+        glGetUniformLocation, glUniform1i,
+        glGenBuffers, glBindBuffer, glBufferData, glDeleteBuffers,
+        glGenVertexArrays, glBindVertexArray, glDeleteVertexArrays, glVertexAttribPointer, glEnableVertexAttribArray,
+        glGenTextures, glBindTexture, glDeleteTextures, glActiveTexture, glTexParameteri, glTexImage2D, glTexSubImage2D,
+        glViewport, glDrawArrays,
+    };
+    return kApi;
+}
+#endif
+
+namespace {
+
+GlCallCounts* gCounts = nullptr;
+GLuint gNextName = 1;
+
+GlCallCounts& count() {
+    static GlCallCounts discarded;
+    GlCallCounts& counts = gCounts ? *gCounts : discarded;
+    counts.calls++;
+    return counts;
+}
+
+GLuint createObject() {
+    count().objectsCreated++;
+    return gNextName++;
+}
+
+void genObjects(GLsizei n, GLuint* names) {
+    GlCallCounts& counts = count();
+    for (GLsizei i = 0; i < n; ++i) {
+        names[i] = gNextName++;
+    }
+    counts.objectsCreated += n;
+}
+
+const GlApi kCountingApi = {
+    [](GLenum) { return createObject(); },
+    [](GLuint, GLsizei, const GLchar* const*, const GLint*) { count(); },
+    [](GLuint) { count().shaderCompiles++; },
+    [](GLuint, GLenum, GLint* value) { count(); *value = GL_TRUE; },
+    [](GLuint, GLsizei size, GLsizei* length, GLchar* log) {
+        count();
+        if (length) *length = 0;
+        if (size > 0) log[0] = '\0';
+    },
+    [](GLuint) { count(); },
+    []() { return createObject(); },
+    [](GLuint, GLuint) { count(); },
+    [](GLuint) { count(); },
+    [](GLuint, GLenum, GLint* value) { count(); *value = GL_TRUE; },
+    [](GLuint) { count(); },
+    [](GLuint) { count(); },
+    [](GLuint, const GLchar*) -> GLint { count(); return 0; },
+    [](GLint, GLint) { count(); },
+    genObjects,
+    [](GLenum, GLuint) { count(); },
+    [](GLenum, GLsizeiptr, const void*, GLenum) { count(); },
+    [](GLsizei, const GLuint*) { count(); },
+    genObjects,
+    [](GLuint) { count(); },
+    [](GLsizei, const GLuint*) { count(); },
+    [](GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) { count(); },
+    [](GLuint) { count(); },
+    genObjects,
+    [](GLenum, GLuint) { count(); },
+    [](GLsizei, const GLuint*) { count(); },
+    [](GLenum) { count(); },
+    [](GLenum, GLenum, GLint) { count(); },
+    [](GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*) { count().textureAllocations++; },
+    [](GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*) { count().textureUploads++; },
+    [](GLint, GLint, GLsizei, GLsizei) { count(); },
+    [](GLenum, GLint, GLsizei) { count().draws++; },
+};
+
+} // namespace
+
+const GlApi& countingGlApi(GlCallCounts* counts) {
+    gCounts = counts;
+    return kCountingApi;
+}
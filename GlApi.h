@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef __ANDROID__
+#include <GLES3/gl3.h>
+#else
+// The subset of the GLES 3 header the renderer needs, so it can be built and
+// run against the counting table on hosts without GL
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef int GLint;
+typedef int GLsizei;
+typedef float GLfloat;
+typedef char GLchar;
+typedef unsigned char GLboolean;
+typedef unsigned int GLbitfield;
+typedef intptr_t GLsizeiptr;
+
+#define GL_FALSE 0
+#define GL_TRUE 1
+#define GL_TRIANGLE_STRIP 0x0005
+#define GL_TEXTURE_2D 0x0DE1
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_FLOAT 0x1406
+#define GL_RGBA 0x1908
+#define GL_LINEAR 0x2601
+#define GL_TEXTURE_MAG_FILTER 0x2800
+#define GL_TEXTURE_MIN_FILTER 0x2801
+#define GL_TEXTURE_WRAP_S 0x2802
+#define GL_TEXTURE_WRAP_T 0x2803
+#define GL_CLAMP_TO_EDGE 0x812F
+#define GL_TEXTURE0 0x84C0
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_STATIC_DRAW 0x88E4
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#endif
+
+// Table of the GL entry points GlRenderer calls. Going through the table
+// lets the same renderer run on a device (systemGlApi) or against a stub
+// that only counts calls (countingGlApi), which is how the per-frame GL call
+// budget is checked without a GPU.
+struct GlApi {
+    GLuint (*createShader)(GLenum type);
+    void (*shaderSource)(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths);
+    void (*compileShader)(GLuint shader);
+    void (*getShaderiv)(GLuint shader, GLenum name, GLint* value);
+    void (*getShaderInfoLog)(GLuint shader, GLsizei size, GLsizei* length, GLchar* log);
+    void (*deleteShader)(GLuint shader);
+    GLuint (*createProgram)();
+    void (*attachShader)(GLuint program, GLuint shader);
+    void (*linkProgram)(GLuint program);
+    void (*getProgramiv)(GLuint program, GLenum name, GLint* value);
+    void (*deleteProgram)(GLuint program);
+    void (*useProgram)(GLuint program);
+    GLint (*getUniformLocation)(GLuint program, const GLchar* name);
+    void (*uniform1i)(GLint location, GLint value);
+    void (*genBuffers)(GLsizei count, GLuint* buffers);
+    void (*bindBuffer)(GLenum target, GLuint buffer);
+    void (*bufferData)(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+    void (*deleteBuffers)(GLsizei count, const GLuint* buffers);
+    void (*genVertexArrays)(GLsizei count, GLuint* arrays);
+    void (*bindVertexArray)(GLuint array);
+    void (*deleteVertexArrays)(GLsizei count, const GLuint* arrays);
+    void (*vertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                const void* pointer);
+    void (*enableVertexAttribArray)(GLuint index);
+    void (*genTextures)(GLsizei count, GLuint* textures);
+    void (*bindTexture)(GLenum target, GLuint texture);
+    void (*deleteTextures)(GLsizei count, const GLuint* textures);
+    void (*activeTexture)(GLenum unit);
+    void (*texParameteri)(GLenum target, GLenum name, GLint value);
+    void (*texImage2D)(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                       GLint border, GLenum format, GLenum type, const void* pixels);
+    void (*texSubImage2D)(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+                          GLenum format, GLenum type, const void* pixels);
+    void (*viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+    void (*drawArrays)(GLenum mode, GLint first, GLsizei count);
+};
+
+#ifdef __ANDROID__
+// The real GLES 3 entry points
+const GlApi& systemGlApi();
+#endif
+
+// What the counting table has seen since the counts were last reset
+struct GlCallCounts {
+    int64_t calls = 0;
+    int64_t shaderCompiles = 0;
+    int64_t objectsCreated = 0;      // Shaders, programs, buffers, vertex arrays and textures
+    int64_t textureAllocations = 0;  // glTexImage2D
+    int64_t textureUploads = 0;      // glTexSubImage2D
+    int64_t draws = 0;
+};
+
+// GL table that renders nothing and records every call in counts. Object
+// names are handed out in sequence and every status query reports success.
+// Only one counting table is active at a time.
+const GlApi& countingGlApi(GlCallCounts* counts);
@@ -0,0 +1,171 @@
+#include "GlRenderer.h"
+
+#define LOG_TAG "VideoPlayer"
+#include "Log.h"
+
+namespace {
+
+const char* const kVertexShader =
+    "#version 300 es\n"
+    "layout(location = 0) in vec4 a_position;\n"
+    "layout(location = 1) in vec2 a_texCoord;\n"
+    "out vec2 v_texCoord;\n"
+    "void main() {\n"
+    "    gl_Position = a_position;\n"
+    "    v_texCoord = a_texCoord;\n"
+    "}\n";
+
+const char* const kFragmentShader =
+    "#version 300 es\n"
+    "precision mediump float;\n"
+    "in vec2 v_texCoord;\n"
+    "out vec4 fragColor;\n"
+    "uniform sampler2D u_texture;\n"
+    "void main() {\n"
+    "    fragColor = texture(u_texture, v_texCoord);\n"
+    "}\n";
+
+// Full-screen quad as a triangle strip: position (xyzw), then texture coordinate
+const GLfloat kQuad[] = {
+    -1.0f, -1.0f, 0.0f, 1.0f,  0.0f, 1.0f,
+     1.0f, -1.0f, 0.0f, 1.0f,  1.0f, 1.0f,
+    -1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+     1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 0.0f,
+};
+
+} // namespace
+
+GlRenderer::GlRenderer(const GlApi& gl, int32_t textureCount)
+    : mGl(gl), mTextureCount(textureCount > 0 ? textureCount : 1) {}
+
+GlRenderer::~GlRenderer() {
+    release();
+}
+
+GLuint GlRenderer::compileShader(GLenum type, const char* source) {
+    GLuint shader = mGl.createShader(type);
+    mGl.shaderSource(shader, 1, &source, nullptr);
+    mGl.compileShader(shader);
+    GLint compiled = GL_FALSE;
+    mGl.getShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        char log[512];
+        mGl.getShaderInfoLog(shader, sizeof(log), nullptr, log);
+        LOGE("Shader compile failed: %s", log);
+        mGl.deleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+bool GlRenderer::buildProgram() {
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, kVertexShader);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, kFragmentShader);
+    if (!vertexShader || !fragmentShader) {
+        if (vertexShader) mGl.deleteShader(vertexShader);
+        if (fragmentShader) mGl.deleteShader(fragmentShader);
+        return false;
+    }
+
+    mProgram = mGl.createProgram();
+    mGl.attachShader(mProgram, vertexShader);
+    mGl.attachShader(mProgram, fragmentShader);
+    mGl.linkProgram(mProgram);
+    // The program keeps the shaders alive for as long as it needs them
+    mGl.deleteShader(vertexShader);
+    mGl.deleteShader(fragmentShader);
+    GLint linked = GL_FALSE;
+    mGl.getProgramiv(mProgram, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        LOGE("Program link failed");
+        mGl.deleteProgram(mProgram);
+        mProgram = 0;
+        return false;
+    }
+    mGl.useProgram(mProgram);
+    mGl.uniform1i(mGl.getUniformLocation(mProgram, "u_texture"), 0);
+
+    // The vertex array captures the attribute layout, so a frame only binds it
+    mGl.genVertexArrays(1, &mVertexArray);
+    mGl.bindVertexArray(mVertexArray);
+    mGl.genBuffers(1, &mVertexBuffer);
+    mGl.bindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+    mGl.bufferData(GL_ARRAY_BUFFER, sizeof(kQuad), kQuad, GL_STATIC_DRAW);
+    mGl.vertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
+    mGl.enableVertexAttribArray(0);
+    mGl.vertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat),
+                            reinterpret_cast<const void*>(4 * sizeof(GLfloat)));
+    mGl.enableVertexAttribArray(1);
+    mGl.activeTexture(GL_TEXTURE0);
+    return true;
+}
+
+bool GlRenderer::setFrameSize(int32_t width, int32_t height) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    if (!mProgram && !buildProgram()) {
+        return false;
+    }
+    if (width == mWidth && height == mHeight && !mTextures.empty()) {
+        return true;
+    }
+
+    deleteTextures();
+    mTextures.resize(mTextureCount);
+    mGl.genTextures(mTextureCount, mTextures.data());
+    for (GLuint texture : mTextures) {
+        mGl.bindTexture(GL_TEXTURE_2D, texture);
+        mGl.texParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        mGl.texParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mGl.texParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        mGl.texParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        mGl.texImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    mWidth = width;
+    mHeight = height;
+    mNextTexture = 0;
+    LOGI("Renderer textures sized %dx%d", width, height);
+    return true;
+}
+
+bool GlRenderer::renderFrame(const uint8_t* rgba, int32_t width, int32_t height) {
+    if (!rgba || !setFrameSize(width, height)) {
+        return false;
+    }
+
+    // Six calls per frame once the renderer is set up
+    mGl.bindTexture(GL_TEXTURE_2D, mTextures[mNextTexture]);
+    mGl.texSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    mGl.useProgram(mProgram);
+    mGl.bindVertexArray(mVertexArray);
+    mGl.viewport(0, 0, width, height);
+    mGl.drawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    mNextTexture = (mNextTexture + 1) % mTextures.size();
+    return true;
+}
+
+void GlRenderer::deleteTextures() {
+    if (!mTextures.empty()) {
+        mGl.deleteTextures(static_cast<GLsizei>(mTextures.size()), mTextures.data());
+        mTextures.clear();
+    }
+    mWidth = 0;
+    mHeight = 0;
+}
+
+void GlRenderer::release() {
+    deleteTextures();
+    if (mVertexBuffer) {
+        mGl.deleteBuffers(1, &mVertexBuffer);
+        mVertexBuffer = 0;
+    }
+    if (mVertexArray) {
+        mGl.deleteVertexArrays(1, &mVertexArray);
+        mVertexArray = 0;
+    }
+    if (mProgram) {
+        mGl.deleteProgram(mProgram);
+        mProgram = 0;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "GlApi.h"
+
+// Draws RGBA frames as a full-screen textured quad. The program, vertex
+// array and vertex buffer are built on the first frame and kept; frames are
+// uploaded with glTexSubImage2D into a small ring of textures so an upload
+// never waits for the GPU to finish drawing the previous frame. Textures are
+// reallocated only when the frame size changes. All calls must come from the
+// thread whose GL context was current when the renderer was first used.
+class GlRenderer {
+public:
+    explicit GlRenderer(const GlApi& gl, int32_t textureCount = 3);
+    ~GlRenderer();
+
+    GlRenderer(const GlRenderer&) = delete;
+    GlRenderer& operator=(const GlRenderer&) = delete;
+
+    // (Re)allocates the texture ring; call on an output format change
+    bool setFrameSize(int32_t width, int32_t height);
+
+    // Uploads one tightly packed RGBA frame and draws it into a viewport of
+    // the frame's size. A frame of a new size reallocates the textures first.
+    bool renderFrame(const uint8_t* rgba, int32_t width, int32_t height);
+
+    // Deletes every GL object; needs the same context to be current
+    void release();
+
+    int32_t width() const { return mWidth; }
+    int32_t height() const { return mHeight; }
+
+private:
+    bool buildProgram();
+    GLuint compileShader(GLenum type, const char* source);
+    void deleteTextures();
+
+    const GlApi& mGl;
+    const int32_t mTextureCount;
+    GLuint mProgram = 0;
+    GLuint mVertexArray = 0;
+    GLuint mVertexBuffer = 0;
+    std::vector<GLuint> mTextures;
+    size_t mNextTexture = 0;
+    int32_t mWidth = 0;
+    int32_t mHeight = 0;
+};
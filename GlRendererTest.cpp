@@ -0,0 +1,96 @@
+// Checks GlRenderer's GL call budget against the counting GL table, so it
+// runs on hosts without a GPU: after the first frame a frame may not
+// compile, create or allocate anything and stays within kCallsPerFrame
+// calls, and a size change allocates the texture ring exactly once.
+// Returns nonzero on the first broken budget.
+#include <cstdint>
+#include <vector>
+
+#include "GlApi.h"
+#include "GlRenderer.h"
+#include "YuvFrame.h"
+
+#define LOG_TAG "GlRendererTest"
+#include "Log.h"
+
+namespace {
+
+const int64_t kCallsPerFrame = 6;
+const int32_t kTextureCount = 3;
+const int64_t kFrames = 1000;
+
+int gFailures = 0;
+
+void expect(bool condition, const char* what, int64_t actual) {
+    if (!condition) {
+        LOGE("%s (got %lld)", what, static_cast<long long>(actual));
+        gFailures++;
+    }
+}
+
+// Renders kFrames frames of the renderer's size and checks the steady state budget
+void expectSteadyFrames(GlRenderer* renderer, GlCallCounts* counts, const char* phase) {
+    std::vector<uint8_t> frame(frameBufferSize(FRAME_FORMAT_RGBA, renderer->width(), renderer->height()));
+    *counts = GlCallCounts();
+    for (int64_t i = 0; i < kFrames; ++i) {
+        if (!renderer->renderFrame(frame.data(), renderer->width(), renderer->height())) {
+            LOGE("%s: renderFrame failed", phase);
+            gFailures++;
+            return;
+        }
+    }
+    LOGI("%s: %.2f GL calls per frame", phase, static_cast<double>(counts->calls) / kFrames);
+    expect(counts->calls <= kCallsPerFrame * kFrames, "GL calls over the per-frame budget", counts->calls);
+    expect(counts->shaderCompiles == 0, "shaders compiled after the first frame", counts->shaderCompiles);
+    expect(counts->objectsCreated == 0, "GL objects created after the first frame", counts->objectsCreated);
+    expect(counts->textureAllocations == 0, "textures allocated without a size change", counts->textureAllocations);
+    expect(counts->textureUploads == kFrames, "texture uploads other than one per frame", counts->textureUploads);
+    expect(counts->draws == kFrames, "draws other than one per frame", counts->draws);
+}
+
+// A size change recreates the texture ring and nothing else
+void expectOneTextureSet(const GlCallCounts& counts, const char* phase) {
+    if (counts.textureAllocations != kTextureCount || counts.objectsCreated != kTextureCount ||
+        counts.shaderCompiles != 0) {
+        LOGE("%s: %lld texture allocations, %lld objects created, %lld shader compiles; expected one set of %d",
+             phase, static_cast<long long>(counts.textureAllocations), static_cast<long long>(counts.objectsCreated),
+             static_cast<long long>(counts.shaderCompiles), kTextureCount);
+        gFailures++;
+    }
+}
+
+} // namespace
+
+int main() {
+    GlCallCounts counts;
+    GlRenderer renderer(countingGlApi(&counts), kTextureCount);
+
+    // The first frame builds everything
+    std::vector<uint8_t> frame(frameBufferSize(FRAME_FORMAT_RGBA, 1280, 720));
+    expect(renderer.renderFrame(frame.data(), 1280, 720), "first frame failed", 0);
+    expect(counts.shaderCompiles == 2, "shaders compiled for the first frame", counts.shaderCompiles);
+    expect(counts.textureAllocations == kTextureCount, "textures allocated for the first frame",
+           counts.textureAllocations);
+    expectSteadyFrames(&renderer, &counts, "720p");
+
+    // An explicit size change allocates one texture set; repeating it allocates nothing
+    counts = GlCallCounts();
+    renderer.setFrameSize(1920, 1080);
+    renderer.setFrameSize(1920, 1080);
+    expectOneTextureSet(counts, "setFrameSize");
+    expectSteadyFrames(&renderer, &counts, "1080p");
+
+    // So does a frame of a new size
+    counts = GlCallCounts();
+    std::vector<uint8_t> small(frameBufferSize(FRAME_FORMAT_RGBA, 640, 360));
+    expect(renderer.renderFrame(small.data(), 640, 360), "resized frame failed", 0);
+    expectOneTextureSet(counts, "resized frame");
+    expectSteadyFrames(&renderer, &counts, "360p");
+
+    if (gFailures) {
+        LOGE("%d GL budget checks failed", gFailures);
+        return 1;
+    }
+    LOGI("GL budget checks passed");
+    return 0;
+}
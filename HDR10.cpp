@@ -2,116 +2,231 @@
 #include <android/native_activity.h>
 #include <android/log.h>
 #include <media/NdkMediaCodec.h>
+#include <media/NdkMediaExtractor.h>
 #include <media/NdkMediaFormat.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <cstring>
+#include <vector>
 
-// Function to extract HDR10+ metadata from HEVC video stream
-bool extractHDR10PlusMetadata(const char* videoPath, uint8_t* metadataBuffer, size_t bufferSize) {
-    // Open video file
-    int fd = open(videoPath, O_RDONLY);
-    if (fd < 0) {
+#include "HDR10.h"
+
+// Size of the NAL length prefix in an extractor sample, or 0 if it uses
+// Annex-B start codes (what MediaExtractor hands out for HEVC)
+static int32_t nalLengthSizeOf(const uint8_t* sample, size_t size) {
+    if ((size >= 3 && sample[0] == 0 && sample[1] == 0 && sample[2] == 1) ||
+        (size >= 4 && sample[0] == 0 && sample[1] == 0 && sample[2] == 0 && sample[3] == 1)) {
+        return 0;
+    }
+    return 4;
+}
+
+// Opens videoPath and selects its first HEVC track; format, if given,
+// receives the track format
+static bool openHevcTrack(AMediaExtractor* extractor, const char* videoPath, AMediaFormat** format) {
+    if (AMediaExtractor_setDataSource(extractor, videoPath) != AMEDIA_OK) {
         __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to open video file: %s", videoPath);
         return false;
     }
+    size_t trackCount = AMediaExtractor_getTrackCount(extractor);
+    for (size_t i = 0; i < trackCount; ++i) {
+        AMediaFormat* trackFormat = AMediaExtractor_getTrackFormat(extractor, i);
+        const char* mime = nullptr;
+        if (AMediaFormat_getString(trackFormat, AMEDIAFORMAT_KEY_MIME, &mime) && !strcmp(mime, "video/hevc")) {
+            AMediaExtractor_selectTrack(extractor, i);
+            if (format) {
+                *format = trackFormat;
+            } else {
+                AMediaFormat_delete(trackFormat);
+            }
+            return true;
+        }
+        AMediaFormat_delete(trackFormat);
+    }
+    __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "No HEVC track in %s", videoPath);
+    return false;
+}
 
-    // Seek to the position where HDR10+ metadata is located in the video stream
-    // Example: Use a HEVC parser to locate and extract the metadata
-    // For simplicity, assume metadata is directly read into metadataBuffer
-    ssize_t bytesRead = read(fd, metadataBuffer, bufferSize);
-
-    close(fd);
-    
-    if (bytesRead <= 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to read HDR10+ metadata from video file");
+// Reads the first HEVC track of videoPath one sample at a time, in decode
+// order, and calls onMetadata for every sample that carries HDR10+ metadata
+// until it returns false. Only the current sample is held in memory.
+template <typename Callback>
+static bool scanHDR10PlusMetadata(const char* videoPath, Callback onMetadata) {
+    AMediaExtractor* extractor = AMediaExtractor_new();
+    if (!openHevcTrack(extractor, videoPath, nullptr)) {
+        AMediaExtractor_delete(extractor);
         return false;
     }
 
+    std::vector<uint8_t> sample;
+    Hdr10PlusMetadata metadata;
+    for (;;) {
+        ssize_t sampleSize = AMediaExtractor_getSampleSize(extractor);
+        if (sampleSize < 0) {
+            break;
+        }
+        if (static_cast<size_t>(sampleSize) > sample.size()) {
+            sample.resize(sampleSize);
+        }
+        ssize_t read = AMediaExtractor_readSampleData(extractor, sample.data(), sample.size());
+        if (read > 0 &&
+            findHdr10PlusInAccessUnit(sample.data(), read, nalLengthSizeOf(sample.data(), read), &metadata) &&
+            !onMetadata(AMediaExtractor_getSampleTime(extractor), metadata)) {
+            break;
+        }
+        if (!AMediaExtractor_advance(extractor)) {
+            break;
+        }
+    }
+    AMediaExtractor_delete(extractor);
     return true;
 }
 
-void decodeHDR10PlusVideo(const char* videoPath) {
-    AMediaCodec* codec = nullptr;
-    AMediaFormat* format = nullptr;
-    int fd = -1;
-
-    // Open video file
-    fd = open(videoPath, O_RDONLY);
-    if (fd < 0) {
-        // Handle file open error
-        __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to open video file: %s", videoPath);
-        return;
-    }
+bool extractHDR10PlusMetadata(const char* videoPath, Hdr10PlusTimeline* timeline) {
+    return scanHDR10PlusMetadata(videoPath, [timeline](int64_t presentationTimeUs, Hdr10PlusMetadata& metadata) {
+        timeline->add(presentationTimeUs, std::move(metadata));
+        return true;
+    });
+}
 
-    // Initialize MediaCodec
-    codec = AMediaCodec_createDecoderByType("video/hevc"); // Use correct MIME type for HDR10+
-    if (!codec) {
-        __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to create MediaCodec");
-        close(fd);
-        return;
+bool extractHDR10PlusMetadata(const char* videoPath, uint8_t* metadataBuffer, size_t bufferSize,
+                              size_t* metadataSize) {
+    bool found = false;
+    bool scanned = scanHDR10PlusMetadata(videoPath, [&](int64_t, const Hdr10PlusMetadata& metadata) {
+        if (metadata.t35Payload.size() <= bufferSize) {
+            memcpy(metadataBuffer, metadata.t35Payload.data(), metadata.t35Payload.size());
+            *metadataSize = metadata.t35Payload.size();
+            found = true;
+        }
+        return false;
+    });
+    if (scanned && !found) {
+        __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "No HDR10+ metadata in %s", videoPath);
     }
+    return found;
+}
 
-    format = AMediaFormat_new();
-    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, "video/hevc");
-    // Set other format parameters as needed
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, 1920);
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, 1080);
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, OMX_COLOR_FormatYUV420Flexible);
+// Bound on metadata waiting for its frame. A decoder holds a few frames at
+// most, so anything beyond this belongs to frames it dropped.
+static const size_t kMaxPendingMetadata = 64;
+static const int64_t kCodecTimeoutUs = 10000;
 
-    // Extract HDR10+ metadata
-    const size_t metadataBufferSize = 1024; // Adjust size as per your metadata requirements
-    uint8_t hdr10PlusMetadata[metadataBufferSize];
-    bool metadataExtracted = extractHDR10PlusMetadata(videoPath, hdr10PlusMetadata, metadataBufferSize);
-    if (metadataExtracted) {
-        AMediaFormat_setBuffer(format, AMEDIAFORMAT_KEY_HDR10_PLUS_INFO, hdr10PlusMetadata, metadataBufferSize);
-    } else {
-        __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to extract HDR10+ metadata");
-        AMediaCodec_delete(codec);
-        AMediaFormat_delete(format);
-        close(fd);
-        return;
+bool decodeHDR10PlusVideo(const char* videoPath, bool p010Output, const Hdr10PlusFrameCallback& onFrame) {
+    AMediaExtractor* extractor = AMediaExtractor_new();
+    AMediaFormat* format = nullptr;
+    if (!openHevcTrack(extractor, videoPath, &format)) {
+        AMediaExtractor_delete(extractor);
+        return false;
     }
 
-    if (AMediaCodec_configure(codec, format, nullptr, nullptr, 0) != AMEDIA_OK) {
-        __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to configure MediaCodec");
-        close(fd);
-        AMediaCodec_delete(codec);
+    // Initialize MediaCodec from the track format, which carries the size, profile and parameter sets
+    AMediaCodec* codec = AMediaCodec_createDecoderByType("video/hevc");
+    if (!codec) {
+        __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to create MediaCodec");
         AMediaFormat_delete(format);
-        return;
+        AMediaExtractor_delete(extractor);
+        return false;
     }
-
-    if (AMediaCodec_start(codec) != AMEDIA_OK) {
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT,
+                          p010Output ? kColorFormatYuvP010 : OMX_COLOR_FormatYUV420Flexible);
+    if (AMediaCodec_configure(codec, format, nullptr, nullptr, 0) != AMEDIA_OK ||
+        AMediaCodec_start(codec) != AMEDIA_OK) {
         __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "Failed to start MediaCodec");
-        close(fd);
-        AMediaCodec_stop(codec);
         AMediaCodec_delete(codec);
         AMediaFormat_delete(format);
-        return;
+        AMediaExtractor_delete(extractor);
+        return false;
     }
+    AMediaFormat_delete(format);
 
-    // Decode frames
-    ssize_t bufIdx = AMediaCodec_dequeueInputBuffer(codec, -1);
-    if (bufIdx >= 0) {
-        size_t bufsize;
-        uint8_t* buf = AMediaCodec_getInputBuffer(codec, bufIdx, &bufsize);
-        ssize_t nread = read(fd, buf, bufsize);
-        if (nread > 0) {
-            AMediaCodec_queueInputBuffer(codec, bufIdx, 0, nread, 0);
+    // Metadata is parsed from each sample while it sits in the codec's input
+    // buffer and waits here until the decoder outputs that frame
+    Hdr10PlusTimeline timeline;
+    Hdr10PlusMetadata metadata;
+    Hdr10PlusFrame frame;
+    frame.colorFormat = p010Output ? kColorFormatYuvP010 : OMX_COLOR_FormatYUV420Flexible;
+    bool sawInputEOS = false;
+    bool sawOutputEOS = false;
+    bool stopped = false;
+    bool failed = false;
+    while (!sawOutputEOS && !stopped && !failed) {
+        if (!sawInputEOS) {
+            ssize_t bufIdx = AMediaCodec_dequeueInputBuffer(codec, kCodecTimeoutUs);
+            if (bufIdx >= 0) {
+                size_t bufsize;
+                uint8_t* buf = AMediaCodec_getInputBuffer(codec, bufIdx, &bufsize);
+                ssize_t sampleSize = AMediaExtractor_readSampleData(extractor, buf, bufsize);
+                int64_t presentationTimeUs = AMediaExtractor_getSampleTime(extractor);
+                if (sampleSize < 0) {
+                    sampleSize = 0;
+                    sawInputEOS = true;
+                } else if (findHdr10PlusInAccessUnit(buf, sampleSize, nalLengthSizeOf(buf, sampleSize), &metadata)) {
+                    timeline.add(presentationTimeUs, std::move(metadata));
+                    timeline.trim(kMaxPendingMetadata);
+                }
+                AMediaCodec_queueInputBuffer(codec, bufIdx, 0, sampleSize, sawInputEOS ? 0 : presentationTimeUs,
+                                             sawInputEOS ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0);
+                if (!sawInputEOS) {
+                    AMediaExtractor_advance(extractor);
+                }
+            }
         }
-    }
 
-    AMediaCodecBufferInfo info;
-    ssize_t status = AMediaCodec_dequeueOutputBuffer(codec, &info, -1);
-    if (status >= 0) {
-        uint8_t* outputData = AMediaCodec_getOutputBuffer(codec, status, nullptr);
-        // Process or dump outputData (e.g., save as image file)
-        // Example: saveFrameToFile(outputData, info.size);
-        AMediaCodec_releaseOutputBuffer(codec, status, false);
+        AMediaCodecBufferInfo info;
+        ssize_t status = AMediaCodec_dequeueOutputBuffer(codec, &info, sawInputEOS ? kCodecTimeoutUs : 0);
+        if (status >= 0) {
+            size_t outSize;
+            uint8_t* outputData = AMediaCodec_getOutputBuffer(codec, status, &outSize);
+            if (outputData && info.size > 0) {
+                bool hasMetadata = timeline.take(info.presentationTimeUs, &metadata);
+                frame.data = outputData + info.offset;
+                frame.size = info.size;
+                frame.presentationTimeUs = info.presentationTimeUs;
+                frame.metadata = hasMetadata ? &metadata : nullptr;
+                stopped = !onFrame(frame);
+            }
+            // The frame is handed out in place, so the buffer goes back only after the callback
+            AMediaCodec_releaseOutputBuffer(codec, status, false);
+            if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+                sawOutputEOS = true;
+            }
+        } else if (status == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            AMediaFormat* outputFormat = AMediaCodec_getOutputFormat(codec);
+            AMediaFormat_getInt32(outputFormat, AMEDIAFORMAT_KEY_WIDTH, &frame.width);
+            AMediaFormat_getInt32(outputFormat, AMEDIAFORMAT_KEY_HEIGHT, &frame.height);
+            AMediaFormat_getInt32(outputFormat, AMEDIAFORMAT_KEY_COLOR_FORMAT, &frame.colorFormat);
+            if (!AMediaFormat_getInt32(outputFormat, AMEDIAFORMAT_KEY_STRIDE, &frame.stride)) {
+                frame.stride = frame.width * (frame.colorFormat == kColorFormatYuvP010 ? 2 : 1);
+            }
+            if (!AMediaFormat_getInt32(outputFormat, AMEDIAFORMAT_KEY_SLICE_HEIGHT, &frame.sliceHeight)) {
+                frame.sliceHeight = frame.height;
+            }
+            AMediaFormat_delete(outputFormat);
+            if (p010Output && frame.colorFormat != kColorFormatYuvP010) {
+                __android_log_print(ANDROID_LOG_WARN, "HDR10+ Decoder", "Decoder ignored P010, output color format %d",
+                                    frame.colorFormat);
+            }
+        } else if (status != AMEDIACODEC_INFO_TRY_AGAIN_LATER && status != AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
+            __android_log_print(ANDROID_LOG_ERROR, "HDR10+ Decoder", "dequeueOutputBuffer failed: %zd", status);
+            failed = true;
+        }
     }
 
     // Clean up
     AMediaCodec_stop(codec);
     AMediaCodec_delete(codec);
-    AMediaFormat_delete(format);
-    close(fd);
+    AMediaExtractor_delete(extractor);
+    return !failed;
+}
+
+void decodeHDR10PlusVideo(const char* videoPath) {
+    int64_t frames = 0;
+    int64_t framesWithMetadata = 0;
+    bool decoded = decodeHDR10PlusVideo(videoPath, true, [&](const Hdr10PlusFrame& frame) {
+        frames++;
+        framesWithMetadata += frame.metadata != nullptr;
+        return true;
+    });
+    if (decoded) {
+        __android_log_print(ANDROID_LOG_INFO, "HDR10+ Decoder", "Decoded %lld frames, %lld with HDR10+ metadata",
+                            static_cast<long long>(frames), static_cast<long long>(framesWithMetadata));
+    }
 }
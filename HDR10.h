@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "HevcSei.h"
+
+// MediaCodecInfo.CodecCapabilities.COLOR_FormatYUVP010: 10-bit 4:2:0 with
+// each sample in the high bits of a 16-bit little endian word, Y plane then
+// interleaved UV plane
+const int32_t kColorFormatYuvP010 = 54;
+
+// One decoded frame. data points into the decoder's output buffer and is
+// only valid during the callback.
+struct Hdr10PlusFrame {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;       // Bytes between luma rows
+    int32_t sliceHeight = 0;  // Rows in the luma plane, padding included
+    int32_t colorFormat = 0;  // kColorFormatYuvP010 unless the decoder fell back to 8 bits
+    int64_t presentationTimeUs = 0;
+    const Hdr10PlusMetadata* metadata = nullptr;  // Null if the frame carried no HDR10+ SEI
+};
+
+// Return false to stop decoding
+typedef std::function<bool(const Hdr10PlusFrame& frame)> Hdr10PlusFrameCallback;
+
+// Collects the HDR10+ metadata of every frame in videoPath by presentation time
+bool extractHDR10PlusMetadata(const char* videoPath, Hdr10PlusTimeline* timeline);
+
+// Copies the ITU-T T.35 payload of the first frame that carries one
+bool extractHDR10PlusMetadata(const char* videoPath, uint8_t* metadataBuffer, size_t bufferSize,
+                              size_t* metadataSize);
+
+// Decodes the HEVC track of videoPath in one pass and hands every frame to
+// onFrame together with its HDR10+ metadata. The SEI is parsed from each
+// sample as it is queued, so the file is read only once. p010Output asks the
+// decoder for 10-bit P010 output.
+bool decodeHDR10PlusVideo(const char* videoPath, bool p010Output, const Hdr10PlusFrameCallback& onFrame);
+
+// Decodes the whole file and logs how many frames carried metadata
+void decodeHDR10PlusVideo(const char* videoPath);
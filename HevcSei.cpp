@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <cstring>
+
+#include "HevcSei.h"
+
+namespace {
+
+const uint8_t kT35CountryCodeUs = 0xB5;
+const uint16_t kT35ProviderCodeSamsung = 0x003C;
+const uint16_t kT35ProviderOrientedCodeHdr10Plus = 0x0001;
+const uint8_t kHdr10PlusApplicationIdentifier = 4;
+const int32_t kSeiPayloadUserDataRegistered = 4;
+
+// SEI NAL units larger than this are truncated; HDR10+ payloads are a few
+// hundred bytes at most
+const size_t kMaxSeiSize = 64 * 1024;
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    // Reads up to 32 bits MSB first; past the end reads zeros and sets overrun
+    uint32_t read(int32_t bits) {
+        uint32_t value = 0;
+        for (int32_t i = 0; i < bits; ++i) {
+            size_t byte = mPosition >> 3;
+            uint32_t bit = 0;
+            if (byte < mSize) {
+                bit = (mData[byte] >> (7 - (mPosition & 7))) & 1;
+            } else {
+                mOverrun = true;
+            }
+            value = (value << 1) | bit;
+            mPosition++;
+        }
+        return value;
+    }
+
+    bool overrun() const { return mOverrun; }
+
+private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mPosition = 0;
+    bool mOverrun = false;
+};
+
+void readLuminanceMatrix(BitReader& bits, uint8_t* rows, uint8_t* cols,
+                         uint8_t (*values)[kHdr10PlusMaxLuminanceDim]) {
+    *rows = static_cast<uint8_t>(bits.read(5));
+    *cols = static_cast<uint8_t>(bits.read(5));
+    for (int32_t row = 0; row < *rows; ++row) {
+        for (int32_t col = 0; col < *cols; ++col) {
+            uint8_t value = static_cast<uint8_t>(bits.read(4));
+            if (row < kHdr10PlusMaxLuminanceDim && col < kHdr10PlusMaxLuminanceDim) {
+                values[row][col] = value;
+            }
+        }
+    }
+    *rows = std::min<uint8_t>(*rows, kHdr10PlusMaxLuminanceDim);
+    *cols = std::min<uint8_t>(*cols, kHdr10PlusMaxLuminanceDim);
+}
+
+// nal is a whole SEI NAL unit including its two header bytes, still escaped
+bool findHdr10PlusInSei(const uint8_t* nal, size_t size, std::vector<uint8_t>* rbsp, Hdr10PlusMetadata* metadata) {
+    // Drop the emulation prevention bytes (00 00 03 -> 00 00)
+    rbsp->clear();
+    int32_t zeros = 0;
+    for (size_t i = 2; i < size; ++i) {
+        if (zeros >= 2 && nal[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+        rbsp->push_back(nal[i]);
+    }
+
+    const uint8_t* data = rbsp->data();
+    size_t end = rbsp->size();
+    size_t pos = 0;
+    // Each message is ff-coded type and size, then the payload; 0x80 is the trailing bits
+    while (pos + 2 <= end && data[pos] != 0x80) {
+        int32_t payloadType = 0;
+        while (pos < end && data[pos] == 0xFF) {
+            payloadType += 255;
+            pos++;
+        }
+        if (pos >= end) {
+            return false;
+        }
+        payloadType += data[pos++];
+        size_t payloadSize = 0;
+        while (pos < end && data[pos] == 0xFF) {
+            payloadSize += 255;
+            pos++;
+        }
+        if (pos >= end) {
+            return false;
+        }
+        payloadSize += data[pos++];
+        if (payloadSize > end - pos) {
+            return false;
+        }
+        if (payloadType == kSeiPayloadUserDataRegistered && parseHdr10PlusT35(data + pos, payloadSize, metadata)) {
+            return true;
+        }
+        pos += payloadSize;
+    }
+    return false;
+}
+
+} // namespace
+
+bool parseHdr10PlusT35(const uint8_t* payload, size_t size, Hdr10PlusMetadata* metadata) {
+    if (size < 7 || payload[0] != kT35CountryCodeUs ||
+        ((payload[1] << 8) | payload[2]) != kT35ProviderCodeSamsung ||
+        ((payload[3] << 8) | payload[4]) != kT35ProviderOrientedCodeHdr10Plus ||
+        payload[5] != kHdr10PlusApplicationIdentifier || payload[6] > 1) {
+        return false;
+    }
+
+    Hdr10PlusMetadata parsed;
+    parsed.applicationVersion = payload[6];
+    BitReader bits(payload + 7, size - 7);
+
+    parsed.numWindows = static_cast<uint8_t>(bits.read(2));
+    if (parsed.numWindows < 1 || parsed.numWindows > kHdr10PlusMaxWindows) {
+        return false;
+    }
+    for (int32_t w = 1; w < parsed.numWindows; ++w) {
+        Hdr10PlusWindow& window = parsed.windows[w];
+        window.upperLeftCornerX = static_cast<uint16_t>(bits.read(16));
+        window.upperLeftCornerY = static_cast<uint16_t>(bits.read(16));
+        window.lowerRightCornerX = static_cast<uint16_t>(bits.read(16));
+        window.lowerRightCornerY = static_cast<uint16_t>(bits.read(16));
+        window.centerOfEllipseX = static_cast<uint16_t>(bits.read(16));
+        window.centerOfEllipseY = static_cast<uint16_t>(bits.read(16));
+        window.rotationAngle = static_cast<uint8_t>(bits.read(8));
+        window.semimajorAxisInternalEllipse = static_cast<uint16_t>(bits.read(16));
+        window.semimajorAxisExternalEllipse = static_cast<uint16_t>(bits.read(16));
+        window.semiminorAxisExternalEllipse = static_cast<uint16_t>(bits.read(16));
+        window.overlapProcessOption = static_cast<uint8_t>(bits.read(1));
+    }
+
+    parsed.targetedSystemDisplayMaximumLuminance = bits.read(27);
+    parsed.targetedSystemDisplayActualPeakLuminanceFlag = bits.read(1);
+    if (parsed.targetedSystemDisplayActualPeakLuminanceFlag) {
+        readLuminanceMatrix(bits, &parsed.numRowsTargetedSystemDisplayActualPeakLuminance,
+                            &parsed.numColsTargetedSystemDisplayActualPeakLuminance,
+                            parsed.targetedSystemDisplayActualPeakLuminance);
+    }
+
+    for (int32_t w = 0; w < parsed.numWindows; ++w) {
+        Hdr10PlusWindow& window = parsed.windows[w];
+        for (uint32_t& maxScl : window.maxScl) {
+            maxScl = bits.read(17);
+        }
+        window.averageMaxRgb = bits.read(17);
+        window.numDistributionMaxRgbPercentiles = static_cast<uint8_t>(bits.read(4));
+        for (int32_t i = 0; i < window.numDistributionMaxRgbPercentiles; ++i) {
+            window.distributionMaxRgbPercentages[i] = static_cast<uint8_t>(bits.read(7));
+            window.distributionMaxRgbPercentiles[i] = bits.read(17);
+        }
+        window.fractionBrightPixels = static_cast<uint16_t>(bits.read(10));
+    }
+
+    parsed.masteringDisplayActualPeakLuminanceFlag = bits.read(1);
+    if (parsed.masteringDisplayActualPeakLuminanceFlag) {
+        readLuminanceMatrix(bits, &parsed.numRowsMasteringDisplayActualPeakLuminance,
+                            &parsed.numColsMasteringDisplayActualPeakLuminance,
+                            parsed.masteringDisplayActualPeakLuminance);
+    }
+
+    for (int32_t w = 0; w < parsed.numWindows; ++w) {
+        Hdr10PlusWindow& window = parsed.windows[w];
+        window.toneMappingFlag = bits.read(1);
+        if (window.toneMappingFlag) {
+            window.kneePointX = static_cast<uint16_t>(bits.read(12));
+            window.kneePointY = static_cast<uint16_t>(bits.read(12));
+            window.numBezierCurveAnchors = static_cast<uint8_t>(bits.read(4));
+            for (int32_t i = 0; i < window.numBezierCurveAnchors; ++i) {
+                window.bezierCurveAnchors[i] = static_cast<uint16_t>(bits.read(10));
+            }
+        }
+        window.colorSaturationMappingFlag = bits.read(1);
+        if (window.colorSaturationMappingFlag) {
+            window.colorSaturationWeight = static_cast<uint8_t>(bits.read(6));
+        }
+    }
+
+    if (bits.overrun()) {
+        return false;
+    }
+    parsed.t35Payload.assign(payload, payload + size);
+    *metadata = std::move(parsed);
+    return true;
+}
+
+HevcSeiParser::HevcSeiParser(AccessUnitCallback onAccessUnit) : mOnAccessUnit(std::move(onAccessUnit)) {}
+
+void HevcSeiParser::feed(const uint8_t* data, size_t size) {
+    mBytesParsed += size;
+    size_t pos = 0;
+    while (pos < size) {
+        // Every start code ends in 0x01, so memchr skips most of the payload
+        const uint8_t* one = static_cast<const uint8_t*>(memchr(data + pos, 1, size - pos));
+        if (!one) {
+            appendNal(data + pos, size - pos);
+            break;
+        }
+        size_t at = one - data;
+        int32_t zeros = 0;
+        size_t back = at;
+        while (zeros < 2 && back > 0 && data[back - 1] == 0) {
+            zeros++;
+            back--;
+        }
+        if (back == 0) {
+            // The zeros may have started in an earlier chunk
+            zeros += mZeroRun;
+        }
+        if (zeros >= 2) {
+            // The start code's zeros went into the NAL and are trimmed when it is parsed
+            appendNal(data + pos, at - pos);
+            finishNal();
+            startNal();
+        } else {
+            appendNal(data + pos, at + 1 - pos);
+        }
+        pos = at + 1;
+    }
+
+    size_t trailing = 0;
+    while (trailing < size && trailing < 3 && data[size - 1 - trailing] == 0) {
+        trailing++;
+    }
+    mZeroRun = trailing == size ? std::min<int32_t>(mZeroRun + static_cast<int32_t>(size), 3)
+                                : static_cast<int32_t>(trailing);
+}
+
+void HevcSeiParser::appendNal(const uint8_t* data, size_t size) {
+    if (!mInNal || size == 0) {
+        return;
+    }
+    if (mHeaderSize < 3) {
+        size_t header = std::min<size_t>(3 - mHeaderSize, size);
+        memcpy(mHeader + mHeaderSize, data, header);
+        mHeaderSize += static_cast<int32_t>(header);
+        data += header;
+        size -= header;
+        if (mHeaderSize == 3) {
+            classifyNal();
+        }
+    }
+    if ((mNalType == HEVC_NAL_SEI_PREFIX || mNalType == HEVC_NAL_SEI_SUFFIX) && size > 0 &&
+        mSei.size() + size <= kMaxSeiSize) {
+        mSei.insert(mSei.end(), data, data + size);
+    }
+}
+
+void HevcSeiParser::startNal() {
+    mInNal = true;
+    mClassified = false;
+    mHeaderSize = 0;
+    mNalType = -1;
+}
+
+void HevcSeiParser::classifyNal() {
+    mClassified = true;
+    mNalType = (mHeader[0] >> 1) & 0x3f;
+    bool vcl = mNalType <= HEVC_NAL_VCL_LAST;
+    // H.265 7.4.2.4.4: these begin a new access unit once the current one has a picture
+    bool startsAccessUnit = mNalType == HEVC_NAL_VPS || mNalType == HEVC_NAL_SPS || mNalType == HEVC_NAL_PPS ||
+                            mNalType == HEVC_NAL_AUD || mNalType == HEVC_NAL_SEI_PREFIX ||
+                            (mNalType >= 41 && mNalType <= 44) || (mNalType >= 48 && mNalType <= 55) ||
+                            (vcl && (mHeader[2] & 0x80));  // first_slice_segment_in_pic_flag
+    if (mAccessUnitHasVcl && startsAccessUnit) {
+        finishAccessUnit();
+    }
+    if (vcl) {
+        mAccessUnitHasVcl = true;
+    }
+    if (mNalType == HEVC_NAL_SEI_PREFIX || mNalType == HEVC_NAL_SEI_SUFFIX) {
+        mSei.assign(mHeader, mHeader + mHeaderSize);
+    }
+}
+
+void HevcSeiParser::finishNal() {
+    if (!mInNal) {
+        return;
+    }
+    mInNal = false;
+    if (!mClassified) {
+        if (mHeaderSize < 2) {
+            return;
+        }
+        mHeader[2] = 0;
+        classifyNal();
+    }
+    if (mNalType != HEVC_NAL_SEI_PREFIX && mNalType != HEVC_NAL_SEI_SUFFIX) {
+        return;
+    }
+    size_t size = mSei.size();
+    while (size > 0 && mSei[size - 1] == 0) {
+        size--;
+    }
+    std::vector<uint8_t> rbsp;
+    Hdr10PlusMetadata metadata;
+    if (findHdr10PlusInSei(mSei.data(), size, &rbsp, &metadata)) {
+        mMetadata = std::move(metadata);
+        mAccessUnitHasMetadata = true;
+    }
+}
+
+void HevcSeiParser::finishAccessUnit() {
+    if (mOnAccessUnit) {
+        mOnAccessUnit(mAccessUnitIndex, mAccessUnitHasMetadata ? &mMetadata : nullptr);
+    }
+    mAccessUnitIndex++;
+    mAccessUnitHasVcl = false;
+    mAccessUnitHasMetadata = false;
+}
+
+void HevcSeiParser::flush() {
+    finishNal();
+    if (mAccessUnitHasVcl) {
+        finishAccessUnit();
+    }
+    mAccessUnitHasMetadata = false;
+    mZeroRun = 0;
+}
+
+bool findHdr10PlusInAccessUnit(const uint8_t* data, size_t size, int32_t nalLengthSize, Hdr10PlusMetadata* metadata) {
+    if (nalLengthSize == 0) {
+        bool found = false;
+        HevcSeiParser parser([&](int64_t, const Hdr10PlusMetadata* parsed) {
+            if (parsed && !found) {
+                *metadata = *parsed;
+                found = true;
+            }
+        });
+        parser.feed(data, size);
+        parser.flush();
+        return found;
+    }
+    if (nalLengthSize != 1 && nalLengthSize != 2 && nalLengthSize != 4) {
+        return false;
+    }
+
+    std::vector<uint8_t> rbsp;
+    size_t pos = 0;
+    while (pos + nalLengthSize <= size) {
+        size_t nalSize = 0;
+        for (int32_t i = 0; i < nalLengthSize; ++i) {
+            nalSize = (nalSize << 8) | data[pos + i];
+        }
+        pos += nalLengthSize;
+        if (nalSize > size - pos) {
+            return false;
+        }
+        int32_t type = nalSize > 0 ? (data[pos] >> 1) & 0x3f : -1;
+        if ((type == HEVC_NAL_SEI_PREFIX || type == HEVC_NAL_SEI_SUFFIX) &&
+            findHdr10PlusInSei(data + pos, nalSize, &rbsp, metadata)) {
+            return true;
+        }
+        pos += nalSize;
+    }
+    return false;
+}
+
+void Hdr10PlusTimeline::add(int64_t presentationTimeUs, Hdr10PlusMetadata metadata) {
+    mEntries[presentationTimeUs] = std::move(metadata);
+}
+
+bool Hdr10PlusTimeline::take(int64_t presentationTimeUs, Hdr10PlusMetadata* metadata) {
+    auto it = mEntries.lower_bound(presentationTimeUs);
+    mEntries.erase(mEntries.begin(), it);
+    if (it == mEntries.end() || it->first != presentationTimeUs) {
+        return false;
+    }
+    *metadata = std::move(it->second);
+    mEntries.erase(it);
+    return true;
+}
+
+void Hdr10PlusTimeline::trim(size_t maxEntries) {
+    while (mEntries.size() > maxEntries) {
+        mEntries.erase(mEntries.begin());
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+// HEVC NAL unit types the parser looks at (H.265 table 7-1)
+enum HevcNalType {
+    HEVC_NAL_VCL_LAST = 31,
+    HEVC_NAL_VPS = 32,
+    HEVC_NAL_SPS = 33,
+    HEVC_NAL_PPS = 34,
+    HEVC_NAL_AUD = 35,
+    HEVC_NAL_SEI_PREFIX = 39,
+    HEVC_NAL_SEI_SUFFIX = 40,
+};
+
+const int32_t kHdr10PlusMaxWindows = 3;
+const int32_t kHdr10PlusMaxPercentiles = 15;
+const int32_t kHdr10PlusMaxBezierAnchors = 15;
+const int32_t kHdr10PlusMaxLuminanceDim = 25;
+
+struct Hdr10PlusWindow {
+    // Window geometry; only set for windows after the first, which covers the frame
+    uint16_t upperLeftCornerX = 0;
+    uint16_t upperLeftCornerY = 0;
+    uint16_t lowerRightCornerX = 0;
+    uint16_t lowerRightCornerY = 0;
+    uint16_t centerOfEllipseX = 0;
+    uint16_t centerOfEllipseY = 0;
+    uint8_t rotationAngle = 0;
+    uint16_t semimajorAxisInternalEllipse = 0;
+    uint16_t semimajorAxisExternalEllipse = 0;
+    uint16_t semiminorAxisExternalEllipse = 0;
+    uint8_t overlapProcessOption = 0;
+
+    // Scene statistics, linearized values in units of 0.00001 (17 bits)
+    uint32_t maxScl[3] = { 0, 0, 0 };
+    uint32_t averageMaxRgb = 0;
+    uint8_t numDistributionMaxRgbPercentiles = 0;
+    uint8_t distributionMaxRgbPercentages[kHdr10PlusMaxPercentiles] = {};
+    uint32_t distributionMaxRgbPercentiles[kHdr10PlusMaxPercentiles] = {};
+    uint16_t fractionBrightPixels = 0;
+
+    // Tone mapping curve
+    bool toneMappingFlag = false;
+    uint16_t kneePointX = 0;
+    uint16_t kneePointY = 0;
+    uint8_t numBezierCurveAnchors = 0;
+    uint16_t bezierCurveAnchors[kHdr10PlusMaxBezierAnchors] = {};
+
+    bool colorSaturationMappingFlag = false;
+    uint8_t colorSaturationWeight = 0;
+};
+
+// SMPTE ST 2094-40 dynamic metadata as carried in an HEVC user data
+// registered (ITU-T T.35) SEI message
+struct Hdr10PlusMetadata {
+    uint8_t applicationVersion = 0;
+    uint8_t numWindows = 0;
+    Hdr10PlusWindow windows[kHdr10PlusMaxWindows];
+
+    uint32_t targetedSystemDisplayMaximumLuminance = 0;  // cd/m2
+    bool targetedSystemDisplayActualPeakLuminanceFlag = false;
+    uint8_t numRowsTargetedSystemDisplayActualPeakLuminance = 0;
+    uint8_t numColsTargetedSystemDisplayActualPeakLuminance = 0;
+    uint8_t targetedSystemDisplayActualPeakLuminance[kHdr10PlusMaxLuminanceDim][kHdr10PlusMaxLuminanceDim] = {};
+
+    bool masteringDisplayActualPeakLuminanceFlag = false;
+    uint8_t numRowsMasteringDisplayActualPeakLuminance = 0;
+    uint8_t numColsMasteringDisplayActualPeakLuminance = 0;
+    uint8_t masteringDisplayActualPeakLuminance[kHdr10PlusMaxLuminanceDim][kHdr10PlusMaxLuminanceDim] = {};
+
+    // The T.35 payload as it appeared in the SEI, starting at the country
+    // code; this is what AMEDIAFORMAT_KEY_HDR10_PLUS_INFO expects
+    std::vector<uint8_t> t35Payload;
+};
+
+// Decodes one ITU-T T.35 payload (country code first). Returns false if it
+// is not HDR10+ or is malformed.
+bool parseHdr10PlusT35(const uint8_t* payload, size_t size, Hdr10PlusMetadata* metadata);
+
+// Streaming HEVC Annex-B parser. Feed the elementary stream in chunks of any
+// size; only SEI NAL units are copied, everything else is skipped in place,
+// so memory use does not depend on the stream size. onAccessUnit runs once
+// per access unit in decode order with its index and its HDR10+ metadata,
+// or null if it carried none.
+class HevcSeiParser {
+public:
+    typedef std::function<void(int64_t accessUnitIndex, const Hdr10PlusMetadata* metadata)> AccessUnitCallback;
+
+    explicit HevcSeiParser(AccessUnitCallback onAccessUnit);
+
+    void feed(const uint8_t* data, size_t size);
+
+    // Ends the last NAL unit and access unit; feed() may be called again
+    // afterwards for a new stream
+    void flush();
+
+    int64_t accessUnitCount() const { return mAccessUnitIndex; }
+    int64_t bytesParsed() const { return mBytesParsed; }
+
+private:
+    void appendNal(const uint8_t* data, size_t size);
+    void startNal();
+    void classifyNal();
+    void finishNal();
+    void finishAccessUnit();
+
+    AccessUnitCallback mOnAccessUnit;
+    int64_t mAccessUnitIndex = 0;
+    int64_t mBytesParsed = 0;
+    int32_t mZeroRun = 0;  // Zero bytes at the end of the data fed so far
+    bool mInNal = false;
+    bool mClassified = false;
+    uint8_t mHeader[3] = { 0, 0, 0 };
+    int32_t mHeaderSize = 0;
+    int32_t mNalType = -1;
+    bool mAccessUnitHasVcl = false;
+    bool mAccessUnitHasMetadata = false;
+    std::vector<uint8_t> mSei;
+    Hdr10PlusMetadata mMetadata;
+};
+
+// Finds the HDR10+ SEI in one access unit, e.g. an extractor sample.
+// nalLengthSize is the size of the NAL length prefix (1, 2 or 4, as in
+// hvcC), or 0 for Annex-B start codes.
+bool findHdr10PlusInAccessUnit(const uint8_t* data, size_t size, int32_t nalLengthSize, Hdr10PlusMetadata* metadata);
+
+// Metadata waiting for its frame. Access units are parsed in decode order
+// but frames come out of the decoder in presentation order, so metadata is
+// keyed by presentation time and collected when the frame with that time is
+// output.
+class Hdr10PlusTimeline {
+public:
+    void add(int64_t presentationTimeUs, Hdr10PlusMetadata metadata);
+
+    // Returns false if the frame carried no metadata. Entries for earlier
+    // timestamps, whose frames the decoder dropped, are discarded.
+    bool take(int64_t presentationTimeUs, Hdr10PlusMetadata* metadata);
+
+    // Drops the earliest entries until at most maxEntries are left
+    void trim(size_t maxEntries);
+
+    size_t size() const { return mEntries.size(); }
+    void clear() { mEntries.clear(); }
+
+private:
+    std::map<int64_t, Hdr10PlusMetadata> mEntries;
+};
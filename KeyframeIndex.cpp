@@ -0,0 +1,164 @@
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "KeyframeIndex.h"
+
+#define LOG_TAG "KeyframeIndex"
+#include "Log.h"
+
+namespace {
+
+const char kMagic[4] = { 'K', 'F', 'I', '1' };
+
+// Cache file header, followed by the input path and the sync times
+struct IndexHeader {
+    char magic[4];
+    uint32_t pathLength;
+    uint64_t inputSize;
+    int64_t inputModifiedNs;
+    int64_t sampleCount;
+    int64_t lastSampleTimeUs;
+    uint64_t syncCount;
+};
+
+bool statInput(const char* inputPath, uint64_t* size, int64_t* modifiedNs) {
+    struct stat st;
+    if (!inputPath || stat(inputPath, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    *size = static_cast<uint64_t>(st.st_size);
+    *modifiedNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// FNV-1a, stable across builds unlike std::hash
+uint64_t hashPath(const char* path) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = path; *c; ++c) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+} // namespace
+
+bool KeyframeIndex::build(SampleSource* source) {
+    mSyncTimesUs.clear();
+    mSampleCount = 0;
+    mLastSampleTimeUs = 0;
+    while (source->getSampleSize() >= 0) {
+        int64_t time = source->getSampleTime();
+        if (source->getSampleFlags() & SAMPLE_FLAG_SYNC) {
+            mSyncTimesUs.push_back(time);
+        }
+        mSampleCount++;
+        mLastSampleTimeUs = std::max(mLastSampleTimeUs, time);
+        if (!source->advance()) {
+            break;
+        }
+    }
+    // Sync samples are normally in presentation order already
+    std::sort(mSyncTimesUs.begin(), mSyncTimesUs.end());
+    return mSampleCount > 0;
+}
+
+bool KeyframeIndex::load(const char* indexPath, const char* inputPath) {
+    IndexHeader expected = {};
+    if (!statInput(inputPath, &expected.inputSize, &expected.inputModifiedNs)) {
+        return false;
+    }
+    FILE* file = fopen(indexPath, "rb");
+    if (!file) {
+        return false;
+    }
+    IndexHeader header;
+    std::string path;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, kMagic, sizeof(kMagic)) &&
+              header.inputSize == expected.inputSize && header.inputModifiedNs == expected.inputModifiedNs &&
+              header.pathLength == strlen(inputPath) && header.syncCount <= static_cast<uint64_t>(header.sampleCount);
+    if (ok) {
+        path.resize(header.pathLength);
+        ok = fread(&path[0], 1, path.size(), file) == path.size() && path == inputPath;
+    }
+    if (ok) {
+        mSyncTimesUs.resize(header.syncCount);
+        ok = fread(mSyncTimesUs.data(), sizeof(int64_t), mSyncTimesUs.size(), file) == mSyncTimesUs.size();
+        mSampleCount = header.sampleCount;
+        mLastSampleTimeUs = header.lastSampleTimeUs;
+    }
+    fclose(file);
+    if (!ok) {
+        mSyncTimesUs.clear();
+        mSampleCount = 0;
+    }
+    return ok;
+}
+
+bool KeyframeIndex::save(const char* indexPath, const char* inputPath) const {
+    IndexHeader header = {};
+    if (!statInput(inputPath, &header.inputSize, &header.inputModifiedNs)) {
+        return false;
+    }
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.pathLength = static_cast<uint32_t>(strlen(inputPath));
+    header.sampleCount = mSampleCount;
+    header.lastSampleTimeUs = mLastSampleTimeUs;
+    header.syncCount = mSyncTimesUs.size();
+
+    // Written under a temporary name and renamed, so a reader never sees half a file
+    std::string tempPath = std::string(indexPath) + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(inputPath, 1, header.pathLength, file) == header.pathLength &&
+              fwrite(mSyncTimesUs.data(), sizeof(int64_t), mSyncTimesUs.size(), file) == mSyncTimesUs.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tempPath.c_str(), indexPath) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+int64_t KeyframeIndex::syncTimeAtOrBefore(int64_t timeUs) const {
+    if (mSyncTimesUs.empty()) {
+        return 0;
+    }
+    auto it = std::upper_bound(mSyncTimesUs.begin(), mSyncTimesUs.end(), timeUs);
+    return it == mSyncTimesUs.begin() ? mSyncTimesUs.front() : *(it - 1);
+}
+
+std::string keyframeIndexPath(const char* inputPath, const char* cacheDir) {
+    if (!cacheDir || cacheDir[0] == '\0') {
+        return std::string(inputPath) + ".keyframes";
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.keyframes", static_cast<unsigned long long>(hashPath(inputPath)));
+    return std::string(cacheDir) + name;
+}
+
+bool loadKeyframeIndex(const char* inputPath, const char* cacheDir, SampleSource* source, KeyframeIndex* index) {
+    uint64_t size;
+    int64_t modifiedNs;
+    if (!statInput(inputPath, &size, &modifiedNs)) {
+        return index->build(source);
+    }
+    std::string indexPath = keyframeIndexPath(inputPath, cacheDir);
+    if (index->load(indexPath.c_str(), inputPath)) {
+        return true;
+    }
+    if (!index->build(source)) {
+        return false;
+    }
+    if (!index->save(indexPath.c_str(), inputPath)) {
+        LOGW("Could not cache the keyframe index at %s", indexPath.c_str());
+    } else {
+        LOGI("Indexed %zu keyframes of %lld samples into %s", index->syncTimesUs().size(),
+             static_cast<long long>(index->sampleCount()), indexPath.c_str());
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CodecBackend.h"
+
+// Presentation times of the sync samples of one video track. Building it
+// walks every sample header once; after that it is kept in a small cache
+// file stamped with the input's size and modification time, so later
+// partial or segmented transcodes of the same file skip the scan.
+class KeyframeIndex {
+public:
+    // Scans the selected track of source from its current position to the end
+    bool build(SampleSource* source);
+
+    // The cache file must have been saved for inputPath as it is now
+    bool load(const char* indexPath, const char* inputPath);
+    bool save(const char* indexPath, const char* inputPath) const;
+
+    // Time of the last sync sample at or before timeUs, or of the first one
+    int64_t syncTimeAtOrBefore(int64_t timeUs) const;
+
+    const std::vector<int64_t>& syncTimesUs() const { return mSyncTimesUs; }
+    int64_t sampleCount() const { return mSampleCount; }
+    int64_t lastSampleTimeUs() const { return mLastSampleTimeUs; }
+
+private:
+    std::vector<int64_t> mSyncTimesUs;
+    int64_t mSampleCount = 0;
+    int64_t mLastSampleTimeUs = 0;
+};
+
+// Where the index of inputPath is cached: "<inputPath>.keyframes", or a file
+// named after a hash of the path inside cacheDir when one is given
+std::string keyframeIndexPath(const char* inputPath, const char* cacheDir);
+
+// Loads the cached index of inputPath, or builds it from source (positioned
+// on its video track's first sample) and caches it. Inputs that are not
+// files, such as the software backend's, are scanned without caching.
+bool loadKeyframeIndex(const char* inputPath, const char* cacheDir, SampleSource* source, KeyframeIndex* index);
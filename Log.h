@@ -0,0 +1,32 @@
+#pragma once
+
+// Logging macros shared by the pipeline sources. Define LOG_TAG before
+// including this header to override the default tag.
+#ifndef LOG_TAG
+#define LOG_TAG "MediaCodec"
+#endif
+
+#ifdef __ANDROID__
+#include <android/log.h>
+
+#define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__))
+#define LOGW(...) ((void)__android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__))
+#define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__))
+#else
+#include <cstdarg>
+#include <cstdio>
+
+// Host builds have no logcat, so messages go to stderr in logcat's "P/tag: msg" layout
+inline void hostLogPrint(char priority, const char* tag, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%c/%s: ", priority, tag);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+#define LOGI(...) hostLogPrint('I', LOG_TAG, __VA_ARGS__)
+#define LOGW(...) hostLogPrint('W', LOG_TAG, __VA_ARGS__)
+#define LOGE(...) hostLogPrint('E', LOG_TAG, __VA_ARGS__)
+#endif
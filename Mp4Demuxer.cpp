@@ -0,0 +1,728 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "Mp4Demuxer.h"
+
+#define LOG_TAG "Mp4Demuxer"
+#include "Log.h"
+
+namespace {
+
+constexpr uint32_t fourcc(const char (&code)[5]) {
+    return (static_cast<uint32_t>(static_cast<uint8_t>(code[0])) << 24) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(code[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(code[2])) << 8) | static_cast<uint8_t>(code[3]);
+}
+
+inline uint16_t readU16(const uint8_t* p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+inline uint32_t readU32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+inline uint64_t readU64(const uint8_t* p) { return (static_cast<uint64_t>(readU32(p)) << 32) | readU32(p + 4); }
+
+struct Box {
+    uint32_t type = 0;
+    const uint8_t* data = nullptr;  // Payload, after the header
+    size_t size = 0;
+};
+
+// Steps through the boxes in data; returns false at the end or on a box
+// that does not fit
+bool nextBox(const uint8_t* data, size_t size, size_t* pos, Box* box) {
+    if (size - *pos < 8) {
+        return false;
+    }
+    const uint8_t* p = data + *pos;
+    uint64_t boxSize = readU32(p);
+    size_t header = 8;
+    if (boxSize == 1) {
+        if (size - *pos < 16) {
+            return false;
+        }
+        boxSize = readU64(p + 8);
+        header = 16;
+    } else if (boxSize == 0) {
+        boxSize = size - *pos;
+    }
+    if (boxSize < header || boxSize > size - *pos) {
+        return false;
+    }
+    box->type = readU32(p + 4);
+    box->data = p + header;
+    box->size = static_cast<size_t>(boxSize) - header;
+    *pos += static_cast<size_t>(boxSize);
+    return true;
+}
+
+bool findBox(const uint8_t* data, size_t size, uint32_t type, Box* box) {
+    size_t pos = 0;
+    while (nextBox(data, size, &pos, box)) {
+        if (box->type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Full boxes start with a version byte and 24 bits of flags
+bool findFullBox(const uint8_t* data, size_t size, uint32_t type, Box* box, uint8_t* version) {
+    if (!findBox(data, size, type, box) || box->size < 4) {
+        return false;
+    }
+    *version = box->data[0];
+    box->data += 4;
+    box->size -= 4;
+    return true;
+}
+
+int64_t ticksToUs(int64_t ticks, uint32_t timescale) {
+    return (ticks / timescale) * 1000000 + (ticks % timescale) * 1000000 / timescale;
+}
+
+void appendStartCode(std::vector<uint8_t>* csd, const uint8_t* nal, size_t size) {
+    static const uint8_t kStartCode[] = { 0, 0, 0, 1 };
+    csd->insert(csd->end(), kStartCode, kStartCode + sizeof(kStartCode));
+    csd->insert(csd->end(), nal, nal + size);
+}
+
+// avcC: SPS go to csd-0 and PPS to csd-1, each with a start code
+bool parseAvcC(const uint8_t* p, size_t size, Mp4TrackInfo* info) {
+    if (size < 7) {
+        return false;
+    }
+    info->nalLengthSize = (p[4] & 3) + 1;
+    size_t pos = 5;
+    for (int32_t list = 0; list < 2; ++list) {
+        if (pos >= size) {
+            return false;
+        }
+        int32_t count = list == 0 ? p[pos] & 0x1f : p[pos];
+        pos++;
+        for (int32_t i = 0; i < count; ++i) {
+            if (size - pos < 2 || size - pos - 2 < readU16(p + pos)) {
+                return false;
+            }
+            size_t nalSize = readU16(p + pos);
+            appendStartCode(list == 0 ? &info->format.csd0 : &info->format.csd1, p + pos + 2, nalSize);
+            pos += 2 + nalSize;
+        }
+    }
+    return true;
+}
+
+// hvcC: VPS, SPS and PPS all go to csd-0
+bool parseHvcC(const uint8_t* p, size_t size, Mp4TrackInfo* info) {
+    if (size < 23) {
+        return false;
+    }
+    info->nalLengthSize = (p[21] & 3) + 1;
+    int32_t arrays = p[22];
+    size_t pos = 23;
+    for (int32_t a = 0; a < arrays; ++a) {
+        if (size - pos < 3) {
+            return false;
+        }
+        int32_t count = readU16(p + pos + 1);
+        pos += 3;
+        for (int32_t i = 0; i < count; ++i) {
+            if (size - pos < 2 || size - pos - 2 < readU16(p + pos)) {
+                return false;
+            }
+            size_t nalSize = readU16(p + pos);
+            appendStartCode(&info->format.csd0, p + pos + 2, nalSize);
+            pos += 2 + nalSize;
+        }
+    }
+    return true;
+}
+
+// Expandable descriptor length in esds
+bool readDescriptorLength(const uint8_t* p, size_t size, size_t* pos, size_t* length) {
+    *length = 0;
+    for (int32_t i = 0; i < 4; ++i) {
+        if (*pos >= size) {
+            return false;
+        }
+        uint8_t byte = p[(*pos)++];
+        *length = (*length << 7) | (byte & 0x7f);
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return true;
+}
+
+// esds: the AudioSpecificConfig in the decoder specific info becomes csd-0
+bool parseEsds(const uint8_t* p, size_t size, Mp4TrackInfo* info) {
+    size_t pos = 0;
+    size_t length;
+    if (pos >= size || p[pos++] != 0x03 || !readDescriptorLength(p, size, &pos, &length) || size - pos < 3) {
+        return false;
+    }
+    uint8_t esFlags = p[pos + 2];
+    pos += 3;
+    if (esFlags & 0x80) pos += 2;
+    if ((esFlags & 0x40) && pos < size) pos += 1 + p[pos];
+    if (esFlags & 0x20) pos += 2;
+    if (pos >= size || p[pos++] != 0x04 || !readDescriptorLength(p, size, &pos, &length) || size - pos < 13) {
+        return false;
+    }
+    info->format.bitRate = static_cast<int32_t>(readU32(p + pos + 9));
+    pos += 13;
+    if (pos >= size || p[pos++] != 0x05 || !readDescriptorLength(p, size, &pos, &length) || size - pos < length) {
+        return false;
+    }
+    info->format.csd0.assign(p + pos, p + pos + length);
+    return true;
+}
+
+bool parseSampleEntry(const uint8_t* stsd, size_t size, bool video, Mp4TrackInfo* info) {
+    size_t pos = 4;  // entry_count
+    Box entry;
+    if (size < 4 || !nextBox(stsd, size, &pos, &entry)) {
+        return false;
+    }
+
+    size_t childrenOffset;
+    if (video) {
+        if (entry.size < 78) {
+            return false;
+        }
+        info->format.width = readU16(entry.data + 24);
+        info->format.height = readU16(entry.data + 26);
+        childrenOffset = 78;
+    } else {
+        if (entry.size < 28) {
+            return false;
+        }
+        // QuickTime sound description versions 1 and 2 carry extra fields
+        uint16_t version = readU16(entry.data + 8);
+        info->format.channelCount = readU16(entry.data + 16);
+        info->format.sampleRate = static_cast<int32_t>(readU32(entry.data + 24) >> 16);
+        childrenOffset = version == 1 ? 44 : (version == 2 ? 64 : 28);
+        if (entry.size < childrenOffset) {
+            return false;
+        }
+        if (version == 2) {
+            // Rate as a 64-bit float, then a 32-bit channel count
+            uint64_t bits = (static_cast<uint64_t>(readU32(entry.data + 32)) << 32) | readU32(entry.data + 36);
+            double rate;
+            memcpy(&rate, &bits, sizeof(rate));
+            info->format.sampleRate = static_cast<int32_t>(rate);
+            info->format.channelCount = static_cast<int32_t>(readU32(entry.data + 40));
+        }
+    }
+
+    const uint8_t* children = entry.data + childrenOffset;
+    size_t childrenSize = entry.size - childrenOffset;
+    Box config;
+    uint8_t version;
+    switch (entry.type) {
+        case fourcc("avc1"):
+        case fourcc("avc3"):
+            info->format.mime = "video/avc";
+            return findBox(children, childrenSize, fourcc("avcC"), &config) && parseAvcC(config.data, config.size, info);
+        case fourcc("hvc1"):
+        case fourcc("hev1"):
+            info->format.mime = "video/hevc";
+            return findBox(children, childrenSize, fourcc("hvcC"), &config) && parseHvcC(config.data, config.size, info);
+        case fourcc("vp09"):
+            info->format.mime = "video/x-vnd.on2.vp9";
+            return true;
+        case fourcc("av01"):
+            info->format.mime = "video/av01";
+            return true;
+        case fourcc("mp4a"):
+            info->format.mime = "audio/mp4a-latm";
+            return findFullBox(children, childrenSize, fourcc("esds"), &config, &version) &&
+                   parseEsds(config.data, config.size, info);
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+Mp4Demuxer::Mp4Demuxer() = default;
+
+Mp4Demuxer::~Mp4Demuxer() {
+    close();
+}
+
+bool Mp4Demuxer::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGE("Failed to open %s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        LOGE("Failed to stat %s", path);
+        ::close(fd);
+        return false;
+    }
+    // The mapping outlives the descriptor
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGE("Failed to map %s: %s", path, strerror(errno));
+        return false;
+    }
+    mData = static_cast<const uint8_t*>(mapping);
+    mSize = static_cast<size_t>(st.st_size);
+
+    Box moov;
+    Box mvhd;
+    uint8_t version;
+    if (!findBox(mData, mSize, fourcc("moov"), &moov) ||
+        !findFullBox(moov.data, moov.size, fourcc("mvhd"), &mvhd, &version) || mvhd.size < (version ? 20u : 12u)) {
+        LOGE("%s has no movie header", path);
+        close();
+        return false;
+    }
+    uint32_t movieTimescale = readU32(mvhd.data + (version ? 16 : 8));
+
+    size_t pos = 0;
+    Box trak;
+    while (nextBox(moov.data, moov.size, &pos, &trak)) {
+        if (trak.type == fourcc("trak") && !parseTrack(trak.data, trak.size, movieTimescale)) {
+            LOGW("Skipping a track of %s", path);
+        }
+    }
+    if (mTracks.empty()) {
+        LOGE("%s has no playable tracks", path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Mp4Demuxer::close() {
+    if (mData) {
+        munmap(const_cast<uint8_t*>(mData), mSize);
+        mData = nullptr;
+        mSize = 0;
+    }
+    mTracks.clear();
+}
+
+bool Mp4Demuxer::parseTrack(const uint8_t* trak, size_t size, uint32_t movieTimescale) {
+    Track track;
+    Mp4TrackInfo& info = track.info;
+    Box box;
+    uint8_t version;
+
+    if (findFullBox(trak, size, fourcc("tkhd"), &box, &version) && box.size >= (version ? 20u : 12u)) {
+        info.trackId = readU32(box.data + (version ? 16 : 8));
+    }
+    Box mdia;
+    if (!findBox(trak, size, fourcc("mdia"), &mdia)) {
+        return false;
+    }
+    Box hdlr;
+    if (!findFullBox(mdia.data, mdia.size, fourcc("hdlr"), &hdlr, &version) || hdlr.size < 8) {
+        return false;
+    }
+    uint32_t handler = readU32(hdlr.data + 4);
+    if (handler != fourcc("vide") && handler != fourcc("soun")) {
+        return true;  // Hint, text and metadata tracks are left out
+    }
+    if (!findFullBox(mdia.data, mdia.size, fourcc("mdhd"), &box, &version) || box.size < (version ? 28u : 16u)) {
+        return false;
+    }
+    info.timescale = readU32(box.data + (version ? 16 : 8));
+    uint64_t duration = version ? readU64(box.data + 20) : readU32(box.data + 12);
+    if (info.timescale == 0) {
+        return false;
+    }
+    info.format.durationUs = ticksToUs(static_cast<int64_t>(duration), info.timescale);
+
+    Box minf;
+    Box stbl;
+    if (!findBox(mdia.data, mdia.size, fourcc("minf"), &minf) || !findBox(minf.data, minf.size, fourcc("stbl"), &stbl)) {
+        return false;
+    }
+    const uint8_t* tables = stbl.data;
+    size_t tablesSize = stbl.size;
+    if (!findFullBox(tables, tablesSize, fourcc("stsd"), &box, &version) ||
+        !parseSampleEntry(box.data, box.size, handler == fourcc("vide"), &info)) {
+        return false;
+    }
+
+    // Sample sizes
+    Box stsz;
+    if (findFullBox(tables, tablesSize, fourcc("stsz"), &stsz, &version) && stsz.size >= 8) {
+        uint32_t fixedSize = readU32(stsz.data);
+        uint32_t count = readU32(stsz.data + 4);
+        if (fixedSize == 0 && (stsz.size - 8) / 4 < count) {
+            return false;
+        }
+        track.sizes.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            track.sizes[i] = fixedSize ? fixedSize : readU32(stsz.data + 8 + 4 * i);
+        }
+    } else if (findFullBox(tables, tablesSize, fourcc("stz2"), &stsz, &version) && stsz.size >= 8) {
+        uint32_t fieldSize = stsz.data[3];
+        uint32_t count = readU32(stsz.data + 4);
+        if ((fieldSize != 4 && fieldSize != 8 && fieldSize != 16) || (stsz.size - 8) * 8 / fieldSize < count) {
+            return false;
+        }
+        track.sizes.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint8_t* p = stsz.data + 8;
+            track.sizes[i] = fieldSize == 16 ? readU16(p + 2 * i)
+                           : fieldSize == 8 ? p[i]
+                           : (i & 1 ? p[i / 2] & 0x0f : p[i / 2] >> 4);
+        }
+    } else {
+        return false;
+    }
+    size_t count = track.sizes.size();
+    info.sampleCount = count;
+
+    // Chunk offsets, expanded through sample-to-chunk into per-sample offsets
+    Box stco;
+    Box stsc;
+    bool wideOffsets = false;
+    if (!findFullBox(tables, tablesSize, fourcc("stco"), &stco, &version)) {
+        if (!findFullBox(tables, tablesSize, fourcc("co64"), &stco, &version)) {
+            return false;
+        }
+        wideOffsets = true;
+    }
+    if (stco.size < 4 || !findFullBox(tables, tablesSize, fourcc("stsc"), &stsc, &version) || stsc.size < 4) {
+        return false;
+    }
+    uint32_t chunkCount = readU32(stco.data);
+    uint32_t runCount = readU32(stsc.data);
+    if ((stco.size - 4) / (wideOffsets ? 8 : 4) < chunkCount || (stsc.size - 4) / 12 < runCount) {
+        return false;
+    }
+    track.offsets.resize(count);
+    size_t sampleIndex = 0;
+    for (uint32_t run = 0; run < runCount && sampleIndex < count; ++run) {
+        const uint8_t* entry = stsc.data + 4 + 12 * run;
+        uint32_t firstChunk = readU32(entry);
+        uint32_t lastChunk = run + 1 < runCount ? readU32(entry + 12) : chunkCount + 1;
+        uint32_t samplesPerChunk = readU32(entry + 4);
+        if (firstChunk < 1 || lastChunk > chunkCount + 1) {
+            return false;
+        }
+        for (uint32_t chunk = firstChunk; chunk < lastChunk && sampleIndex < count; ++chunk) {
+            uint64_t offset = wideOffsets ? readU64(stco.data + 4 + 8 * (chunk - 1))
+                                          : readU32(stco.data + 4 + 4 * (chunk - 1));
+            for (uint32_t i = 0; i < samplesPerChunk && sampleIndex < count; ++i) {
+                track.offsets[sampleIndex] = offset;
+                offset += track.sizes[sampleIndex];
+                sampleIndex++;
+            }
+        }
+    }
+    if (sampleIndex != count) {
+        return false;
+    }
+    uint64_t largest = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (track.offsets[i] > mSize || track.sizes[i] > mSize - track.offsets[i]) {
+            LOGE("Track %u sample %zu lies outside the file", info.trackId, i);
+            return false;
+        }
+        largest = std::max<uint64_t>(largest, track.sizes[i]);
+    }
+    // Length prefixes shorter than the 4-byte start codes grow a sample by at most 4 / nalLengthSize
+    if (info.nalLengthSize > 0 && info.nalLengthSize < 4) {
+        largest = largest * 4 / info.nalLengthSize;
+    }
+    info.format.maxInputSize = static_cast<int32_t>(std::min<uint64_t>(largest, INT32_MAX));
+
+    // Decode times from stts, then the composition offsets from ctts
+    Box stts;
+    if (!findFullBox(tables, tablesSize, fourcc("stts"), &stts, &version) || stts.size < 4 ||
+        (stts.size - 4) / 8 < readU32(stts.data)) {
+        return false;
+    }
+    std::vector<int64_t> decodeTicks(count);
+    int64_t ticks = 0;
+    sampleIndex = 0;
+    for (uint32_t i = 0, entries = readU32(stts.data); i < entries && sampleIndex < count; ++i) {
+        uint32_t runLength = readU32(stts.data + 4 + 8 * i);
+        uint32_t delta = readU32(stts.data + 8 + 8 * i);
+        for (uint32_t j = 0; j < runLength && sampleIndex < count; ++j) {
+            decodeTicks[sampleIndex++] = ticks;
+            ticks += delta;
+        }
+    }
+    while (sampleIndex < count) {
+        decodeTicks[sampleIndex++] = ticks;
+    }
+    std::vector<int64_t> presentationTicks(decodeTicks);
+    Box ctts;
+    if (findFullBox(tables, tablesSize, fourcc("ctts"), &ctts, &version) && ctts.size >= 4 &&
+        (ctts.size - 4) / 8 >= readU32(ctts.data)) {
+        sampleIndex = 0;
+        for (uint32_t i = 0, entries = readU32(ctts.data); i < entries && sampleIndex < count; ++i) {
+            uint32_t runLength = readU32(ctts.data + 4 + 8 * i);
+            // Version 0 offsets are unsigned, but negative ones written as version 0 are common
+            int32_t offset = static_cast<int32_t>(readU32(ctts.data + 8 + 8 * i));
+            for (uint32_t j = 0; j < runLength && sampleIndex < count; ++j) {
+                presentationTicks[sampleIndex++] += offset;
+            }
+        }
+    }
+
+    // The first edit: an empty edit delays the track, a media time skips into it
+    int64_t shiftTicks = 0;
+    int64_t delayUs = 0;
+    Box edts;
+    Box elst;
+    if (findBox(trak, size, fourcc("edts"), &edts) &&
+        findFullBox(edts.data, edts.size, fourcc("elst"), &elst, &version) && elst.size >= 4) {
+        size_t entrySize = version ? 20 : 12;
+        uint32_t entries = readU32(elst.data);
+        for (uint32_t i = 0; i < entries && 4 + (i + 1) * entrySize <= elst.size; ++i) {
+            const uint8_t* entry = elst.data + 4 + i * entrySize;
+            int64_t segmentDuration = version ? static_cast<int64_t>(readU64(entry)) : readU32(entry);
+            int64_t mediaTime = version ? static_cast<int64_t>(readU64(entry + 8))
+                                        : static_cast<int32_t>(readU32(entry + 4));
+            if (mediaTime == -1) {
+                if (movieTimescale > 0) {
+                    delayUs += ticksToUs(segmentDuration, movieTimescale);
+                }
+                continue;
+            }
+            shiftTicks = mediaTime;
+            break;
+        }
+    }
+
+    track.decodeTimesUs.resize(count);
+    track.presentationTimesUs.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        track.decodeTimesUs[i] = ticksToUs(decodeTicks[i] - shiftTicks, info.timescale) + delayUs;
+        track.presentationTimesUs[i] = ticksToUs(presentationTicks[i] - shiftTicks, info.timescale) + delayUs;
+    }
+
+    // Sync samples; without stss every sample is one
+    track.keyframes.assign((count + 63) / 64, 0);
+    Box stss;
+    if (findFullBox(tables, tablesSize, fourcc("stss"), &stss, &version) && stss.size >= 4) {
+        uint32_t entries = readU32(stss.data);
+        for (uint32_t i = 0; i < entries && 4 + 4 * (i + 1) <= stss.size; ++i) {
+            uint32_t sample = readU32(stss.data + 4 + 4 * i);
+            if (sample >= 1 && sample <= count) {
+                track.keyframes[(sample - 1) / 64] |= 1ULL << ((sample - 1) % 64);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            track.keyframes[i / 64] |= 1ULL << (i % 64);
+        }
+    }
+
+    if (handler == fourcc("vide") && info.format.durationUs > 0) {
+        info.format.frameRate = static_cast<int32_t>((count * 1000000LL + info.format.durationUs / 2) /
+                                                     info.format.durationUs);
+    }
+    mTracks.push_back(std::move(track));
+    return true;
+}
+
+bool Mp4Demuxer::sample(size_t trackIndex, size_t index, Mp4SampleView* view) const {
+    if (trackIndex >= mTracks.size() || index >= mTracks[trackIndex].sizes.size()) {
+        return false;
+    }
+    const Track& track = mTracks[trackIndex];
+    view->data = mData + track.offsets[index];
+    view->size = track.sizes[index];
+    view->presentationTimeUs = track.presentationTimesUs[index];
+    view->decodeTimeUs = track.decodeTimesUs[index];
+    view->flags = (track.keyframes[index / 64] >> (index % 64)) & 1 ? SAMPLE_FLAG_SYNC : 0;
+    view->track = static_cast<int>(trackIndex);
+    return true;
+}
+
+bool Mp4Demuxer::selectTrack(size_t track) {
+    if (track >= mTracks.size()) {
+        return false;
+    }
+    mTracks[track].selected = true;
+    return true;
+}
+
+int Mp4Demuxer::nextTrack() const {
+    int best = -1;
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        const Track& track = mTracks[i];
+        if (!track.selected || track.cursor >= track.sizes.size()) {
+            continue;
+        }
+        if (best < 0) {
+            best = static_cast<int>(i);
+            continue;
+        }
+        const Track& current = mTracks[best];
+        int64_t time = track.decodeTimesUs[track.cursor];
+        int64_t bestTime = current.decodeTimesUs[current.cursor];
+        if (time < bestTime || (time == bestTime && track.offsets[track.cursor] < current.offsets[current.cursor])) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+bool Mp4Demuxer::peek(Mp4SampleView* view) const {
+    int track = nextTrack();
+    return track >= 0 && sample(track, mTracks[track].cursor, view);
+}
+
+bool Mp4Demuxer::next(Mp4SampleView* view) {
+    int track = nextTrack();
+    if (track < 0 || !sample(track, mTracks[track].cursor, view)) {
+        return false;
+    }
+    mTracks[track].cursor++;
+    return true;
+}
+
+void Mp4Demuxer::seekTo(int64_t timeUs) {
+    for (Track& track : mTracks) {
+        if (!track.selected) {
+            continue;
+        }
+        // Decode times never exceed presentation times, so no sample past
+        // this one can be presented at or before timeUs
+        size_t index = std::upper_bound(track.decodeTimesUs.begin(), track.decodeTimesUs.end(), timeUs) -
+                       track.decodeTimesUs.begin();
+        while (index > 0) {
+            index--;
+            if (((track.keyframes[index / 64] >> (index % 64)) & 1) && track.presentationTimesUs[index] <= timeUs) {
+                break;
+            }
+        }
+        track.cursor = index;
+    }
+}
+
+namespace {
+
+class Mp4SampleSource : public SampleSource {
+public:
+    bool open(const char* path) {
+        if (!mDemuxer.open(path)) {
+            return false;
+        }
+        mHasSample = mDemuxer.peek(&mSample);
+        return true;
+    }
+
+    int getTrackCount() override { return static_cast<int>(mDemuxer.trackCount()); }
+
+    bool getTrackFormat(int trackIndex, TrackFormat* format) override {
+        if (trackIndex < 0 || static_cast<size_t>(trackIndex) >= mDemuxer.trackCount()) {
+            return false;
+        }
+        *format = mDemuxer.trackInfo(trackIndex).format;
+        return true;
+    }
+
+    bool selectTrack(int trackIndex) override {
+        bool selected = trackIndex >= 0 && mDemuxer.selectTrack(trackIndex);
+        mHasSample = mDemuxer.peek(&mSample);
+        return selected;
+    }
+
+    ssize_t getSampleSize() override { return mHasSample ? static_cast<ssize_t>(annexBSize()) : -1; }
+    int64_t getSampleTime() override { return mHasSample ? mSample.presentationTimeUs : -1; }
+    uint32_t getSampleFlags() override { return mHasSample ? mSample.flags : 0; }
+    int getSampleTrackIndex() override { return mHasSample ? mSample.track : -1; }
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override {
+        if (!mHasSample) {
+            return -1;
+        }
+        int32_t lengthSize = mDemuxer.trackInfo(mSample.track).nalLengthSize;
+        if (lengthSize == 0) {
+            if (capacity < mSample.size) {
+                return -1;
+            }
+            memcpy(buffer, mSample.data, mSample.size);
+            return static_cast<ssize_t>(mSample.size);
+        }
+
+        // Each length prefix becomes a 4-byte start code
+        size_t in = 0;
+        size_t out = 0;
+        while (in + lengthSize <= mSample.size) {
+            size_t nalSize = 0;
+            for (int32_t i = 0; i < lengthSize; ++i) {
+                nalSize = (nalSize << 8) | mSample.data[in + i];
+            }
+            in += lengthSize;
+            if (nalSize > mSample.size - in || capacity - out < 4 + nalSize) {
+                return -1;
+            }
+            static const uint8_t kStartCode[] = { 0, 0, 0, 1 };
+            memcpy(buffer + out, kStartCode, sizeof(kStartCode));
+            memcpy(buffer + out + 4, mSample.data + in, nalSize);
+            in += nalSize;
+            out += 4 + nalSize;
+        }
+        return static_cast<ssize_t>(out);
+    }
+
+    bool advance() override {
+        if (!mHasSample) {
+            return false;
+        }
+        mDemuxer.next(&mSample);
+        mHasSample = mDemuxer.peek(&mSample);
+        return mHasSample;
+    }
+
+    bool seekTo(int64_t timeUs) override {
+        mDemuxer.seekTo(timeUs);
+        mHasSample = mDemuxer.peek(&mSample);
+        return true;
+    }
+
+private:
+    // Size after readSampleData's start code conversion
+    size_t annexBSize() const {
+        int32_t lengthSize = mDemuxer.trackInfo(mSample.track).nalLengthSize;
+        if (lengthSize == 0 || lengthSize == 4) {
+            return mSample.size;
+        }
+        size_t in = 0;
+        size_t out = 0;
+        while (in + lengthSize <= mSample.size) {
+            size_t nalSize = 0;
+            for (int32_t i = 0; i < lengthSize; ++i) {
+                nalSize = (nalSize << 8) | mSample.data[in + i];
+            }
+            in += lengthSize + nalSize;
+            out += 4 + nalSize;
+        }
+        return out;
+    }
+
+    Mp4Demuxer mDemuxer;
+    Mp4SampleView mSample;
+    bool mHasSample = false;
+};
+
+} // namespace
+
+std::unique_ptr<SampleSource> openMp4SampleSource(const char* path) {
+    std::unique_ptr<Mp4SampleSource> source(new Mp4SampleSource());
+    if (!source->open(path)) {
+        return nullptr;
+    }
+    return std::unique_ptr<SampleSource>(source.release());
+}
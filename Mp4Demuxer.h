@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CodecBackend.h"
+
+// One sample of an MP4 track, pointing straight into the mapped file. Video
+// samples keep their NAL length prefixes (see Mp4TrackInfo::nalLengthSize).
+struct Mp4SampleView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int64_t presentationTimeUs = 0;
+    int64_t decodeTimeUs = 0;
+    uint32_t flags = 0;  // SAMPLE_FLAG_SYNC
+    int track = -1;
+};
+
+struct Mp4TrackInfo {
+    TrackFormat format;
+    uint32_t trackId = 0;
+    uint32_t timescale = 0;
+    int32_t nalLengthSize = 0;  // From avcC / hvcC; 0 for other codecs
+    size_t sampleCount = 0;
+};
+
+// ISO-BMFF demuxer over a memory-mapped file. open() walks moov once and
+// flattens every track's sample tables (stts, ctts, stss, stsz, stsc,
+// stco / co64, first edit) into arrays of offset, size, timestamps and a
+// keyframe bit per sample; after that, reading a sample is an array lookup
+// and a pointer into the mapping. Fragmented files (moof) are not
+// supported.
+class Mp4Demuxer {
+public:
+    Mp4Demuxer();
+    ~Mp4Demuxer();
+
+    Mp4Demuxer(const Mp4Demuxer&) = delete;
+    Mp4Demuxer& operator=(const Mp4Demuxer&) = delete;
+
+    bool open(const char* path);
+    void close();
+
+    size_t trackCount() const { return mTracks.size(); }
+    const Mp4TrackInfo& trackInfo(size_t track) const { return mTracks[track].info; }
+
+    // Random access into one track's samples, in decode order
+    bool sample(size_t track, size_t index, Mp4SampleView* view) const;
+
+    // Sequential reading across the selected tracks in decode time order,
+    // like MediaExtractor. next() returns false after the last sample.
+    bool selectTrack(size_t track);
+    bool peek(Mp4SampleView* view) const;
+    bool next(Mp4SampleView* view);
+
+    // Moves every selected track to its last keyframe presented at or
+    // before timeUs, or to its first sample
+    void seekTo(int64_t timeUs);
+
+private:
+    struct Track {
+        Mp4TrackInfo info;
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> sizes;
+        std::vector<int64_t> decodeTimesUs;
+        std::vector<int64_t> presentationTimesUs;
+        std::vector<uint64_t> keyframes;  // One bit per sample
+        bool selected = false;
+        size_t cursor = 0;
+    };
+
+    bool parseTrack(const uint8_t* trak, size_t size, uint32_t movieTimescale);
+    int nextTrack() const;
+
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    std::vector<Track> mTracks;
+};
+
+// SampleSource over Mp4Demuxer. readSampleData converts 4-byte NAL length
+// prefixes to Annex-B start codes while copying, which is what
+// AMediaExtractor hands out for AVC and HEVC.
+std::unique_ptr<SampleSource> openMp4SampleSource(const char* path);
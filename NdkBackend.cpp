@@ -0,0 +1,428 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaFormat.h>
+#include <media/NdkMediaExtractor.h>
+#include <media/NdkMediaMuxer.h>
+#include <android/native_window.h>
+
+#include "CodecBackend.h"
+#include "Mp4Demuxer.h"
+#include "Log.h"
+
+extern "C" {
+int openOutputFile(const char* outputPath);
+size_t getFileSize(const char* filePath);
+}
+
+// Encoder keys by name; their AMEDIAFORMAT_KEY_ constants need newer API levels
+static const char* const kKeyBitrateMode = "bitrate-mode";
+static const char* const kKeyQuality = "quality";
+static const char* const kKeyMaxBFrames = "max-bframes";
+static const char* const kKeyProfile = "profile";
+static const char* const kKeyLevel = "level";
+static const char* const kKeyRequestSync = "request-sync";
+static const char* const kKeyRotation = "rotation-degrees";
+static const char* const kKeyColorStandard = "color-standard";
+static const char* const kKeyColorTransfer = "color-transfer";
+static const char* const kKeyColorRange = "color-range";
+static const char* const kKeyHdrStaticInfo = "hdr-static-info";
+static const char* const kKeyCsd2 = "csd-2";
+
+// Convert an NDK format into the backend-neutral form
+void fromMediaFormat(AMediaFormat* mediaFormat, TrackFormat* format) {
+    const char* mime = nullptr;
+    if (AMediaFormat_getString(mediaFormat, AMEDIAFORMAT_KEY_MIME, &mime)) {
+        format->mime = mime;
+    }
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_WIDTH, &format->width);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_HEIGHT, &format->height);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_BIT_RATE, &format->bitRate);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_FRAME_RATE, &format->frameRate);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_COLOR_FORMAT, &format->colorFormat);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_STRIDE, &format->stride);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_SLICE_HEIGHT, &format->sliceHeight);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_I_FRAME_INTERVAL, &format->iFrameInterval);
+    AMediaFormat_getInt32(mediaFormat, kKeyBitrateMode, &format->bitrateMode);
+    AMediaFormat_getInt32(mediaFormat, kKeyQuality, &format->quality);
+    AMediaFormat_getInt32(mediaFormat, kKeyMaxBFrames, &format->maxBFrames);
+    AMediaFormat_getInt32(mediaFormat, kKeyProfile, &format->profile);
+    AMediaFormat_getInt32(mediaFormat, kKeyLevel, &format->level);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_SAMPLE_RATE, &format->sampleRate);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_CHANNEL_COUNT, &format->channelCount);
+    AMediaFormat_getInt64(mediaFormat, AMEDIAFORMAT_KEY_DURATION, &format->durationUs);
+    AMediaFormat_getInt32(mediaFormat, AMEDIAFORMAT_KEY_MAX_INPUT_SIZE, &format->maxInputSize);
+    AMediaFormat_getInt32(mediaFormat, kKeyRotation, &format->rotationDegrees);
+    AMediaFormat_getInt32(mediaFormat, kKeyColorStandard, &format->colorStandard);
+    AMediaFormat_getInt32(mediaFormat, kKeyColorTransfer, &format->colorTransfer);
+    AMediaFormat_getInt32(mediaFormat, kKeyColorRange, &format->colorRange);
+
+    void* data = nullptr;
+    size_t size = 0;
+    if (AMediaFormat_getBuffer(mediaFormat, AMEDIAFORMAT_KEY_CSD_0, &data, &size)) {
+        format->csd0.assign(static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+    }
+    if (AMediaFormat_getBuffer(mediaFormat, AMEDIAFORMAT_KEY_CSD_1, &data, &size)) {
+        format->csd1.assign(static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+    }
+    if (AMediaFormat_getBuffer(mediaFormat, kKeyCsd2, &data, &size)) {
+        format->csd2.assign(static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+    }
+    if (AMediaFormat_getBuffer(mediaFormat, kKeyHdrStaticInfo, &data, &size)) {
+        format->hdrStaticInfo.assign(static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+    }
+}
+
+// Build an NDK format from the backend-neutral form; caller deletes it
+AMediaFormat* toMediaFormat(const TrackFormat& format) {
+    AMediaFormat* mediaFormat = AMediaFormat_new();
+    AMediaFormat_setString(mediaFormat, AMEDIAFORMAT_KEY_MIME, format.mime.c_str());
+    if (format.width > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_WIDTH, format.width);
+    if (format.height > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_HEIGHT, format.height);
+    if (format.bitRate > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_BIT_RATE, format.bitRate);
+    if (format.frameRate > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_FRAME_RATE, format.frameRate);
+    if (format.colorFormat > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_COLOR_FORMAT, format.colorFormat);
+    if (format.iFrameInterval > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_I_FRAME_INTERVAL, format.iFrameInterval);
+    if (format.bitrateMode >= 0) AMediaFormat_setInt32(mediaFormat, kKeyBitrateMode, format.bitrateMode);
+    if (format.quality > 0) AMediaFormat_setInt32(mediaFormat, kKeyQuality, format.quality);
+    if (format.maxBFrames > 0) AMediaFormat_setInt32(mediaFormat, kKeyMaxBFrames, format.maxBFrames);
+    if (format.profile > 0) AMediaFormat_setInt32(mediaFormat, kKeyProfile, format.profile);
+    if (format.level > 0) AMediaFormat_setInt32(mediaFormat, kKeyLevel, format.level);
+    if (format.sampleRate > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_SAMPLE_RATE, format.sampleRate);
+    if (format.channelCount > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_CHANNEL_COUNT, format.channelCount);
+    if (format.durationUs > 0) AMediaFormat_setInt64(mediaFormat, AMEDIAFORMAT_KEY_DURATION, format.durationUs);
+    if (format.maxInputSize > 0) AMediaFormat_setInt32(mediaFormat, AMEDIAFORMAT_KEY_MAX_INPUT_SIZE, format.maxInputSize);
+    if (format.rotationDegrees != 0) AMediaFormat_setInt32(mediaFormat, kKeyRotation, format.rotationDegrees);
+    if (format.colorStandard > 0) AMediaFormat_setInt32(mediaFormat, kKeyColorStandard, format.colorStandard);
+    if (format.colorTransfer > 0) AMediaFormat_setInt32(mediaFormat, kKeyColorTransfer, format.colorTransfer);
+    if (format.colorRange > 0) AMediaFormat_setInt32(mediaFormat, kKeyColorRange, format.colorRange);
+    if (!format.csd0.empty()) AMediaFormat_setBuffer(mediaFormat, AMEDIAFORMAT_KEY_CSD_0, format.csd0.data(), format.csd0.size());
+    if (!format.csd1.empty()) AMediaFormat_setBuffer(mediaFormat, AMEDIAFORMAT_KEY_CSD_1, format.csd1.data(), format.csd1.size());
+    if (!format.csd2.empty()) AMediaFormat_setBuffer(mediaFormat, kKeyCsd2, format.csd2.data(), format.csd2.size());
+    if (!format.hdrStaticInfo.empty()) {
+        AMediaFormat_setBuffer(mediaFormat, kKeyHdrStaticInfo, format.hdrStaticInfo.data(), format.hdrStaticInfo.size());
+    }
+    return mediaFormat;
+}
+
+namespace {
+
+class NdkSampleSource : public SampleSource {
+public:
+    NdkSampleSource(AMediaExtractor* extractor, int fd) : mExtractor(extractor), mFd(fd) {}
+
+    ~NdkSampleSource() override {
+        AMediaExtractor_delete(mExtractor);
+        close(mFd);
+    }
+
+    int getTrackCount() override {
+        return static_cast<int>(AMediaExtractor_getTrackCount(mExtractor));
+    }
+
+    bool getTrackFormat(int trackIndex, TrackFormat* format) override {
+        AMediaFormat* mediaFormat = AMediaExtractor_getTrackFormat(mExtractor, trackIndex);
+        if (!mediaFormat) {
+            return false;
+        }
+        fromMediaFormat(mediaFormat, format);
+        AMediaFormat_delete(mediaFormat);
+        return true;
+    }
+
+    bool selectTrack(int trackIndex) override {
+        return AMediaExtractor_selectTrack(mExtractor, trackIndex) == AMEDIA_OK;
+    }
+
+    ssize_t getSampleSize() override { return AMediaExtractor_getSampleSize(mExtractor); }
+    int64_t getSampleTime() override { return AMediaExtractor_getSampleTime(mExtractor); }
+    uint32_t getSampleFlags() override { return AMediaExtractor_getSampleFlags(mExtractor); }
+    int getSampleTrackIndex() override { return AMediaExtractor_getSampleTrackIndex(mExtractor); }
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override {
+        return AMediaExtractor_readSampleData(mExtractor, buffer, capacity);
+    }
+
+    bool advance() override { return AMediaExtractor_advance(mExtractor); }
+
+    bool seekTo(int64_t timeUs) override {
+        return AMediaExtractor_seekTo(mExtractor, timeUs, AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC) == AMEDIA_OK;
+    }
+
+private:
+    AMediaExtractor* mExtractor;
+    int mFd;
+};
+
+class NdkVideoCodec : public VideoCodec {
+public:
+    explicit NdkVideoCodec(AMediaCodec* codec) : mCodec(codec) {}
+
+    ~NdkVideoCodec() override {
+        AMediaCodec_delete(mCodec);
+        if (mInputSurface) {
+            ANativeWindow_release(mInputSurface);
+        }
+    }
+
+    bool configure(const TrackFormat& format, CodecSurface* surface, bool encoder) override {
+        // A surface from an earlier configuration is no longer fed by this codec
+        if (mInputSurface) {
+            ANativeWindow_release(mInputSurface);
+            mInputSurface = nullptr;
+        }
+        mEncoder = encoder;
+        AMediaFormat* mediaFormat = toMediaFormat(format);
+        media_status_t status = AMediaCodec_configure(mCodec, mediaFormat, reinterpret_cast<ANativeWindow*>(surface),
+                                                      nullptr, encoder ? AMEDIACODEC_CONFIGURE_FLAG_ENCODE : 0);
+        AMediaFormat_delete(mediaFormat);
+        return status == AMEDIA_OK;
+    }
+
+    CodecSurface* createInputSurface() override {
+#if __ANDROID_API__ >= 26
+        if (!mInputSurface && AMediaCodec_createInputSurface(mCodec, &mInputSurface) != AMEDIA_OK) {
+            LOGE("Failed to create encoder input surface");
+            mInputSurface = nullptr;
+        }
+        return reinterpret_cast<CodecSurface*>(mInputSurface);
+#else
+        // Input surfaces need API 26; the pipeline copies frames instead
+        return nullptr;
+#endif
+    }
+
+    bool setCallback(CodecCallback* callback) override {
+#if __ANDROID_API__ >= 28
+        AMediaCodecOnAsyncNotifyCallback callbacks = {
+            onAsyncInputAvailable, onAsyncOutputAvailable, onAsyncFormatChanged, onAsyncError,
+        };
+        mCallback = callback;
+        if (AMediaCodec_setAsyncNotifyCallback(mCodec, callbacks, this) != AMEDIA_OK) {
+            mCallback = nullptr;
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool start() override { return AMediaCodec_start(mCodec) == AMEDIA_OK; }
+    bool stop() override { return AMediaCodec_stop(mCodec) == AMEDIA_OK; }
+
+    bool flush() override {
+        if (AMediaCodec_flush(mCodec) != AMEDIA_OK) {
+            return false;
+        }
+        // In asynchronous mode a flushed codec hands out no input until restarted
+        if (mCallback && AMediaCodec_start(mCodec) != AMEDIA_OK) {
+            return false;
+        }
+#if __ANDROID_API__ >= 26
+        if (mEncoder) {
+            // Encoders keep their reference frames across a flush otherwise
+            AMediaFormat* params = AMediaFormat_new();
+            AMediaFormat_setInt32(params, kKeyRequestSync, 0);
+            AMediaCodec_setParameters(mCodec, params);
+            AMediaFormat_delete(params);
+        }
+#endif
+        return true;
+    }
+
+    ssize_t dequeueInputBuffer(int64_t timeoutUs) override {
+        return AMediaCodec_dequeueInputBuffer(mCodec, timeoutUs);
+    }
+
+    uint8_t* getInputBuffer(size_t index, size_t* capacity) override {
+        return AMediaCodec_getInputBuffer(mCodec, index, capacity);
+    }
+
+    bool queueInputBuffer(size_t index, size_t offset, size_t size, int64_t presentationTimeUs, uint32_t flags) override {
+        return AMediaCodec_queueInputBuffer(mCodec, index, offset, size, presentationTimeUs, flags) == AMEDIA_OK;
+    }
+
+    ssize_t dequeueOutputBuffer(CodecBufferInfo* info, int64_t timeoutUs) override {
+        AMediaCodecBufferInfo bufferInfo;
+        ssize_t index = AMediaCodec_dequeueOutputBuffer(mCodec, &bufferInfo, timeoutUs);
+        info->offset = bufferInfo.offset;
+        info->size = bufferInfo.size;
+        info->presentationTimeUs = bufferInfo.presentationTimeUs;
+        info->flags = bufferInfo.flags;
+        return index;
+    }
+
+    uint8_t* getOutputBuffer(size_t index, size_t* capacity) override {
+        return AMediaCodec_getOutputBuffer(mCodec, index, capacity);
+    }
+
+    bool releaseOutputBuffer(size_t index, bool render) override {
+        return AMediaCodec_releaseOutputBuffer(mCodec, index, render) == AMEDIA_OK;
+    }
+
+    bool getOutputFormat(TrackFormat* format) override {
+        AMediaFormat* mediaFormat = AMediaCodec_getOutputFormat(mCodec);
+        if (!mediaFormat) {
+            return false;
+        }
+        fromMediaFormat(mediaFormat, format);
+        AMediaFormat_delete(mediaFormat);
+        return true;
+    }
+
+    bool signalEndOfInputStream() override {
+#if __ANDROID_API__ >= 26
+        return AMediaCodec_signalEndOfInputStream(mCodec) == AMEDIA_OK;
+#else
+        return false;
+#endif
+    }
+
+private:
+#if __ANDROID_API__ >= 28
+    static void onAsyncInputAvailable(AMediaCodec* /* codec */, void* userdata, int32_t index) {
+        NdkVideoCodec* self = static_cast<NdkVideoCodec*>(userdata);
+        self->mCallback->onInputAvailable(self, index);
+    }
+
+    static void onAsyncOutputAvailable(AMediaCodec* /* codec */, void* userdata, int32_t index,
+                                       AMediaCodecBufferInfo* bufferInfo) {
+        NdkVideoCodec* self = static_cast<NdkVideoCodec*>(userdata);
+        CodecBufferInfo info = { bufferInfo->offset, bufferInfo->size, bufferInfo->presentationTimeUs,
+                                 bufferInfo->flags };
+        self->mCallback->onOutputAvailable(self, index, info);
+    }
+
+    // mediaFormat stays owned by the codec
+    static void onAsyncFormatChanged(AMediaCodec* /* codec */, void* userdata, AMediaFormat* mediaFormat) {
+        NdkVideoCodec* self = static_cast<NdkVideoCodec*>(userdata);
+        TrackFormat format;
+        fromMediaFormat(mediaFormat, &format);
+        self->mCallback->onFormatChanged(self, format);
+    }
+
+    static void onAsyncError(AMediaCodec* /* codec */, void* userdata, media_status_t error, int32_t actionCode,
+                             const char* detail) {
+        NdkVideoCodec* self = static_cast<NdkVideoCodec*>(userdata);
+        LOGE("Codec error %d (action %d): %s", error, actionCode, detail ? detail : "");
+        self->mCallback->onError(self, error, detail);
+    }
+#endif
+
+    AMediaCodec* mCodec;
+    ANativeWindow* mInputSurface = nullptr;
+    bool mEncoder = false;
+    CodecCallback* mCallback = nullptr;  // Asynchronous mode
+};
+
+class NdkSampleSink : public SampleSink {
+public:
+    NdkSampleSink(AMediaMuxer* muxer, int fd) : mMuxer(muxer), mFd(fd) {}
+
+    ~NdkSampleSink() override {
+        AMediaMuxer_delete(mMuxer);
+        close(mFd);
+    }
+
+    ssize_t addTrack(const TrackFormat& format) override {
+        AMediaFormat* mediaFormat = toMediaFormat(format);
+        ssize_t trackIndex = AMediaMuxer_addTrack(mMuxer, mediaFormat);
+        AMediaFormat_delete(mediaFormat);
+        return trackIndex;
+    }
+
+    bool start() override { return AMediaMuxer_start(mMuxer) == AMEDIA_OK; }
+
+    bool writeSampleData(size_t trackIndex, const uint8_t* data, const CodecBufferInfo& info) override {
+        AMediaCodecBufferInfo bufferInfo = { info.offset, info.size, info.presentationTimeUs, info.flags };
+        return AMediaMuxer_writeSampleData(mMuxer, trackIndex, data, &bufferInfo) == AMEDIA_OK;
+    }
+
+    bool stop() override { return AMediaMuxer_stop(mMuxer) == AMEDIA_OK; }
+
+private:
+    AMediaMuxer* mMuxer;
+    int mFd;
+};
+
+class NdkBackend : public CodecBackend {
+public:
+    explicit NdkBackend(bool useMp4Demuxer) : mUseMp4Demuxer(useMp4Demuxer) {}
+
+    const char* name() const override { return "ndk"; }
+
+    std::unique_ptr<SampleSource> openSource(const char* inputPath) override {
+        if (mUseMp4Demuxer) {
+            std::unique_ptr<SampleSource> source = openMp4SampleSource(inputPath);
+            if (source) {
+                return source;
+            }
+            LOGW("Falling back to AMediaExtractor for %s", inputPath);
+        }
+
+        // Open input file and get file descriptor
+        int inputFd = open(inputPath, O_RDONLY);
+        if (inputFd < 0) {
+            LOGE("Failed to open input file: %s", strerror(errno));
+            return nullptr;
+        }
+
+        // Initialize MediaExtractor from FD
+        AMediaExtractor* extractor = AMediaExtractor_new();
+        media_status_t status = AMediaExtractor_setDataSourceFd(extractor, inputFd, 0, getFileSize(inputPath));
+        if (status != AMEDIA_OK) {
+            LOGE("Failed to set data source for %s", inputPath);
+            AMediaExtractor_delete(extractor);
+            close(inputFd);
+            return nullptr;
+        }
+        return std::unique_ptr<SampleSource>(new NdkSampleSource(extractor, inputFd));
+    }
+
+    std::unique_ptr<VideoCodec> createDecoder(const char* mime) override {
+        AMediaCodec* codec = AMediaCodec_createDecoderByType(mime);
+        if (!codec) {
+            LOGE("Failed to create decoder for %s", mime);
+            return nullptr;
+        }
+        return std::unique_ptr<VideoCodec>(new NdkVideoCodec(codec));
+    }
+
+    std::unique_ptr<VideoCodec> createEncoder(const char* mime) override {
+        AMediaCodec* codec = AMediaCodec_createEncoderByType(mime);
+        if (!codec) {
+            LOGE("Failed to create encoder for %s", mime);
+            return nullptr;
+        }
+        return std::unique_ptr<VideoCodec>(new NdkVideoCodec(codec));
+    }
+
+    std::unique_ptr<SampleSink> openSink(const char* outputPath) override {
+        // Open output file and get file descriptor
+        int outputFd = openOutputFile(outputPath);
+        if (outputFd < 0) {
+            return nullptr;
+        }
+
+        // Initialize MediaMuxer from FD for output MP4 file
+        AMediaMuxer* muxer = AMediaMuxer_newFromFd(outputFd, AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4);
+        if (!muxer) {
+            LOGE("Failed to create muxer");
+            close(outputFd);
+            return nullptr;
+        }
+        return std::unique_ptr<SampleSink>(new NdkSampleSink(muxer, outputFd));
+    }
+
+private:
+    bool mUseMp4Demuxer;
+};
+
+} // namespace
+
+std::unique_ptr<CodecBackend> createNdkBackend(bool useMp4Demuxer) {
+    return std::unique_ptr<CodecBackend>(new NdkBackend(useMp4Demuxer));
+}
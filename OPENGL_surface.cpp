@@ -1,14 +1,23 @@
 #include <jni.h>
 #include <android/log.h>
+#include <android/native_window.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <media/NdkMediaCodec.h>
 #include <media/NdkMediaFormat.h>
 #include <media/NdkMediaExtractor.h>
 #include <media/NdkMediaMuxer.h>
+#include <media/NdkImageReader.h>
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "CodecBackend.h"
+#include "EncodeProfile.h"
 
 extern "C" {
 
@@ -30,196 +39,521 @@ Java_com_example_mediaprocessing_MediaCodecHelper_nativeDecodeAndEncodeVideo(JNI
     env->ReleaseStringUTFChars(outputPath_, outputPath);
 }
 
-void decodeAndEncodeVideo(const char* inputPath, const char* outputPath) {
-    AMediaExtractor *extractor = nullptr;
-    AMediaCodec *decoder = nullptr;
-    AMediaCodec *encoder = nullptr;
+#if __ANDROID_API__ >= 26
+// Zero-copy GL transcode. The decoder renders into an AImageReader, each
+// image's AHardwareBuffer is bound as an external texture and drawn into the
+// encoder's input surface, so decoded pixels are never mapped for the CPU.
+// Shader work on the frame (scaling, overlays, color) belongs in the
+// fragment shader below.
+
+static const int32_t kColorFormatSurface = 0x7F000789;  // COLOR_FormatSurface
+static const int32_t kMaxReaderImages = 4;
+static const int64_t kTimeoutUs = 10000;
+static const int64_t kEndOfStreamTimeoutUs = 500000;  // Wait for rendered frames to reach the reader
+
+static const char* kVertexShader =
+    "attribute vec4 aPosition;\n"
+    "attribute vec2 aTexCoord;\n"
+    "varying vec2 vTexCoord;\n"
+    "void main() {\n"
+    "    gl_Position = aPosition;\n"
+    "    vTexCoord = aTexCoord;\n"
+    "}\n";
+
+static const char* kFragmentShader =
+    "#extension GL_OES_EGL_image_external : require\n"
+    "precision mediump float;\n"
+    "uniform samplerExternalOES uTexture;\n"
+    "varying vec2 vTexCoord;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(uTexture, vTexCoord);\n"
+    "}\n";
+
+// Full-screen quad as x, y, s, t. Image row 0 is the top of the frame.
+static const GLfloat kQuad[] = {
+    -1.0f, -1.0f, 0.0f, 1.0f,
+     1.0f, -1.0f, 1.0f, 1.0f,
+    -1.0f,  1.0f, 0.0f, 0.0f,
+     1.0f,  1.0f, 1.0f, 0.0f,
+};
+
+// EGL context drawing into the encoder input surface
+struct GlStage {
     EGLDisplay display = EGL_NO_DISPLAY;
     EGLSurface surface = EGL_NO_SURFACE;
     EGLContext context = EGL_NO_CONTEXT;
+    GLuint program = 0;
+    GLuint texture = 0;
+    GLint positionLocation = -1;
+    GLint texCoordLocation = -1;
 
-    // Initialize EGL
-    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    EGLBoolean initialized = eglInitialize(display, NULL, NULL);
-    if (initialized != EGL_TRUE) {
+    // Extension entry points
+    PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC getNativeClientBuffer = nullptr;
+    PFNEGLCREATEIMAGEKHRPROC createImage = nullptr;
+    PFNEGLDESTROYIMAGEKHRPROC destroyImage = nullptr;
+    PFNEGLPRESENTATIONTIMEANDROIDPROC presentationTime = nullptr;
+    PFNEGLCREATESYNCKHRPROC createSync = nullptr;
+    PFNEGLDESTROYSYNCKHRPROC destroySync = nullptr;
+    PFNEGLDUPNATIVEFENCEFDANDROIDPROC dupNativeFence = nullptr;
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC imageTargetTexture = nullptr;
+};
+
+// Everything one transcode owns
+struct SurfaceTranscode {
+    int inputFd = -1;
+    int outputFd = -1;
+    AMediaExtractor *extractor = nullptr;
+    AMediaCodec *decoder = nullptr;
+    AMediaCodec *encoder = nullptr;
+    AMediaMuxer *muxer = nullptr;
+    AImageReader *reader = nullptr;
+    ANativeWindow *encoderWindow = nullptr;
+    GlStage gl;
+    ssize_t trackIndex = -1;
+    bool muxerStarted = false;
+};
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled != GL_TRUE) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Shader compile failed: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static bool initGlStage(GlStage* gl, ANativeWindow* window) {
+    gl->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (eglInitialize(gl->display, NULL, NULL) != EGL_TRUE) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to initialize EGL");
-        return;
+        gl->display = EGL_NO_DISPLAY;
+        return false;
     }
 
-    // Setup EGL context
+    // The encoder surface only accepts recordable configs
     EGLConfig config;
-    EGLint numConfigs;
+    EGLint numConfigs = 0;
     const EGLint attribs[] = {
         EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
         EGL_BLUE_SIZE, 8,
         EGL_GREEN_SIZE, 8,
         EGL_RED_SIZE, 8,
         EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RECORDABLE_ANDROID, EGL_TRUE,
         EGL_NONE
     };
-    eglChooseConfig(display, attribs, &config, 1, &numConfigs);
+    if (eglChooseConfig(gl->display, attribs, &config, 1, &numConfigs) != EGL_TRUE || numConfigs < 1) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "No recordable EGL config");
+        return false;
+    }
 
-    surface = eglCreateWindowSurface(display, config, nullptr, NULL);
+    gl->surface = eglCreateWindowSurface(gl->display, config, window, NULL);
     EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
-    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
-    eglMakeCurrent(display, surface, surface, context);
+    gl->context = eglCreateContext(gl->display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (gl->surface == EGL_NO_SURFACE || gl->context == EGL_NO_CONTEXT ||
+        eglMakeCurrent(gl->display, gl->surface, gl->surface, gl->context) != EGL_TRUE) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create EGL surface: 0x%x", eglGetError());
+        return false;
+    }
+
+    gl->getNativeClientBuffer = reinterpret_cast<PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC>(
+            eglGetProcAddress("eglGetNativeClientBufferANDROID"));
+    gl->createImage = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(eglGetProcAddress("eglCreateImageKHR"));
+    gl->destroyImage = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(eglGetProcAddress("eglDestroyImageKHR"));
+    gl->presentationTime = reinterpret_cast<PFNEGLPRESENTATIONTIMEANDROIDPROC>(
+            eglGetProcAddress("eglPresentationTimeANDROID"));
+    gl->createSync = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(eglGetProcAddress("eglCreateSyncKHR"));
+    gl->destroySync = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(eglGetProcAddress("eglDestroySyncKHR"));
+    gl->dupNativeFence = reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(
+            eglGetProcAddress("eglDupNativeFenceFDANDROID"));
+    gl->imageTargetTexture = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(
+            eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+    if (!gl->getNativeClientBuffer || !gl->createImage || !gl->destroyImage ||
+        !gl->presentationTime || !gl->imageTargetTexture) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Missing EGL image extensions");
+        return false;
+    }
 
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, kVertexShader);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, kFragmentShader);
+    if (!vertexShader || !fragmentShader) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+    gl->program = glCreateProgram();
+    glAttachShader(gl->program, vertexShader);
+    glAttachShader(gl->program, fragmentShader);
+    glLinkProgram(gl->program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(gl->program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to link GL program");
+        return false;
+    }
+    gl->positionLocation = glGetAttribLocation(gl->program, "aPosition");
+    gl->texCoordLocation = glGetAttribLocation(gl->program, "aTexCoord");
+
+    // Program state does not change between frames, so set it once
+    glUseProgram(gl->program);
+    glUniform1i(glGetUniformLocation(gl->program, "uTexture"), 0);
+    glVertexAttribPointer(gl->positionLocation, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), kQuad);
+    glVertexAttribPointer(gl->texCoordLocation, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), kQuad + 2);
+    glEnableVertexAttribArray(gl->positionLocation);
+    glEnableVertexAttribArray(gl->texCoordLocation);
+
+    glGenTextures(1, &gl->texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, gl->texture);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    return true;
+}
+
+static void releaseGlStage(GlStage* gl) {
+    if (gl->display == EGL_NO_DISPLAY) {
+        return;
+    }
+    if (gl->context != EGL_NO_CONTEXT) {
+        if (gl->texture) {
+            glDeleteTextures(1, &gl->texture);
+        }
+        if (gl->program) {
+            glDeleteProgram(gl->program);
+        }
+    }
+    eglMakeCurrent(gl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (gl->surface != EGL_NO_SURFACE) {
+        eglDestroySurface(gl->display, gl->surface);
+    }
+    if (gl->context != EGL_NO_CONTEXT) {
+        eglDestroyContext(gl->display, gl->context);
+    }
+    eglTerminate(gl->display);
+    *gl = GlStage();
+}
+
+// Draws one decoded image into the encoder surface and submits it. The image
+// goes back to the reader once the GPU has finished sampling it.
+static bool renderImage(GlStage* gl, AImage* image) {
+    int64_t timestampNs = 0;
+    AHardwareBuffer *hardwareBuffer = nullptr;
+    AImage_getTimestamp(image, &timestampNs);
+    if (AImage_getHardwareBuffer(image, &hardwareBuffer) != AMEDIA_OK || !hardwareBuffer) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Decoded image has no hardware buffer");
+        AImage_delete(image);
+        return false;
+    }
+
+    const EGLint imageAttribs[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+    EGLImageKHR eglImage = gl->createImage(gl->display, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+                                           gl->getNativeClientBuffer(hardwareBuffer), imageAttribs);
+    if (eglImage == EGL_NO_IMAGE_KHR) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create EGL image: 0x%x", eglGetError());
+        AImage_delete(image);
+        return false;
+    }
+
+    gl->imageTargetTexture(GL_TEXTURE_EXTERNAL_OES, static_cast<GLeglImageOES>(eglImage));
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // Hand the image back behind a fence instead of stalling on glFinish
+    int fenceFd = -1;
+    if (gl->createSync && gl->dupNativeFence) {
+        EGLSyncKHR sync = gl->createSync(gl->display, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+        if (sync != EGL_NO_SYNC_KHR) {
+            glFlush();
+            fenceFd = gl->dupNativeFence(gl->display, sync);
+            gl->destroySync(gl->display, sync);
+        }
+    }
+    if (fenceFd < 0) {
+        glFinish();
+    }
+
+    gl->presentationTime(gl->display, gl->surface, timestampNs);
+    bool swapped = eglSwapBuffers(gl->display, gl->surface) == EGL_TRUE;
+    gl->destroyImage(gl->display, eglImage);
+    AImage_deleteAsync(image, fenceFd);
+    if (!swapped) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "eglSwapBuffers failed: 0x%x", eglGetError());
+    }
+    return swapped;
+}
+
+// Writes every encoded sample that is ready to the muxer
+static bool drainEncoder(SurfaceTranscode* t, int64_t timeoutUs, bool* sawOutputEOS) {
+    AMediaCodecBufferInfo info;
+    while (true) {
+        ssize_t index = AMediaCodec_dequeueOutputBuffer(t->encoder, &info, timeoutUs);
+        if (index == AMEDIACODEC_INFO_TRY_AGAIN_LATER) {
+            return true;
+        }
+        if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            AMediaFormat *outputFormat = AMediaCodec_getOutputFormat(t->encoder);
+            t->trackIndex = AMediaMuxer_addTrack(t->muxer, outputFormat);
+            AMediaFormat_delete(outputFormat);
+            if (t->trackIndex < 0 || AMediaMuxer_start(t->muxer) != AMEDIA_OK) {
+                __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to start muxer");
+                return false;
+            }
+            t->muxerStarted = true;
+            continue;
+        }
+        if (index < 0) {
+            continue;
+        }
+
+        size_t capacity;
+        uint8_t *data = AMediaCodec_getOutputBuffer(t->encoder, index, &capacity);
+        // Codec config is carried by the output format, not as a sample
+        bool isConfig = (info.flags & AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG) != 0;
+        if (info.size > 0 && !isConfig && t->muxerStarted) {
+            AMediaMuxer_writeSampleData(t->muxer, t->trackIndex, data, &info);
+        }
+        AMediaCodec_releaseOutputBuffer(t->encoder, index, false);
+        if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+            *sawOutputEOS = true;
+            return true;
+        }
+        timeoutUs = 0;
+    }
+}
+
+static bool openSurfaceTranscode(SurfaceTranscode* t, const char* inputPath, const char* outputPath) {
     // Open input file and get file descriptor
-    int inputFd = open(inputPath, O_RDONLY);
-    if (inputFd < 0) {
+    t->inputFd = open(inputPath, O_RDONLY);
+    if (t->inputFd < 0) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to open input file: %s", strerror(errno));
-        return;
+        return false;
     }
 
     // Initialize MediaExtractor from FD
-    extractor = AMediaExtractor_new();
-    media_status_t status = AMediaExtractor_setDataSourceFd(extractor, inputFd, 0, getFileSize(inputPath));
-    if (status != AMEDIA_OK) {
+    t->extractor = AMediaExtractor_new();
+    if (AMediaExtractor_setDataSourceFd(t->extractor, t->inputFd, 0, getFileSize(inputPath)) != AMEDIA_OK) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to set data source for %s", inputPath);
-        close(inputFd);
-        return;
+        return false;
     }
 
     // Get video track format from extractor
-    int trackCount = AMediaExtractor_getTrackCount(extractor);
+    int trackCount = AMediaExtractor_getTrackCount(t->extractor);
     AMediaFormat *trackFormat = nullptr;
-    int videoTrackIndex = -1;
-    for (int i = 0; i < trackCount; ++i) {
-        trackFormat = AMediaExtractor_getTrackFormat(extractor, i);
-        const char *mime;
-        if (AMediaFormat_getString(trackFormat, AMEDIAFORMAT_KEY_MIME, &mime) && !strncmp(mime, "video/", 6)) {
-            videoTrackIndex = i;
-            break;
+    const char *mime = nullptr;
+    for (int i = 0; i < trackCount && !trackFormat; ++i) {
+        AMediaFormat *format = AMediaExtractor_getTrackFormat(t->extractor, i);
+        if (AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime) && !strncmp(mime, "video/", 6)) {
+            AMediaExtractor_selectTrack(t->extractor, i);
+            trackFormat = format;
+        } else {
+            AMediaFormat_delete(format);
         }
     }
-
-    if (videoTrackIndex < 0) {
+    if (!trackFormat) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "No video track found");
-        close(inputFd);
-        AMediaExtractor_delete(extractor);
-        return;
+        return false;
+    }
+    TrackFormat sourceFormat;
+    fromMediaFormat(trackFormat, &sourceFormat);
+    int32_t width = sourceFormat.width > 0 ? sourceFormat.width : 1280;
+    int32_t height = sourceFormat.height > 0 ? sourceFormat.height : 720;
+
+    // Encoder takes its input from a surface instead of byte buffers; its
+    // settings follow the source (see EncodeProfile.h)
+    TrackFormat encodeFormat = resolveEncodeProfile(EncodeProfile(), sourceFormat);
+    encodeFormat.colorFormat = kColorFormatSurface;
+    t->encoder = AMediaCodec_createEncoderByType(encodeFormat.mime.c_str());
+    AMediaFormat *encoderFormat = toMediaFormat(encodeFormat);
+    bool encoderReady = t->encoder &&
+        AMediaCodec_configure(t->encoder, encoderFormat, nullptr, nullptr, AMEDIACODEC_CONFIGURE_FLAG_ENCODE) == AMEDIA_OK &&
+        AMediaCodec_createInputSurface(t->encoder, &t->encoderWindow) == AMEDIA_OK;
+    AMediaFormat_delete(encoderFormat);
+    if (!encoderReady) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create encoder input surface");
+        AMediaFormat_delete(trackFormat);
+        return false;
+    }
+
+    // GL draws into the encoder surface; the context stays current on this thread
+    if (!initGlStage(&t->gl, t->encoderWindow)) {
+        AMediaFormat_delete(trackFormat);
+        return false;
     }
 
-    AMediaExtractor_selectTrack(extractor, videoTrackIndex);
+    // Decoder renders into GPU-only images that GL samples directly
+    ANativeWindow *readerWindow = nullptr;
+    if (AImageReader_newWithUsage(width, height, AIMAGE_FORMAT_PRIVATE, AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE,
+                                  kMaxReaderImages, &t->reader) != AMEDIA_OK ||
+        AImageReader_getWindow(t->reader, &readerWindow) != AMEDIA_OK) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create image reader");
+        AMediaFormat_delete(trackFormat);
+        return false;
+    }
 
-    // Initialize MediaCodec decoder
-    decoder = AMediaCodec_createDecoderByType("video/avc");
-    if (!decoder) {
+    t->decoder = AMediaCodec_createDecoderByType(mime);
+    bool decoderReady = t->decoder &&
+        AMediaCodec_configure(t->decoder, trackFormat, readerWindow, nullptr, 0) == AMEDIA_OK;
+    AMediaFormat_delete(trackFormat);
+    if (!decoderReady) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create decoder");
-        close(inputFd);
-        AMediaExtractor_delete(extractor);
-        return;
+        return false;
     }
 
-    AMediaCodec_configure(decoder, trackFormat, nullptr, nullptr, 0);
-    AMediaCodec_start(decoder);
+    t->outputFd = openOutputFile(outputPath);
+    if (t->outputFd < 0) {
+        return false;
+    }
+    t->muxer = AMediaMuxer_newFromFd(t->outputFd, AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4);
 
-    // Initialize MediaCodec encoder
-    encoder = AMediaCodec_createEncoderByType("video/avc");
-    if (!encoder) {
-        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create encoder");
-        close(inputFd);
-        AMediaCodec_stop(decoder);
-        AMediaCodec_delete(decoder);
-        AMediaExtractor_delete(extractor);
-        return;
+    if (!t->muxer || AMediaCodec_start(t->encoder) != AMEDIA_OK || AMediaCodec_start(t->decoder) != AMEDIA_OK) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to start codecs");
+        return false;
     }
+    return true;
+}
 
-    AMediaFormat *encoderFormat = AMediaFormat_new();
-    AMediaFormat_setString(encoderFormat, AMEDIAFORMAT_KEY_MIME, "video/avc");
-    AMediaFormat_setInt32(encoderFormat, AMEDIAFORMAT_KEY_WIDTH, 1280);  // Specify your video width
-    AMediaFormat_setInt32(encoderFormat, AMEDIAFORMAT_KEY_HEIGHT, 720);  // Specify your video height
-    AMediaFormat_setInt32(encoderFormat, AMEDIAFORMAT_KEY_BIT_RATE, 2000000);  // Specify your video bit rate
-    AMediaFormat_setInt32(encoderFormat, AMEDIAFORMAT_KEY_FRAME_RATE, 30);  // Specify your video frame rate
+static void closeSurfaceTranscode(SurfaceTranscode* t) {
+    if (t->decoder) {
+        AMediaCodec_stop(t->decoder);
+        AMediaCodec_delete(t->decoder);
+    }
+    // The decoder has stopped producing into the reader
+    if (t->reader) {
+        AImageReader_delete(t->reader);
+    }
+    releaseGlStage(&t->gl);
+    if (t->encoder) {
+        AMediaCodec_stop(t->encoder);
+        AMediaCodec_delete(t->encoder);
+    }
+    if (t->encoderWindow) {
+        ANativeWindow_release(t->encoderWindow);
+    }
+    if (t->muxer) {
+        if (t->muxerStarted) {
+            AMediaMuxer_stop(t->muxer);
+        }
+        AMediaMuxer_delete(t->muxer);
+    }
+    if (t->extractor) {
+        AMediaExtractor_delete(t->extractor);
+    }
+    if (t->outputFd >= 0) {
+        close(t->outputFd);
+    }
+    if (t->inputFd >= 0) {
+        close(t->inputFd);
+    }
+}
 
-    AMediaCodec_configure(encoder, encoderFormat, nullptr, nullptr, AMEDIACODEC_CONFIGURE_FLAG_ENCODE);
-    AMediaCodec_start(encoder);
+void decodeAndEncodeVideo(const char* inputPath, const char* outputPath) {
+    SurfaceTranscode transcode;
+    SurfaceTranscode *t = &transcode;
+    if (!openSurfaceTranscode(t, inputPath, outputPath)) {
+        closeSurfaceTranscode(t);
+        return;
+    }
 
-    // Buffer info for MediaCodec operations
     AMediaCodecBufferInfo decoderBufferInfo;
-    AMediaCodecBufferInfo encoderBufferInfo;
     bool sawInputEOS = false;
+    bool sawDecoderEOS = false;
+    bool sentEncoderEOS = false;
     bool sawOutputEOS = false;
-
-    // Setup OpenGL ES rendering
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    int64_t framesRendered = 0;
+    int64_t framesDrawn = 0;
+    int64_t endOfStreamWaitUs = 0;
 
     while (!sawOutputEOS) {
         // Decode input frames
-        ssize_t decoderInputBufferIndex = AMediaCodec_dequeueInputBuffer(decoder, 10000);  // Timeout in microseconds
-        if (decoderInputBufferIndex >= 0) {
-            size_t bufferSize;
-            uint8_t *decoderInputBuffer = AMediaCodec_getInputBuffer(decoder, decoderInputBufferIndex, &bufferSize);
-            ssize_t sampleSize = AMediaExtractor_readSampleData(extractor, decoderInputBuffer, bufferSize);
-            if (sampleSize < 0) {
-                sampleSize = 0;
-                sawInputEOS = true;
+        if (!sawInputEOS) {
+            ssize_t decoderInputBufferIndex = AMediaCodec_dequeueInputBuffer(t->decoder, kTimeoutUs);
+            if (decoderInputBufferIndex >= 0) {
+                size_t bufferSize;
+                uint8_t *decoderInputBuffer = AMediaCodec_getInputBuffer(t->decoder, decoderInputBufferIndex, &bufferSize);
+                ssize_t sampleSize = AMediaExtractor_readSampleData(t->extractor, decoderInputBuffer, bufferSize);
+                if (sampleSize < 0) {
+                    sawInputEOS = true;
+                    AMediaCodec_queueInputBuffer(t->decoder, decoderInputBufferIndex, 0, 0, 0,
+                                                 AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+                } else {
+                    int64_t presentationTimeUs = AMediaExtractor_getSampleTime(t->extractor);
+                    uint32_t flags = (AMediaExtractor_getSampleFlags(t->extractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC)
+                                             ? AMEDIACODEC_BUFFER_FLAG_KEY_FRAME
+                                             : 0;
+                    AMediaCodec_queueInputBuffer(t->decoder, decoderInputBufferIndex, 0, sampleSize, presentationTimeUs,
+                                                 flags);
+                    AMediaExtractor_advance(t->extractor);
+                }
             }
-            int64_t presentationTimeUs = AMediaExtractor_getSampleTime(extractor);
-            uint32_t flags = AMediaExtractor_getSampleFlags(extractor);
-            AMediaCodec_queueInputBuffer(decoder, decoderInputBufferIndex, 0, sampleSize, presentationTimeUs, flags);
-            AMediaExtractor_advance(extractor);
         }
 
-        // Decode output frames
-        ssize_t decoderOutputBufferIndex = AMediaCodec_dequeueOutputBuffer(decoder, &decoderBufferInfo, 10000);
-        if (decoderOutputBufferIndex >= 0) {
-            // Render the decoded frame onto the OpenGL ES surface
-            glClear(GL_COLOR_BUFFER_BIT);
-            // Sample rendering of a red triangle (replace with actual rendering logic)
-            GLfloat vertices[] = {
-                -0.5f, -0.5f, 0.0f,
-                 0.5f, -0.5f, 0.0f,
-                 0.0f,  0.5f, 0.0f
-            };
-            // Compile shader, link program, etc. (OpenGL ES initialization steps)
-            // Draw frame logic
-            glDrawArrays(GL_TRIANGLES, 0, 3);
-            eglSwapBuffers(display, surface);
-
-            AMediaCodec_releaseOutputBuffer(decoder, decoderOutputBufferIndex, false);
-            if ((decoderBufferInfo.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0) {
-                sawOutputEOS = true;
+        // Render decoded frames into the image reader; the pixels stay on the GPU
+        if (!sawDecoderEOS) {
+            ssize_t decoderOutputBufferIndex = AMediaCodec_dequeueOutputBuffer(t->decoder, &decoderBufferInfo, 0);
+            if (decoderOutputBufferIndex >= 0) {
+                bool render = decoderBufferInfo.size > 0;
+                AMediaCodec_releaseOutputBuffer(t->decoder, decoderOutputBufferIndex, render);
+                if (render) {
+                    framesRendered++;
+                }
+                if ((decoderBufferInfo.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0) {
+                    sawDecoderEOS = true;
+                }
             }
-        } else if (decoderOutputBufferIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
-            AMediaFormat *newFormat = AMediaCodec_getOutputFormat(decoder);
-            // Do something with the new format (optional)
         }
 
-        // Encode frames from OpenGL ES surface
-        ssize_t encoderInputBufferIndex = AMediaCodec_dequeueInputBuffer(encoder, 10000);
-        if (encoderInputBufferIndex >= 0) {
-            // Read from OpenGL ES surface and encode here (not implemented in this snippet)
-            AMediaCodec_queueInputBuffer(encoder, encoderInputBufferIndex, 0, /* size */, /* presentationTimeUs */, /* flags */);
+        // Draw every frame that has reached the reader into the encoder surface
+        AImage *image = nullptr;
+        while (AImageReader_acquireNextImage(t->reader, &image) == AMEDIA_OK) {
+            renderImage(&t->gl, image);
+            framesDrawn++;
+            endOfStreamWaitUs = 0;
         }
 
-        // Encode output frames
-        ssize_t encoderOutputBufferIndex = AMediaCodec_dequeueOutputBuffer(encoder, &encoderBufferInfo, 10000);
-        if (encoderOutputBufferIndex >= 0) {
-            uint8_t *encoderOutputBuffer = AMediaCodec_getOutputBuffer(encoder, encoderOutputBufferIndex, nullptr);
-            AMediaCodec_releaseOutputBuffer(encoder, encoderOutputBufferIndex, false);
-            if ((encoderBufferInfo.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0) {
-                sawOutputEOS = true;
+        // End the encoder stream once the last rendered frame has been drawn
+        if (sawDecoderEOS && !sentEncoderEOS) {
+            if (framesDrawn >= framesRendered || endOfStreamWaitUs >= kEndOfStreamTimeoutUs) {
+                if (framesDrawn < framesRendered) {
+                    __android_log_print(ANDROID_LOG_WARN, "MediaCodec", "%lld rendered frames never reached GL",
+                                        static_cast<long long>(framesRendered - framesDrawn));
+                }
+                AMediaCodec_signalEndOfInputStream(t->encoder);
+                sentEncoderEOS = true;
+            } else {
+                usleep(1000);
+                endOfStreamWaitUs += 1000;
             }
-        } else if (encoderOutputBufferIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
-            AMediaFormat *newFormat = AMediaCodec_getOutputFormat(encoder);
-            // Do something with the new format (optional)
         }
-    }
 
-    // Clean up
-    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    eglDestroySurface(display, surface);
-    eglDestroyContext(display, context);
-    eglTerminate(display);
+        // Encode output frames
+        if (!drainEncoder(t, sentEncoderEOS ? kTimeoutUs : 0, &sawOutputEOS)) {
+            break;
+        }
+    }
 
-    close(inputFd);
-    AMediaCodec_stop(decoder);
-    AMediaCodec_delete(decoder);
-    AMediaCodec_stop(encoder);
-    AMediaCodec_delete(encoder);
-    AMediaExtractor_delete(extractor);
+    __android_log_print(ANDROID_LOG_INFO, "MediaCodec", "Surface transcode drew %lld of %lld frames",
+                        static_cast<long long>(framesDrawn), static_cast<long long>(framesRendered));
+    closeSurfaceTranscode(t);
+}
+#else
+// Input surfaces and GPU-only image readers need API 26
+void decodeAndEncodeVideo(const char* /* inputPath */, const char* /* outputPath */) {
+    __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Surface transcode needs API 26, built for %d",
+                        __ANDROID_API__);
 }
+#endif
 
 // Helper function to open output file and return file descriptor
 int openOutputFile(const char* outputPath) {
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+
+#include "PipelineTelemetry.h"
+
+namespace {
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Frames a codec may swallow without output before its queue times are dropped
+const size_t kMaxUnmatchedFrames = 4096;
+
+void updateMin(std::atomic<int64_t>* target, int64_t value) {
+    int64_t current = target->load(std::memory_order_relaxed);
+    while (value < current && !target->compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void updateMax(std::atomic<int64_t>* target, int64_t value) {
+    int64_t current = target->load(std::memory_order_relaxed);
+    while (value > current && !target->compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void appendf(std::string* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string* out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) {
+        out->append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+    }
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() {
+    for (std::atomic<int64_t>& count : mCounts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::indexOf(int64_t value) {
+    if (value < 2 * kHalfSubBuckets) {
+        return static_cast<int>(value);
+    }
+    int msb = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    int shift = msb - (kSubBucketBits - 1);
+    int subBucket = static_cast<int>(value >> shift);  // In [kHalfSubBuckets, 2 * kHalfSubBuckets)
+    return 2 * kHalfSubBuckets + (msb - kSubBucketBits) * kHalfSubBuckets + (subBucket - kHalfSubBuckets);
+}
+
+int64_t LatencyHistogram::valueAt(int index) {
+    if (index < 2 * kHalfSubBuckets) {
+        return index;
+    }
+    int offset = index - 2 * kHalfSubBuckets;
+    int msb = kSubBucketBits + offset / kHalfSubBuckets;
+    int shift = msb - (kSubBucketBits - 1);
+    int64_t lower = static_cast<int64_t>(kHalfSubBuckets + offset % kHalfSubBuckets) << shift;
+    return lower + (static_cast<int64_t>(1) << shift) / 2;
+}
+
+void LatencyHistogram::record(int64_t valueUs) {
+    int64_t value = valueUs < 0 ? 0 : std::min(valueUs, (static_cast<int64_t>(1) << kMaxValueBits) - 1);
+    mCounts[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(value, std::memory_order_relaxed);
+    updateMin(&mMin, value);
+    updateMax(&mMax, value);
+}
+
+int64_t LatencyHistogram::min() const {
+    int64_t value = mMin.load(std::memory_order_relaxed);
+    return value == INT64_MAX ? 0 : value;
+}
+
+double LatencyHistogram::mean() const {
+    int64_t total = count();
+    return total > 0 ? static_cast<double>(mSum.load(std::memory_order_relaxed)) / total : 0.0;
+}
+
+int64_t LatencyHistogram::percentile(double percentile) const {
+    int64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    int64_t rank = static_cast<int64_t>(percentile / 100.0 * total + 0.5);
+    rank = std::max<int64_t>(1, std::min(rank, total));
+    int64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += mCounts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::max(min(), std::min(valueAt(i), max()));
+        }
+    }
+    return max();
+}
+
+PipelineTelemetry::PipelineTelemetry() {
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        mCounters[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < GAUGE_COUNT; ++i) {
+        mGauges[i].store(0, std::memory_order_relaxed);
+        mGaugeMax[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void PipelineTelemetry::begin() {
+    int64_t unset = 0;
+    mBeginUs.compare_exchange_strong(unset, nowUs());
+    mEndUs.store(0);
+}
+
+void PipelineTelemetry::end() {
+    mEndUs.store(nowUs());
+}
+
+int64_t PipelineTelemetry::elapsedUs() const {
+    int64_t beginUs = mBeginUs.load();
+    if (beginUs == 0) {
+        return 0;
+    }
+    int64_t endUs = mEndUs.load();
+    return (endUs != 0 ? endUs : nowUs()) - beginUs;
+}
+
+void PipelineTelemetry::addGauge(PipelineGauge gauge, int64_t delta) {
+    int64_t value = mGauges[gauge].fetch_add(delta, std::memory_order_relaxed) + delta;
+    updateMax(&mGaugeMax[gauge], value);
+}
+
+void PipelineTelemetry::setGauge(PipelineGauge gauge, int64_t value) {
+    mGauges[gauge].store(value, std::memory_order_relaxed);
+    updateMax(&mGaugeMax[gauge], value);
+}
+
+PipelineTelemetry::CodecClock* PipelineTelemetry::clockFor(PipelineStage stage) {
+    return stage == STAGE_DECODE ? &mDecoderClock : stage == STAGE_ENCODE ? &mEncoderClock : nullptr;
+}
+
+void PipelineTelemetry::start(CodecClock* clock, int64_t presentationTimeUs, int64_t timeUs) {
+    std::lock_guard<std::mutex> lock(clock->mutex);
+    if (clock->queuedUs.size() >= kMaxUnmatchedFrames) {
+        clock->queuedUs.clear();
+    }
+    clock->queuedUs[presentationTimeUs] = timeUs;
+}
+
+bool PipelineTelemetry::finish(CodecClock* clock, PipelineStage stage, int64_t presentationTimeUs, int64_t timeUs) {
+    int64_t queuedUs;
+    {
+        std::lock_guard<std::mutex> lock(clock->mutex);
+        auto it = clock->queuedUs.find(presentationTimeUs);
+        if (it == clock->queuedUs.end()) {
+            return false;
+        }
+        queuedUs = it->second;
+        clock->queuedUs.erase(it);
+    }
+    mStages[stage].record(timeUs - queuedUs);
+    return true;
+}
+
+void PipelineTelemetry::queued(PipelineStage stage, int64_t presentationTimeUs) {
+    CodecClock* clock = clockFor(stage);
+    if (!clock) {
+        return;
+    }
+    int64_t timeUs = nowUs();
+    start(clock, presentationTimeUs, timeUs);
+    if (stage == STAGE_DECODE) {
+        start(&mFrameClock, presentationTimeUs, timeUs);
+    }
+    addGauge(stage == STAGE_DECODE ? GAUGE_DECODER_IN_FLIGHT : GAUGE_ENCODER_IN_FLIGHT, 1);
+}
+
+void PipelineTelemetry::produced(PipelineStage stage, int64_t presentationTimeUs) {
+    CodecClock* clock = clockFor(stage);
+    if (!clock) {
+        return;
+    }
+    int64_t timeUs = nowUs();
+    if (stage == STAGE_ENCODE) {
+        finish(&mFrameClock, STAGE_FRAME, presentationTimeUs, timeUs);
+    }
+    if (finish(clock, stage, presentationTimeUs, timeUs)) {
+        addGauge(stage == STAGE_DECODE ? GAUGE_DECODER_IN_FLIGHT : GAUGE_ENCODER_IN_FLIGHT, -1);
+    }
+}
+
+const char* PipelineTelemetry::stageName(PipelineStage stage) {
+    static const char* const kNames[STAGE_COUNT] = {
+        "extract", "decode", "copy", "process", "encode", "mux", "frame",
+    };
+    return kNames[stage];
+}
+
+const char* PipelineTelemetry::gaugeName(PipelineGauge gauge) {
+    static const char* const kNames[GAUGE_COUNT] = {
+        "decoder_in_flight", "encoder_in_flight", "pending_frames", "event_queue",
+    };
+    return kNames[gauge];
+}
+
+const char* PipelineTelemetry::counterName(PipelineCounter counter) {
+    static const char* const kNames[COUNTER_COUNT] = {
+        "samples_read", "bytes_read", "frames_decoded", "frames_encoded", "bytes_copied", "bytes_written",
+        "decoder_input_try_again", "decoder_output_try_again", "encoder_input_try_again",
+        "encoder_output_try_again",
+    };
+    return kNames[counter];
+}
+
+std::string PipelineTelemetry::toJson() const {
+    int64_t elapsed = elapsedUs();
+    double seconds = elapsed / 1e6;
+    auto perSecond = [seconds](int64_t value) { return seconds > 0 ? value / seconds : 0.0; };
+
+    std::string json;
+    appendf(&json, "{\"elapsed_us\":%" PRId64 ",\"frames_per_second\":%.2f,\"input_bytes_per_second\":%.0f,"
+            "\"output_bytes_per_second\":%.0f,\"counters\":{", elapsed,
+            perSecond(counter(COUNTER_FRAMES_ENCODED)), perSecond(counter(COUNTER_BYTES_READ)),
+            perSecond(counter(COUNTER_BYTES_WRITTEN)));
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        PipelineCounter id = static_cast<PipelineCounter>(i);
+        appendf(&json, "%s\"%s\":%" PRId64, i ? "," : "", counterName(id), counter(id));
+    }
+    json += "},\"gauges\":{";
+    for (int i = 0; i < GAUGE_COUNT; ++i) {
+        PipelineGauge id = static_cast<PipelineGauge>(i);
+        appendf(&json, "%s\"%s\":{\"current\":%" PRId64 ",\"max\":%" PRId64 "}", i ? "," : "", gaugeName(id),
+                gauge(id), gaugeMax(id));
+    }
+    json += "},\"stages\":{";
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        PipelineStage id = static_cast<PipelineStage>(i);
+        const LatencyHistogram& histogram = stage(id);
+        appendf(&json, "%s\"%s\":{\"count\":%" PRId64 ",\"min_us\":%" PRId64 ",\"mean_us\":%.1f,", i ? "," : "",
+                stageName(id), histogram.count(), histogram.min(), histogram.mean());
+        appendf(&json, "\"p50_us\":%" PRId64 ",\"p90_us\":%" PRId64 ",\"p99_us\":%" PRId64 ",\"max_us\":%" PRId64 "}",
+                histogram.percentile(50), histogram.percentile(90), histogram.percentile(99), histogram.max());
+    }
+    json += "}}";
+    return json;
+}
+
+StageTimer::StageTimer(PipelineTelemetry* telemetry, PipelineStage stage)
+    : mTelemetry(telemetry), mStage(stage), mStartUs(telemetry ? nowUs() : 0) {}
+
+StageTimer::~StageTimer() {
+    if (mTelemetry) {
+        mTelemetry->recordStage(mStage, nowUs() - mStartUs);
+    }
+}
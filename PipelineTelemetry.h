@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Latency histogram with HdrHistogram's log-linear layout: values below 64
+// are counted exactly, and above that every power of two is split into 32
+// linear sub-buckets, so a reported value is within about 3% of the
+// recorded one. Values are in microseconds, clamped to about 19 hours.
+// Recording is lock-free and safe from any thread.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t valueUs);
+
+    int64_t count() const { return mCount.load(std::memory_order_relaxed); }
+    int64_t min() const;
+    int64_t max() const { return mMax.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    // Value at or below which percentile (0-100) of the recorded values
+    // fall, or 0 when nothing was recorded
+    int64_t percentile(double percentile) const;
+
+private:
+    static const int kSubBucketBits = 6;
+    static const int kHalfSubBuckets = 1 << (kSubBucketBits - 1);
+    static const int kMaxValueBits = 36;
+    static const int kBucketCount = 2 * kHalfSubBuckets + (kMaxValueBits - kSubBucketBits) * kHalfSubBuckets;
+
+    static int indexOf(int64_t value);
+    static int64_t valueAt(int index);  // Middle of the bucket
+
+    std::atomic<int64_t> mCounts[kBucketCount];
+    std::atomic<int64_t> mCount{0};
+    std::atomic<int64_t> mSum{0};
+    std::atomic<int64_t> mMin{INT64_MAX};
+    std::atomic<int64_t> mMax{0};
+};
+
+// Per-frame latency of the pipeline stages (PipelineTelemetry::stage)
+enum PipelineStage {
+    STAGE_EXTRACT,  // Reading one sample from the extractor
+    STAGE_DECODE,   // Decoder input queued -> frame out, matched by presentation time
+    STAGE_COPY,     // Decoded frame copied, scaled and converted into the encoder input
+    STAGE_PROCESS,  // FrameProcessor
+    STAGE_ENCODE,   // Encoder input queued (or rendered to its surface) -> sample out
+    STAGE_MUX,      // Writing one encoded sample, with the passthrough samples it releases
+    STAGE_FRAME,    // Decoder input queued -> encoded sample out: the whole pipeline per frame
+    STAGE_COUNT,
+};
+
+// Buffers held at a point of the pipeline (PipelineTelemetry::gauge)
+enum PipelineGauge {
+    GAUGE_DECODER_IN_FLIGHT,  // Samples queued to the decoder and not yet out
+    GAUGE_ENCODER_IN_FLIGHT,  // Frames queued to the encoder and not yet out
+    GAUGE_PENDING_FRAMES,     // Decoded frames waiting for an encoder input buffer
+    GAUGE_EVENT_QUEUE,        // Codec notifications waiting for the event loop (asyncCodecs)
+    GAUGE_COUNT,
+};
+
+// Running totals (PipelineTelemetry::counter)
+enum PipelineCounter {
+    COUNTER_SAMPLES_READ,
+    COUNTER_BYTES_READ,
+    COUNTER_FRAMES_DECODED,
+    COUNTER_FRAMES_ENCODED,
+    COUNTER_BYTES_COPIED,
+    COUNTER_BYTES_WRITTEN,
+    COUNTER_DECODER_INPUT_TRY_AGAIN,  // Dequeue calls that returned CODEC_INFO_TRY_AGAIN_LATER
+    COUNTER_DECODER_OUTPUT_TRY_AGAIN,
+    COUNTER_ENCODER_INPUT_TRY_AGAIN,
+    COUNTER_ENCODER_OUTPUT_TRY_AGAIN,
+    COUNTER_COUNT,
+};
+
+// Live measurements of one transcode (TranscodeOptions::telemetry), or of
+// several when they share it; every call is thread safe, so it can be read
+// while the transcode runs. The pipeline stages record into it at a cost of
+// a clock read and a few relaxed atomics per frame and stage.
+class PipelineTelemetry {
+public:
+    PipelineTelemetry();
+
+    PipelineTelemetry(const PipelineTelemetry&) = delete;
+    PipelineTelemetry& operator=(const PipelineTelemetry&) = delete;
+
+    // Throughput is measured from the first begin() to the last end()
+    // (or now while running)
+    void begin();
+    void end();
+
+    void recordStage(PipelineStage stage, int64_t latencyUs) { mStages[stage].record(latencyUs); }
+    void add(PipelineCounter counter, int64_t value = 1) {
+        mCounters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+    void addGauge(PipelineGauge gauge, int64_t delta);
+    void setGauge(PipelineGauge gauge, int64_t value);
+
+    // STAGE_DECODE and STAGE_ENCODE: call queued when a buffer goes into the
+    // codec and produced when the buffer with the same presentation time
+    // comes out; the codec's gauge follows along. STAGE_FRAME runs from the
+    // decoder's queued to the encoder's produced.
+    void queued(PipelineStage stage, int64_t presentationTimeUs);
+    void produced(PipelineStage stage, int64_t presentationTimeUs);
+
+    const LatencyHistogram& stage(PipelineStage stage) const { return mStages[stage]; }
+    int64_t counter(PipelineCounter counter) const { return mCounters[counter].load(std::memory_order_relaxed); }
+    int64_t gauge(PipelineGauge gauge) const { return mGauges[gauge].load(std::memory_order_relaxed); }
+    int64_t gaugeMax(PipelineGauge gauge) const { return mGaugeMax[gauge].load(std::memory_order_relaxed); }
+    int64_t elapsedUs() const;
+
+    // Every stage, gauge and counter, with frames and bytes per second
+    std::string toJson() const;
+
+    static const char* stageName(PipelineStage stage);
+    static const char* gaugeName(PipelineGauge gauge);
+    static const char* counterName(PipelineCounter counter);
+
+private:
+    // Queue times by presentation time for the codec latency stages
+    struct CodecClock {
+        std::mutex mutex;
+        std::unordered_map<int64_t, int64_t> queuedUs;
+    };
+
+    CodecClock* clockFor(PipelineStage stage);
+    void start(CodecClock* clock, int64_t presentationTimeUs, int64_t timeUs);
+    bool finish(CodecClock* clock, PipelineStage stage, int64_t presentationTimeUs, int64_t timeUs);
+
+    LatencyHistogram mStages[STAGE_COUNT];
+    std::atomic<int64_t> mCounters[COUNTER_COUNT];
+    std::atomic<int64_t> mGauges[GAUGE_COUNT];
+    std::atomic<int64_t> mGaugeMax[GAUGE_COUNT];
+    std::atomic<int64_t> mBeginUs{0};
+    std::atomic<int64_t> mEndUs{0};
+    CodecClock mDecoderClock;
+    CodecClock mEncoderClock;
+    CodecClock mFrameClock;
+};
+
+// Times a scope into one stage
+class StageTimer {
+public:
+    StageTimer(PipelineTelemetry* telemetry, PipelineStage stage);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    PipelineTelemetry* mTelemetry;
+    PipelineStage mStage;
+    int64_t mStartUs;
+};
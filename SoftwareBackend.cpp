@@ -0,0 +1,966 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SoftwareBackend.h"
+#include "YuvFrame.h"
+#include "Log.h"
+
+namespace {
+
+const uint32_t kSampleMagic = 0x31565753;  // "SWV1"
+const size_t kSampleHeaderSize = 24;
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Header at the start of every synthetic compressed sample
+struct SampleHeader {
+    uint32_t magic;
+    uint32_t frameIndex;
+    int64_t presentationTimeUs;
+    uint32_t checksum;
+    uint32_t flags;
+};
+static_assert(sizeof(SampleHeader) == kSampleHeaderSize, "unexpected SampleHeader size");
+
+size_t compressedSampleSize(const SoftwareBackendConfig& config, bool keyFrame) {
+    size_t size = config.frameRate > 0 ? config.bitRate / 8 / config.frameRate : 0;
+    if (keyFrame) {
+        size *= 4;
+    }
+    return std::max(size, kSampleHeaderSize);
+}
+
+// AAC LC AudioSpecificConfig for the synthetic audio track
+std::vector<uint8_t> audioSpecificConfig(int32_t sampleRate, int32_t channelCount) {
+    static const int32_t kRates[] = { 96000, 88200, 64000, 48000, 44100, 32000,
+                                      24000, 22050, 16000, 12000, 11025, 8000 };
+    uint32_t rateIndex = 0xf;
+    for (uint32_t i = 0; i < sizeof(kRates) / sizeof(kRates[0]); ++i) {
+        if (kRates[i] == sampleRate) {
+            rateIndex = i;
+        }
+    }
+    if (rateIndex == 0xf) {
+        // Explicit 24-bit rate after the escape index
+        uint64_t bits = (2ULL << 35) | (0xfULL << 31) | (static_cast<uint64_t>(sampleRate & 0xffffff) << 7) |
+                        (static_cast<uint64_t>(channelCount) << 3);
+        return { static_cast<uint8_t>(bits >> 32), static_cast<uint8_t>(bits >> 24), static_cast<uint8_t>(bits >> 16),
+                 static_cast<uint8_t>(bits >> 8), static_cast<uint8_t>(bits) };
+    }
+    uint32_t bits = (2 << 11) | (rateIndex << 7) | (channelCount << 3);
+    return { static_cast<uint8_t>(bits >> 8), static_cast<uint8_t>(bits) };
+}
+
+const int32_t kAudioFrameSamples = 1024;
+const int32_t kAudioChannels = 2;
+
+// Track 0 is video; track 1, when configured, is audio. Samples of the
+// selected tracks come out in time order, video first on a tie; with
+// bFrames, video samples are in decode order instead.
+class SoftwareSampleSource : public SampleSource {
+public:
+    explicit SoftwareSampleSource(const SoftwareBackendConfig& config, SoftwareBackendStats* stats)
+        : mConfig(config), mStats(stats) {
+        if (mConfig.bFrames > 0) {
+            buildDecodeOrder();
+        }
+        if (mConfig.audioSampleRate > 0) {
+            int64_t durationUs = sampleTime(mConfig.frameCount);
+            mAudioFrameCount = static_cast<int32_t>(
+                    (durationUs * mConfig.audioSampleRate / 1000000 + kAudioFrameSamples - 1) / kAudioFrameSamples);
+        }
+    }
+
+    int getTrackCount() override { return mConfig.audioSampleRate > 0 ? 2 : 1; }
+
+    bool getTrackFormat(int trackIndex, TrackFormat* format) override {
+        if (trackIndex == 1 && mConfig.audioSampleRate > 0) {
+            format->mime = "audio/mp4a-latm";
+            format->sampleRate = mConfig.audioSampleRate;
+            format->channelCount = kAudioChannels;
+            format->bitRate = mConfig.audioBitRate;
+            format->durationUs = audioTime(mAudioFrameCount);
+            format->csd0 = audioSpecificConfig(mConfig.audioSampleRate, kAudioChannels);
+            return true;
+        }
+        if (trackIndex != 0) {
+            return false;
+        }
+        format->mime = "video/avc";
+        format->width = mConfig.width;
+        format->height = mConfig.height;
+        format->frameRate = mConfig.frameRate;
+        format->bitRate = mConfig.bitRate;
+        format->durationUs = sampleTime(mConfig.frameCount);
+        return true;
+    }
+
+    bool selectTrack(int trackIndex) override {
+        if (trackIndex == 1 && mConfig.audioSampleRate > 0) {
+            mAudioSelected = true;
+            return true;
+        }
+        if (trackIndex == 0) {
+            mSelected = true;
+        }
+        return trackIndex == 0;
+    }
+
+    ssize_t getSampleSize() override {
+        if (audioIsNext()) {
+            return audioSampleSize();
+        }
+        if (!hasSample()) {
+            return -1;
+        }
+        return compressedSampleSize(mConfig, isSync());
+    }
+
+    int64_t getSampleTime() override {
+        if (audioIsNext()) {
+            return audioTime(mAudioIndex);
+        }
+        return hasSample() ? sampleTime(frame()) : -1;
+    }
+
+    uint32_t getSampleFlags() override {
+        if (audioIsNext()) {
+            return SAMPLE_FLAG_SYNC;
+        }
+        return hasSample() && isSync() ? SAMPLE_FLAG_SYNC : 0;
+    }
+
+    int getSampleTrackIndex() override {
+        if (audioIsNext()) {
+            return 1;
+        }
+        return hasSample() ? 0 : -1;
+    }
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override {
+        ssize_t size = getSampleSize();
+        if (size < 0 || static_cast<size_t>(size) > capacity) {
+            return -1;
+        }
+        if (audioIsNext()) {
+            memset(buffer, mAudioIndex & 0xff, size);
+            return size;
+        }
+        SampleHeader header = { kSampleMagic, static_cast<uint32_t>(frame()), sampleTime(frame()), 0, getSampleFlags() };
+        memcpy(buffer, &header, sizeof(header));
+        memset(buffer + sizeof(header), frame() & 0xff, size - sizeof(header));
+        mStats->samplesRead++;
+        return size;
+    }
+
+    bool advance() override {
+        if (audioIsNext()) {
+            mAudioIndex++;
+        } else if (hasSample()) {
+            mFrameIndex++;
+        } else {
+            return false;
+        }
+        return hasSample() || hasAudioSample();
+    }
+
+    bool seekTo(int64_t timeUs) override {
+        int32_t frame = 0;
+        if (mConfig.frameRate > 0 && timeUs > 0) {
+            frame = static_cast<int32_t>(std::min<int64_t>(timeUs * mConfig.frameRate / 1000000, mConfig.frameCount - 1));
+        }
+        if (mConfig.gopSize > 1) {
+            frame -= frame % mConfig.gopSize;
+        }
+        frame = std::max(frame, 0);
+        mFrameIndex = frame;
+        if (!mDecodeOrder.empty()) {
+            mFrameIndex = static_cast<int32_t>(std::find(mDecodeOrder.begin(), mDecodeOrder.end(), frame) -
+                                               mDecodeOrder.begin());
+        }
+        // Every audio frame is a sync sample
+        mAudioIndex = 0;
+        if (mConfig.audioSampleRate > 0 && timeUs > 0) {
+            mAudioIndex = static_cast<int32_t>(std::min<int64_t>(
+                    timeUs * mConfig.audioSampleRate / 1000000 / kAudioFrameSamples, mAudioFrameCount));
+        }
+        return mSelected || mAudioSelected;
+    }
+
+private:
+    bool hasSample() const { return mSelected && mFrameIndex < mConfig.frameCount; }
+    bool hasAudioSample() const { return mAudioSelected && mAudioIndex < mAudioFrameCount; }
+    bool isSync() const { return mConfig.gopSize <= 1 || frame() % mConfig.gopSize == 0; }
+
+    // Presentation index of the sample at decode position mFrameIndex
+    int32_t frame() const { return mDecodeOrder.empty() ? mFrameIndex : mDecodeOrder[mFrameIndex]; }
+
+    // Sync samples, every (bFrames + 1)th frame of a GOP and the last frame
+    // are references, as is a closed GOP's last frame. Each reference is
+    // stored before the frames presented since the previous one, so in an
+    // open GOP a sync sample's leading frames follow it.
+    void buildDecodeOrder() {
+        int32_t gopSize = mConfig.gopSize > 1 ? mConfig.gopSize : 1;
+        int32_t previous = -1;
+        for (int32_t frame = 0; frame < mConfig.frameCount; ++frame) {
+            int32_t offset = frame % gopSize;
+            bool reference = offset % (mConfig.bFrames + 1) == 0 || frame == mConfig.frameCount - 1 ||
+                             (!mConfig.openGop && offset == gopSize - 1);
+            if (!reference) {
+                continue;
+            }
+            mDecodeOrder.push_back(frame);
+            for (int32_t leading = previous + 1; leading < frame; ++leading) {
+                mDecodeOrder.push_back(leading);
+            }
+            previous = frame;
+        }
+    }
+
+    bool audioIsNext() const {
+        return hasAudioSample() && (!hasSample() || audioTime(mAudioIndex) < sampleTime(frame()));
+    }
+
+    ssize_t audioSampleSize() const {
+        return std::max<ssize_t>(static_cast<int64_t>(mConfig.audioBitRate) / 8 * kAudioFrameSamples /
+                                         mConfig.audioSampleRate, 1);
+    }
+
+    int64_t sampleTime(int32_t frameIndex) const {
+        return mConfig.frameRate > 0 ? static_cast<int64_t>(frameIndex) * 1000000 / mConfig.frameRate : 0;
+    }
+
+    int64_t audioTime(int32_t frameIndex) const {
+        return static_cast<int64_t>(frameIndex) * kAudioFrameSamples * 1000000 / mConfig.audioSampleRate;
+    }
+
+    SoftwareBackendConfig mConfig;
+    SoftwareBackendStats* mStats;
+    bool mSelected = false;
+    bool mAudioSelected = false;
+    int32_t mFrameIndex = 0;            // Decode position
+    std::vector<int32_t> mDecodeOrder;  // Presentation index per decode position, empty without bFrames
+    int32_t mAudioIndex = 0;
+    int32_t mAudioFrameCount = 0;
+};
+
+} // namespace
+
+// Software stand-in for an encoder input surface. A decoder configured with
+// it passes each rendered frame by reference; the frame's output buffer stays
+// busy until the encoder has consumed it and calls done.
+struct CodecSurface {
+    std::function<void(const uint8_t* data, const CodecBufferInfo& info, std::function<void()> done)> queueFrame;
+};
+
+namespace {
+
+// Buffer bookkeeping shared by the software decoder and encoder. Queued input
+// is processed as soon as an output buffer is free; each processed frame then
+// becomes visible to dequeueOutputBuffer only after the configured latency,
+// serialized as if a single codec core were doing the work. In asynchronous
+// mode a notification thread, like MediaCodec's looper, hands out free input
+// buffers and each output as soon as it is visible.
+class SoftwareCodec : public VideoCodec {
+public:
+    SoftwareCodec(const SoftwareBackendConfig& config, SoftwareBackendStats* stats, int64_t latencyUs)
+        : mConfig(config), mStats(stats), mLatencyUs(latencyUs) {}
+
+    ~SoftwareCodec() override { stopNotifier(); }
+
+    bool configure(const TrackFormat& format, CodecSurface* surface, bool encoder) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mStarted) {
+            return false;
+        }
+        mFormat = format;
+        mEncoder = encoder;
+        mOutputSurface = encoder ? nullptr : surface;
+        mSurfaceInput = false;
+        size_t depth = std::max(mConfig.queueDepth, 1);
+        // Frames held for reordering keep their output buffers on top of the queue
+        size_t outputDepth = depth + reorderDepth();
+        mInputBuffers.assign(depth, std::vector<uint8_t>(inputCapacity()));
+        mOutputBuffers.assign(outputDepth, std::vector<uint8_t>(outputCapacity()));
+        mOutputInfo.assign(outputDepth, CodecBufferInfo());
+        mConfigured = true;
+        return true;
+    }
+
+    CodecSurface* createInputSurface() override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mConfigured || !mEncoder || mStarted) {
+            return nullptr;
+        }
+        mSurfaceInput = true;
+        if (!mInputSurface) {
+            mInputSurface.reset(new CodecSurface());
+            mInputSurface->queueFrame = [this](const uint8_t* data, const CodecBufferInfo& info, std::function<void()> done) {
+                queueSurfaceFrame(data, info, std::move(done));
+            };
+        }
+        return mInputSurface.get();
+    }
+
+    bool setCallback(CodecCallback* callback) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mStarted) {
+            return false;
+        }
+        mCallback = callback;
+        return true;
+    }
+
+    bool start() override {
+        if (mConfig.codecStartLatencyUs > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(mConfig.codecStartLatencyUs));
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mConfigured || mStarted) {
+            return false;
+        }
+        resetBuffers();
+        mFormatPending = true;
+        mStarted = true;
+        mStats->codecsStarted++;
+        if (mCallback) {
+            mNotifier = std::thread(&SoftwareCodec::notifyLoop, this);
+        }
+        return true;
+    }
+
+    bool stop() override {
+        std::vector<std::function<void()>> completions;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStarted = false;
+            dropPending(&completions);
+            mCondition.notify_all();
+        }
+        stopNotifier();
+        runCompletions(completions);
+        return true;
+    }
+
+    bool flush() override {
+        std::vector<std::function<void()>> completions;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mStarted) {
+                return false;
+            }
+            dropPending(&completions);
+            resetBuffers();
+            mCondition.notify_all();
+        }
+        runCompletions(completions);
+        return true;
+    }
+
+    ssize_t dequeueInputBuffer(int64_t timeoutUs) override {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mCallback) {
+            return CODEC_INFO_TRY_AGAIN_LATER;
+        }
+        if (!waitFor(lock, timeoutUs, [this] { return !mFreeInputs.empty() || !mStarted; }) || !mStarted) {
+            return CODEC_INFO_TRY_AGAIN_LATER;
+        }
+        size_t index = mFreeInputs.front();
+        mFreeInputs.pop_front();
+        return index;
+    }
+
+    uint8_t* getInputBuffer(size_t index, size_t* capacity) override {
+        if (index >= mInputBuffers.size()) {
+            return nullptr;
+        }
+        if (capacity) {
+            *capacity = mInputBuffers[index].size();
+        }
+        return mInputBuffers[index].data();
+    }
+
+    bool queueInputBuffer(size_t index, size_t offset, size_t size, int64_t presentationTimeUs, uint32_t flags) override {
+        std::vector<std::function<void()>> completions;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mStarted || index >= mInputBuffers.size() || offset + size > mInputBuffers[index].size()) {
+                return false;
+            }
+            // Raw frames in encoder input buffers were necessarily copied there by the CPU
+            if (mEncoder) {
+                mStats->bytesCopied += size;
+            }
+            CodecBufferInfo info = { static_cast<int32_t>(offset), static_cast<int32_t>(size), presentationTimeUs, flags };
+            mPending.push_back({ static_cast<ssize_t>(index), info, nullptr, nullptr });
+            processPending(&completions);
+        }
+        runCompletions(completions);
+        return true;
+    }
+
+    ssize_t dequeueOutputBuffer(CodecBufferInfo* info, int64_t timeoutUs) override {
+        std::unique_lock<std::mutex> lock(mMutex);
+        int64_t deadlineUs = timeoutUs < 0 ? INT64_MAX : nowUs() + timeoutUs;
+        while (mStarted && !mCallback) {
+            int64_t wakeUs = deadlineUs;
+            if (!mReady.empty()) {
+                // Like MediaCodec, announce the output format ahead of the first buffer
+                if (mFormatPending) {
+                    mFormatPending = false;
+                    return CODEC_INFO_OUTPUT_FORMAT_CHANGED;
+                }
+                const ReadyOutput& ready = mReady.front();
+                if (ready.readyAtUs <= nowUs()) {
+                    *info = ready.info;
+                    ssize_t index = ready.index;
+                    mOutputInfo[index] = ready.info;
+                    mReady.pop_front();
+                    return index;
+                }
+                wakeUs = std::min(wakeUs, ready.readyAtUs);
+            }
+            if (nowUs() >= deadlineUs) {
+                break;
+            }
+            if (wakeUs == INT64_MAX) {
+                mCondition.wait(lock);
+            } else {
+                mCondition.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::microseconds(wakeUs)));
+            }
+        }
+        return CODEC_INFO_TRY_AGAIN_LATER;
+    }
+
+    uint8_t* getOutputBuffer(size_t index, size_t* capacity) override {
+        if (index >= mOutputBuffers.size()) {
+            return nullptr;
+        }
+        if (capacity) {
+            *capacity = mOutputBuffers[index].size();
+        }
+        return mOutputBuffers[index].data();
+    }
+
+    bool releaseOutputBuffer(size_t index, bool render) override {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (index >= mOutputBuffers.size()) {
+            return false;
+        }
+        CodecBufferInfo info = mOutputInfo[index];
+        CodecSurface* surface = mOutputSurface;
+        lock.unlock();
+
+        if (render && surface && info.size > 0) {
+            // Zero copy: the encoder reads this buffer in place and frees it when done
+            const uint8_t* data = mOutputBuffers[index].data() + info.offset;
+            surface->queueFrame(data, info, [this, index] { returnOutputBuffer(index); });
+        } else {
+            returnOutputBuffer(index);
+        }
+        return true;
+    }
+
+    bool getOutputFormat(TrackFormat* format) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mConfigured) {
+            return false;
+        }
+        describeOutputFormat(format);
+        return true;
+    }
+
+    bool signalEndOfInputStream() override {
+        std::vector<std::function<void()>> completions;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mStarted) {
+                return false;
+            }
+            CodecBufferInfo info = { 0, 0, 0, CODEC_BUFFER_FLAG_END_OF_STREAM };
+            mPending.push_back({ -1, info, nullptr, nullptr });
+            processPending(&completions);
+        }
+        runCompletions(completions);
+        return true;
+    }
+
+protected:
+    virtual size_t inputCapacity() const = 0;
+    virtual size_t outputCapacity() const = 0;
+    virtual void describeOutputFormat(TrackFormat* format) const = 0;
+
+    // Turns one input buffer into one output buffer, returning the output size
+    virtual size_t process(const uint8_t* input, const CodecBufferInfo& inputInfo,
+                           uint8_t* output, size_t outputCapacity, uint32_t* outputFlags) = 0;
+
+    // Outputs held back to come out in presentation order
+    virtual int32_t reorderDepth() const { return 0; }
+
+    // False drops the input without an output, as a decoder drops a frame
+    // whose references it never got; called with the codec locked
+    virtual bool decodable(const uint8_t* /* input */, const CodecBufferInfo& /* inputInfo */) { return true; }
+
+    // A new stream starts after start() or flush(); called with the codec locked
+    virtual void restartStream() {}
+
+    SoftwareBackendConfig mConfig;
+    SoftwareBackendStats* mStats;
+    TrackFormat mFormat;
+    bool mEncoder = false;
+
+private:
+    struct PendingInput {
+        ssize_t index;  // -1 for surface frames and for an end of stream without a buffer
+        CodecBufferInfo info;
+        const uint8_t* data;  // Surface frames only: the producer's buffer
+        std::function<void()> done;  // Surface frames only: frees the producer's buffer
+    };
+
+    struct ReadyOutput {
+        ssize_t index;
+        CodecBufferInfo info;
+        int64_t readyAtUs;
+    };
+
+    template <typename Predicate>
+    bool waitFor(std::unique_lock<std::mutex>& lock, int64_t timeoutUs, Predicate predicate) {
+        if (timeoutUs < 0) {
+            mCondition.wait(lock, predicate);
+            return true;
+        }
+        return mCondition.wait_for(lock, std::chrono::microseconds(timeoutUs), predicate);
+    }
+
+    // Asynchronous mode: announces free input buffers (none for surface
+    // input) and visible outputs, with the callback called unlocked
+    void notifyLoop() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mStarted) {
+            if (!mFreeInputs.empty() && !mSurfaceInput) {
+                size_t index = mFreeInputs.front();
+                mFreeInputs.pop_front();
+                lock.unlock();
+                mCallback->onInputAvailable(this, index);
+                lock.lock();
+                continue;
+            }
+            if (!mReady.empty()) {
+                if (mFormatPending) {
+                    mFormatPending = false;
+                    TrackFormat format;
+                    describeOutputFormat(&format);
+                    lock.unlock();
+                    mCallback->onFormatChanged(this, format);
+                    lock.lock();
+                    continue;
+                }
+                ReadyOutput ready = mReady.front();
+                if (ready.readyAtUs <= nowUs()) {
+                    mReady.pop_front();
+                    mOutputInfo[ready.index] = ready.info;
+                    lock.unlock();
+                    mCallback->onOutputAvailable(this, ready.index, ready.info);
+                    lock.lock();
+                    continue;
+                }
+                mCondition.wait_until(lock, std::chrono::steady_clock::time_point(
+                                                    std::chrono::microseconds(ready.readyAtUs)));
+                continue;
+            }
+            mCondition.wait(lock);
+        }
+    }
+
+    void stopNotifier() {
+        if (mNotifier.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStarted = false;
+                mCondition.notify_all();
+            }
+            mNotifier.join();
+        }
+    }
+
+    // Called with mMutex held
+    void resetBuffers() {
+        mFreeInputs.clear();
+        mFreeOutputs.clear();
+        for (size_t i = 0; i < mInputBuffers.size(); ++i) mFreeInputs.push_back(i);
+        for (size_t i = 0; i < mOutputBuffers.size(); ++i) mFreeOutputs.push_back(i);
+        mPending.clear();
+        mReady.clear();
+        mHeld.clear();
+        mBusyUntilUs = 0;
+        restartStream();
+    }
+
+    // Hands surface frames that were never encoded back to their producer;
+    // called with mMutex held
+    void dropPending(std::vector<std::function<void()>>* completions) {
+        for (PendingInput& pending : mPending) {
+            if (pending.done) {
+                completions->push_back(std::move(pending.done));
+            }
+        }
+        mPending.clear();
+    }
+
+    // Encoder side of the input surface
+    void queueSurfaceFrame(const uint8_t* data, const CodecBufferInfo& info, std::function<void()> done) {
+        std::vector<std::function<void()>> completions;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mStarted) {
+                CodecBufferInfo surfaceInfo = { 0, info.size, info.presentationTimeUs, 0 };
+                mPending.push_back({ -1, surfaceInfo, data, std::move(done) });
+                processPending(&completions);
+            } else {
+                completions.push_back(std::move(done));
+            }
+        }
+        runCompletions(completions);
+    }
+
+    void returnOutputBuffer(size_t index) {
+        std::vector<std::function<void()>> completions;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFreeOutputs.push_back(index);
+            processPending(&completions);
+        }
+        runCompletions(completions);
+    }
+
+    // Surface completions call into the producing codec, so they run after
+    // mMutex is released to keep the two codecs' locks unordered
+    static void runCompletions(std::vector<std::function<void()>>& completions) {
+        for (std::function<void()>& done : completions) {
+            done();
+        }
+    }
+
+    // Called with mMutex held
+    void processPending(std::vector<std::function<void()>>* completions) {
+        while (!mPending.empty() && !mFreeOutputs.empty()) {
+            PendingInput pending = std::move(mPending.front());
+            mPending.pop_front();
+            const uint8_t* input = nullptr;
+            if (pending.info.size > 0) {
+                input = pending.data ? pending.data : mInputBuffers[pending.index].data() + pending.info.offset;
+            }
+            bool endOfStream = (pending.info.flags & CODEC_BUFFER_FLAG_END_OF_STREAM) != 0;
+            if (input && !endOfStream && !decodable(input, pending.info)) {
+                finishInput(&pending, completions);
+                continue;
+            }
+            size_t outputIndex = mFreeOutputs.front();
+            mFreeOutputs.pop_front();
+
+            CodecBufferInfo outputInfo = { 0, 0, pending.info.presentationTimeUs, 0 };
+            if (input) {
+                std::vector<uint8_t>& output = mOutputBuffers[outputIndex];
+                outputInfo.size = static_cast<int32_t>(process(input, pending.info, output.data(), output.size(),
+                                                               &outputInfo.flags));
+                mBusyUntilUs = std::max(mBusyUntilUs, nowUs()) + mLatencyUs;
+            } else {
+                mBusyUntilUs = std::max(mBusyUntilUs, nowUs());
+            }
+            if (endOfStream) {
+                outputInfo.flags |= CODEC_BUFFER_FLAG_END_OF_STREAM;
+            }
+            ReadyOutput ready = { static_cast<ssize_t>(outputIndex), outputInfo, mBusyUntilUs };
+            if (reorderDepth() > 0 && outputInfo.size > 0 && !endOfStream) {
+                // The earliest held frame comes out once more than the reorder depth are held
+                mHeld.insert(std::upper_bound(mHeld.begin(), mHeld.end(), ready, presentedBefore), ready);
+                if (static_cast<int32_t>(mHeld.size()) > reorderDepth()) {
+                    releaseHeld(1);
+                }
+            } else {
+                releaseHeld(mHeld.size());
+                mReady.push_back(ready);
+            }
+            finishInput(&pending, completions);
+        }
+        mCondition.notify_all();
+    }
+
+    // Called with mMutex held
+    void finishInput(PendingInput* pending, std::vector<std::function<void()>>* completions) {
+        if (pending->index >= 0) {
+            mFreeInputs.push_back(pending->index);
+        }
+        if (pending->done) {
+            completions->push_back(std::move(pending->done));
+        }
+    }
+
+    static bool presentedBefore(const ReadyOutput& a, const ReadyOutput& b) {
+        return a.info.presentationTimeUs < b.info.presentationTimeUs;
+    }
+
+    // Makes the count earliest held frames visible once the latest frame is
+    // done; called with mMutex held
+    void releaseHeld(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            ReadyOutput ready = mHeld[i];
+            ready.readyAtUs = mBusyUntilUs;
+            mReady.push_back(ready);
+        }
+        mHeld.erase(mHeld.begin(), mHeld.begin() + count);
+    }
+
+    int64_t mLatencyUs;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mConfigured = false;
+    bool mStarted = false;
+    bool mFormatPending = false;
+    int64_t mBusyUntilUs = 0;
+    std::vector<std::vector<uint8_t>> mInputBuffers;
+    std::vector<std::vector<uint8_t>> mOutputBuffers;
+    std::vector<CodecBufferInfo> mOutputInfo;  // Last info handed out per output buffer
+    CodecSurface* mOutputSurface = nullptr;  // Decoder only
+    std::unique_ptr<CodecSurface> mInputSurface;  // Encoder only
+    bool mSurfaceInput = false;  // Encoder configured for mInputSurface
+    CodecCallback* mCallback = nullptr;  // Asynchronous mode
+    std::thread mNotifier;
+    std::deque<size_t> mFreeInputs;
+    std::deque<size_t> mFreeOutputs;
+    std::deque<PendingInput> mPending;
+    std::deque<ReadyOutput> mReady;
+    std::vector<ReadyOutput> mHeld;  // Decoded, waiting for earlier frames; in presentation order
+};
+
+// Compressed sample -> raw frame in the configured decoder layout
+class SoftwareDecoder : public SoftwareCodec {
+public:
+    SoftwareDecoder(const SoftwareBackendConfig& config, SoftwareBackendStats* stats)
+        : SoftwareCodec(config, stats, config.decodeLatencyUs) {}
+
+protected:
+    int32_t width() const { return mFormat.width > 0 ? mFormat.width : mConfig.width; }
+    int32_t height() const { return mFormat.height > 0 ? mFormat.height : mConfig.height; }
+    FrameFormat frameFormat() const { return frameFormatFromColorFormat(mConfig.decoderColorFormat); }
+
+    size_t inputCapacity() const override { return compressedSampleSize(mConfig, true); }
+    size_t outputCapacity() const override {
+        return frameBufferSize(frameFormat(), width(), height(), mConfig.decoderStride, mConfig.decoderSliceHeight);
+    }
+
+    void describeOutputFormat(TrackFormat* format) const override {
+        format->mime = "video/raw";
+        format->width = width();
+        format->height = height();
+        format->frameRate = mConfig.frameRate;
+        format->colorFormat = mConfig.decoderColorFormat;
+        format->stride = mConfig.decoderStride;
+        format->sliceHeight = mConfig.decoderSliceHeight;
+    }
+
+    size_t process(const uint8_t* input, const CodecBufferInfo& inputInfo,
+                   uint8_t* output, size_t outputCapacity, uint32_t* outputFlags) override {
+        SampleHeader header = {};
+        if (static_cast<size_t>(inputInfo.size) >= sizeof(header)) {
+            memcpy(&header, input, sizeof(header));
+        }
+        FrameView frame;
+        if (!wrapFrame(output, outputCapacity, frameFormat(), width(), height(),
+                       mConfig.decoderStride, mConfig.decoderSliceHeight, &frame)) {
+            return 0;
+        }
+
+        // Flat luma that changes every frame, neutral chroma and zeroed padding
+        if (frame.strides[0] != width() || mConfig.decoderSliceHeight > height()) {
+            memset(output, 0, outputCapacity);
+        }
+        int32_t chromaWidth = (width() + 1) / 2;
+        int32_t chromaRows = (height() + 1) / 2;
+        for (int32_t row = 0; row < height(); ++row) {
+            memset(frame.planes[0] + static_cast<size_t>(row) * frame.strides[0], header.frameIndex & 0xff, width());
+        }
+        for (int32_t plane = 1; plane < 3 && frame.planes[plane]; ++plane) {
+            size_t rowBytes = frame.format == FRAME_FORMAT_I420 ? chromaWidth : 2 * chromaWidth;
+            for (int32_t row = 0; row < chromaRows; ++row) {
+                memset(frame.planes[plane] + static_cast<size_t>(row) * frame.strides[plane], 0x80, rowBytes);
+            }
+        }
+        *outputFlags = (header.flags & SAMPLE_FLAG_SYNC) ? CODEC_BUFFER_FLAG_KEY_FRAME : 0;
+        mStats->framesDecoded++;
+        return outputCapacity;
+    }
+
+    int32_t reorderDepth() const override { return mConfig.bFrames; }
+
+    // Frames presented before the sync sample decoding started at are an
+    // open GOP's leading frames, whose reference is in the previous GOP
+    bool decodable(const uint8_t* input, const CodecBufferInfo& inputInfo) override {
+        SampleHeader header = {};
+        if (static_cast<size_t>(inputInfo.size) >= sizeof(header)) {
+            memcpy(&header, input, sizeof(header));
+        }
+        if (mStartSyncUs < 0 && (header.flags & SAMPLE_FLAG_SYNC)) {
+            mStartSyncUs = header.presentationTimeUs;
+        }
+        return mStartSyncUs < 0 || header.presentationTimeUs >= mStartSyncUs;
+    }
+
+    void restartStream() override { mStartSyncUs = -1; }
+
+private:
+    int64_t mStartSyncUs = -1;
+};
+
+// Raw tightly packed frame -> compressed sample
+class SoftwareEncoder : public SoftwareCodec {
+public:
+    SoftwareEncoder(const SoftwareBackendConfig& config, SoftwareBackendStats* stats)
+        : SoftwareCodec(config, stats, config.encodeLatencyUs) {}
+
+protected:
+    int32_t width() const { return mFormat.width > 0 ? mFormat.width : mConfig.width; }
+    int32_t height() const { return mFormat.height > 0 ? mFormat.height : mConfig.height; }
+
+    int32_t gopSize() const {
+        int32_t frameRate = mFormat.frameRate > 0 ? mFormat.frameRate : mConfig.frameRate;
+        return mFormat.iFrameInterval > 0 ? mFormat.iFrameInterval * frameRate : mConfig.gopSize;
+    }
+
+    size_t inputCapacity() const override {
+        FrameFormat format = frameFormatFromColorFormat(mFormat.colorFormat);
+        return frameBufferSize(format != FRAME_FORMAT_UNKNOWN ? format : FRAME_FORMAT_I420, width(), height());
+    }
+    size_t outputCapacity() const override { return compressedSampleSize(mConfig, true); }
+
+    void describeOutputFormat(TrackFormat* format) const override {
+        static const uint8_t kSps[] = { 0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1f };
+        static const uint8_t kPps[] = { 0x00, 0x00, 0x00, 0x01, 0x68, 0xce, 0x3c, 0x80 };
+        format->mime = mFormat.mime.empty() ? "video/avc" : mFormat.mime;
+        format->width = width();
+        format->height = height();
+        format->bitRate = mFormat.bitRate > 0 ? mFormat.bitRate : mConfig.bitRate;
+        format->frameRate = mFormat.frameRate > 0 ? mFormat.frameRate : mConfig.frameRate;
+        format->csd0.assign(kSps, kSps + sizeof(kSps));
+        format->csd1.assign(kPps, kPps + sizeof(kPps));
+    }
+
+    size_t process(const uint8_t* input, const CodecBufferInfo& inputInfo,
+                   uint8_t* output, size_t outputCapacity, uint32_t* outputFlags) override {
+        // Sample one byte per 4 KiB so the checksum depends on the whole frame
+        uint32_t checksum = 0;
+        for (int32_t i = 0; i < inputInfo.size; i += 4096) {
+            checksum = checksum * 31 + input[i];
+        }
+
+        bool keyFrame = gopSize() <= 1 || mFrameIndex % gopSize() == 0;
+        size_t size = std::min(compressedSampleSize(mConfig, keyFrame), outputCapacity);
+        SampleHeader header = { kSampleMagic, mFrameIndex, inputInfo.presentationTimeUs, checksum,
+                                keyFrame ? static_cast<uint32_t>(SAMPLE_FLAG_SYNC) : 0 };
+        memcpy(output, &header, sizeof(header));
+        memset(output + sizeof(header), checksum & 0xff, size - sizeof(header));
+
+        *outputFlags = keyFrame ? CODEC_BUFFER_FLAG_KEY_FRAME : 0;
+        mFrameIndex++;
+        mStats->framesEncoded++;
+        return size;
+    }
+
+    void restartStream() override { mFrameIndex = 0; }
+
+private:
+    uint32_t mFrameIndex = 0;
+};
+
+class SoftwareSampleSink : public SampleSink {
+public:
+    SoftwareSampleSink(int fd, SoftwareBackendStats* stats) : mFd(fd), mStats(stats) {}
+
+    ~SoftwareSampleSink() override {
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+
+    ssize_t addTrack(const TrackFormat& /* format */) override {
+        return mStarted ? -1 : mTrackCount++;
+    }
+
+    bool start() override {
+        mStarted = true;
+        return true;
+    }
+
+    bool writeSampleData(size_t trackIndex, const uint8_t* data, const CodecBufferInfo& info) override {
+        if (!mStarted || trackIndex >= static_cast<size_t>(mTrackCount)) {
+            return false;
+        }
+        if (mFd >= 0 && write(mFd, data + info.offset, info.size) != info.size) {
+            LOGE("Failed to write sample at %lld", static_cast<long long>(info.presentationTimeUs));
+            return false;
+        }
+        mStats->samplesWritten++;
+        mStats->bytesWritten += info.size;
+        return true;
+    }
+
+    bool stop() override {
+        bool wasStarted = mStarted;
+        mStarted = false;
+        return wasStarted;
+    }
+
+private:
+    int mFd;
+    SoftwareBackendStats* mStats;
+    ssize_t mTrackCount = 0;
+    bool mStarted = false;
+};
+
+} // namespace
+
+void SoftwareBackend::simulateCreate() {
+    if (mConfig.codecCreateLatencyUs > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(mConfig.codecCreateLatencyUs));
+    }
+    mStats.codecsCreated++;
+}
+
+std::unique_ptr<SampleSource> SoftwareBackend::openSource(const char* /* inputPath */) {
+    return std::unique_ptr<SampleSource>(new SoftwareSampleSource(mConfig, &mStats));
+}
+
+std::unique_ptr<VideoCodec> SoftwareBackend::createDecoder(const char* /* mime */) {
+    simulateCreate();
+    return std::unique_ptr<VideoCodec>(new SoftwareDecoder(mConfig, &mStats));
+}
+
+std::unique_ptr<VideoCodec> SoftwareBackend::createEncoder(const char* /* mime */) {
+    simulateCreate();
+    return std::unique_ptr<VideoCodec>(new SoftwareEncoder(mConfig, &mStats));
+}
+
+std::unique_ptr<SampleSink> SoftwareBackend::openSink(const char* outputPath) {
+    int outputFd = -1;
+    if (outputPath && outputPath[0] != '\0') {
+        outputFd = open(outputPath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (outputFd < 0) {
+            LOGE("Failed to open output file: %s", outputPath);
+            return nullptr;
+        }
+    }
+    return std::unique_ptr<SampleSink>(new SoftwareSampleSink(outputFd, &mStats));
+}
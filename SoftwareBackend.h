@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "CodecBackend.h"
+
+// Deterministic in-process stand-in for MediaCodec. The source synthesizes
+// compressed samples (video, plus optionally an AAC-like audio track
+// interleaved by time that only a passthrough can consume), the decoder turns each one into a raw frame (I420 or
+// NV12, optionally with hardware-style row and slice padding), the
+// encoder turns each raw frame back into a compressed sample and the sink
+// only counts what it receives (or appends it to a file). A decoder rendering
+// into the encoder's input surface hands frames over without a copy, and
+// bytesCopied tracks the raw frame bytes that went through the byte-buffer
+// path, so a zero-copy transcode must leave it at zero. Every codec models
+// a fixed per-frame processing cost and a bounded number of buffers, so the
+// pipeline sees the same back-pressure it would get from a hardware codec.
+// With bFrames, samples come in decode order and the decoder reorders them
+// into presentation order; a decoder that starts at an open GOP's sync
+// sample drops the leading frames it cannot reconstruct, like the RASL
+// pictures of a CRA.
+struct SoftwareBackendConfig {
+    int32_t width = 1280;
+    int32_t height = 720;
+    int32_t frameRate = 30;
+    int32_t frameCount = 300;
+    int32_t gopSize = 30;               // Distance between sync samples
+    int32_t bFrames = 0;                // Frames stored after the later reference they sit before
+    bool openGop = false;               // A sync sample's leading B-frames reference the previous GOP
+    int32_t bitRate = 2000000;          // Sets the synthetic compressed sample size
+    int64_t decodeLatencyUs = 0;        // Processing time per decoded frame
+    int64_t encodeLatencyUs = 0;        // Processing time per encoded frame
+    int32_t queueDepth = 4;             // Input and output buffers per codec
+    int32_t decoderColorFormat = CODEC_COLOR_FORMAT_YUV420_PLANAR;  // I420 or NV12 decoder output
+    int32_t decoderStride = 0;          // Decoder output row stride, 0 for tightly packed
+    int32_t decoderSliceHeight = 0;     // Decoder output luma rows, 0 for tightly packed
+    int64_t codecCreateLatencyUs = 0;   // Time createDecoder / createEncoder take
+    int64_t codecStartLatencyUs = 0;    // Time configure + start take; flush is free
+    int32_t audioSampleRate = 0;        // Above zero, adds a stereo audio track of 1024-sample frames
+    int32_t audioBitRate = 128000;
+};
+
+struct SoftwareBackendStats {
+    std::atomic<int64_t> samplesRead{0};
+    std::atomic<int64_t> framesDecoded{0};
+    std::atomic<int64_t> framesEncoded{0};
+    std::atomic<int64_t> bytesCopied{0};  // Raw frame bytes written into encoder input buffers
+    std::atomic<int64_t> samplesWritten{0};
+    std::atomic<int64_t> bytesWritten{0};
+    std::atomic<int64_t> codecsCreated{0};
+    std::atomic<int64_t> codecsStarted{0};
+};
+
+class SoftwareBackend : public CodecBackend {
+public:
+    explicit SoftwareBackend(const SoftwareBackendConfig& config) : mConfig(config) {}
+
+    const char* name() const override { return "software"; }
+
+    // The input path is ignored; samples are generated from the config
+    std::unique_ptr<SampleSource> openSource(const char* inputPath) override;
+    std::unique_ptr<VideoCodec> createDecoder(const char* mime) override;
+    std::unique_ptr<VideoCodec> createEncoder(const char* mime) override;
+
+    // A null or empty path discards the samples after counting them
+    std::unique_ptr<SampleSink> openSink(const char* outputPath) override;
+
+    const SoftwareBackendConfig& config() const { return mConfig; }
+    const SoftwareBackendStats& stats() const { return mStats; }
+
+private:
+    void simulateCreate();
+
+    SoftwareBackendConfig mConfig;
+    SoftwareBackendStats mStats;
+};
@@ -0,0 +1,214 @@
+#include <chrono>
+
+#include "TranscodeEngine.h"
+#include "Log.h"
+
+namespace {
+
+CodecPoolOptions codecPoolOptions(int32_t maxCodecInstances) {
+    CodecPoolOptions options;
+    options.maxInstances = maxCodecInstances;
+    return options;
+}
+
+} // namespace
+
+TranscodeEngine::TranscodeEngine(CodecBackend* backend, int32_t maxCodecInstances)
+    : mBackend(backend),
+      mCodecPool(backend, codecPoolOptions(maxCodecInstances > kCodecInstancesPerJob ? maxCodecInstances
+                                                                                    : kCodecInstancesPerJob)) {
+    int32_t workerCount = maxCodecInstances / kCodecInstancesPerJob;
+    if (workerCount < 1) {
+        workerCount = 1;
+    }
+    for (int32_t i = 0; i < workerCount; ++i) {
+        mWorkers.emplace_back(&TranscodeEngine::workerLoop, this);
+    }
+}
+
+TranscodeEngine::~TranscodeEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mShutdown = true;
+        for (auto& entry : mJobs) {
+            entry.second->cancelled = true;
+        }
+        for (const std::shared_ptr<Job>& job : mQueue) {
+            job->state = TRANSCODE_JOB_CANCELLED;
+        }
+        mQueue.clear();
+    }
+    mDoneCondition.notify_all();
+    mQueueCondition.notify_all();
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+int64_t TranscodeEngine::submit(const char* inputPath, const char* outputPath, const TranscodeOptions& options) {
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->inputPath = inputPath ? inputPath : "";
+    job->outputPath = outputPath ? outputPath : "";
+    job->keyframeIndexDir = options.keyframeIndexDir ? options.keyframeIndexDir : "";
+    job->options = options;
+
+    // The job owns every string and flag the transcode reads
+    job->options.keyframeIndexDir = options.keyframeIndexDir ? job->keyframeIndexDir.c_str() : nullptr;
+    job->options.cancelled = &job->cancelled;
+    if (!job->options.codecPool) {
+        job->options.codecPool = &mCodecPool;
+    }
+    if (!job->options.framePool) {
+        job->options.framePool = &mFramePool;
+    }
+    if (!job->options.telemetry) {
+        job->options.telemetry = &job->telemetry;
+    }
+
+    // Each job is budgeted one decoder and one encoder
+    job->options.parallelSegments = 1;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    job->id = mNextJobId++;
+    if (!job->options.tracer && !mTraceDirectory.empty()) {
+        job->tracer.reset(new FrameTracer());
+        job->tracePath = mTraceDirectory + "/transcode-" + std::to_string(job->id) + ".json";
+        job->options.tracer = job->tracer.get();
+    }
+    mJobs[job->id] = job;
+    mQueue.push_back(job);
+    mQueueCondition.notify_one();
+    return job->id;
+}
+
+bool TranscodeEngine::poll(int64_t jobId, TranscodeJobStatus* status) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mJobs.find(jobId);
+    if (it == mJobs.end()) {
+        return false;
+    }
+    status->state = it->second->state;
+    status->result = it->second->result;
+    return true;
+}
+
+bool TranscodeEngine::cancel(int64_t jobId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mJobs.find(jobId);
+    if (it == mJobs.end()) {
+        return false;
+    }
+    std::shared_ptr<Job> job = it->second;
+    if (job->state == TRANSCODE_JOB_QUEUED) {
+        // Never started, so nothing to stop
+        for (auto queued = mQueue.begin(); queued != mQueue.end(); ++queued) {
+            if (*queued == job) {
+                mQueue.erase(queued);
+                break;
+            }
+        }
+        job->state = TRANSCODE_JOB_CANCELLED;
+        mDoneCondition.notify_all();
+        return true;
+    }
+    if (job->state == TRANSCODE_JOB_RUNNING) {
+        job->cancelled = true;
+        return true;
+    }
+    return false;
+}
+
+bool TranscodeEngine::wait(int64_t jobId, int64_t timeoutUs, TranscodeJobStatus* status) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto it = mJobs.find(jobId);
+    if (it == mJobs.end()) {
+        return false;
+    }
+    std::shared_ptr<Job> job = it->second;
+    auto finished = [&job] { return job->state != TRANSCODE_JOB_QUEUED && job->state != TRANSCODE_JOB_RUNNING; };
+    bool done;
+    if (timeoutUs < 0) {
+        mDoneCondition.wait(lock, finished);
+        done = true;
+    } else {
+        done = mDoneCondition.wait_for(lock, std::chrono::microseconds(timeoutUs), finished);
+    }
+    if (status) {
+        status->state = job->state;
+        status->result = job->result;
+    }
+    return done;
+}
+
+bool TranscodeEngine::release(int64_t jobId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mJobs.find(jobId);
+    if (it == mJobs.end()) {
+        return false;
+    }
+    TranscodeJobState state = it->second->state;
+    if (state == TRANSCODE_JOB_QUEUED || state == TRANSCODE_JOB_RUNNING) {
+        return false;
+    }
+    mJobs.erase(it);
+    return true;
+}
+
+void TranscodeEngine::setTraceDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTraceDirectory = directory;
+}
+
+bool TranscodeEngine::telemetryJson(int64_t jobId, std::string* json) {
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mJobs.find(jobId);
+        if (it == mJobs.end()) {
+            return false;
+        }
+        job = it->second;
+    }
+    // Telemetry is safe to read while the job writes it
+    *json = job->options.telemetry->toJson();
+    return true;
+}
+
+void TranscodeEngine::workerLoop() {
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mQueueCondition.wait(lock, [this] { return mShutdown || !mQueue.empty(); });
+            if (mShutdown) {
+                return;
+            }
+            job = mQueue.front();
+            mQueue.pop_front();
+            job->state = TRANSCODE_JOB_RUNNING;
+        }
+        runJob(job);
+    }
+}
+
+void TranscodeEngine::runJob(const std::shared_ptr<Job>& job) {
+    TranscodeResult result;
+    bool ok = transcodeVideo(mBackend, job->inputPath.c_str(), job->outputPath.c_str(), job->options, &result);
+    LOGI("Job %lld telemetry: %s", static_cast<long long>(job->id), job->options.telemetry->toJson().c_str());
+    if (job->tracer && job->tracer->writeChromeTrace(job->tracePath.c_str())) {
+        LOGI("Job %lld trace: %s (%lld spans, %lld dropped)", static_cast<long long>(job->id), job->tracePath.c_str(),
+             static_cast<long long>(job->tracer->recorded()), static_cast<long long>(job->tracer->dropped()));
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    job->result = result;
+    if (job->cancelled) {
+        job->state = TRANSCODE_JOB_CANCELLED;
+    } else if (ok) {
+        job->state = TRANSCODE_JOB_SUCCEEDED;
+    } else {
+        LOGE("Transcode job %lld failed: %s", static_cast<long long>(job->id), job->inputPath.c_str());
+        job->state = TRANSCODE_JOB_FAILED;
+    }
+    mDoneCondition.notify_all();
+}
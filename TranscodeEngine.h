@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CodecBackend.h"
+#include "CodecPool.h"
+#include "FramePool.h"
+#include "FrameTracer.h"
+#include "PipelineTelemetry.h"
+#include "Transcoder.h"
+
+enum TranscodeJobState {
+    TRANSCODE_JOB_UNKNOWN = 0,
+    TRANSCODE_JOB_QUEUED,
+    TRANSCODE_JOB_RUNNING,
+    TRANSCODE_JOB_SUCCEEDED,
+    TRANSCODE_JOB_FAILED,
+    TRANSCODE_JOB_CANCELLED,
+};
+
+struct TranscodeJobStatus {
+    TranscodeJobState state = TRANSCODE_JOB_UNKNOWN;
+    TranscodeResult result;
+};
+
+// Runs many transcodes in one process. Jobs are queued on submit() and
+// started in order as codec instances free up; each running job holds one
+// decoder and one encoder. All per-job state lives in the job itself, so
+// jobs never share queues or muxers. Codecs come from the engine's codec
+// pool unless a job brings its own, so back-to-back jobs of the same shape
+// reuse warm codecs instead of starting new ones. The CPU copies of frames
+// come from one frame pool, so its cap bounds them across all jobs.
+class TranscodeEngine {
+public:
+    // maxCodecInstances caps the decoders plus encoders alive at once
+    TranscodeEngine(CodecBackend* backend, int32_t maxCodecInstances);
+
+    // Cancels queued and running jobs and waits for them to stop
+    ~TranscodeEngine();
+
+    TranscodeEngine(const TranscodeEngine&) = delete;
+    TranscodeEngine& operator=(const TranscodeEngine&) = delete;
+
+    // Returns a job id (> 0)
+    int64_t submit(const char* inputPath, const char* outputPath, const TranscodeOptions& options);
+
+    // Returns false for an unknown job id
+    bool poll(int64_t jobId, TranscodeJobStatus* status);
+    bool cancel(int64_t jobId);
+
+    // Waits until the job finishes or timeoutUs passes (negative waits
+    // forever). Returns true if the job finished.
+    bool wait(int64_t jobId, int64_t timeoutUs, TranscodeJobStatus* status);
+
+    // Forgets a finished job; running or queued jobs are not released
+    bool release(int64_t jobId);
+
+    // Snapshot of the job's telemetry (see PipelineTelemetry::toJson), live
+    // while it runs. Jobs submitted without options.telemetry get their own.
+    // Returns false for an unknown job id.
+    bool telemetryJson(int64_t jobId, std::string* json);
+
+    // When set, jobs submitted afterwards without options.tracer are traced
+    // and write their timeline to <directory>/transcode-<job id>.json when
+    // they finish (see FrameTracer.h); empty turns tracing off
+    void setTraceDirectory(const std::string& directory);
+
+    int32_t maxConcurrentJobs() const { return static_cast<int32_t>(mWorkers.size()); }
+
+    CodecBackend* backend() const { return mBackend; }
+
+    // Holds at most maxCodecInstances codecs; also usable for transcodes run
+    // outside the engine, which then count against the same limit
+    CodecPool* codecPool() { return &mCodecPool; }
+
+    // Given to jobs submitted without options.framePool; also usable for
+    // transcodes run outside the engine
+    FramePool* framePool() { return &mFramePool; }
+
+private:
+    struct Job {
+        int64_t id;
+        std::string inputPath;
+        std::string outputPath;
+        std::string keyframeIndexDir;
+        TranscodeOptions options;
+        std::atomic<bool> cancelled{false};
+        TranscodeJobState state = TRANSCODE_JOB_QUEUED;
+        TranscodeResult result;
+        PipelineTelemetry telemetry;  // Unless the options bring one
+        std::unique_ptr<FrameTracer> tracer;  // With a trace directory
+        std::string tracePath;
+    };
+
+    static const int32_t kCodecInstancesPerJob = 2;
+
+    void workerLoop();
+    void runJob(const std::shared_ptr<Job>& job);
+
+    CodecBackend* mBackend;
+    CodecPool mCodecPool;
+    FramePool mFramePool;
+    std::mutex mMutex;
+    std::condition_variable mQueueCondition;  // Signals new jobs and shutdown to workers
+    std::condition_variable mDoneCondition;   // Signals finished jobs to waiters
+    std::deque<std::shared_ptr<Job>> mQueue;
+    std::map<int64_t, std::shared_ptr<Job>> mJobs;
+    std::vector<std::thread> mWorkers;
+    int64_t mNextJobId = 1;
+    bool mShutdown = false;
+    std::string mTraceDirectory;
+};
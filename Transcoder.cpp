@@ -0,0 +1,2272 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "CodecPool.h"
+#include "Fmp4Muxer.h"
+#include "FramePool.h"
+#include "FrameScaler.h"
+#include "FrameTracer.h"
+#include "KeyframeIndex.h"
+#include "PipelineTelemetry.h"
+#include "Transcoder.h"
+#include "WorkerPool.h"
+#include "YuvFrame.h"
+#include "Log.h"
+
+namespace {
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Silence after which a stalled codec is let one frame deeper than before:
+// four of its average output intervals within these bounds, the upper one
+// until it has produced two frames. Past twice the limit only a codec that
+// has been silent for kStuckUs is let deeper, so it cannot wedge the feeder.
+const int64_t kMinWriteOffUs = 10000;
+const int64_t kMaxWriteOffUs = 100000;
+const int64_t kStuckUs = 1000000;
+
+// Caps the number of frames handed to a codec that it has not produced yet.
+// Frames are tracked by presentation time, so an output frees the place of
+// its own frame however late it comes, and a frame overtaken by more frames
+// fed after it than the limit is taken to have been dropped by the
+// codec (decode-only frames, RASL frames after a seek) and frees its place
+// then. A codec that reports TRY_AGAIN_LATER while its feeder is blocked may
+// need more input before it can emit anything (reorder depth, encoder
+// lookahead), so the drain stage calls relieve(), which lets the codec hold
+// one frame more: at once the first time, after a silence (see
+// kMinWriteOffUs) every further time, so a codec needing deeper input pays
+// that wait once per frame of depth rather than on every frame.
+class InFlightLimit {
+public:
+    explicit InFlightLimit(int32_t limit) : mLimit(limit > 0 ? limit : 1) {}
+
+    // Waits for room for the frame presented at timeUs. Returns false if
+    // the pipeline was aborted while waiting.
+    bool acquire(int64_t timeUs, const std::atomic<bool>& aborted, int64_t timeoutUs) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (static_cast<int32_t>(mPending.size()) >= mLimit + mExtra) {
+            if (aborted) {
+                return false;
+            }
+            mWaiting = true;
+            mCondition.wait_for(lock, std::chrono::microseconds(timeoutUs));
+            mWaiting = false;
+        }
+        mPending.push_back({ timeUs, 0 });
+        return true;
+    }
+
+    // The codec produced the frame presented at timeUs
+    void release(int64_t timeUs) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        int64_t now = nowUs();
+        if (mLastOutputUs > 0) {
+            int64_t intervalUs = now - mLastOutputUs;
+            mOutputIntervalUs = mOutputIntervalUs > 0 ? mOutputIntervalUs + (intervalUs - mOutputIntervalUs) / 8
+                                                      : intervalUs;
+        }
+        mLastOutputUs = now;
+        mLastEventUs = now;
+
+        size_t index = 0;
+        while (index < mPending.size() && mPending[index].timeUs != timeUs) {
+            index++;
+        }
+        if (index == mPending.size()) {
+            // Not a time it was given (end of stream): the oldest frame makes room
+            index = 0;
+        }
+        if (index < mPending.size()) {
+            mPending.erase(mPending.begin() + index);
+        }
+        // Frames fed before it were overtaken; codecs reorder by fewer
+        // frames than the limit, so those overtaken more often will not come out
+        for (size_t i = 0; i < index && i < mPending.size();) {
+            if (++mPending[i].overtaken > mLimit) {
+                mPending.erase(mPending.begin() + i);
+                index--;
+            } else {
+                ++i;
+            }
+        }
+        mCondition.notify_one();
+    }
+
+    void relieve() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mWaiting || mPending.empty()) {
+            return;
+        }
+        int64_t now = nowUs();
+        if (mLastEventUs == 0) {
+            mLastEventUs = now;
+        }
+        if (mExtra > 0) {
+            int64_t silenceUs = mOutputIntervalUs > 0
+                    ? std::min(kMaxWriteOffUs, std::max(kMinWriteOffUs, 4 * mOutputIntervalUs))
+                    : kMaxWriteOffUs;
+            if (mExtra >= mLimit) {
+                silenceUs = kStuckUs;
+            }
+            if (now - mLastEventUs < silenceUs) {
+                return;
+            }
+            if (mExtra >= mLimit) {
+                LOGW("Codec holds %d frames without output; letting it take one more", mLimit + mExtra);
+            }
+        }
+        mLastEventUs = now;
+        mExtra++;
+        mCondition.notify_one();
+    }
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCondition.notify_all();
+    }
+
+private:
+    struct PendingFrame {
+        int64_t timeUs;
+        int32_t overtaken;  // Frames fed after it that came out first
+    };
+
+    const int32_t mLimit;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<PendingFrame> mPending;  // Frames in the codec, in feed order
+    int32_t mExtra = 0;                 // Frames relieve() let the codec hold beyond mLimit
+    int64_t mOutputIntervalUs = 0;      // Running average time between outputs
+    int64_t mLastOutputUs = 0;
+    int64_t mLastEventUs = 0;           // Last output or relief
+    bool mWaiting = false;
+};
+
+// Presentation times a pipeline keeps. Decoded frames outside
+// [startUs, endUs) are dropped, and shiftUs is subtracted from output times.
+// A negative endUs runs to the end of the input.
+struct FrameWindow {
+    int64_t startUs;
+    int64_t endUs;
+    int64_t shiftUs;
+
+    bool contains(int64_t timeUs) const { return timeUs >= startUs && (endUs < 0 || timeUs < endUs); }
+};
+
+const FrameWindow kWholeInput = { 0, -1, 0 };
+
+// An input track copied into the output without decoding
+struct PassthroughTrack {
+    int sourceIndex;
+    TrackFormat format;
+};
+
+// PASSTHROUGH_* kind of a track, or 0 for one that is never passed through
+uint32_t passthroughKind(const std::string& mime) {
+    if (mime.empty() || !mime.compare(0, 6, "video/") || !mime.compare(0, 6, "image/")) {
+        return 0;
+    }
+    if (!mime.compare(0, 6, "audio/")) {
+        return PASSTHROUGH_AUDIO;
+    }
+    if (!mime.compare(0, 5, "text/") || mime == "application/x-subrip" || mime == "application/ttml+xml" ||
+        mime == "application/x-quicktime-tx3g" || mime == "application/cea-608" || mime == "application/cea-708") {
+        return PASSTHROUGH_SUBTITLE;
+    }
+    return PASSTHROUGH_METADATA;
+}
+
+// The tracks of extractor of the given PASSTHROUGH_* kinds
+std::vector<PassthroughTrack> findPassthroughTracks(SampleSource* extractor, uint32_t kinds) {
+    std::vector<PassthroughTrack> tracks;
+    int trackCount = extractor->getTrackCount();
+    for (int i = 0; i < trackCount; ++i) {
+        PassthroughTrack track = { i, TrackFormat() };
+        if (extractor->getTrackFormat(i, &track.format) && (passthroughKind(track.format.mime) & kinds)) {
+            tracks.push_back(track);
+        }
+    }
+    return tracks;
+}
+
+// Same, selecting each one next to the video track
+std::vector<PassthroughTrack> selectPassthroughTracks(SampleSource* extractor, uint32_t kinds) {
+    std::vector<PassthroughTrack> tracks;
+    for (PassthroughTrack& track : findPassthroughTracks(extractor, kinds)) {
+        if (extractor->selectTrack(track.sourceIndex)) {
+            LOGI("Passing track %d (%s) through", track.sourceIndex, track.format.mime.c_str());
+            tracks.push_back(track);
+        }
+    }
+    return tracks;
+}
+
+// The muxer of one pipeline. Encoded video is written as the encoder
+// produces it. Passthrough samples are read by the feed stage, which runs
+// ahead of the encoder by the depth of both codecs, so each one waits here
+// until the video has been written up to its presentation time; the muxer
+// then sees every track in time order, and only under this lock.
+class PassthroughMuxer {
+public:
+    PassthroughMuxer(SampleSink* muxer, const std::vector<PassthroughTrack>& tracks, const FrameWindow& window)
+        : mMuxer(muxer), mWindow(window) {
+        for (const PassthroughTrack& track : tracks) {
+            mTracks.push_back({ track.sourceIndex, track.format, -1 });
+        }
+    }
+
+    // Safe from any stage: the tracks are fixed at construction
+    bool carries(int sourceIndex) const { return findTrack(sourceIndex) >= 0; }
+
+    // Adds the video track and every passthrough track the muxer takes,
+    // then starts it
+    bool start(const TrackFormat& videoFormat) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mVideoTrack = mMuxer->addTrack(videoFormat);
+        if (mVideoTrack < 0) {
+            return false;
+        }
+        for (Track& track : mTracks) {
+            track.muxerIndex = mMuxer->addTrack(track.format);
+            if (track.muxerIndex < 0) {
+                LOGW("Dropping track %d (%s): the muxer does not take it", track.sourceIndex,
+                     track.format.mime.c_str());
+            }
+        }
+        if (!mMuxer->start()) {
+            return false;
+        }
+        mStarted = true;
+        return true;
+    }
+
+    bool started() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStarted;
+    }
+
+    // info is in output time
+    bool writeVideo(const uint8_t* data, const CodecBufferInfo& info) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mStarted || !mMuxer->writeSampleData(mVideoTrack, data, info)) {
+            return false;
+        }
+        mVideoTimeUs = std::max(mVideoTimeUs, info.presentationTimeUs);
+        return flushLocked(mVideoTimeUs);
+    }
+
+    // Takes extractor's current sample, which must be on a passthrough
+    // track. Samples outside the window are skipped without reading them.
+    bool copySample(SampleSource* extractor, int sourceIndex) {
+        int64_t timeUs = extractor->getSampleTime();
+        if (!mWindow.contains(timeUs)) {
+            return true;
+        }
+        PendingSample sample;
+        ssize_t size = extractor->getSampleSize();
+        sample.data.resize(size > 0 ? size : 0);
+        if (size < 0 || extractor->readSampleData(sample.data.data(), sample.data.size()) != size) {
+            LOGE("Error reading passthrough sample at %lld", static_cast<long long>(timeUs));
+            return false;
+        }
+        sample.track = findTrack(sourceIndex);
+        sample.info.offset = 0;
+        sample.info.size = static_cast<int32_t>(size);
+        sample.info.presentationTimeUs = timeUs - mWindow.shiftUs;
+        sample.info.flags = (extractor->getSampleFlags() & SAMPLE_FLAG_SYNC) ? CODEC_BUFFER_FLAG_KEY_FRAME : 0;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPending.push_back(std::move(sample));
+        return !mStarted || flushLocked(mVideoTimeUs);
+    }
+
+    // Writes whatever is still waiting, once no more video will come
+    bool finish() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return !mStarted || flushLocked(INT64_MAX);
+    }
+
+    int64_t samplesWritten() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mSamplesWritten;
+    }
+
+private:
+    struct Track {
+        int sourceIndex;
+        TrackFormat format;
+        ssize_t muxerIndex;
+    };
+
+    struct PendingSample {
+        size_t track;
+        std::vector<uint8_t> data;
+        CodecBufferInfo info;
+    };
+
+    ssize_t findTrack(int sourceIndex) const {
+        for (size_t i = 0; i < mTracks.size(); ++i) {
+            if (mTracks[i].sourceIndex == sourceIndex) {
+                return static_cast<ssize_t>(i);
+            }
+        }
+        return -1;
+    }
+
+    bool flushLocked(int64_t untilUs) {
+        while (!mPending.empty() && mPending.front().info.presentationTimeUs <= untilUs) {
+            const PendingSample& sample = mPending.front();
+            ssize_t muxerIndex = mTracks[sample.track].muxerIndex;
+            if (muxerIndex >= 0) {
+                if (!mMuxer->writeSampleData(muxerIndex, sample.data.data(), sample.info)) {
+                    LOGE("Failed to write passthrough sample at %lld",
+                         static_cast<long long>(sample.info.presentationTimeUs));
+                    return false;
+                }
+                mSamplesWritten++;
+            }
+            mPending.pop_front();
+        }
+        return true;
+    }
+
+    SampleSink* mMuxer;
+    const FrameWindow mWindow;
+    std::vector<Track> mTracks;
+    std::mutex mMutex;
+    std::deque<PendingSample> mPending;
+    ssize_t mVideoTrack = -1;
+    int64_t mVideoTimeUs = INT64_MIN;
+    bool mStarted = false;
+    int64_t mSamplesWritten = 0;
+};
+
+// Feeds every sample of extractor's selected video track to decoder, then
+// end of stream, holding limit for each sample. Samples of passthrough
+// tracks go to passthrough instead; without one, only the video track may
+// be selected. Returns false on a read or queue error, or when aborted.
+bool feedDecoder(SampleSource* extractor, VideoCodec* decoder, PassthroughMuxer* passthrough, InFlightLimit* limit,
+                 int64_t timeoutUs, const std::atomic<bool>& aborted, PipelineTelemetry* telemetry,
+                 FrameTracer* tracer, int64_t* samplesRead) {
+    bool sawInputEOS = false;
+    while (!sawInputEOS && !aborted) {
+        int track;
+        while (passthrough && !aborted && (track = extractor->getSampleTrackIndex()) >= 0 &&
+               passthrough->carries(track)) {
+            if (!passthrough->copySample(extractor, track)) {
+                return false;
+            }
+            extractor->advance();
+        }
+        if (!limit->acquire(extractor->getSampleTime(), aborted, timeoutUs)) {
+            return false;
+        }
+        ssize_t inputBufferIndex;
+        while ((inputBufferIndex = decoder->dequeueInputBuffer(timeoutUs)) < 0) {
+            if (aborted) {
+                return false;
+            }
+            if (inputBufferIndex == CODEC_INFO_TRY_AGAIN_LATER) {
+                telemetry->add(COUNTER_DECODER_INPUT_TRY_AGAIN);
+            }
+        }
+        TraceScope trace(tracer, TRACE_FEED, -1, inputBufferIndex);
+        size_t inputCapacity;
+        uint8_t *inputBuffer = decoder->getInputBuffer(inputBufferIndex, &inputCapacity);
+
+        // Get sample size and time
+        ssize_t sampleSize = extractor->getSampleSize();
+        int64_t sampleTime = 0;
+        uint32_t sampleFlags = 0;
+        if (sampleSize < 0) {
+            sawInputEOS = true;
+            sampleSize = 0;
+            sampleFlags = CODEC_BUFFER_FLAG_END_OF_STREAM;
+        } else {
+            sampleTime = extractor->getSampleTime();
+            sampleFlags = (extractor->getSampleFlags() & SAMPLE_FLAG_SYNC) ? CODEC_BUFFER_FLAG_KEY_FRAME : 0;
+            trace.setFrame(sampleTime, inputBufferIndex);
+
+            // Copy sample data directly
+            ssize_t bytesRead;
+            {
+                StageTimer timer(telemetry, STAGE_EXTRACT);
+                bytesRead = extractor->readSampleData(inputBuffer, inputCapacity);
+            }
+            if (bytesRead != sampleSize) {
+                LOGE("Error reading sample data: %zd", bytesRead);
+                return false;
+            }
+            (*samplesRead)++;
+            telemetry->add(COUNTER_SAMPLES_READ);
+            telemetry->add(COUNTER_BYTES_READ, bytesRead);
+        }
+
+        // Queue input buffer and advance to the next sample. The queue time
+        // goes first, since the frame may come out before queueInputBuffer returns.
+        if (!sawInputEOS) {
+            telemetry->queued(STAGE_DECODE, sampleTime);
+        }
+        if (!decoder->queueInputBuffer(inputBufferIndex, 0, sampleSize, sampleTime, sampleFlags)) {
+            LOGE("Failed to queue decoder input at %lld", static_cast<long long>(sampleTime));
+            return false;
+        }
+        if (!sawInputEOS) {
+            extractor->advance();
+        }
+    }
+    return !aborted;
+}
+
+// Copies a decoded frame laid out as format into an encoder input buffer
+// laid out as encode, dropping the decoder's row and slice padding, scaling
+// it to the encoder's size and converting between I420 and NV12 when the
+// codecs disagree. Unknown layouts are copied byte for byte. scratch holds
+// the frame between a scale and a conversion, and frameFormat gets the
+// layout of what was written. Returns the bytes written.
+size_t copyDecodedFrame(uint8_t* decoded, size_t decodedSize, const TrackFormat& format, const TrackFormat& encode,
+                        const TranscodeOptions& options, std::vector<uint8_t>* scratch, uint8_t* input,
+                        size_t inputCapacity, TrackFormat* frameFormat) {
+    *frameFormat = format;
+    FrameFormat decodedFormat = frameFormatFromColorFormat(format.colorFormat);
+    FrameFormat encoderFormat = frameFormatFromColorFormat(encode.colorFormat);
+    FrameView source;
+    FrameView destination;
+    bool converted = wrapFrame(decoded, decodedSize, decodedFormat, format.width, format.height, format.stride,
+                               format.sliceHeight, &source) &&
+                     wrapFrame(input, inputCapacity, encoderFormat, encode.width, encode.height, 0, 0,
+                               &destination);
+    if (converted) {
+        if (format.width == encode.width && format.height == encode.height) {
+            converted = convertFrame(source, destination);
+        } else if (decodedFormat == encoderFormat) {
+            converted = scaleFrame(source, destination, options.scaleFilter, options.workerPool);
+        } else {
+            // Scale in the decoder's layout, then convert
+            FrameView scaled;
+            scratch->resize(frameBufferSize(decodedFormat, encode.width, encode.height));
+            converted = wrapFrame(scratch->data(), scratch->size(), decodedFormat, encode.width, encode.height, 0,
+                                  0, &scaled) &&
+                        scaleFrame(source, scaled, options.scaleFilter, options.workerPool) &&
+                        convertFrame(scaled, destination);
+        }
+    }
+    if (converted) {
+        frameFormat->width = encode.width;
+        frameFormat->height = encode.height;
+        frameFormat->colorFormat = encode.colorFormat;
+        frameFormat->stride = 0;
+        frameFormat->sliceHeight = 0;
+        return frameBufferSize(encoderFormat, encode.width, encode.height);
+    }
+
+    size_t size = decodedSize;
+    if (size > inputCapacity) {
+        LOGE("Decoded frame (%zu bytes) does not fit encoder input (%zu bytes)", size, inputCapacity);
+        size = inputCapacity;
+    }
+    memcpy(input, decoded, size);
+    return size;
+}
+
+// Three-stage transcode: feedStage (extractor -> decoder input),
+// decodeStage (decoder output -> encoder input) and muxStage (encoder
+// output -> muxer). Each stage owns its side of one codec, drains everything
+// that is available before waiting again, and passes end of stream on.
+class TranscodePipeline {
+    // Encoder input buffer filled by the decode stage, waiting to be queued
+    struct PendingEncode {
+        size_t inputBufferIndex;
+        size_t size;
+        int64_t presentationTimeUs;
+    };
+
+public:
+    TranscodePipeline(const TranscodeOptions& options, SampleSource* extractor, VideoCodec* decoder,
+                      VideoCodec* encoder, PassthroughMuxer* muxer, const TrackFormat& encodeFormat, bool useSurface,
+                      const FrameWindow& window)
+        : mOptions(options), mExtractor(extractor), mDecoder(decoder), mEncoder(encoder), mMuxer(muxer),
+          mEncodeFormat(encodeFormat), mUseSurface(useSurface), mWindow(window),
+          mOwnTelemetry(options.telemetry ? nullptr : new PipelineTelemetry()),
+          mTelemetry(options.telemetry ? options.telemetry : mOwnTelemetry.get()),
+          mDecoderLimit(options.maxFramesInFlight), mEncoderLimit(options.maxFramesInFlight),
+          mReorder([this](PendingEncode& frame) { queueEncoderInput(frame); }) {}
+
+    bool run(TranscodeResult* result) {
+        std::thread feedThread(&TranscodePipeline::feedStage, this);
+        std::thread decodeThread(&TranscodePipeline::decodeStage, this);
+        muxStage();
+        feedThread.join();
+        decodeThread.join();
+        mReorder.drain();
+        if (!mAborted && mMuxer->started() && !mMuxer->finish()) {
+            mAborted = true;
+        }
+
+        result->samplesRead = mSamplesRead;
+        result->framesDecoded = mFramesDecoded;
+        result->framesEncoded = mFramesEncoded;
+        result->samplesWritten = mSamplesWritten;
+        result->bytesWritten = mBytesWritten;
+        result->bytesCopied = mBytesCopied;
+        result->framesSkipped = mFramesSkipped;
+        result->samplesPassedThrough = mMuxer->samplesWritten();
+        result->usedSurface = mUseSurface;
+        return !mAborted;
+    }
+
+private:
+    void abort() {
+        mAborted = true;
+        mDecoderLimit.wake();
+        mEncoderLimit.wake();
+    }
+
+    // Stage 1: extractor -> decoder input
+    void feedStage() {
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("feed");
+        }
+        if (!feedDecoder(mExtractor, mDecoder, mMuxer, &mDecoderLimit, mOptions.timeoutUs, mAborted, mTelemetry,
+                         mOptions.tracer, &mSamplesRead)) {
+            abort();
+        }
+    }
+
+    // Stage 2: decoder output -> encoder input
+    void decodeStage() {
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("decode");
+        }
+        CodecBufferInfo info;
+        int64_t timeoutUs = mOptions.timeoutUs;
+        while (!mAborted) {
+            ssize_t outputBufferIndex = mDecoder->dequeueOutputBuffer(&info, timeoutUs);
+            if (outputBufferIndex == CODEC_INFO_TRY_AGAIN_LATER) {
+                // Drained; wait for the next frame
+                mTelemetry->add(COUNTER_DECODER_OUTPUT_TRY_AGAIN);
+                mDecoderLimit.relieve();
+                timeoutUs = mOptions.timeoutUs;
+                continue;
+            }
+            if (outputBufferIndex == CODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+                mDecoder->getOutputFormat(&mDecodedFormat);
+                LOGI("Decoder output format changed: %dx%d color %d",
+                     mDecodedFormat.width, mDecodedFormat.height, mDecodedFormat.colorFormat);
+                continue;
+            }
+            if (outputBufferIndex < 0) {
+                continue;
+            }
+            TraceScope trace(mOptions.tracer, TRACE_DECODED, info.presentationTimeUs, outputBufferIndex);
+            if (mDecodedFormat.width == 0) {
+                // A warm decoder from the codec pool does not announce its format again
+                mDecoder->getOutputFormat(&mDecodedFormat);
+            }
+
+            mDecoderLimit.release(info.presentationTimeUs);
+            bool endOfStream = (info.flags & CODEC_BUFFER_FLAG_END_OF_STREAM) != 0;
+            if (info.size > 0) {
+                mTelemetry->produced(STAGE_DECODE, info.presentationTimeUs);
+                mTelemetry->add(COUNTER_FRAMES_DECODED);
+            }
+            if (info.size > 0 && !mWindow.contains(info.presentationTimeUs)) {
+                // Pre-roll from the sync sample before the window, or a frame
+                // past its end that was only fed to complete reordering
+                mFramesDecoded++;
+                mFramesSkipped++;
+                info.size = 0;
+            }
+            if (mUseSurface) {
+                // Rendering hands the frame to the encoder surface; no copy, no encoder buffer
+                if (info.size > 0) {
+                    mFramesDecoded++;
+                    mTelemetry->queued(STAGE_ENCODE, info.presentationTimeUs);
+                }
+                mDecoder->releaseOutputBuffer(outputBufferIndex, info.size > 0);
+                if (endOfStream) {
+                    mEncoder->signalEndOfInputStream();
+                    return;
+                }
+                timeoutUs = 0;
+                continue;
+            }
+            if (info.size > 0) {
+                mFramesDecoded++;
+                if (!encodeFrame(outputBufferIndex, info)) {
+                    mDecoder->releaseOutputBuffer(outputBufferIndex, false);
+                    abort();
+                    return;
+                }
+            }
+            mDecoder->releaseOutputBuffer(outputBufferIndex, false);
+
+            if (endOfStream) {
+                // Frames still on the worker pool go to the encoder first
+                mReorder.drain();
+                if (mAborted) {
+                    return;
+                }
+
+                // Pass end of stream on to the encoder
+                ssize_t inputBufferIndex;
+                while ((inputBufferIndex = mEncoder->dequeueInputBuffer(mOptions.timeoutUs)) < 0) {
+                    if (mAborted) {
+                        return;
+                    }
+                }
+                mEncoder->queueInputBuffer(inputBufferIndex, 0, 0, info.presentationTimeUs,
+                                           CODEC_BUFFER_FLAG_END_OF_STREAM);
+                return;
+            }
+
+            // Keep draining without waiting while output is available
+            timeoutUs = 0;
+        }
+    }
+
+    bool encodeFrame(size_t outputBufferIndex, const CodecBufferInfo& info) {
+        if (!mEncoderLimit.acquire(info.presentationTimeUs, mAborted, mOptions.timeoutUs)) {
+            return false;
+        }
+        ssize_t inputBufferIndex;
+        while ((inputBufferIndex = mEncoder->dequeueInputBuffer(mOptions.timeoutUs)) < 0) {
+            if (mAborted) {
+                return false;
+            }
+            if (inputBufferIndex == CODEC_INFO_TRY_AGAIN_LATER) {
+                mTelemetry->add(COUNTER_ENCODER_INPUT_TRY_AGAIN);
+            }
+        }
+
+        size_t outputCapacity;
+        uint8_t *outputBuffer = mDecoder->getOutputBuffer(outputBufferIndex, &outputCapacity);
+        size_t inputCapacity;
+        uint8_t *inputBuffer = mEncoder->getInputBuffer(inputBufferIndex, &inputCapacity);
+        size_t size;
+        {
+            StageTimer timer(mTelemetry, STAGE_COPY);
+            TraceScope trace(mOptions.tracer, TRACE_COPY, info.presentationTimeUs, inputBufferIndex);
+            size = copyDecodedFrame(outputBuffer + info.offset, info.size, mDecodedFormat, mEncodeFormat, mOptions,
+                                    &mScaled, inputBuffer, inputCapacity, &mFrameFormat);
+        }
+        mBytesCopied += size;
+        mTelemetry->add(COUNTER_BYTES_COPIED, size);
+
+        PendingEncode frame = { static_cast<size_t>(inputBufferIndex), size, info.presentationTimeUs };
+        FrameProcessor* processor = mOptions.frameProcessor;
+        if (!processor) {
+            return queueEncoderInput(frame);
+        }
+        if (!mOptions.workerPool) {
+            {
+                StageTimer timer(mTelemetry, STAGE_PROCESS);
+                TraceScope trace(mOptions.tracer, TRACE_PROCESS, info.presentationTimeUs, inputBufferIndex);
+                processor->process(inputBuffer, size, mFrameFormat, info.presentationTimeUs, nullptr);
+            }
+            return queueEncoderInput(frame);
+        }
+
+        // Process on the pool; the reorder buffer queues frames to the encoder in decode order
+        uint64_t sequence = mReorder.reserve();
+        WorkerPool* pool = mOptions.workerPool;
+        TrackFormat format = mFrameFormat;
+        mTelemetry->addGauge(GAUGE_PENDING_FRAMES, 1);
+        pool->submit([this, processor, pool, inputBuffer, frame, sequence, format] {
+            {
+                StageTimer timer(mTelemetry, STAGE_PROCESS);
+                TraceScope trace(mOptions.tracer, TRACE_PROCESS, frame.presentationTimeUs, frame.inputBufferIndex);
+                processor->process(inputBuffer, frame.size, format, frame.presentationTimeUs, pool);
+            }
+            mTelemetry->addGauge(GAUGE_PENDING_FRAMES, -1);
+            mReorder.complete(sequence, frame);
+        });
+        return true;
+    }
+
+    bool queueEncoderInput(const PendingEncode& frame) {
+        if (mAborted) {
+            return false;
+        }
+        mTelemetry->queued(STAGE_ENCODE, frame.presentationTimeUs);
+        if (!mEncoder->queueInputBuffer(frame.inputBufferIndex, 0, frame.size, frame.presentationTimeUs, 0)) {
+            LOGE("Failed to queue encoder input at %lld", static_cast<long long>(frame.presentationTimeUs));
+            abort();
+            return false;
+        }
+        return true;
+    }
+
+    bool startMuxer() {
+        TrackFormat encodedFormat;
+        mEncoder->getOutputFormat(&encodedFormat);
+        if (!mMuxer->start(encodedFormat)) {
+            LOGE("Failed to start muxer");
+            abort();
+            return false;
+        }
+        return true;
+    }
+
+    // Stage 3: encoder output -> muxer
+    void muxStage() {
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("mux");
+        }
+        CodecBufferInfo encodeInfo;
+        int64_t timeoutUs = mOptions.timeoutUs;
+        bool muxerStarted = false;
+        while (!mAborted) {
+            if (mOptions.cancelled && *mOptions.cancelled) {
+                LOGI("Transcode cancelled");
+                abort();
+                return;
+            }
+            ssize_t encodeOutputIndex = mEncoder->dequeueOutputBuffer(&encodeInfo, timeoutUs);
+            if (encodeOutputIndex == CODEC_INFO_TRY_AGAIN_LATER) {
+                mTelemetry->add(COUNTER_ENCODER_OUTPUT_TRY_AGAIN);
+                if (!mUseSurface) {
+                    mEncoderLimit.relieve();
+                }
+                timeoutUs = mOptions.timeoutUs;
+                continue;
+            }
+            if (encodeOutputIndex == CODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+                if (!muxerStarted && !startMuxer()) {
+                    return;
+                }
+                muxerStarted = true;
+                continue;
+            }
+            if (encodeOutputIndex < 0) {
+                continue;
+            }
+            TraceScope trace(mOptions.tracer, TRACE_ENCODED, encodeInfo.presentationTimeUs, encodeOutputIndex);
+
+            size_t encodedDataSize;
+            uint8_t *encodedData = mEncoder->getOutputBuffer(encodeOutputIndex, &encodedDataSize);
+            // Codec config is carried by the output format, not as a sample
+            bool isConfig = (encodeInfo.flags & CODEC_BUFFER_FLAG_CODEC_CONFIG) != 0;
+            if (encodeInfo.size > 0 && !isConfig) {
+                // A warm encoder from the codec pool does not announce its format again
+                if (!muxerStarted && !startMuxer()) {
+                    mEncoder->releaseOutputBuffer(encodeOutputIndex, false);
+                    return;
+                }
+                muxerStarted = true;
+                if (!mUseSurface) {
+                    mEncoderLimit.release(encodeInfo.presentationTimeUs);
+                }
+                mFramesEncoded++;
+                mTelemetry->produced(STAGE_ENCODE, encodeInfo.presentationTimeUs);
+                mTelemetry->add(COUNTER_FRAMES_ENCODED);
+                encodeInfo.presentationTimeUs -= mWindow.shiftUs;
+                bool written;
+                {
+                    StageTimer timer(mTelemetry, STAGE_MUX);
+                    TraceScope muxTrace(mOptions.tracer, TRACE_MUX, encodeInfo.presentationTimeUs, encodeOutputIndex);
+                    written = mMuxer->writeVideo(encodedData, encodeInfo);
+                }
+                if (!written) {
+                    LOGE("Failed to write sample at %lld", static_cast<long long>(encodeInfo.presentationTimeUs));
+                    mEncoder->releaseOutputBuffer(encodeOutputIndex, false);
+                    abort();
+                    return;
+                }
+                mSamplesWritten++;
+                mBytesWritten += encodeInfo.size;
+                mTelemetry->add(COUNTER_BYTES_WRITTEN, encodeInfo.size);
+            }
+            mEncoder->releaseOutputBuffer(encodeOutputIndex, false);
+            if (encodeInfo.flags & CODEC_BUFFER_FLAG_END_OF_STREAM) {
+                return;
+            }
+            timeoutUs = 0;
+        }
+    }
+
+    const TranscodeOptions& mOptions;
+    SampleSource* mExtractor;
+    VideoCodec* mDecoder;
+    VideoCodec* mEncoder;
+    PassthroughMuxer* mMuxer;
+    const TrackFormat mEncodeFormat;
+    const bool mUseSurface;
+    const FrameWindow mWindow;
+    std::unique_ptr<PipelineTelemetry> mOwnTelemetry;  // When the options bring none
+    PipelineTelemetry* mTelemetry;
+
+    InFlightLimit mDecoderLimit;
+    InFlightLimit mEncoderLimit;
+    FrameReorderBuffer<PendingEncode> mReorder;
+    TrackFormat mDecodedFormat;
+    TrackFormat mFrameFormat;  // Layout of the frame handed to the encoder and frameProcessor
+    std::vector<uint8_t> mScaled;  // Scaled frame waiting for a color conversion
+    std::atomic<bool> mAborted{false};
+
+    // Each counter is written by a single stage and read after the join
+    int64_t mSamplesRead = 0;
+    int64_t mFramesDecoded = 0;
+    int64_t mFramesEncoded = 0;
+    int64_t mSamplesWritten = 0;
+    int64_t mBytesWritten = 0;
+    int64_t mBytesCopied = 0;
+    int64_t mFramesSkipped = 0;
+};
+
+// How long the event loop sleeps without events before looking at the
+// cancel flag again; buffers themselves move on events only
+const int64_t kEventLoopIdleUs = 100000;
+
+// Transcode for codecs in asynchronous mode. Both codecs post their
+// notifications to this pipeline and one event loop moves every buffer on as
+// soon as its codec hands it over: a free decoder input gets the next sample,
+// a decoded frame goes into the next free encoder input (or is rendered to
+// the encoder surface), and encoded output goes to the muxer. No thread waits
+// on a dequeue timeout, and the codecs' own buffer counts bound the frames in
+// flight. The frame processor runs on the loop, with workerPool only
+// splitting each frame.
+class AsyncTranscodePipeline : public CodecCallback {
+    struct Event {
+        enum Type { INPUT, OUTPUT, FORMAT, ERROR } type;
+        VideoCodec* codec;
+        size_t index;
+        CodecBufferInfo info;
+        TrackFormat format;
+    };
+
+    // Decoder output waiting for an encoder input buffer
+    struct DecodedFrame {
+        size_t index;
+        CodecBufferInfo info;
+        bool released;  // Frame handed on; only an end of stream may be left to pass
+    };
+
+public:
+    AsyncTranscodePipeline(const TranscodeOptions& options, SampleSource* extractor, VideoCodec* decoder,
+                           VideoCodec* encoder, PassthroughMuxer* muxer, const TrackFormat& encodeFormat,
+                           const FrameWindow& window)
+        : mOptions(options), mExtractor(extractor), mDecoder(decoder), mEncoder(encoder), mMuxer(muxer),
+          mEncodeFormat(encodeFormat), mWindow(window),
+          mOwnTelemetry(options.telemetry ? nullptr : new PipelineTelemetry()),
+          mTelemetry(options.telemetry ? options.telemetry : mOwnTelemetry.get()) {}
+
+    // Called on the codecs' threads
+    void onInputAvailable(VideoCodec* codec, size_t index) override {
+        post({ Event::INPUT, codec, index, CodecBufferInfo(), TrackFormat() });
+    }
+
+    void onOutputAvailable(VideoCodec* codec, size_t index, const CodecBufferInfo& info) override {
+        post({ Event::OUTPUT, codec, index, info, TrackFormat() });
+    }
+
+    void onFormatChanged(VideoCodec* codec, const TrackFormat& format) override {
+        post({ Event::FORMAT, codec, 0, CodecBufferInfo(), format });
+    }
+
+    void onError(VideoCodec* codec, int32_t error, const char* detail) override {
+        LOGE("%s error %d: %s", codec == mDecoder ? "Decoder" : "Encoder", error, detail ? detail : "");
+        post({ Event::ERROR, codec, 0, CodecBufferInfo(), TrackFormat() });
+    }
+
+    // Runs the event loop on the calling thread until the encoder's end of
+    // stream, an error or cancellation. useSurface says the decoder renders
+    // into the encoder's input surface.
+    bool run(bool useSurface, TranscodeResult* result) {
+        mUseSurface = useSurface;
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("event loop");
+        }
+        while (!mAborted && !mEncoderDone) {
+            if (mOptions.cancelled && *mOptions.cancelled) {
+                LOGI("Transcode cancelled");
+                mAborted = true;
+                break;
+            }
+            Event event;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                if (mEvents.empty()) {
+                    mCondition.wait_for(lock, std::chrono::microseconds(kEventLoopIdleUs));
+                    continue;
+                }
+                event = std::move(mEvents.front());
+                mEvents.pop_front();
+                mTelemetry->setGauge(GAUGE_EVENT_QUEUE, mEvents.size());
+            }
+            handle(event);
+        }
+        if (!mAborted && mMuxer->started() && !mMuxer->finish()) {
+            mAborted = true;
+        }
+
+        result->samplesRead = mSamplesRead;
+        result->framesDecoded = mFramesDecoded;
+        result->framesEncoded = mFramesEncoded;
+        result->samplesWritten = mSamplesWritten;
+        result->bytesWritten = mBytesWritten;
+        result->bytesCopied = mBytesCopied;
+        result->framesSkipped = mFramesSkipped;
+        result->samplesPassedThrough = mMuxer->samplesWritten();
+        result->usedSurface = mUseSurface;
+        return !mAborted;
+    }
+
+private:
+    void post(Event event) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEvents.push_back(std::move(event));
+        mTelemetry->setGauge(GAUGE_EVENT_QUEUE, mEvents.size());
+        mCondition.notify_one();
+    }
+
+    void handle(const Event& event) {
+        bool decoder = event.codec == mDecoder;
+        switch (event.type) {
+        case Event::ERROR:
+            mAborted = true;
+            break;
+        case Event::FORMAT:
+            if (decoder) {
+                mDecodedFormat = event.format;
+                LOGI("Decoder output format changed: %dx%d color %d",
+                     mDecodedFormat.width, mDecodedFormat.height, mDecodedFormat.colorFormat);
+            } else if (!mMuxerStarted) {
+                startMuxer(event.format);
+            }
+            break;
+        case Event::INPUT:
+            if (decoder) {
+                mDecoderInputs.push_back(event.index);
+                feed();
+            } else {
+                mEncoderInputs.push_back(event.index);
+                drainDecoded();
+            }
+            break;
+        case Event::OUTPUT:
+            if (decoder) {
+                if (event.info.size > 0) {
+                    mTelemetry->produced(STAGE_DECODE, event.info.presentationTimeUs);
+                    mTelemetry->add(COUNTER_FRAMES_DECODED);
+                }
+                mDecoded.push_back({ event.index, event.info, false });
+                drainDecoded();
+            } else {
+                writeEncoded(event.index, event.info);
+            }
+            break;
+        }
+        mTelemetry->setGauge(GAUGE_PENDING_FRAMES, mDecoded.size());
+    }
+
+    // Fills every free decoder input with the next video sample, copying
+    // passthrough samples on the way
+    void feed() {
+        while (!mAborted && !mInputDone && !mDecoderInputs.empty()) {
+            int track = mExtractor->getSampleTrackIndex();
+            if (track >= 0 && mMuxer->carries(track)) {
+                if (!mMuxer->copySample(mExtractor, track)) {
+                    mAborted = true;
+                    return;
+                }
+                mExtractor->advance();
+                continue;
+            }
+
+            size_t inputBufferIndex = mDecoderInputs.front();
+            mDecoderInputs.pop_front();
+            TraceScope trace(mOptions.tracer, TRACE_FEED, -1, inputBufferIndex);
+            size_t inputCapacity;
+            uint8_t *inputBuffer = mDecoder->getInputBuffer(inputBufferIndex, &inputCapacity);
+            ssize_t sampleSize = mExtractor->getSampleSize();
+            int64_t sampleTime = 0;
+            uint32_t sampleFlags = 0;
+            if (sampleSize < 0) {
+                mInputDone = true;
+                sampleSize = 0;
+                sampleFlags = CODEC_BUFFER_FLAG_END_OF_STREAM;
+            } else {
+                sampleTime = mExtractor->getSampleTime();
+                sampleFlags = (mExtractor->getSampleFlags() & SAMPLE_FLAG_SYNC) ? CODEC_BUFFER_FLAG_KEY_FRAME : 0;
+                trace.setFrame(sampleTime, inputBufferIndex);
+                ssize_t bytesRead;
+                {
+                    StageTimer timer(mTelemetry, STAGE_EXTRACT);
+                    bytesRead = mExtractor->readSampleData(inputBuffer, inputCapacity);
+                }
+                if (bytesRead != sampleSize) {
+                    LOGE("Error reading sample data: %zd", bytesRead);
+                    mAborted = true;
+                    return;
+                }
+                mSamplesRead++;
+                mTelemetry->add(COUNTER_SAMPLES_READ);
+                mTelemetry->add(COUNTER_BYTES_READ, bytesRead);
+            }
+            if (!mInputDone) {
+                mTelemetry->queued(STAGE_DECODE, sampleTime);
+            }
+            if (!mDecoder->queueInputBuffer(inputBufferIndex, 0, sampleSize, sampleTime, sampleFlags)) {
+                LOGE("Failed to queue decoder input at %lld", static_cast<long long>(sampleTime));
+                mAborted = true;
+                return;
+            }
+            if (!mInputDone) {
+                mExtractor->advance();
+            }
+        }
+    }
+
+    // Hands decoded frames on in order while the encoder has room for them
+    void drainDecoded() {
+        while (!mAborted && !mDecoded.empty()) {
+            DecodedFrame& frame = mDecoded.front();
+            if (!frame.released) {
+                TraceScope trace(mOptions.tracer, TRACE_DECODED, frame.info.presentationTimeUs, frame.index);
+                if (mDecodedFormat.width == 0) {
+                    mDecoder->getOutputFormat(&mDecodedFormat);
+                }
+                if (frame.info.size > 0 && !mWindow.contains(frame.info.presentationTimeUs)) {
+                    // Pre-roll before the window, or a frame past its end fed to complete reordering
+                    mFramesDecoded++;
+                    mFramesSkipped++;
+                    frame.info.size = 0;
+                }
+                if (frame.info.size > 0 && !mUseSurface) {
+                    if (mEncoderInputs.empty()) {
+                        return;
+                    }
+                    mFramesDecoded++;
+                    if (!encodeFrame(frame)) {
+                        mDecoder->releaseOutputBuffer(frame.index, false);
+                        mAborted = true;
+                        return;
+                    }
+                    mDecoder->releaseOutputBuffer(frame.index, false);
+                } else {
+                    // Rendering hands the frame to the encoder surface; no copy, no encoder buffer
+                    if (frame.info.size > 0) {
+                        mFramesDecoded++;
+                        mTelemetry->queued(STAGE_ENCODE, frame.info.presentationTimeUs);
+                    }
+                    mDecoder->releaseOutputBuffer(frame.index, frame.info.size > 0);
+                }
+                frame.released = true;
+            }
+
+            if (frame.info.flags & CODEC_BUFFER_FLAG_END_OF_STREAM) {
+                if (mUseSurface) {
+                    mEncoder->signalEndOfInputStream();
+                } else {
+                    if (mEncoderInputs.empty()) {
+                        return;
+                    }
+                    size_t inputBufferIndex = mEncoderInputs.front();
+                    mEncoderInputs.pop_front();
+                    mEncoder->queueInputBuffer(inputBufferIndex, 0, 0, frame.info.presentationTimeUs,
+                                               CODEC_BUFFER_FLAG_END_OF_STREAM);
+                }
+            }
+            mDecoded.pop_front();
+        }
+    }
+
+    bool encodeFrame(const DecodedFrame& frame) {
+        size_t inputBufferIndex = mEncoderInputs.front();
+        mEncoderInputs.pop_front();
+        size_t outputCapacity;
+        uint8_t *outputBuffer = mDecoder->getOutputBuffer(frame.index, &outputCapacity);
+        size_t inputCapacity;
+        uint8_t *inputBuffer = mEncoder->getInputBuffer(inputBufferIndex, &inputCapacity);
+        size_t size;
+        {
+            StageTimer timer(mTelemetry, STAGE_COPY);
+            TraceScope trace(mOptions.tracer, TRACE_COPY, frame.info.presentationTimeUs, inputBufferIndex);
+            size = copyDecodedFrame(outputBuffer + frame.info.offset, frame.info.size, mDecodedFormat, mEncodeFormat,
+                                    mOptions, &mScaled, inputBuffer, inputCapacity, &mFrameFormat);
+        }
+        mBytesCopied += size;
+        mTelemetry->add(COUNTER_BYTES_COPIED, size);
+        if (mOptions.frameProcessor) {
+            StageTimer timer(mTelemetry, STAGE_PROCESS);
+            TraceScope trace(mOptions.tracer, TRACE_PROCESS, frame.info.presentationTimeUs, inputBufferIndex);
+            mOptions.frameProcessor->process(inputBuffer, size, mFrameFormat, frame.info.presentationTimeUs,
+                                             mOptions.workerPool);
+        }
+        mTelemetry->queued(STAGE_ENCODE, frame.info.presentationTimeUs);
+        if (!mEncoder->queueInputBuffer(inputBufferIndex, 0, size, frame.info.presentationTimeUs, 0)) {
+            LOGE("Failed to queue encoder input at %lld", static_cast<long long>(frame.info.presentationTimeUs));
+            return false;
+        }
+        return true;
+    }
+
+    bool startMuxer(const TrackFormat& encodedFormat) {
+        if (!mMuxer->start(encodedFormat)) {
+            LOGE("Failed to start muxer");
+            mAborted = true;
+            return false;
+        }
+        mMuxerStarted = true;
+        return true;
+    }
+
+    void writeEncoded(size_t index, CodecBufferInfo info) {
+        TraceScope trace(mOptions.tracer, TRACE_ENCODED, info.presentationTimeUs, index);
+        size_t encodedDataSize;
+        uint8_t *encodedData = mEncoder->getOutputBuffer(index, &encodedDataSize);
+        // Codec config is carried by the output format, not as a sample
+        bool isConfig = (info.flags & CODEC_BUFFER_FLAG_CODEC_CONFIG) != 0;
+        if (info.size > 0 && !isConfig) {
+            if (!mMuxerStarted) {
+                TrackFormat encodedFormat;
+                mEncoder->getOutputFormat(&encodedFormat);
+                if (!startMuxer(encodedFormat)) {
+                    mEncoder->releaseOutputBuffer(index, false);
+                    return;
+                }
+            }
+            mFramesEncoded++;
+            mTelemetry->produced(STAGE_ENCODE, info.presentationTimeUs);
+            mTelemetry->add(COUNTER_FRAMES_ENCODED);
+            info.presentationTimeUs -= mWindow.shiftUs;
+            bool written;
+            {
+                StageTimer timer(mTelemetry, STAGE_MUX);
+                TraceScope muxTrace(mOptions.tracer, TRACE_MUX, info.presentationTimeUs, index);
+                written = mMuxer->writeVideo(encodedData, info);
+            }
+            if (!written) {
+                LOGE("Failed to write sample at %lld", static_cast<long long>(info.presentationTimeUs));
+                mEncoder->releaseOutputBuffer(index, false);
+                mAborted = true;
+                return;
+            }
+            mSamplesWritten++;
+            mBytesWritten += info.size;
+            mTelemetry->add(COUNTER_BYTES_WRITTEN, info.size);
+        }
+        mEncoder->releaseOutputBuffer(index, false);
+        if (info.flags & CODEC_BUFFER_FLAG_END_OF_STREAM) {
+            mEncoderDone = true;
+        }
+    }
+
+    const TranscodeOptions& mOptions;
+    SampleSource* mExtractor;
+    VideoCodec* mDecoder;
+    VideoCodec* mEncoder;
+    PassthroughMuxer* mMuxer;
+    const TrackFormat mEncodeFormat;
+    const FrameWindow mWindow;
+    std::unique_ptr<PipelineTelemetry> mOwnTelemetry;  // When the options bring none
+    PipelineTelemetry* mTelemetry;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<Event> mEvents;
+
+    // Everything below is touched by the event loop only
+    bool mUseSurface = false;
+    bool mAborted = false;
+    bool mInputDone = false;
+    bool mEncoderDone = false;
+    bool mMuxerStarted = false;
+    std::deque<size_t> mDecoderInputs;
+    std::deque<size_t> mEncoderInputs;
+    std::deque<DecodedFrame> mDecoded;
+    TrackFormat mDecodedFormat;
+    TrackFormat mFrameFormat;
+    std::vector<uint8_t> mScaled;
+    int64_t mSamplesRead = 0;
+    int64_t mFramesDecoded = 0;
+    int64_t mFramesEncoded = 0;
+    int64_t mSamplesWritten = 0;
+    int64_t mBytesWritten = 0;
+    int64_t mBytesCopied = 0;
+    int64_t mFramesSkipped = 0;
+};
+
+// Opens inputPath and selects its first video track
+std::unique_ptr<SampleSource> openVideoTrack(CodecBackend* backend, const char* inputPath, TrackFormat* trackFormat) {
+    std::unique_ptr<SampleSource> extractor = backend->openSource(inputPath);
+    if (!extractor) {
+        return nullptr;
+    }
+
+    // Get video track format from extractor
+    int trackCount = extractor->getTrackCount();
+    int videoTrackIndex = -1;
+    for (int i = 0; i < trackCount; ++i) {
+        if (extractor->getTrackFormat(i, trackFormat) && !strncmp(trackFormat->mime.c_str(), "video/", 6)) {
+            videoTrackIndex = i;
+            break;
+        }
+    }
+
+    if (videoTrackIndex < 0) {
+        LOGE("No video track found");
+        return nullptr;
+    }
+
+    extractor->selectTrack(videoTrackIndex);
+    return extractor;
+}
+
+// Runs the pipeline with a decoder and an encoder created for it in
+// asynchronous mode (see AsyncTranscodePipeline). Returns false with
+// *unsupported set, before touching extractor or muxer, when either codec
+// has no asynchronous mode.
+bool runAsyncPipeline(CodecBackend* backend, SampleSource* extractor, const TrackFormat& trackFormat,
+                      const TrackFormat& format, const std::vector<PassthroughTrack>& passthrough, SampleSink* muxer,
+                      const TranscodeOptions& options, const FrameWindow& window, TranscodeResult* result,
+                      bool* unsupported) {
+    *unsupported = false;
+    std::unique_ptr<VideoCodec> encoder = backend->createEncoder(format.mime.c_str());
+    std::unique_ptr<VideoCodec> decoder = backend->createDecoder(trackFormat.mime.c_str());
+    if (!encoder || !decoder) {
+        return false;
+    }
+
+    // The callback goes in before configure
+    PassthroughMuxer pipelineMuxer(muxer, passthrough, window);
+    AsyncTranscodePipeline pipeline(options, extractor, decoder.get(), encoder.get(), &pipelineMuxer, format, window);
+    if (!encoder->setCallback(&pipeline) || !decoder->setCallback(&pipeline)) {
+        *unsupported = true;
+        return false;
+    }
+
+    CodecSurface* surface = nullptr;
+    if (options.useSurface && !options.frameProcessor) {
+        TrackFormat surfaceFormat = format;
+        surfaceFormat.colorFormat = CODEC_COLOR_FORMAT_SURFACE;
+        if (encoder->configure(surfaceFormat, true)) {
+            surface = encoder->createInputSurface();
+        }
+        if (!surface) {
+            LOGW("Encoder has no input surface, copying frames instead");
+            encoder = backend->createEncoder(format.mime.c_str());
+            if (!encoder || !encoder->setCallback(&pipeline)) {
+                return false;
+            }
+        }
+    }
+
+    if ((!surface && !encoder->configure(format, true)) || !encoder->start()) {
+        LOGE("Failed to start encoder");
+        return false;
+    }
+    if (!decoder->configure(trackFormat, surface, false) || !decoder->start()) {
+        LOGE("Failed to start decoder");
+        encoder->stop();
+        return false;
+    }
+
+    bool ok = pipeline.run(surface != nullptr, result);
+
+    // Stopped before the pipeline goes, so no notification outlives it
+    encoder->stop();
+    decoder->stop();
+    if (pipelineMuxer.started()) {
+        muxer->stop();
+    }
+    return ok;
+}
+
+// Acquires a decoder and an encoder for trackFormat and runs the pipeline
+// from extractor's current position into muxer, copying the samples of the
+// passthrough tracks selected on extractor alongside
+bool runPipeline(CodecBackend* backend, SampleSource* extractor, const TrackFormat& trackFormat,
+                 const std::vector<PassthroughTrack>& passthrough, SampleSink* muxer, const TranscodeOptions& options,
+                 const FrameWindow& window, TranscodeResult* result) {
+    TrackFormat format = resolveEncodeProfile(options.encode, trackFormat);
+    LOGI("Encoding %s %dx%d at %d fps, %d bit/s", format.mime.c_str(), format.width, format.height,
+         format.frameRate, format.bitRate);
+    if (options.useSurface && options.frameProcessor) {
+        LOGW("Surface input ignored: the frame processor needs decoded pixels");
+    }
+
+    if (options.asyncCodecs) {
+        bool unsupported;
+        bool ok = runAsyncPipeline(backend, extractor, trackFormat, format, passthrough, muxer, options, window,
+                                   result, &unsupported);
+        if (!unsupported) {
+            return ok;
+        }
+        LOGW("Codecs have no asynchronous mode, polling instead");
+    }
+
+    // Initialize encoder
+    CodecLease encoder(backend, options.codecPool);
+
+    // Surface input: the decoder renders into the encoder, bypassing the CPU
+    CodecSurface* surface = nullptr;
+    if (options.useSurface && !options.frameProcessor) {
+        TrackFormat surfaceFormat = format;
+        surfaceFormat.colorFormat = CODEC_COLOR_FORMAT_SURFACE;
+        if (!encoder.acquire(surfaceFormat, true, nullptr, &surface)) {
+            LOGW("Encoder has no input surface, copying frames instead");
+            surface = nullptr;
+        }
+    }
+
+    if (!surface && !encoder.acquire(format, true)) {
+        LOGE("Failed to start encoder");
+        return false;
+    }
+
+    // Initialize decoder
+    CodecLease decoder(backend, options.codecPool);
+    if (!decoder.acquire(trackFormat, false, surface)) {
+        LOGE("Failed to start decoder");
+        return false;
+    }
+
+    PassthroughMuxer pipelineMuxer(muxer, passthrough, window);
+    TranscodePipeline pipeline(options, extractor, decoder.get(), encoder.get(), &pipelineMuxer, format,
+                               surface != nullptr, window);
+    bool ok = pipeline.run(result);
+
+    // Clean up; codecs that finished their stream cleanly stay warm in the pool
+    encoder.finish(ok);
+    decoder.finish(ok);
+    if (pipelineMuxer.started()) {
+        muxer->stop();
+    }
+    return ok;
+}
+
+// Hands out the selected track's samples until the (reorderSamples + 1)th
+// one presented at or after endTimeUs, so frames presented before endTimeUs
+// that come after a later reference in decode order are still fed. A sync
+// sample past the end is fed too, since an open GOP's leading frames follow
+// it in decode order; the range then ends at the first sample presented at
+// or after it. Samples of ignored tracks (passthrough tracks selected next
+// to the video) never end the range.
+class RangeSampleSource : public SampleSource {
+public:
+    RangeSampleSource(SampleSource* source, int64_t endTimeUs, int32_t reorderSamples)
+        : mSource(source), mEndTimeUs(endTimeUs), mReorderSamples(reorderSamples) {}
+
+    void ignoreTrack(int trackIndex) { mIgnoredTracks.push_back(trackIndex); }
+
+    int getTrackCount() override { return mSource->getTrackCount(); }
+    bool getTrackFormat(int trackIndex, TrackFormat* format) override {
+        return mSource->getTrackFormat(trackIndex, format);
+    }
+    bool selectTrack(int trackIndex) override { return mSource->selectTrack(trackIndex); }
+
+    ssize_t getSampleSize() override { return ended() ? -1 : mSource->getSampleSize(); }
+    int64_t getSampleTime() override { return ended() ? -1 : mSource->getSampleTime(); }
+    uint32_t getSampleFlags() override { return ended() ? 0 : mSource->getSampleFlags(); }
+    int getSampleTrackIndex() override { return ended() ? -1 : mSource->getSampleTrackIndex(); }
+
+    ssize_t readSampleData(uint8_t* buffer, size_t capacity) override {
+        return ended() ? -1 : mSource->readSampleData(buffer, capacity);
+    }
+
+    bool advance() override {
+        if (ended()) {
+            return false;
+        }
+        if (pastEnd()) {
+            mSamplesPastEnd++;
+            if (mSyncPastEndUs < 0 && (mSource->getSampleFlags() & SAMPLE_FLAG_SYNC)) {
+                mSyncPastEndUs = mSource->getSampleTime();
+            }
+        }
+        return mSource->advance() && !ended();
+    }
+
+    bool seekTo(int64_t timeUs) override {
+        mSamplesPastEnd = 0;
+        mSyncPastEndUs = -1;
+        mEnded = false;
+        return mSource->seekTo(timeUs);
+    }
+
+private:
+    bool pastEnd() {
+        return mEndTimeUs >= 0 && mSource->getSampleTime() >= mEndTimeUs &&
+               std::find(mIgnoredTracks.begin(), mIgnoredTracks.end(), mSource->getSampleTrackIndex()) ==
+                       mIgnoredTracks.end();
+    }
+
+    // Once ended, later samples of ignored tracks stay hidden too
+    bool ended() {
+        if (!mEnded && pastEnd()) {
+            mEnded = (mSyncPastEndUs >= 0 && mSource->getSampleTime() >= mSyncPastEndUs) ||
+                     mSamplesPastEnd >= mReorderSamples;
+        }
+        return mEnded;
+    }
+
+    SampleSource* mSource;
+    int64_t mEndTimeUs;
+    int32_t mReorderSamples;
+    int32_t mSamplesPastEnd = 0;
+    int64_t mSyncPastEndUs = -1;        // First sync sample fed past the end
+    std::vector<int> mIgnoredTracks;
+    bool mEnded = false;
+};
+
+// Samples a range transcode feeds past its end, enough for the B-frame
+// reordering of common encoders
+const int32_t kRangeReorderSamples = 16;
+
+// Puts the encoded samples of concurrently transcoded segments into one
+// muxer in segment order. The segment at the head writes straight through;
+// later segments are buffered until the head reaches them, and may only
+// start within `window` segments of the head so the buffers stay bounded.
+class SegmentStitcher {
+public:
+    SegmentStitcher(SampleSink* muxer, size_t segmentCount, size_t window)
+        : mMuxer(muxer), mSegments(segmentCount), mWindow(window) {}
+
+    // Returns false once the transcode is aborted
+    bool waitToStart(size_t segment) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this, segment] { return mAborted || segment < mHead + mWindow; });
+        return !mAborted;
+    }
+
+    // Every segment's encoder reports its format; the first one starts the muxer
+    bool addFormat(const TrackFormat& format) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mMuxerStarted) {
+            if (format.csd0 != mFormat.csd0 || format.csd1 != mFormat.csd1) {
+                LOGW("Segment encoder produced different codec config; the output keeps the first one");
+            }
+            return true;
+        }
+        mTrackIndex = mMuxer->addTrack(format);
+        if (mTrackIndex < 0 || !mMuxer->start()) {
+            LOGE("Failed to start muxer");
+            return false;
+        }
+        mFormat = format;
+        mMuxerStarted = true;
+        return true;
+    }
+
+    bool write(size_t segment, const uint8_t* data, const CodecBufferInfo& info) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mAborted || !mMuxerStarted) {
+            return false;
+        }
+        if (segment == mHead) {
+            return mMuxer->writeSampleData(mTrackIndex, data, info);
+        }
+        Segment& buffered = mSegments[segment];
+        CodecBufferInfo sample = info;
+        sample.offset = static_cast<int32_t>(buffered.data.size());
+        buffered.data.insert(buffered.data.end(), data + info.offset, data + info.offset + info.size);
+        buffered.samples.push_back(sample);
+        return true;
+    }
+
+    // The segment's encoder is drained; moves the head past finished
+    // segments, flushing each new head's buffered samples
+    bool finish(size_t segment) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSegments[segment].finished = true;
+        while (!mAborted && mHead < mSegments.size() && mSegments[mHead].finished) {
+            mHead++;
+            if (mHead < mSegments.size() && !flushLocked(&mSegments[mHead])) {
+                mAborted = true;
+            }
+        }
+        mCondition.notify_all();
+        return !mAborted;
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mAborted = true;
+        mCondition.notify_all();
+    }
+
+    bool muxerStarted() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMuxerStarted;
+    }
+
+private:
+    struct Segment {
+        std::vector<uint8_t> data;
+        std::vector<CodecBufferInfo> samples;
+        bool finished = false;
+    };
+
+    bool flushLocked(Segment* segment) {
+        for (const CodecBufferInfo& sample : segment->samples) {
+            if (!mMuxer->writeSampleData(mTrackIndex, segment->data.data(), sample)) {
+                LOGE("Failed to write sample at %lld", static_cast<long long>(sample.presentationTimeUs));
+                return false;
+            }
+        }
+        std::vector<uint8_t>().swap(segment->data);
+        std::vector<CodecBufferInfo>().swap(segment->samples);
+        return true;
+    }
+
+    SampleSink* mMuxer;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<Segment> mSegments;
+    const size_t mWindow;
+    size_t mHead = 0;
+    ssize_t mTrackIndex = -1;
+    TrackFormat mFormat;
+    bool mMuxerStarted = false;
+    bool mAborted = false;
+};
+
+// The muxer one segment's pipeline sees
+class SegmentSink : public SampleSink {
+public:
+    SegmentSink(SegmentStitcher* stitcher, size_t segment) : mStitcher(stitcher), mSegment(segment) {}
+
+    ssize_t addTrack(const TrackFormat& format) override { return mStitcher->addFormat(format) ? 0 : -1; }
+    bool start() override { return true; }
+    bool writeSampleData(size_t /* trackIndex */, const uint8_t* data, const CodecBufferInfo& info) override {
+        return mStitcher->write(mSegment, data, info);
+    }
+    bool stop() override { return true; }
+
+private:
+    SegmentStitcher* mStitcher;
+    size_t mSegment;
+};
+
+// Segment start times: sync samples at least minDurationUs apart
+std::vector<int64_t> planSegments(const KeyframeIndex& index, int64_t minDurationUs) {
+    std::vector<int64_t> starts;
+    for (int64_t time : index.syncTimesUs()) {
+        if (starts.empty() || time - starts.back() >= minDurationUs) {
+            starts.push_back(time);
+        }
+    }
+    return starts;
+}
+
+void addResult(const TranscodeResult& segment, TranscodeResult* total) {
+    total->samplesRead += segment.samplesRead;
+    total->framesDecoded += segment.framesDecoded;
+    total->framesEncoded += segment.framesEncoded;
+    total->framesSkipped += segment.framesSkipped;
+    total->samplesWritten += segment.samplesWritten;
+    total->bytesWritten += segment.bytesWritten;
+    total->bytesCopied += segment.bytesCopied;
+    total->samplesPassedThrough += segment.samplesPassedThrough;
+    total->usedSurface = segment.usedSurface;
+}
+
+std::unique_ptr<SampleSink> openOutput(CodecBackend* backend, const char* outputPath, const TranscodeOptions& options) {
+    if (options.fragmentDurationUs > 0) {
+        Fmp4MuxerOptions muxerOptions;
+        muxerOptions.fragmentDurationUs = options.fragmentDurationUs;
+        return openFmp4Muxer(outputPath, muxerOptions);
+    }
+    return backend->openSink(outputPath);
+}
+
+bool transcodeSegments(CodecBackend* backend, const char* inputPath, const char* outputPath,
+                       const TranscodeOptions& options, TranscodeResult* result) {
+    TrackFormat trackFormat;
+    std::unique_ptr<SampleSource> scanner = openVideoTrack(backend, inputPath, &trackFormat);
+    if (!scanner) {
+        return false;
+    }
+    if (!findPassthroughTracks(scanner.get(), options.passthroughTracks).empty()) {
+        LOGW("Segmented transcodes carry video only; passthrough tracks are dropped");
+    }
+    KeyframeIndex index;
+    if (!loadKeyframeIndex(inputPath, options.keyframeIndexDir, scanner.get(), &index)) {
+        LOGE("No samples in %s", inputPath);
+        return false;
+    }
+    scanner.reset();
+    std::vector<int64_t> starts = planSegments(index, options.minSegmentDurationUs);
+    if (starts.empty()) {
+        starts.push_back(0);
+    }
+    size_t sessions = std::min(static_cast<size_t>(options.parallelSegments), starts.size());
+    LOGI("Transcoding %zu segments on %zu sessions", starts.size(), sessions);
+
+    std::unique_ptr<SampleSink> muxer = openOutput(backend, outputPath, options);
+    if (!muxer) {
+        return false;
+    }
+    // Sessions take their decoder and encoder one after the other, so a pool
+    // too small for all of them at once could leave each holding an encoder
+    TranscodeOptions segmentOptions = options;
+    if (options.codecPool && options.codecPool->maxInstances() < static_cast<int32_t>(2 * sessions)) {
+        LOGW("Codec pool holds fewer than %zu codecs; segments create their own", 2 * sessions);
+        segmentOptions.codecPool = nullptr;
+    }
+
+    SegmentStitcher stitcher(muxer.get(), starts.size(), 2 * sessions);
+    std::atomic<size_t> nextSegment{0};
+    std::atomic<bool> failed{false};
+    std::mutex resultMutex;
+
+    auto session = [&] {
+        for (size_t segment = nextSegment++; segment < starts.size(); segment = nextSegment++) {
+            if ((options.cancelled && *options.cancelled) || !stitcher.waitToStart(segment)) {
+                break;
+            }
+            TrackFormat format;
+            std::unique_ptr<SampleSource> extractor = openVideoTrack(backend, inputPath, &format);
+            // The first segment also takes any samples before the first sync sample
+            bool ok = extractor && (segment == 0 || extractor->seekTo(starts[segment]));
+            TranscodeResult segmentResult;
+            if (ok) {
+                // Each segment is fed past its end for the frames presented before the next start,
+                // such as an open GOP's leading frames, which the next segment's decoder cannot
+                // reconstruct; the window then keeps every frame in exactly one segment
+                int64_t endUs = segment + 1 < starts.size() ? starts[segment + 1] : -1;
+                RangeSampleSource source(extractor.get(), endUs, kRangeReorderSamples);
+                FrameWindow window = { segment == 0 ? kWholeInput.startUs : starts[segment], endUs, 0 };
+                SegmentSink sink(&stitcher, segment);
+                ok = runPipeline(backend, &source, format, {}, &sink, segmentOptions, window, &segmentResult) &&
+                     stitcher.finish(segment);
+            }
+            {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                addResult(segmentResult, result);
+            }
+            if (!ok) {
+                LOGE("Segment %zu at %lld failed", segment, static_cast<long long>(starts[segment]));
+                failed = true;
+                stitcher.abort();
+                break;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < sessions; ++i) {
+        threads.emplace_back(session);
+    }
+    session();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    if (stitcher.muxerStarted()) {
+        muxer->stop();
+    }
+    return !failed && nextSegment >= starts.size() && !(options.cancelled && *options.cancelled);
+}
+
+
+// A decoded picture shared by every rendition of a ladder, packed I420 in
+// a frame pool buffer. The decode stage fills it once; each rendition holds
+// a reference until its encoder has a scaled copy, and the last one hands
+// the buffer back to the pool.
+struct LadderFrame {
+    std::shared_ptr<FrameBuffer> data;
+    TrackFormat format;
+    int64_t presentationTimeUs;
+};
+
+// Frames waiting for one rendition's encoder. It is bounded, so the slowest
+// encoder holds the decoder back instead of letting frames pile up. A null
+// frame is end of stream.
+class LadderQueue {
+public:
+    explicit LadderQueue(size_t capacity) : mCapacity(capacity > 0 ? capacity : 1) {}
+
+    // Returns false once closed
+    bool push(std::shared_ptr<const LadderFrame> frame) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return mClosed || mFrames.size() < mCapacity; });
+        if (mClosed) {
+            return false;
+        }
+        mFrames.push_back(std::move(frame));
+        mCondition.notify_all();
+        return true;
+    }
+
+    // Returns false once closed
+    bool pop(std::shared_ptr<const LadderFrame>* frame) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return mClosed || !mFrames.empty(); });
+        if (mClosed) {
+            return false;
+        }
+        *frame = std::move(mFrames.front());
+        mFrames.pop_front();
+        mCondition.notify_all();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+        mFrames.clear();
+        mCondition.notify_all();
+    }
+
+private:
+    const size_t mCapacity;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<std::shared_ptr<const LadderFrame>> mFrames;
+    bool mClosed = false;
+};
+
+// One decoder fanned out to several encoders. feedStage and decodeStage
+// are the first two stages of TranscodePipeline, except that each decoded
+// frame is converted once into a LadderFrame and queued to every
+// rendition. Each rendition then runs its own encodeStage (scale into the
+// encoder's input buffer) and muxStage, so encoders of different sizes
+// proceed in parallel and only wait for one another through the decoder.
+class LadderPipeline {
+    struct Rendition {
+        Rendition(VideoCodec* encoder, SampleSink* muxer, const TrackFormat& format, int32_t maxFramesInFlight)
+            : encoder(encoder), muxer(muxer), format(format), limit(maxFramesInFlight), queue(maxFramesInFlight) {}
+
+        VideoCodec* encoder;
+        SampleSink* muxer;
+        const TrackFormat format;
+        InFlightLimit limit;
+        LadderQueue queue;
+        std::vector<uint8_t> scaled;  // I420 scratch for encoders that take another layout
+        ssize_t trackIndex = -1;
+        bool muxerStarted = false;
+        TranscodeResult result;
+    };
+
+public:
+    LadderPipeline(const TranscodeOptions& options, SampleSource* extractor, VideoCodec* decoder)
+        : mOptions(options), mExtractor(extractor), mDecoder(decoder),
+          mOwnFramePool(options.framePool ? nullptr : new FramePool()),
+          mFramePool(options.framePool ? options.framePool : mOwnFramePool.get()),
+          mOwnTelemetry(options.telemetry ? nullptr : new PipelineTelemetry()),
+          mTelemetry(options.telemetry ? options.telemetry : mOwnTelemetry.get()),
+          mDecoderLimit(options.maxFramesInFlight) {}
+
+    void addRendition(VideoCodec* encoder, SampleSink* muxer, const TrackFormat& format) {
+        mRenditions.emplace_back(new Rendition(encoder, muxer, format, mOptions.maxFramesInFlight));
+    }
+
+    bool run(std::vector<TranscodeResult>* results) {
+        std::vector<std::thread> threads;
+        threads.emplace_back(&LadderPipeline::feedStage, this);
+        for (auto& rendition : mRenditions) {
+            threads.emplace_back(&LadderPipeline::encodeStage, this, rendition.get());
+            threads.emplace_back(&LadderPipeline::muxStage, this, rendition.get());
+        }
+        decodeStage();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        results->clear();
+        for (auto& rendition : mRenditions) {
+            TranscodeResult result = rendition->result;
+            result.samplesRead = mSamplesRead;
+            result.framesDecoded = mFramesDecoded;
+            results->push_back(result);
+        }
+        return !mAborted;
+    }
+
+    bool muxerStarted(size_t rendition) const { return mRenditions[rendition]->muxerStarted; }
+
+private:
+    void abort() {
+        mAborted = true;
+        mDecoderLimit.wake();
+        mFramePool->wake();
+        for (auto& rendition : mRenditions) {
+            rendition->limit.wake();
+            rendition->queue.close();
+        }
+    }
+
+    // Stage 1: extractor -> decoder input
+    void feedStage() {
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("feed");
+        }
+        if (!feedDecoder(mExtractor, mDecoder, nullptr, &mDecoderLimit, mOptions.timeoutUs, mAborted, mTelemetry,
+                         mOptions.tracer, &mSamplesRead)) {
+            abort();
+        }
+    }
+
+    // Stage 2: decoder output -> one shared frame per picture -> every rendition
+    void decodeStage() {
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("decode");
+        }
+        CodecBufferInfo info;
+        int64_t timeoutUs = mOptions.timeoutUs;
+        while (!mAborted) {
+            if (mOptions.cancelled && *mOptions.cancelled) {
+                LOGI("Transcode cancelled");
+                abort();
+                return;
+            }
+            ssize_t outputBufferIndex = mDecoder->dequeueOutputBuffer(&info, timeoutUs);
+            if (outputBufferIndex == CODEC_INFO_TRY_AGAIN_LATER) {
+                mTelemetry->add(COUNTER_DECODER_OUTPUT_TRY_AGAIN);
+                mDecoderLimit.relieve();
+                timeoutUs = mOptions.timeoutUs;
+                continue;
+            }
+            if (outputBufferIndex == CODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+                mDecoder->getOutputFormat(&mDecodedFormat);
+                LOGI("Decoder output format changed: %dx%d color %d",
+                     mDecodedFormat.width, mDecodedFormat.height, mDecodedFormat.colorFormat);
+                continue;
+            }
+            if (outputBufferIndex < 0) {
+                continue;
+            }
+            TraceScope trace(mOptions.tracer, TRACE_DECODED, info.presentationTimeUs, outputBufferIndex);
+            if (mDecodedFormat.width == 0) {
+                // A warm decoder from the codec pool does not announce its format again
+                mDecoder->getOutputFormat(&mDecodedFormat);
+            }
+
+            mDecoderLimit.release(info.presentationTimeUs);
+            bool endOfStream = (info.flags & CODEC_BUFFER_FLAG_END_OF_STREAM) != 0;
+            std::shared_ptr<LadderFrame> frame;
+            if (info.size > 0) {
+                mFramesDecoded++;
+                mTelemetry->produced(STAGE_DECODE, info.presentationTimeUs);
+                mTelemetry->add(COUNTER_FRAMES_DECODED);
+                frame = shareFrame(outputBufferIndex, info);
+            }
+            mDecoder->releaseOutputBuffer(outputBufferIndex, false);
+            if (info.size > 0 && !frame) {
+                abort();
+                return;
+            }
+            if (frame || endOfStream) {
+                for (auto& rendition : mRenditions) {
+                    if (!rendition->queue.push(frame)) {
+                        return;
+                    }
+                }
+            }
+            if (endOfStream) {
+                return;
+            }
+            timeoutUs = 0;
+        }
+    }
+
+    // Packs the decoder output into a frame every rendition can read, and
+    // runs the frame processor on it once for all of them. Waits for a pool
+    // buffer while the renditions hold the pool's whole budget; the decoder
+    // output buffer stays queued meanwhile, which stalls the decoder.
+    std::shared_ptr<LadderFrame> shareFrame(size_t outputBufferIndex, const CodecBufferInfo& info) {
+        const TrackFormat& format = mDecodedFormat;
+        size_t outputCapacity;
+        uint8_t* output = mDecoder->getOutputBuffer(outputBufferIndex, &outputCapacity);
+        FrameView source;
+        if (!wrapFrame(output + info.offset, info.size, frameFormatFromColorFormat(format.colorFormat), format.width,
+                       format.height, format.stride, format.sliceHeight, &source)) {
+            LOGE("Cannot read decoder output: %dx%d color %d", format.width, format.height, format.colorFormat);
+            return nullptr;
+        }
+        std::shared_ptr<LadderFrame> frame = std::make_shared<LadderFrame>();
+        frame->data = mFramePool->acquire(frameBufferSize(FRAME_FORMAT_I420, format.width, format.height), -1,
+                                          &mAborted);
+        if (!frame->data) {
+            return nullptr;
+        }
+        frame->format = format;
+        frame->format.colorFormat = CODEC_COLOR_FORMAT_YUV420_PLANAR;
+        frame->format.stride = 0;
+        frame->format.sliceHeight = 0;
+        frame->presentationTimeUs = info.presentationTimeUs;
+        FrameView packed;
+        {
+            StageTimer timer(mTelemetry, STAGE_COPY);
+            TraceScope trace(mOptions.tracer, TRACE_COPY, info.presentationTimeUs, outputBufferIndex);
+            if (!wrapFrame(frame->data->data(), frame->data->size(), FRAME_FORMAT_I420, format.width,
+                           format.height, 0, 0, &packed) ||
+                !convertFrame(source, packed)) {
+                return nullptr;
+            }
+        }
+        mTelemetry->add(COUNTER_BYTES_COPIED, frame->data->size());
+        if (mOptions.frameProcessor) {
+            StageTimer timer(mTelemetry, STAGE_PROCESS);
+            TraceScope trace(mOptions.tracer, TRACE_PROCESS, info.presentationTimeUs, outputBufferIndex);
+            mOptions.frameProcessor->process(frame->data->data(), frame->data->size(), frame->format,
+                                             frame->presentationTimeUs, mOptions.workerPool);
+        }
+        return frame;
+    }
+
+    // Stage 3, per rendition: shared frame -> scaled into encoder input
+    void encodeStage(Rendition* rendition) {
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("encode " + renditionName(rendition));
+        }
+        VideoCodec* encoder = rendition->encoder;
+        std::shared_ptr<const LadderFrame> frame;
+        while (rendition->queue.pop(&frame)) {
+            if (frame && !rendition->limit.acquire(frame->presentationTimeUs, mAborted, mOptions.timeoutUs)) {
+                return;
+            }
+            ssize_t inputBufferIndex;
+            while ((inputBufferIndex = encoder->dequeueInputBuffer(mOptions.timeoutUs)) < 0) {
+                if (mAborted) {
+                    return;
+                }
+                if (inputBufferIndex == CODEC_INFO_TRY_AGAIN_LATER) {
+                    mTelemetry->add(COUNTER_ENCODER_INPUT_TRY_AGAIN);
+                }
+            }
+            if (!frame) {
+                // Pass end of stream on to the encoder
+                encoder->queueInputBuffer(inputBufferIndex, 0, 0, 0, CODEC_BUFFER_FLAG_END_OF_STREAM);
+                return;
+            }
+
+            size_t inputCapacity;
+            uint8_t* input = encoder->getInputBuffer(inputBufferIndex, &inputCapacity);
+            size_t size;
+            {
+                StageTimer timer(mTelemetry, STAGE_COPY);
+                TraceScope trace(mOptions.tracer, TRACE_COPY, frame->presentationTimeUs, inputBufferIndex);
+                size = scaleInto(rendition, *frame, input, inputCapacity);
+            }
+            if (size == 0) {
+                LOGE("Cannot scale %dx%d into a %dx%d encoder", frame->format.width, frame->format.height,
+                     rendition->format.width, rendition->format.height);
+                abort();
+                return;
+            }
+            rendition->result.bytesCopied += size;
+            mTelemetry->add(COUNTER_BYTES_COPIED, size);
+            if (!encoder->queueInputBuffer(inputBufferIndex, 0, size, frame->presentationTimeUs, 0)) {
+                LOGE("Failed to queue encoder input at %lld", static_cast<long long>(frame->presentationTimeUs));
+                abort();
+                return;
+            }
+            frame.reset();
+        }
+    }
+
+    // Returns the bytes written to input, or zero if the layouts cannot be converted
+    size_t scaleInto(Rendition* rendition, const LadderFrame& frame, uint8_t* input, size_t inputCapacity) {
+        const TrackFormat& format = rendition->format;
+        FrameFormat encoderFormat = frameFormatFromColorFormat(format.colorFormat);
+        FrameView source;
+        FrameView destination;
+        if (!wrapFrame(frame.data->data(), frame.data->size(), FRAME_FORMAT_I420, frame.format.width,
+                       frame.format.height, 0, 0, &source) ||
+            !wrapFrame(input, inputCapacity, encoderFormat, format.width, format.height, 0, 0, &destination)) {
+            return 0;
+        }
+        bool ok;
+        if (source.width == destination.width && source.height == destination.height) {
+            ok = convertFrame(source, destination);
+        } else if (encoderFormat == FRAME_FORMAT_I420) {
+            ok = scaleFrame(source, destination, mOptions.scaleFilter, mOptions.workerPool);
+        } else {
+            FrameView scaled;
+            rendition->scaled.resize(frameBufferSize(FRAME_FORMAT_I420, format.width, format.height));
+            ok = wrapFrame(rendition->scaled.data(), rendition->scaled.size(), FRAME_FORMAT_I420, format.width,
+                           format.height, 0, 0, &scaled) &&
+                 scaleFrame(source, scaled, mOptions.scaleFilter, mOptions.workerPool) &&
+                 convertFrame(scaled, destination);
+        }
+        return ok ? frameBufferSize(encoderFormat, format.width, format.height) : 0;
+    }
+
+    // Names the rendition's trace tracks by its size
+    static std::string renditionName(const Rendition* rendition) {
+        return std::to_string(rendition->format.width) + "x" + std::to_string(rendition->format.height);
+    }
+
+    bool startMuxer(Rendition* rendition) {
+        TrackFormat encodedFormat;
+        rendition->encoder->getOutputFormat(&encodedFormat);
+        rendition->trackIndex = rendition->muxer->addTrack(encodedFormat);
+        if (rendition->trackIndex < 0 || !rendition->muxer->start()) {
+            LOGE("Failed to start muxer");
+            abort();
+            return false;
+        }
+        rendition->muxerStarted = true;
+        return true;
+    }
+
+    // Stage 4, per rendition: encoder output -> muxer
+    void muxStage(Rendition* rendition) {
+        if (mOptions.tracer) {
+            mOptions.tracer->nameThread("mux " + renditionName(rendition));
+        }
+        VideoCodec* encoder = rendition->encoder;
+        TranscodeResult& result = rendition->result;
+        CodecBufferInfo encodeInfo;
+        int64_t timeoutUs = mOptions.timeoutUs;
+        while (!mAborted) {
+            ssize_t encodeOutputIndex = encoder->dequeueOutputBuffer(&encodeInfo, timeoutUs);
+            if (encodeOutputIndex == CODEC_INFO_TRY_AGAIN_LATER) {
+                mTelemetry->add(COUNTER_ENCODER_OUTPUT_TRY_AGAIN);
+                rendition->limit.relieve();
+                timeoutUs = mOptions.timeoutUs;
+                continue;
+            }
+            if (encodeOutputIndex == CODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+                if (!rendition->muxerStarted && !startMuxer(rendition)) {
+                    return;
+                }
+                continue;
+            }
+            if (encodeOutputIndex < 0) {
+                continue;
+            }
+            TraceScope trace(mOptions.tracer, TRACE_ENCODED, encodeInfo.presentationTimeUs, encodeOutputIndex);
+
+            size_t encodedDataSize;
+            uint8_t *encodedData = encoder->getOutputBuffer(encodeOutputIndex, &encodedDataSize);
+            // Codec config is carried by the output format, not as a sample
+            bool isConfig = (encodeInfo.flags & CODEC_BUFFER_FLAG_CODEC_CONFIG) != 0;
+            if (encodeInfo.size > 0 && !isConfig) {
+                // A warm encoder from the codec pool does not announce its format again
+                if (!rendition->muxerStarted && !startMuxer(rendition)) {
+                    encoder->releaseOutputBuffer(encodeOutputIndex, false);
+                    return;
+                }
+                rendition->limit.release(encodeInfo.presentationTimeUs);
+                result.framesEncoded++;
+                mTelemetry->add(COUNTER_FRAMES_ENCODED);
+                bool written;
+                {
+                    StageTimer timer(mTelemetry, STAGE_MUX);
+                    TraceScope muxTrace(mOptions.tracer, TRACE_MUX, encodeInfo.presentationTimeUs, encodeOutputIndex);
+                    written = rendition->muxer->writeSampleData(rendition->trackIndex, encodedData, encodeInfo);
+                }
+                if (!written) {
+                    LOGE("Failed to write sample at %lld", static_cast<long long>(encodeInfo.presentationTimeUs));
+                    encoder->releaseOutputBuffer(encodeOutputIndex, false);
+                    abort();
+                    return;
+                }
+                result.samplesWritten++;
+                result.bytesWritten += encodeInfo.size;
+                mTelemetry->add(COUNTER_BYTES_WRITTEN, encodeInfo.size);
+            }
+            encoder->releaseOutputBuffer(encodeOutputIndex, false);
+            if (encodeInfo.flags & CODEC_BUFFER_FLAG_END_OF_STREAM) {
+                return;
+            }
+            timeoutUs = 0;
+        }
+    }
+
+    const TranscodeOptions& mOptions;
+    SampleSource* mExtractor;
+    VideoCodec* mDecoder;
+    std::unique_ptr<FramePool> mOwnFramePool;  // When the options bring none; outlives the queued frames
+    FramePool* mFramePool;
+    std::vector<std::unique_ptr<Rendition>> mRenditions;
+    std::unique_ptr<PipelineTelemetry> mOwnTelemetry;  // When the options bring none
+    PipelineTelemetry* mTelemetry;
+
+    InFlightLimit mDecoderLimit;
+    TrackFormat mDecodedFormat;
+    std::atomic<bool> mAborted{false};
+
+    // Written by the feed and decode stages, read after the join
+    int64_t mSamplesRead = 0;
+    int64_t mFramesDecoded = 0;
+};
+
+// Brackets one public transcode call in the telemetry's begin and end
+class TelemetryScope {
+public:
+    explicit TelemetryScope(PipelineTelemetry* telemetry) : mTelemetry(telemetry) {
+        if (mTelemetry) {
+            mTelemetry->begin();
+        }
+    }
+
+    ~TelemetryScope() {
+        if (mTelemetry) {
+            mTelemetry->end();
+        }
+    }
+
+private:
+    PipelineTelemetry* mTelemetry;
+};
+
+} // namespace
+
+bool transcodeVideo(CodecBackend* backend, const char* inputPath, const char* outputPath,
+                    const TranscodeOptions& options, TranscodeResult* result) {
+    int64_t startUs = nowUs();
+    *result = TranscodeResult();
+    TelemetryScope telemetry(options.telemetry);
+
+    if (options.parallelSegments > 1) {
+        bool ok = transcodeSegments(backend, inputPath, outputPath, options, result);
+        result->elapsedUs = nowUs() - startUs;
+        return ok;
+    }
+
+    TrackFormat trackFormat;
+    std::unique_ptr<SampleSource> extractor = openVideoTrack(backend, inputPath, &trackFormat);
+    if (!extractor) {
+        return false;
+    }
+    std::vector<PassthroughTrack> passthrough = selectPassthroughTracks(extractor.get(), options.passthroughTracks);
+    std::unique_ptr<SampleSink> muxer = openOutput(backend, outputPath, options);
+    if (!muxer) {
+        return false;
+    }
+    bool ok = runPipeline(backend, extractor.get(), trackFormat, passthrough, muxer.get(), options, kWholeInput,
+                          result);
+    result->elapsedUs = nowUs() - startUs;
+    return ok;
+}
+
+bool transcodeRange(CodecBackend* backend, const char* inputPath, const char* outputPath, int64_t startUs,
+                    int64_t endUs, const TranscodeOptions& options, TranscodeResult* result) {
+    int64_t startedUs = nowUs();
+    *result = TranscodeResult();
+    TelemetryScope telemetry(options.telemetry);
+    if (startUs < 0 || (endUs >= 0 && endUs <= startUs)) {
+        LOGE("Invalid range %lld - %lld", static_cast<long long>(startUs), static_cast<long long>(endUs));
+        return false;
+    }
+
+    TrackFormat trackFormat;
+    KeyframeIndex index;
+    std::unique_ptr<SampleSource> extractor = openVideoTrack(backend, inputPath, &trackFormat);
+    if (!extractor || !loadKeyframeIndex(inputPath, options.keyframeIndexDir, extractor.get(), &index)) {
+        return false;
+    }
+
+    // Passthrough tracks are selected after the scan so the index only
+    // holds video sync samples; the seek positions them too
+    std::vector<PassthroughTrack> passthrough = selectPassthroughTracks(extractor.get(), options.passthroughTracks);
+
+    // Decoding starts at the sync sample the range depends on
+    int64_t seekUs = index.syncTimeAtOrBefore(startUs);
+    if (!extractor->seekTo(seekUs)) {
+        LOGE("Failed to seek to %lld", static_cast<long long>(seekUs));
+        return false;
+    }
+    std::unique_ptr<SampleSink> muxer = openOutput(backend, outputPath, options);
+    if (!muxer) {
+        return false;
+    }
+    RangeSampleSource source(extractor.get(), endUs, kRangeReorderSamples);
+    for (const PassthroughTrack& track : passthrough) {
+        source.ignoreTrack(track.sourceIndex);
+    }
+    FrameWindow window = { startUs, endUs, startUs };
+    bool ok = runPipeline(backend, &source, trackFormat, passthrough, muxer.get(), options, window, result);
+    result->elapsedUs = nowUs() - startedUs;
+    LOGI("Range %lld - %lld: decoded %lld frames from %lld, kept %lld", static_cast<long long>(startUs),
+         static_cast<long long>(endUs), static_cast<long long>(result->framesDecoded), static_cast<long long>(seekUs),
+         static_cast<long long>(result->framesDecoded - result->framesSkipped));
+    return ok;
+}
+
+bool transcodeLadder(CodecBackend* backend, const char* inputPath, const std::vector<LadderRendition>& renditions,
+                     const TranscodeOptions& options, std::vector<TranscodeResult>* results) {
+    int64_t startUs = nowUs();
+    results->assign(renditions.size(), TranscodeResult());
+    TelemetryScope telemetry(options.telemetry);
+    if (renditions.empty()) {
+        return false;
+    }
+    if (options.useSurface) {
+        LOGW("Surface input ignored: ladder renditions are scaled from shared decoded frames");
+    }
+
+    TrackFormat trackFormat;
+    std::unique_ptr<SampleSource> extractor = openVideoTrack(backend, inputPath, &trackFormat);
+    if (!extractor) {
+        return false;
+    }
+    if (!findPassthroughTracks(extractor.get(), options.passthroughTracks).empty()) {
+        LOGW("Ladder renditions carry video only; passthrough tracks are dropped");
+    }
+
+    // All codecs are held at once, so a pool that cannot fit them is left alone
+    CodecPool* codecPool = options.codecPool;
+    if (codecPool && codecPool->maxInstances() < static_cast<int32_t>(renditions.size() + 1)) {
+        LOGW("Codec pool holds fewer than %zu codecs; the ladder creates its own", renditions.size() + 1);
+        codecPool = nullptr;
+    }
+
+    // Every encoder is configured before decoding starts
+    std::vector<std::unique_ptr<CodecLease>> encoders;
+    std::vector<std::unique_ptr<SampleSink>> muxers;
+    std::vector<TrackFormat> formats;
+    bool ok = true;
+    for (const LadderRendition& rendition : renditions) {
+        TrackFormat format = resolveEncodeProfile(rendition.encode, trackFormat);
+        LOGI("Rendition %s: %s %dx%d at %d fps, %d bit/s", rendition.outputPath ? rendition.outputPath : "",
+             format.mime.c_str(), format.width, format.height, format.frameRate, format.bitRate);
+        if (frameFormatFromColorFormat(format.colorFormat) == FRAME_FORMAT_UNKNOWN) {
+            LOGE("Ladder encoders need a planar or semi-planar color format, not %d", format.colorFormat);
+            ok = false;
+            break;
+        }
+        std::unique_ptr<CodecLease> encoder(new CodecLease(backend, codecPool));
+        std::unique_ptr<SampleSink> muxer = openOutput(backend, rendition.outputPath, options);
+        if (!muxer || !encoder->acquire(format, true)) {
+            LOGE("Failed to start encoder for %s", rendition.outputPath ? rendition.outputPath : "");
+            ok = false;
+            break;
+        }
+        encoders.push_back(std::move(encoder));
+        muxers.push_back(std::move(muxer));
+        formats.push_back(format);
+    }
+
+    CodecLease decoder(backend, codecPool);
+    if (ok && !decoder.acquire(trackFormat, false)) {
+        LOGE("Failed to start decoder");
+        ok = false;
+    }
+
+    if (ok) {
+        LadderPipeline pipeline(options, extractor.get(), decoder.get());
+        for (size_t i = 0; i < encoders.size(); ++i) {
+            pipeline.addRendition(encoders[i]->get(), muxers[i].get(), formats[i]);
+        }
+        ok = pipeline.run(results);
+        decoder.finish(ok);
+        for (size_t i = 0; i < encoders.size(); ++i) {
+            encoders[i]->finish(ok);
+            if (pipeline.muxerStarted(i)) {
+                muxers[i]->stop();
+            }
+        }
+    }
+
+    int64_t elapsedUs = nowUs() - startUs;
+    for (TranscodeResult& result : *results) {
+        result.elapsedUs = elapsedUs;
+    }
+    return ok;
+}
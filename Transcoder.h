@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "CodecBackend.h"
+#include "EncodeProfile.h"
+#include "FrameScaler.h"
+
+class CodecPool;
+class FramePool;
+class FrameTracer;
+class PipelineTelemetry;
+class WorkerPool;
+
+// CPU work applied to every decoded frame before it is encoded
+class FrameProcessor {
+public:
+    virtual ~FrameProcessor() = default;
+
+    // Edits frame in place. frame is the encoder input buffer holding a copy
+    // of the decoded picture described by format; it is tightly packed in the
+    // encoder's color format and size whenever both layouts are known (see
+    // YuvFrame.h and FrameScaler.h). With a worker pool this runs on pool
+    // threads for several frames at once, and pool may be used to split the
+    // frame into slices; without one pool is null.
+    virtual void process(uint8_t* frame, size_t size, const TrackFormat& format,
+                         int64_t presentationTimeUs, WorkerPool* pool) = 0;
+};
+
+// Kinds of input track copied to the output without decoding
+// (TranscodeOptions::passthroughTracks)
+enum {
+    PASSTHROUGH_AUDIO = 1,     // audio/*
+    PASSTHROUGH_SUBTITLE = 2,  // text/* and the subtitle application/* types
+    PASSTHROUGH_METADATA = 4,  // Any other track that is not video or an image
+};
+
+// Encoder settings for transcodeVideo
+struct TranscodeOptions {
+    EncodeProfile encode;  // Resolved against the input's video track (see EncodeProfile.h)
+    int64_t timeoutUs = 10000;  // Dequeue timeout in microseconds
+    // Frames each codec may hold before its feeder waits. A codec that
+    // stalls waiting for more input (reorder depth, lookahead) is let up to
+    // as many again, one frame per stall; past that only after a second
+    // without output. Frames the codec drops stop counting once the limit's
+    // worth of later frames has come out.
+    int32_t maxFramesInFlight = 8;
+    const std::atomic<bool>* cancelled = nullptr;  // Optional; setting it stops the transcode early
+    FrameProcessor* frameProcessor = nullptr;  // Optional CPU stage between decoder and encoder
+    WorkerPool* workerPool = nullptr;  // Runs frameProcessor off the decode stage; frames stay in order
+    ScaleFilter scaleFilter = SCALE_FILTER_BILINEAR;  // When the encoder size differs from the decoded one
+
+    // Decoder renders straight into the encoder's input surface, so decoded
+    // pixels never reach the CPU. Ignored with a frameProcessor, which needs
+    // the pixels; falls back to copying when the encoder has no input surface.
+    bool useSurface = false;
+
+    // Above zero, the output is fragmented MP4 written by Fmp4Muxer with
+    // fragments of about this length, so it is playable while encoding goes
+    // on; otherwise the backend's muxer finalizes the file at the end
+    int64_t fragmentDurationUs = 0;
+
+    // Above one, the video track is cut at sync samples into segments of at
+    // least minSegmentDurationUs that are transcoded on this many
+    // decoder / encoder pairs at once and joined in order. Every segment
+    // starts with a keyframe, so expect one keyframe per segment on top of
+    // the encoder's own.
+    int32_t parallelSegments = 1;
+    int64_t minSegmentDurationUs = 10000000;
+
+    // Directory for cached keyframe indexes (see KeyframeIndex.h); null
+    // keeps them next to the input
+    const char* keyframeIndexDir = nullptr;
+
+    // Input tracks of these kinds are selected along with the video track
+    // and their compressed samples copied into the output as they are read,
+    // interleaved with the encoded video by presentation time, so the
+    // output keeps its audio without a second pass over the input. Tracks
+    // the muxer rejects are dropped with a warning. Segmented and ladder
+    // transcodes carry video only.
+    uint32_t passthroughTracks = PASSTHROUGH_AUDIO;
+
+    // Borrows the decoder and encoders from this pool and hands them back
+    // warm when the transcode succeeds, so a run of short jobs skips codec
+    // startup (see CodecPool.h). Must belong to the backend passed in; null
+    // creates codecs for this transcode alone.
+    CodecPool* codecPool = nullptr;
+
+    // Holds the CPU copies of decoded frames that stages share, such as the
+    // picture a ladder fans out to its renditions (see FramePool.h). Its
+    // memory cap holds the decoder back when consumers fall behind. Null
+    // gives the transcode a pool of its own.
+    FramePool* framePool = nullptr;
+
+    // Runs both codecs in asynchronous mode (AMediaCodec_setAsyncNotifyCallback,
+    // API 28): their notifications go to one event loop per pipeline, which
+    // hands each buffer on as soon as its codec releases it, in place of three
+    // threads polling with timeoutUs. Falls back to polling when a codec has
+    // no asynchronous mode. The codecs are created for the transcode rather
+    // than taken from codecPool, maxFramesInFlight gives way to the codecs'
+    // own buffer counts, and frameProcessor runs on the event loop, with
+    // workerPool only splitting frames. transcodeLadder always polls.
+    bool asyncCodecs = false;
+
+    // Receives per-stage latency histograms, buffer gauges and throughput
+    // counters while the transcode runs (see PipelineTelemetry.h); may be
+    // read from another thread meanwhile. A ladder counts the frames and
+    // bytes of every rendition and has no encode or whole-frame latency,
+    // its encoders sharing presentation times. Null keeps the measurements
+    // internal.
+    PipelineTelemetry* telemetry = nullptr;
+
+    // Records a span per frame and stage on every pipeline thread, with
+    // presentation time and buffer index, for a timeline of where frames
+    // wait (see FrameTracer.h). Null records nothing.
+    FrameTracer* tracer = nullptr;
+};
+
+struct TranscodeResult {
+    int64_t samplesRead = 0;
+    int64_t framesDecoded = 0;
+    int64_t framesEncoded = 0;
+    int64_t samplesWritten = 0;
+    int64_t bytesWritten = 0;
+    int64_t bytesCopied = 0;  // Decoded bytes copied into encoder input buffers
+    int64_t framesSkipped = 0;  // Decoded outside the requested range and dropped
+    int64_t samplesPassedThrough = 0;  // Copied from passthrough tracks without decoding
+    bool usedSurface = false;
+    int64_t elapsedUs = 0;
+};
+
+// Runs extractor -> decoder -> encoder -> muxer for the first video track of
+// inputPath using the codecs of the given backend. The three stages (feed the
+// decoder, move decoded frames into the encoder, mux encoded samples) run on
+// their own threads and overlap. With options.parallelSegments above one,
+// several such pipelines run on GOP-aligned segments of the input instead.
+// Returns false on error.
+bool transcodeVideo(CodecBackend* backend, const char* inputPath, const char* outputPath,
+                    const TranscodeOptions& options, TranscodeResult* result);
+
+// Transcodes the frames of inputPath presented in [startUs, endUs) (a
+// negative endUs runs to the end). Decoding starts at the preceding sync
+// sample, found through the cached keyframe index, and frames before startUs
+// are decoded but dropped; feeding stops shortly after endUs, so the cost
+// follows the clip length rather than the file length. Output timestamps
+// start at zero. parallelSegments is ignored.
+bool transcodeRange(CodecBackend* backend, const char* inputPath, const char* outputPath, int64_t startUs,
+                    int64_t endUs, const TranscodeOptions& options, TranscodeResult* result);
+
+// One output of transcodeLadder
+struct LadderRendition {
+    EncodeProfile encode;
+    const char* outputPath = nullptr;
+};
+
+// Adaptive bitrate ladder: decodes the first video track of inputPath once
+// and encodes every frame into each rendition on its own encoder and muxer,
+// so the decode is paid once per input rather than once per rendition. Each
+// decoded frame is packed into one reference-counted I420 copy (after the
+// frameProcessor, which runs once for all renditions) that every rendition
+// scales into its encoder's input, split across workerPool when there is
+// one. The slowest encoder paces the decoder through maxFramesInFlight.
+// Frames always go through byte buffers, so useSurface and
+// parallelSegments are ignored. results gets one entry per rendition, each
+// with the shared decode counters.
+bool transcodeLadder(CodecBackend* backend, const char* inputPath, const std::vector<LadderRendition>& renditions,
+                     const TranscodeOptions& options, std::vector<TranscodeResult>* results);
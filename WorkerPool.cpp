@@ -0,0 +1,163 @@
+#include <chrono>
+
+#include "WorkerPool.h"
+
+namespace {
+
+// Lets submit() and parallelFor() find the calling worker's own deque
+thread_local const WorkerPool* tPool = nullptr;
+thread_local int32_t tWorkerIndex = -1;
+
+} // namespace
+
+WorkerPool::WorkerPool(int32_t threadCount) {
+    if (threadCount <= 0) {
+        threadCount = static_cast<int32_t>(std::thread::hardware_concurrency());
+        if (threadCount <= 0) {
+            threadCount = 1;
+        }
+    }
+    for (int32_t i = 0; i < threadCount; ++i) {
+        mQueues.emplace_back(new WorkQueue());
+    }
+    for (int32_t i = 0; i < threadCount; ++i) {
+        mThreads.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStop = true;
+    }
+    mSleepCondition.notify_all();
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+    int32_t index = tPool == this ? tWorkerIndex
+                                  : static_cast<int32_t>(mNextQueue.fetch_add(1, std::memory_order_relaxed) % mQueues.size());
+    {
+        std::lock_guard<std::mutex> lock(mQueues[index]->mutex);
+        mQueues[index]->tasks.push_back(std::move(task));
+    }
+    mQueued.fetch_add(1, std::memory_order_release);
+
+    // Take the sleep lock so a worker between its check and its wait cannot miss this
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mSleepCondition.notify_one();
+}
+
+bool WorkerPool::popLocal(int32_t index, std::function<void()>* task) {
+    WorkQueue& queue = *mQueues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    *task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkerPool::steal(int32_t thief, std::function<void()>* task) {
+    size_t count = mQueues.size();
+    size_t start = thief >= 0 ? thief + 1 : mNextQueue.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+        WorkQueue& queue = *mQueues[(start + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            *task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs one queued task, preferring the worker's own deque. index is -1 for
+// threads outside the pool.
+bool WorkerPool::runOne(int32_t index) {
+    if (mQueued.load(std::memory_order_acquire) <= 0) {
+        return false;
+    }
+    std::function<void()> task;
+    if ((index >= 0 && popLocal(index, &task)) || steal(index, &task)) {
+        mQueued.fetch_sub(1, std::memory_order_relaxed);
+        task();
+        return true;
+    }
+    return false;
+}
+
+void WorkerPool::workerLoop(int32_t index) {
+    tPool = this;
+    tWorkerIndex = index;
+    while (true) {
+        if (runOne(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepCondition.wait(lock, [this] { return mStop || mQueued.load(std::memory_order_acquire) > 0; });
+        if (mStop) {
+            return;
+        }
+    }
+}
+
+void WorkerPool::parallelFor(int32_t begin, int32_t end, int32_t grain,
+                             const std::function<void(int32_t, int32_t)>& body) {
+    if (end <= begin) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+
+    // Roughly four chunks per worker keeps stealing effective without tiny tasks
+    int32_t count = end - begin;
+    int32_t chunk = count / (threadCount() * 4);
+    if (chunk < grain) {
+        chunk = grain;
+    }
+    int32_t chunks = (count + chunk - 1) / chunk;
+    if (chunks == 1) {
+        body(begin, end);
+        return;
+    }
+
+    struct Completion {
+        std::atomic<int32_t> remaining;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+    std::shared_ptr<Completion> completion = std::make_shared<Completion>();
+    completion->remaining = chunks;
+
+    // Queue all but the first chunk, which the caller runs right away
+    for (int32_t i = 1; i < chunks; ++i) {
+        int32_t first = begin + i * chunk;
+        int32_t last = first + chunk < end ? first + chunk : end;
+        submit([completion, &body, first, last] {
+            body(first, last);
+            if (completion->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(completion->mutex);
+                completion->condition.notify_all();
+            }
+        });
+    }
+    body(begin, begin + chunk);
+    completion->remaining.fetch_sub(1, std::memory_order_acq_rel);
+
+    // Help with queued work until the remaining chunks are done
+    int32_t self = tPool == this ? tWorkerIndex : -1;
+    while (completion->remaining.load(std::memory_order_acquire) > 0) {
+        if (runOne(self)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(completion->mutex);
+        completion->condition.wait_for(lock, std::chrono::microseconds(200),
+                                       [&completion] { return completion->remaining.load() == 0; });
+    }
+}
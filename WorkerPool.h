@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FrameQueue.h"
+
+// Work-stealing thread pool for CPU-side frame work. Every worker owns a
+// deque: it pushes and pops its own tasks at the back (newest first, cache
+// warm) and, when empty, steals the oldest task from another worker's front.
+// Tasks submitted from outside the pool are spread round-robin.
+class WorkerPool {
+public:
+    // threadCount <= 0 uses one worker per core
+    explicit WorkerPool(int32_t threadCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int32_t threadCount() const { return static_cast<int32_t>(mThreads.size()); }
+
+    void submit(std::function<void()> task);
+
+    // Runs body(first, last) over [begin, end) in chunks of at least grain
+    // items and returns when every chunk is done. The calling thread runs
+    // chunks too, so nesting inside a pool task cannot deadlock.
+    void parallelFor(int32_t begin, int32_t end, int32_t grain, const std::function<void(int32_t, int32_t)>& body);
+
+private:
+    struct alignas(kCacheLineSize) WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(int32_t index);
+    bool popLocal(int32_t index, std::function<void()>* task);
+    bool steal(int32_t thief, std::function<void()>* task);
+    bool runOne(int32_t index);
+
+    std::vector<std::unique_ptr<WorkQueue>> mQueues;
+    std::vector<std::thread> mThreads;
+    std::atomic<uint32_t> mNextQueue{0};
+    std::atomic<int64_t> mQueued{0};
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCondition;
+    bool mStop = false;
+};
+
+// Releases frames strictly in sequence order even when the work on them
+// finishes out of order. Each frame gets a sequence number from reserve()
+// and is handed to the emit callback, on whichever thread completes the gap,
+// once it and every earlier frame are complete().
+template <typename Frame>
+class FrameReorderBuffer {
+public:
+    explicit FrameReorderBuffer(std::function<void(Frame&)> emit) : mEmit(std::move(emit)) {}
+
+    uint64_t reserve() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mNextReserved++;
+    }
+
+    void complete(uint64_t sequence, Frame frame) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.emplace(sequence, std::move(frame));
+        // One thread emits at a time so frames reach the callback in order
+        if (mEmitting) {
+            return;
+        }
+        mEmitting = true;
+        while (!mDone.empty() && mDone.begin()->first == mNextEmitted) {
+            Frame next = std::move(mDone.begin()->second);
+            mDone.erase(mDone.begin());
+            lock.unlock();
+            mEmit(next);
+            lock.lock();
+            mNextEmitted++;
+        }
+        mEmitting = false;
+        mCondition.notify_all();
+    }
+
+    // Waits until every reserved frame has been emitted
+    void drain() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return mNextEmitted == mNextReserved && !mEmitting; });
+    }
+
+private:
+    std::function<void(Frame&)> mEmit;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::map<uint64_t, Frame> mDone;
+    uint64_t mNextReserved = 0;
+    uint64_t mNextEmitted = 0;
+    bool mEmitting = false;
+};
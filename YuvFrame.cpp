@@ -0,0 +1,455 @@
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "YuvFrame.h"
+#include "CodecBackend.h"
+
+namespace {
+
+int32_t chromaWidth(int32_t width) { return (width + 1) / 2; }
+int32_t chromaHeight(int32_t height) { return (height + 1) / 2; }
+
+void copyPlane(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, size_t rowBytes, int32_t rows) {
+    if (srcStride == dstStride && static_cast<size_t>(srcStride) == rowBytes) {
+        memcpy(dst, src, rowBytes * rows);
+        return;
+    }
+    for (int32_t y = 0; y < rows; ++y) {
+        memcpy(dst + static_cast<size_t>(y) * dstStride, src + static_cast<size_t>(y) * srcStride, rowBytes);
+    }
+}
+
+// Row kernels. count is in chroma pairs for the UV kernels and in pixels for
+// yuvToRgbaRow; the vector versions finish the tail with the scalar ones.
+
+void splitUVScalar(const uint8_t* uv, uint8_t* u, uint8_t* v, int32_t count) {
+    for (int32_t i = 0; i < count; ++i) {
+        u[i] = uv[2 * i];
+        v[i] = uv[2 * i + 1];
+    }
+}
+
+void mergeUVScalar(const uint8_t* u, const uint8_t* v, uint8_t* uv, int32_t count) {
+    for (int32_t i = 0; i < count; ++i) {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+void swapUVScalar(const uint8_t* src, uint8_t* dst, int32_t count) {
+    for (int32_t i = 0; i < count; ++i) {
+        uint8_t first = src[2 * i];
+        dst[2 * i] = src[2 * i + 1];
+        dst[2 * i + 1] = first;
+    }
+}
+
+// BT.601 limited range in 6-bit fixed point, sized so the vector kernels can
+// stay in 16-bit lanes: (Y - 16) * 74.5 + 102 * V' etc. with V' = V - 128.
+// The half in the luma scale is added as (Y - 16) >> 1.
+const int32_t kYScale = 74;
+const int32_t kVToR = 102;
+const int32_t kUToG = 25;
+const int32_t kVToG = 52;
+const int32_t kUToB = 129;
+
+inline uint8_t clampPixel(int32_t value) {
+    value = (value + 32) >> 6;
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+void yuvToRgbaRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int32_t width) {
+    for (int32_t x = 0; x < width; ++x) {
+        int32_t luma = (y[x] - 16) * kYScale + ((y[x] - 16) >> 1);
+        int32_t cb = u[x / 2] - 128;
+        int32_t cr = v[x / 2] - 128;
+        rgba[4 * x] = clampPixel(luma + kVToR * cr);
+        rgba[4 * x + 1] = clampPixel(luma - kUToG * cb - kVToG * cr);
+        rgba[4 * x + 2] = clampPixel(luma + kUToB * cb);
+        rgba[4 * x + 3] = 255;
+    }
+}
+
+#if defined(__SSE2__)
+
+void splitUVSimd(const uint8_t* uv, uint8_t* u, uint8_t* v, int32_t count) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    int32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + 2 * i));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + 2 * i + 16));
+        __m128i us = _mm_packus_epi16(_mm_and_si128(first, lowBytes), _mm_and_si128(second, lowBytes));
+        __m128i vs = _mm_packus_epi16(_mm_srli_epi16(first, 8), _mm_srli_epi16(second, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + i), us);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + i), vs);
+    }
+    splitUVScalar(uv + 2 * i, u + i, v + i, count - i);
+}
+
+void mergeUVSimd(const uint8_t* u, const uint8_t* v, uint8_t* uv, int32_t count) {
+    int32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i us = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + i));
+        __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + 2 * i), _mm_unpacklo_epi8(us, vs));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + 2 * i + 16), _mm_unpackhi_epi8(us, vs));
+    }
+    mergeUVScalar(u + i, v + i, uv + 2 * i, count - i);
+}
+
+void swapUVSimd(const uint8_t* src, uint8_t* dst, int32_t count) {
+    int32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        __m128i swapped = _mm_or_si128(_mm_slli_epi16(pairs, 8), _mm_srli_epi16(pairs, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), swapped);
+    }
+    swapUVScalar(src + 2 * i, dst + 2 * i, count - i);
+}
+
+// Eight pixels worth of one channel, from 16-bit fixed point to bytes
+inline __m128i packChannel(__m128i low, __m128i high) {
+    const __m128i round = _mm_set1_epi16(32);
+    low = _mm_srai_epi16(_mm_adds_epi16(low, round), 6);
+    high = _mm_srai_epi16(_mm_adds_epi16(high, round), 6);
+    return _mm_packus_epi16(low, high);
+}
+
+void yuvToRgbaRowSimd(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int32_t width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lumaOffset = _mm_set1_epi16(16);
+    const __m128i chromaOffset = _mm_set1_epi16(128);
+    const __m128i yScale = _mm_set1_epi16(kYScale);
+    const __m128i vToR = _mm_set1_epi16(kVToR);
+    const __m128i uToG = _mm_set1_epi16(kUToG);
+    const __m128i vToG = _mm_set1_epi16(kVToG);
+    const __m128i uToB = _mm_set1_epi16(kUToB);
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    int32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+        __m128i lumaLow = _mm_sub_epi16(_mm_unpacklo_epi8(luma, zero), lumaOffset);
+        __m128i lumaHigh = _mm_sub_epi16(_mm_unpackhi_epi8(luma, zero), lumaOffset);
+        lumaLow = _mm_add_epi16(_mm_mullo_epi16(lumaLow, yScale), _mm_srai_epi16(lumaLow, 1));
+        lumaHigh = _mm_add_epi16(_mm_mullo_epi16(lumaHigh, yScale), _mm_srai_epi16(lumaHigh, 1));
+
+        // Eight chroma samples, each shared by two neighbouring pixels
+        __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2)), zero),
+                                   chromaOffset);
+        __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2)), zero),
+                                   chromaOffset);
+        __m128i cbLow = _mm_unpacklo_epi16(cb, cb);
+        __m128i cbHigh = _mm_unpackhi_epi16(cb, cb);
+        __m128i crLow = _mm_unpacklo_epi16(cr, cr);
+        __m128i crHigh = _mm_unpackhi_epi16(cr, cr);
+
+        __m128i red = packChannel(_mm_adds_epi16(lumaLow, _mm_mullo_epi16(crLow, vToR)),
+                                  _mm_adds_epi16(lumaHigh, _mm_mullo_epi16(crHigh, vToR)));
+        __m128i green = packChannel(
+                _mm_subs_epi16(_mm_subs_epi16(lumaLow, _mm_mullo_epi16(cbLow, uToG)), _mm_mullo_epi16(crLow, vToG)),
+                _mm_subs_epi16(_mm_subs_epi16(lumaHigh, _mm_mullo_epi16(cbHigh, uToG)), _mm_mullo_epi16(crHigh, vToG)));
+        __m128i blue = packChannel(_mm_adds_epi16(lumaLow, _mm_mullo_epi16(cbLow, uToB)),
+                                   _mm_adds_epi16(lumaHigh, _mm_mullo_epi16(cbHigh, uToB)));
+
+        __m128i redGreenLow = _mm_unpacklo_epi8(red, green);
+        __m128i redGreenHigh = _mm_unpackhi_epi8(red, green);
+        __m128i blueAlphaLow = _mm_unpacklo_epi8(blue, alpha);
+        __m128i blueAlphaHigh = _mm_unpackhi_epi8(blue, alpha);
+        __m128i* out = reinterpret_cast<__m128i*>(rgba + 4 * x);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(redGreenLow, blueAlphaLow));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(redGreenLow, blueAlphaLow));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(redGreenHigh, blueAlphaHigh));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(redGreenHigh, blueAlphaHigh));
+    }
+    yuvToRgbaRowScalar(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x);
+}
+
+const char* const kSimdName = "sse2";
+
+#elif defined(__ARM_NEON)
+
+void splitUVSimd(const uint8_t* uv, uint8_t* u, uint8_t* v, int32_t count) {
+    int32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pairs = vld2q_u8(uv + 2 * i);
+        vst1q_u8(u + i, pairs.val[0]);
+        vst1q_u8(v + i, pairs.val[1]);
+    }
+    splitUVScalar(uv + 2 * i, u + i, v + i, count - i);
+}
+
+void mergeUVSimd(const uint8_t* u, const uint8_t* v, uint8_t* uv, int32_t count) {
+    int32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pairs;
+        pairs.val[0] = vld1q_u8(u + i);
+        pairs.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + 2 * i, pairs);
+    }
+    mergeUVScalar(u + i, v + i, uv + 2 * i, count - i);
+}
+
+void swapUVSimd(const uint8_t* src, uint8_t* dst, int32_t count) {
+    int32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+    }
+    swapUVScalar(src + 2 * i, dst + 2 * i, count - i);
+}
+
+// Eight pixels of luma and their shared chroma to RGBA
+inline void storeRgba8(int16x8_t luma, int16x8_t cb, int16x8_t cr, uint8_t* rgba) {
+    uint8x8x4_t pixels;
+    pixels.val[0] = vqmovun_s16(vrshrq_n_s16(vqaddq_s16(luma, vmulq_n_s16(cr, kVToR)), 6));
+    pixels.val[1] = vqmovun_s16(vrshrq_n_s16(
+            vqsubq_s16(vqsubq_s16(luma, vmulq_n_s16(cb, kUToG)), vmulq_n_s16(cr, kVToG)), 6));
+    pixels.val[2] = vqmovun_s16(vrshrq_n_s16(vqaddq_s16(luma, vmulq_n_s16(cb, kUToB)), 6));
+    pixels.val[3] = vdup_n_u8(255);
+    vst4_u8(rgba, pixels);
+}
+
+void yuvToRgbaRowSimd(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int32_t width) {
+    const uint8x8_t lumaOffset = vdup_n_u8(16);
+    const uint8x8_t chromaOffset = vdup_n_u8(128);
+
+    int32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t luma = vld1q_u8(y + x);
+        int16x8_t lumaLow = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(luma), lumaOffset));
+        int16x8_t lumaHigh = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(luma), lumaOffset));
+        lumaLow = vaddq_s16(vmulq_n_s16(lumaLow, kYScale), vshrq_n_s16(lumaLow, 1));
+        lumaHigh = vaddq_s16(vmulq_n_s16(lumaHigh, kYScale), vshrq_n_s16(lumaHigh, 1));
+
+        // Eight chroma samples, each shared by two neighbouring pixels
+        int16x8_t cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + x / 2), chromaOffset));
+        int16x8_t cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + x / 2), chromaOffset));
+        int16x8x2_t cbPairs = vzipq_s16(cb, cb);
+        int16x8x2_t crPairs = vzipq_s16(cr, cr);
+
+        storeRgba8(lumaLow, cbPairs.val[0], crPairs.val[0], rgba + 4 * x);
+        storeRgba8(lumaHigh, cbPairs.val[1], crPairs.val[1], rgba + 4 * x + 32);
+    }
+    yuvToRgbaRowScalar(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x);
+}
+
+const char* const kSimdName = "neon";
+
+#else
+
+void splitUVSimd(const uint8_t* uv, uint8_t* u, uint8_t* v, int32_t count) { splitUVScalar(uv, u, v, count); }
+void mergeUVSimd(const uint8_t* u, const uint8_t* v, uint8_t* uv, int32_t count) { mergeUVScalar(u, v, uv, count); }
+void swapUVSimd(const uint8_t* src, uint8_t* dst, int32_t count) { swapUVScalar(src, dst, count); }
+
+void yuvToRgbaRowSimd(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int32_t width) {
+    yuvToRgbaRowScalar(y, u, v, rgba, width);
+}
+
+const char* const kSimdName = "scalar";
+
+#endif
+
+struct YuvKernels {
+    void (*splitUV)(const uint8_t* uv, uint8_t* u, uint8_t* v, int32_t count);
+    void (*mergeUV)(const uint8_t* u, const uint8_t* v, uint8_t* uv, int32_t count);
+    void (*swapUV)(const uint8_t* src, uint8_t* dst, int32_t count);
+    void (*yuvToRgbaRow)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int32_t width);
+};
+
+const YuvKernels kScalarKernels = { splitUVScalar, mergeUVScalar, swapUVScalar, yuvToRgbaRowScalar };
+const YuvKernels kSimdKernels = { splitUVSimd, mergeUVSimd, swapUVSimd, yuvToRgbaRowSimd };
+
+bool isYuv(FrameFormat format) {
+    return format == FRAME_FORMAT_I420 || format == FRAME_FORMAT_NV12 || format == FRAME_FORMAT_NV21;
+}
+
+// YUV -> RGBA one row at a time; semi-planar chroma is split into scratch rows first
+bool convertToRgba(const FrameView& src, const FrameView& dst, const YuvKernels& kernels) {
+    int32_t chroma = chromaWidth(src.width);
+    std::vector<uint8_t> scratch;
+    if (src.format != FRAME_FORMAT_I420) {
+        scratch.resize(2 * chroma);
+    }
+    const uint8_t* u = nullptr;
+    const uint8_t* v = nullptr;
+    for (int32_t row = 0; row < src.height; ++row) {
+        if (row % 2 == 0) {
+            int32_t chromaRow = row / 2;
+            if (src.format == FRAME_FORMAT_I420) {
+                u = src.planes[1] + static_cast<size_t>(chromaRow) * src.strides[1];
+                v = src.planes[2] + static_cast<size_t>(chromaRow) * src.strides[2];
+            } else {
+                const uint8_t* interleaved = src.planes[1] + static_cast<size_t>(chromaRow) * src.strides[1];
+                bool swapped = src.format == FRAME_FORMAT_NV21;
+                kernels.splitUV(interleaved, &scratch[swapped ? chroma : 0], &scratch[swapped ? 0 : chroma], chroma);
+                u = &scratch[0];
+                v = &scratch[chroma];
+            }
+        }
+        kernels.yuvToRgbaRow(src.planes[0] + static_cast<size_t>(row) * src.strides[0], u, v,
+                             dst.planes[0] + static_cast<size_t>(row) * dst.strides[0], src.width);
+    }
+    return true;
+}
+
+// Chroma planes between I420, NV12 and NV21
+bool convertChroma(const FrameView& src, const FrameView& dst, const YuvKernels& kernels) {
+    int32_t width = chromaWidth(src.width);
+    int32_t height = chromaHeight(src.height);
+    if (src.format == dst.format) {
+        size_t rowBytes = src.format == FRAME_FORMAT_I420 ? width : 2 * width;
+        copyPlane(src.planes[1], src.strides[1], dst.planes[1], dst.strides[1], rowBytes, height);
+        if (src.format == FRAME_FORMAT_I420) {
+            copyPlane(src.planes[2], src.strides[2], dst.planes[2], dst.strides[2], rowBytes, height);
+        }
+        return true;
+    }
+
+    for (int32_t row = 0; row < height; ++row) {
+        const uint8_t* srcRow = src.planes[1] + static_cast<size_t>(row) * src.strides[1];
+        uint8_t* dstRow = dst.planes[1] + static_cast<size_t>(row) * dst.strides[1];
+        if (src.format == FRAME_FORMAT_I420) {
+            const uint8_t* v = src.planes[2] + static_cast<size_t>(row) * src.strides[2];
+            if (dst.format == FRAME_FORMAT_NV12) {
+                kernels.mergeUV(srcRow, v, dstRow, width);
+            } else {
+                kernels.mergeUV(v, srcRow, dstRow, width);
+            }
+        } else if (dst.format == FRAME_FORMAT_I420) {
+            uint8_t* v = dst.planes[2] + static_cast<size_t>(row) * dst.strides[2];
+            if (src.format == FRAME_FORMAT_NV12) {
+                kernels.splitUV(srcRow, dstRow, v, width);
+            } else {
+                kernels.splitUV(srcRow, v, dstRow, width);
+            }
+        } else {
+            kernels.swapUV(srcRow, dstRow, width);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+FrameFormat frameFormatFromColorFormat(int32_t colorFormat) {
+    switch (colorFormat) {
+        case CODEC_COLOR_FORMAT_YUV420_PLANAR:
+        case CODEC_COLOR_FORMAT_YUV420_PACKED_PLANAR:
+            return FRAME_FORMAT_I420;
+        case CODEC_COLOR_FORMAT_YUV420_SEMI_PLANAR:
+        case CODEC_COLOR_FORMAT_YUV420_PACKED_SEMI_PLANAR:
+            return FRAME_FORMAT_NV12;
+        default:
+            return FRAME_FORMAT_UNKNOWN;
+    }
+}
+
+size_t frameBufferSize(FrameFormat format, int32_t width, int32_t height, int32_t stride, int32_t sliceHeight) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    if (format == FRAME_FORMAT_RGBA) {
+        return static_cast<size_t>(stride > 0 ? stride : 4 * width) * height;
+    }
+    if (!isYuv(format)) {
+        return 0;
+    }
+    size_t lumaStride = stride > 0 ? stride : width;
+    size_t lumaRows = sliceHeight > 0 ? sliceHeight : height;
+    size_t chromaRows = (lumaRows + 1) / 2;
+    if (format == FRAME_FORMAT_I420) {
+        // Tightly packed odd widths round the chroma rows up
+        size_t chromaStride = stride > 0 ? (lumaStride + 1) / 2 : chromaWidth(width);
+        return lumaStride * lumaRows + 2 * chromaStride * chromaRows;
+    }
+    size_t chromaStride = stride > 0 ? lumaStride : 2 * chromaWidth(width);
+    return lumaStride * lumaRows + chromaStride * chromaRows;
+}
+
+bool wrapFrame(uint8_t* data, size_t size, FrameFormat format, int32_t width, int32_t height,
+               int32_t stride, int32_t sliceHeight, FrameView* view) {
+    if (!data || width <= 0 || height <= 0 || (format != FRAME_FORMAT_RGBA && !isYuv(format))) {
+        return false;
+    }
+    *view = FrameView();
+    view->format = format;
+    view->width = width;
+    view->height = height;
+
+    if (format == FRAME_FORMAT_RGBA) {
+        view->strides[0] = stride > 0 ? stride : 4 * width;
+        if (view->strides[0] < 4 * width ||
+            size < static_cast<size_t>(view->strides[0]) * (height - 1) + 4 * static_cast<size_t>(width)) {
+            return false;
+        }
+        view->planes[0] = data;
+        return true;
+    }
+
+    int32_t lumaStride = stride > 0 ? stride : width;
+    int32_t lumaRows = sliceHeight > 0 ? sliceHeight : height;
+    if (lumaStride < width || lumaRows < height) {
+        return false;
+    }
+    int32_t chroma = chromaWidth(width);
+    int32_t chromaRows = chromaHeight(height);
+    size_t chromaOffset = static_cast<size_t>(lumaStride) * lumaRows;
+    size_t end;
+    view->planes[0] = data;
+    view->strides[0] = lumaStride;
+    if (format == FRAME_FORMAT_I420) {
+        int32_t chromaStride = stride > 0 ? (lumaStride + 1) / 2 : chroma;
+        if (chromaStride < chroma) {
+            return false;
+        }
+        size_t planeSize = static_cast<size_t>(chromaStride) * ((lumaRows + 1) / 2);
+        view->planes[1] = data + chromaOffset;
+        view->planes[2] = data + chromaOffset + planeSize;
+        view->strides[1] = chromaStride;
+        view->strides[2] = chromaStride;
+        end = chromaOffset + planeSize + static_cast<size_t>(chromaStride) * (chromaRows - 1) + chroma;
+    } else {
+        int32_t chromaStride = stride > 0 ? lumaStride : 2 * chroma;
+        if (chromaStride < 2 * chroma) {
+            return false;
+        }
+        view->planes[1] = data + chromaOffset;
+        view->strides[1] = chromaStride;
+        end = chromaOffset + static_cast<size_t>(chromaStride) * (chromaRows - 1) + 2 * chroma;
+    }
+    // Decoders may leave the padding after the last chroma row out of the buffer
+    return size >= end;
+}
+
+bool convertFrame(const FrameView& src, const FrameView& dst, bool allowSimd) {
+    if (src.width != dst.width || src.height != dst.height || src.width <= 0 || src.height <= 0) {
+        return false;
+    }
+    const YuvKernels& kernels = allowSimd ? kSimdKernels : kScalarKernels;
+    if (src.format == FRAME_FORMAT_RGBA && dst.format == FRAME_FORMAT_RGBA) {
+        copyPlane(src.planes[0], src.strides[0], dst.planes[0], dst.strides[0], 4 * static_cast<size_t>(src.width),
+                  src.height);
+        return true;
+    }
+    if (!isYuv(src.format)) {
+        return false;
+    }
+    if (dst.format == FRAME_FORMAT_RGBA) {
+        return convertToRgba(src, dst, kernels);
+    }
+    if (!isYuv(dst.format)) {
+        return false;
+    }
+    copyPlane(src.planes[0], src.strides[0], dst.planes[0], dst.strides[0], src.width, src.height);
+    return convertChroma(src, dst, kernels);
+}
+
+const char* yuvKernelName() {
+    return kSimdName;
+}
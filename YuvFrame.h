@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Raw frame layouts handled by the conversion kernels. The YUV formats are
+// 4:2:0 with chroma subsampled 2x2.
+enum FrameFormat {
+    FRAME_FORMAT_UNKNOWN = 0,
+    FRAME_FORMAT_I420,  // Y plane, U plane, V plane (COLOR_FormatYUV420Planar)
+    FRAME_FORMAT_NV12,  // Y plane, interleaved UV plane (COLOR_FormatYUV420SemiPlanar)
+    FRAME_FORMAT_NV21,  // Y plane, interleaved VU plane (camera preview)
+    FRAME_FORMAT_RGBA,  // One plane, 4 bytes per pixel
+};
+
+// Non-owning view of one frame. Strides are in bytes and planes a format
+// does not use are null: I420 uses all three, NV12 / NV21 keep the
+// interleaved chroma in planes[1], RGBA only has planes[0].
+struct FrameView {
+    FrameFormat format = FRAME_FORMAT_UNKNOWN;
+    int32_t width = 0;
+    int32_t height = 0;
+    uint8_t* planes[3] = { nullptr, nullptr, nullptr };
+    int32_t strides[3] = { 0, 0, 0 };
+};
+
+// Maps a MediaCodec color format to a frame format. Flexible and vendor
+// formats come back as FRAME_FORMAT_UNKNOWN.
+FrameFormat frameFormatFromColorFormat(int32_t colorFormat);
+
+// Bytes needed for a frame laid out the way MediaCodec lays out its buffers:
+// luma rows are stride bytes apart, chroma starts stride * sliceHeight bytes
+// in and I420 chroma rows are stride / 2 apart. Zero stride or slice height
+// means tightly packed.
+size_t frameBufferSize(FrameFormat format, int32_t width, int32_t height, int32_t stride = 0, int32_t sliceHeight = 0);
+
+// Points view at a frame stored in data with the layout above. Returns false
+// if the format is unknown or size is too small.
+bool wrapFrame(uint8_t* data, size_t size, FrameFormat format, int32_t width, int32_t height,
+               int32_t stride, int32_t sliceHeight, FrameView* view);
+
+// Copies src into dst, repacking strides and converting between I420, NV12
+// and NV21, or from any of them to RGBA (BT.601, limited range). Both views
+// must have the same dimensions. allowSimd = false forces the scalar
+// kernels, which give bit-identical results.
+bool convertFrame(const FrameView& src, const FrameView& dst, bool allowSimd = true);
+
+// Vector kernels compiled into this build: "sse2", "neon" or "scalar"
+const char* yuvKernelName();
@@ -2,7 +2,15 @@
 #include <jni.h>
 #include <android/log.h>
 #include <media/NdkMediaCodec.h>
-#include <GLES3/gl3.h>
+#include <media/NdkMediaExtractor.h>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "FrameDumper.h"
+#include "GlRenderer.h"
+#include "YuvFrame.h"
 
 // Define logging tag
 #define LOG_TAG "VideoPlayer"
@@ -11,150 +19,24 @@
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__))
 #define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__))
 
-// Function to dump frame to file
-void dumpFrame(uint8_t* frameData, int width, int height, int frameNumber) {
-    // Construct file name
-    char filename[256];
-    snprintf(filename, sizeof(filename), "/sdcard/frame_%d.raw", frameNumber);
-
-    // Open file
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
-        LOGE("Failed to open file %s", filename);
-        return;
-    }
-
-    // Write frame data to file
-    fwrite(frameData, sizeof(uint8_t), width * height * 4, file);
-
-    // Close file
-    fclose(file);
-
-    LOGI("Frame %d dumped to %s", frameNumber, filename);
+// Function to render OpenGL frame. The renderer keeps its program, vertex
+// array and textures between frames, so only the upload and draw happen here;
+// the dumper copies the frame and writes it on its own thread
+void renderFrame(GlRenderer& renderer, FrameDumper& dumper, uint8_t* frameData, int width, int height,
+                 int64_t presentationTimeUs, bool keyframe) {
+    renderer.renderFrame(frameData, width, height);
+
+    FrameDumpInfo info;
+    info.width = width;
+    info.height = height;
+    info.format = FRAME_FORMAT_RGBA;
+    info.presentationTimeUs = presentationTimeUs;
+    info.keyframe = keyframe;
+    dumper.submit(frameData, frameBufferSize(FRAME_FORMAT_RGBA, width, height), info);
 }
 
-// Function to render OpenGL frame
-void renderFrame(uint8_t* frameData, int width, int height) {
-    // Process frame data (if needed)
-
-    // Clear the color buffer
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // Set viewport dimensions
-    glViewport(0, 0, width, height);
-
-    // Sample vertex and fragment shader for rendering a textured quad
-    const char* vertexShaderCode =
-        "#version 300 es\n"
-        "layout(location = 0) in vec4 a_position;\n"
-        "layout(location = 1) in vec2 a_texCoord;\n"
-        "out vec2 v_texCoord;\n"
-        "void main() {\n"
-        "    gl_Position = a_position;\n"
-        "    v_texCoord = a_texCoord;\n"
-        "}\n";
-
-    const char* fragmentShaderCode =
-        "#version 300 es\n"
-        "precision mediump float;\n"
-        "in vec2 v_texCoord;\n"
-        "out vec4 fragColor;\n"
-        "uniform sampler2D u_texture;\n"
-        "void main() {\n"
-        "    fragColor = texture(u_texture, v_texCoord);\n"
-        "}\n";
-
-    // Compile shaders
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderCode, nullptr);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderCode, nullptr);
-    glCompileShader(fragmentShader);
-
-    // Create shader program
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    // Delete shaders (no longer needed after linking)
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    // Set up vertex data and attributes for a textured quad
-    GLfloat vertices[] = {
-        -1.0f, -1.0f, 0.0f, 1.0f,  // Position 0
-         0.0f,  1.0f,             // TexCoord 0
-         1.0f, -1.0f, 0.0f, 1.0f,  // Position 1
-         1.0f,  1.0f,             // TexCoord 1
-        -1.0f,  1.0f, 0.0f, 1.0f,  // Position 2
-         0.0f,  0.0f,             // TexCoord 2
-         1.0f,  1.0f, 0.0f, 1.0f,  // Position 3
-         1.0f,  0.0f              // TexCoord 3
-    };
-
-    // Create VBO and VAO
-    GLuint vbo, vao;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    // Position attribute
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // TexCoord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
-
-    // Set active texture unit
-    glActiveTexture(GL_TEXTURE0);
-
-    // Generate texture
-    GLuint textureId;
-    glGenTextures(1, &textureId);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load frame data into texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, frameData);
-
-    // Bind shader program and set uniform
-    glUseProgram(shaderProgram);
-    GLint uTextureLoc = glGetUniformLocation(shaderProgram, "u_texture");
-    glUniform1i(uTextureLoc, 0); // Texture unit 0
-
-    // Draw the quad
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-    // Cleanup
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
-
-    glDeleteTextures(1, &textureId);
-    glDeleteProgram(shaderProgram);
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
-
-    // Dump frame
-    dumpFrame(frameData, width, height, 0); // Adjust frame number as needed
-}
-
-// JNI function to decode video, render frames, and dump each frame
-extern "C" JNIEXPORT void JNICALL
-Java_your_package_name_VideoRendererActivity_renderAndDumpFrames(JNIEnv *env, jobject instance, jstring videoPath) {
+// Decodes the video, renders every frame and dumps the ones options selects
+static void renderAndDump(JNIEnv *env, jstring videoPath, const FrameDumpOptions& dumpOptions) {
     // Convert Java string to C string
     const char *path = env->GetStringUTFChars(videoPath, nullptr);
 
@@ -192,6 +74,21 @@ Java_your_package_name_VideoRendererActivity_renderAndDumpFrames(JNIEnv *env, jo
     bool sawInputEOS = false;
     bool sawOutputEOS = false;
 
+    // Decoder output layout, updated on format changes; frames are converted
+    // to RGBA before they are uploaded and dumped
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;
+    int32_t sliceHeight = 0;
+    int32_t colorFormat = 0;
+    std::vector<uint8_t> rgbaFrame;
+    // Built on the first frame on the caller's current GL context
+    GlRenderer renderer(systemGlApi());
+    FrameDumper dumper(dumpOptions);
+    dumper.open();
+    // Decoder output carries no sync flag, so remember which input samples were keyframes
+    std::set<int64_t> keyframeTimesUs;
+
     while (!sawOutputEOS) {
         if (!sawInputEOS) {
             ssize_t bufIdx = AMediaCodec_dequeueInputBuffer(codec, -1);
@@ -204,6 +101,9 @@ Java_your_package_name_VideoRendererActivity_renderAndDumpFrames(JNIEnv *env, jo
                     sawInputEOS = true;
                 }
                 int64_t presentationTimeUs = AMediaExtractor_getSampleTime(extractor);
+                if (!sawInputEOS && (AMediaExtractor_getSampleFlags(extractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC)) {
+                    keyframeTimesUs.insert(presentationTimeUs);
+                }
                 AMediaCodec_queueInputBuffer(codec, bufIdx, 0, sampleSize, presentationTimeUs,
                                              sawInputEOS ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0);
                 if (!sawInputEOS) {
@@ -216,9 +116,21 @@ Java_your_package_name_VideoRendererActivity_renderAndDumpFrames(JNIEnv *env, jo
         if (outIdx >= 0) {
             size_t out_size;
             uint8_t *out_data = AMediaCodec_getOutputBuffer(codec, outIdx, &out_size);
-            if (out_size > 0) {
+            bool keyframe = keyframeTimesUs.count(info.presentationTimeUs) > 0;
+            keyframeTimesUs.erase(keyframeTimesUs.begin(), keyframeTimesUs.upper_bound(info.presentationTimeUs));
+            FrameView yuv;
+            FrameView rgba;
+            if (info.size > 0 &&
+                wrapFrame(out_data + info.offset, info.size, frameFormatFromColorFormat(colorFormat),
+                          width, height, stride, sliceHeight, &yuv)) {
+                rgbaFrame.resize(frameBufferSize(FRAME_FORMAT_RGBA, width, height));
+                wrapFrame(rgbaFrame.data(), rgbaFrame.size(), FRAME_FORMAT_RGBA, width, height, 0, 0, &rgba);
+                convertFrame(yuv, rgba);
+
                 // Render the frame
-                renderFrame(out_data, info.width, info.height);
+                renderFrame(renderer, dumper, rgbaFrame.data(), width, height, info.presentationTimeUs, keyframe);
+            } else if (info.size > 0) {
+                LOGE("Unsupported decoder output: color format %d, %dx%d", colorFormat, width, height);
             }
             AMediaCodec_releaseOutputBuffer(codec, outIdx, false);
             if ((info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0) {
@@ -226,15 +138,25 @@ Java_your_package_name_VideoRendererActivity_renderAndDumpFrames(JNIEnv *env, jo
             }
         } else if (outIdx == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
             AMediaFormat* newFormat = AMediaCodec_getOutputFormat(codec);
-            // Update width and height from new format
-            int width, height;
+            // Update the frame layout from the new format
             AMediaFormat_getInt32(newFormat, AMEDIAFORMAT_KEY_WIDTH, &width);
             AMediaFormat_getInt32(newFormat, AMEDIAFORMAT_KEY_HEIGHT, &height);
-            // Handle format change (if needed)
+            AMediaFormat_getInt32(newFormat, AMEDIAFORMAT_KEY_COLOR_FORMAT, &colorFormat);
+            if (!AMediaFormat_getInt32(newFormat, AMEDIAFORMAT_KEY_STRIDE, &stride)) {
+                stride = 0;
+            }
+            if (!AMediaFormat_getInt32(newFormat, AMEDIAFORMAT_KEY_SLICE_HEIGHT, &sliceHeight)) {
+                sliceHeight = 0;
+            }
             AMediaFormat_delete(newFormat);
+            // Textures are only reallocated when the size actually changes
+            renderer.setFrameSize(width, height);
         }
     }
 
+    // Waits for the queued frames to reach storage
+    dumper.close();
+
     // Release resources
     AMediaCodec_stop(codec);
     AMediaCodec_delete(codec);
@@ -243,3 +165,39 @@ Java_your_package_name_VideoRendererActivity_renderAndDumpFrames(JNIEnv *env, jo
     // Release Java string
     env->ReleaseStringUTFChars(videoPath, path);
 }
+
+// JNI function to decode video, render frames, and dump each frame to /sdcard/frame_<n>.raw
+extern "C" JNIEXPORT void JNICALL
+Java_your_package_name_VideoRendererActivity_renderAndDumpFrames(JNIEnv *env, jobject instance, jstring videoPath) {
+    renderAndDump(env, videoPath, FrameDumpOptions());
+}
+
+// Same, with the dump destination and frame selection chosen by the caller.
+// timestampsUs takes precedence over keyframesOnly, which takes precedence
+// over everyNth; packed writes one file at outputPath plus outputPath.idx.
+extern "C" JNIEXPORT void JNICALL
+Java_your_package_name_VideoRendererActivity_renderAndDumpSelectedFrames(JNIEnv *env, jobject instance,
+                                                                         jstring videoPath, jstring outputPath,
+                                                                         jboolean packed, jint everyNth,
+                                                                         jboolean keyframesOnly,
+                                                                         jlongArray timestampsUs) {
+    FrameDumpOptions options;
+    const char *output = env->GetStringUTFChars(outputPath, nullptr);
+    options.outputPath = output;
+    env->ReleaseStringUTFChars(outputPath, output);
+    options.packed = packed;
+
+    jint timestampCount = timestampsUs ? env->GetArrayLength(timestampsUs) : 0;
+    if (timestampCount > 0) {
+        std::vector<jlong> timestamps(timestampCount);
+        env->GetLongArrayRegion(timestampsUs, 0, timestampCount, timestamps.data());
+        options.timestampsUs.assign(timestamps.begin(), timestamps.end());
+        options.selection = FRAME_DUMP_TIMESTAMPS;
+    } else if (keyframesOnly) {
+        options.selection = FRAME_DUMP_KEYFRAMES;
+    } else if (everyNth > 1) {
+        options.selection = FRAME_DUMP_EVERY_NTH;
+        options.everyNth = everyNth;
+    }
+    renderAndDump(env, videoPath, options);
+}
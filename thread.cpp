@@ -7,21 +7,29 @@
 #include <media/NdkMediaFormat.h>
 #include <media/NdkMediaExtractor.h>
 #include <media/NdkMediaMuxer.h>
+#include <cerrno>
+#include <cstring>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
+
+#include "CodecBackend.h"
+#include "EncodeProfile.h"
+#include "FrameQueue.h"
 
 extern "C" {
 
-// Global variables for synchronization
-std::mutex gDecoderMutex;
-std::condition_variable gDecoderCV;
-std::queue<ssize_t> gDecodedFrames;  // Queue to hold decoded frame indices
+// Capacity of the decoded and encoded frame queues
+const size_t kFrameQueueCapacity = 16;
+
+// Per-transcode state shared by the decoder and encoder threads
+struct TranscodeSession {
+    AMediaExtractor *extractor = nullptr;
+    AMediaCodec *decoder = nullptr;
+    AMediaCodec *encoder = nullptr;
+    AMediaMuxer *muxer = nullptr;
 
-std::mutex gEncoderMutex;
-std::condition_variable gEncoderCV;
-std::queue<ssize_t> gEncodedFrames;  // Queue to hold encoded frame indices
+    SpscFrameQueue decodedFrames{kFrameQueueCapacity};  // main thread -> decodeThread
+    SpscFrameQueue encodedFrames{kFrameQueueCapacity};  // decodeThread -> encodeThread
+};
 
 // Function prototypes
 void encodeVideo(const char* inputPath, const char* outputPath);
@@ -55,58 +63,103 @@ Java_com_example_mediaprocessing_MediaCodecHelper_nativeDecodeVideo(JNIEnv *env,
     env->ReleaseStringUTFChars(outputPath_, outputPath);
 }
 
+// Push every encoder output that is ready onto the mux queue
+static bool drainEncoder(TranscodeSession *session, int64_t timeoutUs) {
+    bool sawOutputEOS = false;
+    while (!sawOutputEOS) {
+        AMediaCodecBufferInfo info;
+        ssize_t outputBufferIndex = AMediaCodec_dequeueOutputBuffer(session->encoder, &info, timeoutUs);
+        if (outputBufferIndex == AMEDIACODEC_INFO_TRY_AGAIN_LATER) {
+            break;
+        }
+        if (outputBufferIndex < 0 && outputBufferIndex != AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            continue;
+        }
+        FrameDescriptor frame = { outputBufferIndex, info.offset, info.size, info.presentationTimeUs, info.flags };
+        if (outputBufferIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            frame.flags = 0;
+        }
+        session->encodedFrames.push(frame);
+        sawOutputEOS = outputBufferIndex >= 0 && (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+    }
+    return sawOutputEOS;
+}
+
 // Decoder thread function
-void decodeThread(AMediaExtractor *extractor, AMediaCodec *decoder, bool *sawInputEOS) {
-    while (!(*sawInputEOS)) {
-        std::unique_lock<std::mutex> lock(gDecoderMutex);
-        gDecoderCV.wait(lock, []{ return !gDecodedFrames.empty(); });  // Wait for frames to decode
-        ssize_t outputBufferIndex = gDecodedFrames.front();
-        gDecodedFrames.pop();
-        lock.unlock();
+void decodeThread(TranscodeSession *session) {
+    FrameDescriptor frame;
+    while (session->decodedFrames.pop(&frame)) {  // Wait for decoded frames
+        bool endOfStream = (frame.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0;
+
+        // Copy the decoded frame into an encoder input buffer
+        if (frame.size > 0) {
+            ssize_t inputBufferIndex;
+            while ((inputBufferIndex = AMediaCodec_dequeueInputBuffer(session->encoder, 10000)) < 0) {  // Timeout in microseconds
+                drainEncoder(session, 0);
+            }
+            size_t inputSize;
+            uint8_t *inputBuffer = AMediaCodec_getInputBuffer(session->encoder, inputBufferIndex, &inputSize);
+            uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(session->decoder, frame.bufferIndex, nullptr);
+            size_t size = frame.size < (int32_t) inputSize ? frame.size : inputSize;
+            memcpy(inputBuffer, outputBuffer + frame.offset, size);
+            AMediaCodec_queueInputBuffer(session->encoder, inputBufferIndex, 0, size, frame.presentationTimeUs, 0);
+        }
 
         // Process the decoded frame
-        AMediaCodec_releaseOutputBuffer(decoder, outputBufferIndex, false);
+        AMediaCodec_releaseOutputBuffer(session->decoder, frame.bufferIndex, false);
 
-        // Signal availability of decoded frame to encoder
-        gEncoderCV.notify_one();
+        if (endOfStream) {
+            // Signal end of input to encoder
+            ssize_t inputBufferIndex;
+            while ((inputBufferIndex = AMediaCodec_dequeueInputBuffer(session->encoder, 10000)) < 0) {
+                drainEncoder(session, 0);
+            }
+            AMediaCodec_queueInputBuffer(session->encoder, inputBufferIndex, 0, 0, frame.presentationTimeUs,
+                                         AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+            while (!drainEncoder(session, 10000)) {
+            }
+            break;
+        }
 
-        // Advance to the next sample
-        AMediaExtractor_advance(extractor);
+        drainEncoder(session, 0);
     }
+    session->encodedFrames.close();
 }
 
 // Encoder thread function
-void encodeThread(AMediaCodec *encoder, AMediaMuxer *muxer, int trackIndex, bool *sawOutputEOS) {
-    while (!(*sawOutputEOS)) {
-        std::unique_lock<std::mutex> lock(gEncoderMutex);
-        gEncoderCV.wait(lock, []{ return !gEncodedFrames.empty(); });  // Wait for frames to encode
-        ssize_t outputBufferIndex = gEncodedFrames.front();
-        gEncodedFrames.pop();
-        lock.unlock();
+void encodeThread(TranscodeSession *session) {
+    ssize_t trackIndex = -1;
+    FrameDescriptor frame;
+    while (session->encodedFrames.pop(&frame)) {  // Wait for frames to mux
+        if (frame.bufferIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            AMediaFormat *encoderFormat = AMediaCodec_getOutputFormat(session->encoder);
+            trackIndex = AMediaMuxer_addTrack(session->muxer, encoderFormat);
+            AMediaFormat_delete(encoderFormat);
+            AMediaMuxer_start(session->muxer);
+            continue;
+        }
 
         // Process the encoded frame
-        AMediaCodecBufferInfo info;
-        ssize_t inputBufferIndex = AMediaCodec_dequeueInputBuffer(encoder, 10000);  // Timeout in microseconds
-        if (inputBufferIndex >= 0) {
-            uint8_t *inputBuffer = AMediaCodec_getInputBuffer(encoder, inputBufferIndex, nullptr);
-            ssize_t bytesRead = AMediaCodec_getOutputBuffer(encoder, outputBufferIndex, nullptr);
-
-            AMediaMuxer_writeSampleData(muxer, trackIndex, inputBuffer, &info);
-            AMediaCodec_releaseOutputBuffer(encoder, outputBufferIndex, false);
+        AMediaCodecBufferInfo info = { frame.offset, frame.size, frame.presentationTimeUs, frame.flags };
+        bool isConfig = (frame.flags & AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG) != 0;
+        if (frame.size > 0 && !isConfig && trackIndex >= 0) {
+            uint8_t *encodedData = AMediaCodec_getOutputBuffer(session->encoder, frame.bufferIndex, nullptr);
+            AMediaMuxer_writeSampleData(session->muxer, trackIndex, encodedData, &info);
+        }
+        AMediaCodec_releaseOutputBuffer(session->encoder, frame.bufferIndex, false);
 
-            if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
-                *sawOutputEOS = true;
-            }
+        if (frame.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+            break;
         }
     }
+    if (trackIndex >= 0) {
+        AMediaMuxer_stop(session->muxer);
+    }
 }
 
 void encodeVideo(const char* inputPath, const char* outputPath) {
-    AMediaExtractor *extractor = nullptr;
-    AMediaCodec *decoder = nullptr;
-    AMediaCodec *encoder = nullptr;
+    TranscodeSession session;
     AMediaFormat *format = nullptr;
-    AMediaMuxer *muxer = nullptr;
 
     // Open input file and get file descriptor
     int inputFd = open(inputPath, O_RDONLY);
@@ -116,132 +169,157 @@ void encodeVideo(const char* inputPath, const char* outputPath) {
     }
 
     // Initialize MediaExtractor from FD
-    extractor = AMediaExtractor_new();
-    media_status_t status = AMediaExtractor_setDataSourceFd(extractor, inputFd, 0, getFileSize(inputPath));
+    session.extractor = AMediaExtractor_new();
+    media_status_t status = AMediaExtractor_setDataSourceFd(session.extractor, inputFd, 0, getFileSize(inputPath));
     if (status != AMEDIA_OK) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to set data source for %s", inputPath);
         close(inputFd);
+        AMediaExtractor_delete(session.extractor);
         return;
     }
 
     // Get video track format from extractor
-    int trackCount = AMediaExtractor_getTrackCount(extractor);
+    int trackCount = AMediaExtractor_getTrackCount(session.extractor);
     AMediaFormat *trackFormat = nullptr;
     int videoTrackIndex = -1;
     for (int i = 0; i < trackCount; ++i) {
-        trackFormat = AMediaExtractor_getTrackFormat(extractor, i);
+        trackFormat = AMediaExtractor_getTrackFormat(session.extractor, i);
         const char *mime;
         if (AMediaFormat_getString(trackFormat, AMEDIAFORMAT_KEY_MIME, &mime) && !strncmp(mime, "video/", 6)) {
             videoTrackIndex = i;
             break;
         }
+        AMediaFormat_delete(trackFormat);
     }
 
     if (videoTrackIndex < 0) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "No video track found");
         close(inputFd);
-        AMediaExtractor_delete(extractor);
+        AMediaExtractor_delete(session.extractor);
         return;
     }
 
-    AMediaExtractor_selectTrack(extractor, videoTrackIndex);
+    AMediaExtractor_selectTrack(session.extractor, videoTrackIndex);
+
+    // Encoder settings follow the source: same size and frame rate, bitrate sized for them
+    TrackFormat sourceFormat;
+    fromMediaFormat(trackFormat, &sourceFormat);
+    TrackFormat encodeFormat = resolveEncodeProfile(EncodeProfile(), sourceFormat);
 
     // Initialize MediaCodec decoder
-    decoder = AMediaCodec_createDecoderByType("video/avc");
-    if (!decoder) {
+    session.decoder = AMediaCodec_createDecoderByType(sourceFormat.mime.c_str());
+    if (!session.decoder) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create decoder");
         close(inputFd);
-        AMediaExtractor_delete(extractor);
+        AMediaFormat_delete(trackFormat);
+        AMediaExtractor_delete(session.extractor);
         return;
     }
 
-    AMediaCodec_configure(decoder, trackFormat, nullptr, nullptr, 0);
-    AMediaCodec_start(decoder);
+    AMediaCodec_configure(session.decoder, trackFormat, nullptr, nullptr, 0);
+    AMediaCodec_start(session.decoder);
+    AMediaFormat_delete(trackFormat);
 
     // Initialize MediaCodec encoder
-    encoder = AMediaCodec_createEncoderByType("video/avc");
-    if (!encoder) {
+    session.encoder = AMediaCodec_createEncoderByType(encodeFormat.mime.c_str());
+    if (!session.encoder) {
         __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create encoder");
         close(inputFd);
-        AMediaCodec_stop(decoder);
-        AMediaCodec_delete(decoder);
-        AMediaExtractor_delete(extractor);
+        AMediaCodec_stop(session.decoder);
+        AMediaCodec_delete(session.decoder);
+        AMediaExtractor_delete(session.extractor);
         return;
     }
 
-    format = AMediaFormat_new();
-    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, "video/avc");
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, 1280);  // Specify your video width
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, 720);  // Specify your video height
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, 2000000);  // Specify your video bit rate
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_FRAME_RATE, 30);  // Specify your video frame rate
-    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, 19);  // COLOR_FormatYUV420Planar (NV12)
+    format = toMediaFormat(encodeFormat);
 
-    AMediaCodec_configure(encoder, format, nullptr, nullptr, AMEDIACODEC_CONFIGURE_FLAG_ENCODE);
-    AMediaCodec_start(encoder);
+    AMediaCodec_configure(session.encoder, format, nullptr, nullptr, AMEDIACODEC_CONFIGURE_FLAG_ENCODE);
+    AMediaCodec_start(session.encoder);
 
-    // Start decoder thread
-    bool sawInputEOS = false;
-    std::thread decoderThread(decodeThread, extractor, decoder, &sawInputEOS);
+    // Open output file and initialize MediaMuxer from FD
+    int outputFd = openOutputFile(outputPath);
+    session.muxer = outputFd >= 0 ? AMediaMuxer_newFromFd(outputFd, AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4) : nullptr;
+    if (!session.muxer) {
+        __android_log_print(ANDROID_LOG_ERROR, "MediaCodec", "Failed to create muxer");
+        close(inputFd);
+        if (outputFd >= 0) {
+            close(outputFd);
+        }
+        AMediaCodec_stop(session.decoder);
+        AMediaCodec_delete(session.decoder);
+        AMediaCodec_stop(session.encoder);
+        AMediaCodec_delete(session.encoder);
+        AMediaExtractor_delete(session.extractor);
+        AMediaFormat_delete(format);
+        return;
+    }
 
-    // Start encoder thread
-    bool sawOutputEOS = false;
-    AMediaFormat *encoderFormat = AMediaCodec_getOutputFormat(encoder);
-    int trackIndex = AMediaMuxer_addTrack(muxer, encoderFormat);
-    AMediaMuxer_start(muxer);
-    std::thread encoderThread(encodeThread, encoder, muxer, trackIndex, &sawOutputEOS);
+    // Start decoder and encoder threads
+    std::thread decoderThread(decodeThread, &session);
+    std::thread encoderThread(encodeThread, &session);
 
     // Main decoding loop
-    while (!sawInputEOS) {
-        ssize_t inputBufferIndex = AMediaCodec_dequeueInputBuffer(decoder, 10000);  // Timeout in microseconds
-        if (inputBufferIndex >= 0) {
-            uint8_t *inputBuffer = AMediaCodec_getInputBuffer(decoder, inputBufferIndex, nullptr);
-
-            // Read sample data from extractor
-            ssize_t sampleSize = AMediaExtractor_readSampleData(extractor, inputBuffer, inputBufferIndex);
-            if (sampleSize < 0) {
-                sawInputEOS = true;
-                sampleSize = 0;
+    bool sawInputEOS = false;
+    bool sawOutputEOS = false;
+    while (!sawOutputEOS) {
+        if (!sawInputEOS) {
+            ssize_t inputBufferIndex = AMediaCodec_dequeueInputBuffer(session.decoder, 10000);  // Timeout in microseconds
+            if (inputBufferIndex >= 0) {
+                size_t inputSize;
+                uint8_t *inputBuffer = AMediaCodec_getInputBuffer(session.decoder, inputBufferIndex, &inputSize);
+
+                // Read sample data from extractor
+                ssize_t sampleSize = AMediaExtractor_readSampleData(session.extractor, inputBuffer, inputSize);
+                int64_t sampleTime = 0;
+                uint32_t sampleFlags = 0;
+                if (sampleSize < 0) {
+                    sawInputEOS = true;
+                    sampleSize = 0;
+                    sampleFlags = AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+                } else {
+                    sampleTime = AMediaExtractor_getSampleTime(session.extractor);
+                    if (AMediaExtractor_getSampleFlags(session.extractor) & AMEDIAEXTRACTOR_SAMPLE_FLAG_SYNC) {
+                        sampleFlags = AMEDIACODEC_BUFFER_FLAG_KEY_FRAME;
+                    }
+                }
+
+                // Queue input buffer to decoder
+                AMediaCodec_queueInputBuffer(session.decoder, inputBufferIndex, 0, sampleSize, sampleTime, sampleFlags);
+
+                // Advance extractor to next sample
+                AMediaExtractor_advance(session.extractor);
             }
-            int64_t sampleTime = AMediaExtractor_getSampleTime(extractor);
-            uint32_t sampleFlags = AMediaExtractor_getSampleFlags(extractor);
-
-            // Queue input buffer to decoder
-            AMediaCodec_queueInputBuffer(decoder, inputBufferIndex, 0, sampleSize, sampleTime, sampleFlags);
-
-            // Advance extractor to next sample
-            AMediaExtractor_advance(extractor);
         }
 
-        // Handle decoder output buffers
+        // Hand every available decoder output to the decoder thread; a full
+        // queue blocks here, which throttles the feed above
         AMediaCodecBufferInfo info;
-        ssize_t outputBufferIndex = AMediaCodec_dequeueOutputBuffer(decoder, &info, 10000);
-        if (outputBufferIndex >= 0) {
-            std::unique_lock<std::mutex> lock(gDecoderMutex);
-            gDecodedFrames.push(outputBufferIndex);
-            lock.unlock();
-            gDecoderCV.notify_one();
+        ssize_t outputBufferIndex;
+        while ((outputBufferIndex = AMediaCodec_dequeueOutputBuffer(session.decoder, &info, sawInputEOS ? 10000 : 0)) >= 0) {
+            FrameDescriptor frame = { outputBufferIndex, info.offset, info.size, info.presentationTimeUs, info.flags };
+            session.decodedFrames.push(frame);
+            if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+                sawOutputEOS = true;
+                break;
+            }
         }
     }
 
-    // Signal end of input to decoder
-    decoderThread.join();  // Wait for decoder thread to finish
-
-    // Signal end of input to encoder
-    AMediaCodec_signalEndOfInputStream(encoder);
-
-    // Wait for encoder thread to finish
+    // Wait for decoder and encoder threads to finish
+    session.decodedFrames.close();
+    decoderThread.join();
     encoderThread.join();
 
     // Clean up
+    AMediaMuxer_delete(session.muxer);
     close(inputFd);
-    AMediaCodec_stop(decoder);
-    AMediaCodec_delete(decoder);
-    AMediaCodec_stop(encoder);
-    AMediaCodec_delete(encoder);
-    AMediaExtractor_delete(extractor);
-    AMediaMuxer_stop(muxer);
-    AMediaMuxer_delete(muxer);
+    close(outputFd);
+    AMediaCodec_stop(session.decoder);
+    AMediaCodec_delete(session.decoder);
+    AMediaCodec_stop(session.encoder);
+    AMediaCodec_delete(session.encoder);
+    AMediaExtractor_delete(session.extractor);
+    AMediaFormat_delete(format);
 }
 
 void decodeVideo(const char* inputPath, const char* outputPath) {